@@ -0,0 +1,906 @@
+// Microbenchmark for the ad blocker matching structures.
+//
+// Builds synthetic rule sets and reports the average cost of a lookup. Does not
+// depend on the Ultralight runtime, so it runs on any machine with a compiler.
+//
+// Usage: adblock_bench [--quick]
+//
+// Links alloc_counter, which tracks the bytes live on the heap, to report what
+// each rule costs. The behavior the benchmarks rely on is checked by
+// adblock_tests.
+#include "adblock_fixtures.h"
+#include "alloc_counter.h"
+
+#include "AdBlocker.h"
+#include "AhoCorasick.h"
+#include "BloomFilter.h"
+#include "CosmeticFilter.h"
+#include "DirectoryWatcher.h"
+#include "FilterEngine.h"
+#include "FilterLoader.h"
+#include "FilterPipeline.h"
+#include "FilterSet.h"
+#include "FilterSnapshot.h"
+#include "FilterStats.h"
+#include "GlobIndex.h"
+#include "HistoryLog.h"
+#include "HistoryStore.h"
+#include "HostMatcher.h"
+#include "HostVerdictCache.h"
+#include "NetworkFilter.h"
+#include "PublicSuffix.h"
+#include "RegexSet.h"
+#include "RequestLog.h"
+#include "SiteAllowlist.h"
+#include "SitePolicy.h"
+#include "StringArena.h"
+#include "ViewTraffic.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <regex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    // Request hosts: ~10% fall under a rule (as a subdomain), the rest are unrelated.
+    std::vector<std::string> MakeQueries(std::mt19937_64 &rng, const std::vector<std::string> &rules, size_t count)
+    {
+        std::vector<std::string> queries;
+        queries.reserve(count);
+        std::uniform_int_distribution<size_t> pick(0, rules.size() - 1);
+        std::uniform_int_distribution<int> pct(0, 99);
+        for (size_t i = 0; i < count; ++i)
+        {
+            if (pct(rng) < 10)
+                queries.push_back("cdn." + rules[pick(rng)]);
+            else
+                queries.push_back("www." + RandomLabel(rng, 3, 8) + "." + RandomDomain(rng));
+        }
+        return queries;
+    }
+
+    void BenchSubstrings(size_t rule_count, size_t query_count)
+    {
+        std::mt19937_64 rng(rule_count + 1);
+        std::vector<std::string> rules;
+        rules.reserve(rule_count);
+        for (size_t i = 0; i < rule_count; ++i)
+            rules.push_back("/" + RandomLabel(rng, 5, 10));
+
+        AhoCorasick ac;
+        auto t0 = Clock::now();
+        ac.Build(rules);
+        auto t1 = Clock::now();
+
+        std::vector<std::string> urls;
+        urls.reserve(query_count);
+        for (size_t i = 0; i < query_count; ++i)
+            urls.push_back(RandomURL(rng));
+        size_t hits = 0;
+        auto t2 = Clock::now();
+        for (const auto &u : urls)
+            hits += ac.Matches(u) ? 1 : 0;
+        auto t3 = Clock::now();
+
+        double build_ms = std::chrono::duration<double, std::milli>(t1 - t0).count();
+        double ns = std::chrono::duration<double, std::nano>(t3 - t2).count() / (double)urls.size();
+        std::printf("substr rules=%-8zu states=%-8zu build=%8.2f ms  lookup=%7.1f ns  hits=%zu/%zu  table=%zu KB\n",
+                    rule_count, ac.state_count(), build_ms, ns, hits, urls.size(), ac.memory_bytes() / 1024);
+    }
+
+    void BenchGlobs(size_t rule_count, size_t query_count)
+    {
+        std::mt19937_64 rng(rule_count + 2);
+        GlobIndex index;
+        for (size_t i = 0; i < rule_count; ++i)
+            index.Add("*/" + RandomLabel(rng, 4, 8) + "/*." + RandomLabel(rng, 2, 3) + "?*");
+        auto t0 = Clock::now();
+        index.Build();
+        auto t1 = Clock::now();
+
+        std::vector<std::string> urls;
+        urls.reserve(query_count);
+        for (size_t i = 0; i < query_count; ++i)
+            urls.push_back(RandomURL(rng));
+        size_t hits = 0;
+        auto t2 = Clock::now();
+        for (const auto &u : urls)
+            hits += index.Matches(u) ? 1 : 0;
+        auto t3 = Clock::now();
+
+        double build_ms = std::chrono::duration<double, std::milli>(t1 - t0).count();
+        double ns = std::chrono::duration<double, std::nano>(t3 - t2).count() / (double)urls.size();
+        std::printf("globs  rules=%-8zu generic=%-7zu build=%8.2f ms  lookup=%7.1f ns  hits=%zu/%zu\n",
+                    rule_count, index.untokenized_count(), build_ms, ns, hits, urls.size());
+    }
+
+    void BenchPathologicalGlob()
+    {
+        // "*a*a*...*b" against "aaaa...": quadratic for backtracking matchers.
+        std::string pattern;
+        for (int i = 0; i < 32; ++i)
+            pattern += "*a";
+        pattern += "*b";
+        std::string text(20000, 'a');
+        auto t0 = Clock::now();
+        bool m = GlobIndex::GlobMatch(text, pattern);
+        auto t1 = Clock::now();
+        std::printf("globs  pathological 32-star pattern on 20k chars: %.3f ms (match=%d)\n",
+                    std::chrono::duration<double, std::milli>(t1 - t0).count(), (int)m);
+    }
+
+    void BenchFilters(size_t rule_count, size_t query_count)
+    {
+        std::mt19937_64 rng(rule_count + 3);
+        FilterEngine engine;
+        const char *options[] = {"$third-party", "$script", "$image,third-party", "$stylesheet", "$domain=" };
+        std::uniform_int_distribution<size_t> pick(0, 4);
+        std::vector<std::string> targets; // URLs some rule is written for
+        for (size_t i = 0; i < rule_count; ++i)
+        {
+            std::string rule;
+            switch (i % 3)
+            {
+            case 0:
+                rule = "||" + RandomDomain(rng) + "^";
+                break;
+            case 1:
+            {
+                std::string host = RandomDomain(rng), dir = RandomLabel(rng, 3, 6);
+                rule = "||" + host + "/" + dir + "/";
+                targets.push_back("https://" + host + "/" + dir + "/banner.png");
+                break;
+            }
+            default:
+                rule = "/" + RandomLabel(rng, 4, 8) + "^";
+                break;
+            }
+            std::string opt = options[pick(rng)];
+            if (opt == "$domain=")
+                opt += RandomDomain(rng);
+            engine.AddRule(rule + opt);
+        }
+        engine.Build();
+
+        std::vector<std::string> urls, origins;
+        for (size_t i = 0; i < query_count; ++i)
+        {
+            // One request in four is aimed at a rule (options may still spare it)
+            urls.push_back(i % 4 == 0 && !targets.empty() ? targets[rng() % targets.size()] : RandomURL(rng));
+            origins.push_back("https://" + RandomDomain(rng));
+        }
+        size_t blocked = 0;
+        auto t0 = Clock::now();
+        for (size_t i = 0; i < urls.size(); ++i)
+            blocked += IsBlocking(Verdict(engine, urls[i], origins[i])) ? 1 : 0;
+        auto t1 = Clock::now();
+        double ns = std::chrono::duration<double, std::nano>(t1 - t0).count() / (double)urls.size();
+        std::printf("abp    rules=%-8zu filters=%-7zu                  lookup=%7.1f ns  hits=%zu/%zu\n",
+                    rule_count, engine.filter_rule_count(), ns, blocked, urls.size());
+    }
+
+    void BenchHosts(size_t rule_count, size_t query_count)
+    {
+        std::mt19937_64 rng(rule_count);
+        std::vector<std::string> rules;
+        rules.reserve(rule_count);
+        for (size_t i = 0; i < rule_count; ++i)
+            rules.push_back(RandomDomain(rng));
+
+        HostMatcher matcher;
+        auto t0 = Clock::now();
+        matcher.Reserve(rules.size());
+        for (const auto &r : rules)
+            matcher.Add(r);
+        auto t1 = Clock::now();
+
+        auto queries = MakeQueries(rng, rules, query_count);
+        size_t hits = 0;
+        auto t2 = Clock::now();
+        for (const auto &q : queries)
+            hits += matcher.Matches(q) ? 1 : 0;
+        auto t3 = Clock::now();
+
+        double build_ms = std::chrono::duration<double, std::milli>(t1 - t0).count();
+        double ns = std::chrono::duration<double, std::nano>(t3 - t2).count() / (double)queries.size();
+        std::printf("hosts  rules=%-8zu unique=%-8zu build=%8.2f ms  lookup=%7.1f ns  hits=%zu/%zu  bloom=%zu KB\n",
+                    rule_count, matcher.size(), build_ms, ns, hits, queries.size(), matcher.prefilter_bytes() / 1024);
+    }
+
+    void BenchOptimize(size_t rule_count, size_t query_count)
+    {
+        std::mt19937_64 rng(rule_count + 67);
+        std::vector<std::string> targets;
+        const std::string list = RedundantList(rng, rule_count, targets);
+        std::vector<std::string> urls;
+        for (size_t i = 0; i < query_count; ++i)
+            urls.push_back(i % 4 ? RandomURL(rng) : targets[i % targets.size()]);
+
+        size_t blocked = 0;
+        auto lookup_ns = [&](const FilterEngine &engine)
+        {
+            auto t0 = Clock::now();
+            for (const auto &u : urls)
+                blocked += engine.IsBlockedURL(u) ? 1 : 0;
+            auto t1 = Clock::now();
+            return std::chrono::duration<double, std::nano>(t1 - t0).count() / (double)urls.size();
+        };
+        FilterEngine plain, optimized;
+        plain.LoadBuffer(list);
+        plain.Build();
+        optimized.LoadBuffer(list);
+        auto t0 = Clock::now();
+        const FilterEngine::OptimizeStats stats = optimized.Optimize();
+        auto t1 = Clock::now();
+        optimized.Build();
+        const double plain_ns = lookup_ns(plain);
+        const double optimized_ns = lookup_ns(optimized);
+        std::printf("optim  rules=%-8zu -> %-8zu optimize=%6.1f ms  url lookup=%6.1f -> %6.1f ns  "
+                    "(-%zu hosts, -%zu substrings, -%zu globs, %zu globs->substrings; %zu blocked)\n",
+                    plain.rule_count(), optimized.rule_count(),
+                    std::chrono::duration<double, std::milli>(t1 - t0).count(), plain_ns, optimized_ns, stats.hosts,
+                    stats.substrings, stats.globs, stats.globs_to_substrings, blocked);
+    }
+
+    void BenchSnapshot(size_t rule_count)
+    {
+        std::mt19937_64 rng(rule_count + 5);
+        std::vector<std::string> targets;
+        const std::string text = MixedList(rng, rule_count, targets);
+
+        auto t0 = Clock::now();
+        FilterEngine parsed;
+        std::istringstream in(text);
+        parsed.LoadStream(in);
+        parsed.Build();
+        auto t1 = Clock::now();
+
+        const std::string path = TempSnapshotPath("adblock_bench");
+        parsed.SaveSnapshot(path, 0);
+        auto t2 = Clock::now();
+        FilterEngine mapped;
+        mapped.LoadSnapshot(FilterSnapshot::Open(path));
+        auto t3 = Clock::now();
+
+        std::printf("snap   rules=%-8zu parse=%8.2f ms  load=%8.2f ms  file=%zu KB\n", rule_count,
+                    std::chrono::duration<double, std::milli>(t1 - t0).count(),
+                    std::chrono::duration<double, std::milli>(t3 - t2).count(),
+                    (size_t)std::filesystem::file_size(path) / 1024);
+        std::filesystem::remove(path);
+    }
+
+    void BenchRegex(size_t rule_count, size_t query_count)
+    {
+        std::mt19937_64 rng(rule_count + 9);
+        RegexSet set;
+        for (size_t i = 0; i < rule_count; ++i)
+            set.Add("/\\/" + RandomLabel(rng, 3, 6) + "[0-9]{1,3}\\/(ad|banner)s?\\." + RandomLabel(rng, 2, 3) + "$/");
+        auto t0 = Clock::now();
+        set.Build();
+        auto t1 = Clock::now();
+
+        std::vector<std::string> urls;
+        urls.reserve(query_count);
+        for (size_t i = 0; i < query_count; ++i)
+            urls.push_back(RandomURL(rng));
+        for (const auto &u : urls)
+            set.Matches(u); // fill the state cache
+        size_t hits = 0;
+        auto t2 = Clock::now();
+        for (const auto &u : urls)
+            hits += set.Matches(u) ? 1 : 0;
+        auto t3 = Clock::now();
+
+        // "(a+)+b" against "aaaa...": exponential for backtracking matchers.
+        RegexSet nested;
+        nested.Add("/(a+)+b/");
+        nested.Build();
+        const std::string text(20000, 'a');
+        auto t4 = Clock::now();
+        const bool m = nested.Matches(text);
+        auto t5 = Clock::now();
+
+        std::printf("regex  rules=%-8zu nfa=%-9zu build=%8.2f ms  lookup=%7.1f ns  hits=%zu/%zu  states=%zu  "
+                    "(a+)+b on 20k chars: %.3f ms (match=%d)\n",
+                    rule_count, set.nfa_size(), std::chrono::duration<double, std::milli>(t1 - t0).count(),
+                    std::chrono::duration<double, std::nano>(t3 - t2).count() / (double)urls.size(), hits, urls.size(),
+                    set.cached_states(), std::chrono::duration<double, std::milli>(t5 - t4).count(), (int)m);
+    }
+
+    // Lookups on several threads at once: each thread matches with its own
+    // DFA, so throughput should grow with the threads instead of queueing.
+    void BenchRegexThreads(size_t rule_count, size_t query_count)
+    {
+        std::mt19937_64 rng(rule_count + 10);
+        RegexSet set;
+        for (size_t i = 0; i < rule_count; ++i)
+            set.Add("/\\/" + RandomLabel(rng, 3, 6) + "[0-9]{1,3}\\/(ad|banner)s?\\." + RandomLabel(rng, 2, 3) + "$/");
+        set.Build();
+        std::vector<std::string> urls;
+        urls.reserve(query_count);
+        for (size_t i = 0; i < query_count; ++i)
+            urls.push_back(RandomURL(rng));
+
+        std::printf("regex  rules=%-8zu cores=%u  lookups/s by threads:", rule_count, std::thread::hardware_concurrency());
+        for (size_t n = 1; n <= 4; n *= 2)
+        {
+            // Each thread fills its own cache first, then all start together.
+            std::atomic<size_t> ready{0};
+            std::atomic<bool> go{false};
+            std::vector<std::thread> threads;
+            for (size_t t = 0; t < n; ++t)
+                threads.emplace_back([&]()
+                                     {
+                    for (const auto &u : urls)
+                        set.Matches(u);
+                    ready.fetch_add(1);
+                    while (!go.load(std::memory_order_acquire))
+                        std::this_thread::yield();
+                    for (const auto &u : urls)
+                        set.Matches(u); });
+            while (ready.load() < n)
+                std::this_thread::yield();
+            auto t0 = Clock::now();
+            go.store(true, std::memory_order_release);
+            for (auto &t : threads)
+                t.join();
+            auto t1 = Clock::now();
+            const double seconds = std::chrono::duration<double>(t1 - t0).count();
+            std::printf("  %zu: %6.2f M", n, (double)(n * urls.size()) / seconds / 1e6);
+        }
+        std::printf("\n");
+    }
+
+    // Page-like traffic: most requests go to a few dozen hosts.
+    void BenchHostCache(size_t rule_count, size_t query_count)
+    {
+        std::mt19937_64 rng(rule_count + 7);
+        HostMatcher matcher;
+        std::vector<std::string> rules;
+        for (size_t i = 0; i < rule_count; ++i)
+        {
+            rules.push_back(RandomDomain(rng));
+            matcher.Add(rules.back());
+        }
+        std::vector<std::string> hot;
+        for (size_t i = 0; i < 48; ++i)
+            hot.push_back(i % 6 == 0 ? "ads." + rules[rng() % rules.size()] : "cdn" + std::to_string(i) + ".site.com");
+        std::vector<std::string> queries;
+        for (size_t i = 0; i < query_count; ++i)
+            queries.push_back(i % 10 == 0 ? "x." + RandomDomain(rng) : hot[rng() % hot.size()]);
+
+        size_t direct_hits = 0, cached_hits = 0;
+        auto t0 = Clock::now();
+        for (const auto &q : queries)
+            direct_hits += matcher.Matches(q) ? 1 : 0;
+        auto t1 = Clock::now();
+        HostVerdictCache cache;
+        for (const auto &q : queries)
+        {
+            bool blocked = false;
+            if (!cache.Lookup(q, 1, blocked))
+            {
+                blocked = matcher.Matches(q);
+                cache.Insert(q, 1, blocked);
+            }
+            cached_hits += blocked ? 1 : 0;
+        }
+        auto t2 = Clock::now();
+
+        HostVerdictCache::Stats st = cache.stats();
+        double direct_ns = std::chrono::duration<double, std::nano>(t1 - t0).count() / (double)queries.size();
+        double cached_ns = std::chrono::duration<double, std::nano>(t2 - t1).count() / (double)queries.size();
+        std::printf("hcache rules=%-8zu direct=%7.1f ns  cached=%7.1f ns  hit rate=%.1f%%%s\n", rule_count, direct_ns,
+                    cached_ns, 100.0 * (double)st.hits / (double)(st.hits + st.misses),
+                    direct_hits == cached_hits ? "" : "  VERDICT MISMATCH");
+    }
+
+    void BenchLoader(size_t host_lines)
+    {
+        std::vector<std::string> targets;
+        auto paths = WriteLists("adblock_bench",host_lines, targets);
+
+        auto t0 = Clock::now();
+        FilterEngine serial;
+        for (const auto &p : paths)
+            serial.LoadFile(p);
+        serial.Build();
+        auto t1 = Clock::now();
+        FilterEngine parallel;
+        FilterLoader loader;
+        loader.Load(paths, parallel);
+        parallel.Build();
+        auto t2 = Clock::now();
+
+        std::printf("load   hosts=%-8zu serial=%8.2f ms  parallel=%8.2f ms  threads=%zu\n", host_lines,
+                    std::chrono::duration<double, std::milli>(t1 - t0).count(),
+                    std::chrono::duration<double, std::milli>(t2 - t1).count(), loader.threads());
+        for (const auto &p : paths)
+            std::filesystem::remove(p);
+    }
+
+    // Cost of the counters on the request path.
+    void BenchStats(size_t query_count)
+    {
+        FilterStats stats;
+        std::vector<MatchedRule> rules;
+        std::vector<std::string> texts;
+        std::mt19937_64 rng(11);
+        for (size_t i = 0; i < 1000; ++i)
+            texts.push_back(RandomDomain(rng));
+        for (const auto &t : texts)
+            rules.push_back({RuleKind::Host, t});
+
+        auto t0 = Clock::now();
+        for (size_t i = 0; i < query_count; ++i)
+            stats.RecordRequest(i & 4095, false);
+        auto t1 = Clock::now();
+        for (size_t i = 0; i < query_count; ++i)
+            stats.RecordHit(rules[i % rules.size()]);
+        auto t2 = Clock::now();
+        auto t3 = Clock::now();
+        stats.Collect();
+        auto t4 = Clock::now();
+
+        std::printf("stats  request=%6.1f ns  hit=%6.1f ns  collect=%8.2f ms\n",
+                    std::chrono::duration<double, std::nano>(t1 - t0).count() / (double)query_count,
+                    std::chrono::duration<double, std::nano>(t2 - t1).count() / (double)query_count,
+                    std::chrono::duration<double, std::milli>(t4 - t3).count());
+    }
+
+    // Per-navigation selector lookup against many site-specific rules.
+    void BenchCosmetic(size_t rule_count, size_t queries)
+    {
+        std::mt19937_64 rng(rule_count + 13);
+        std::vector<std::string> domains;
+        std::string list;
+        for (size_t i = 0; i < rule_count; ++i)
+        {
+            domains.push_back(RandomDomain(rng));
+            list += domains.back() + "##." + RandomLabel(rng, 4, 10) + "\n";
+            if (i % 16 == 0)
+                list += "##.g" + RandomLabel(rng, 4, 10) + "\n";
+        }
+        FilterSet set(BuiltEngine(list), {});
+        std::vector<std::string> hosts = MakeQueries(rng, domains, queries);
+
+        size_t found = 0;
+        auto t0 = Clock::now();
+        for (const auto &h : hosts)
+            found += set.HidingSelectorsForHost(h).size();
+        auto t1 = Clock::now();
+        std::printf("cosm   rules=%-8zu %8.1f ns/host  selectors=%zu generic=%zu\n", rule_count,
+                    std::chrono::duration<double, std::nano>(t1 - t0).count() / hosts.size(), found,
+                    set.GenericHidingSelectors().size());
+    }
+
+    // The request path against the copies it used to make: a std::string per
+    // component from the network layer and a ToLower() copy of each.
+    void BenchRequestPath(size_t query_count)
+    {
+        std::mt19937_64 rng(37);
+        std::vector<std::string> targets;
+        RequestPath path(FilterSet(BuiltEngine(MixedList(rng, 10000, targets)), {}));
+        std::vector<std::string> urls = RequestURLs(rng, targets, 4096);
+        const std::string origin = "https://News.Site.ORG";
+        for (const auto &u : urls)
+            path.Allow(u, origin);
+
+        size_t blocked = 0;
+        size_t before = ThreadAllocations();
+        auto t0 = Clock::now();
+        for (size_t i = 0; i < query_count; ++i)
+        {
+            const std::string &u = urls[i % urls.size()];
+            std::string host = FilterEngine::ToLower(std::string(url_util::HostFromURL(u)));
+            std::string url = FilterEngine::ToLower(std::string(u));
+            std::string from = FilterEngine::ToLower(std::string(origin));
+            RequestContext ctx = RequestContext::Make(url, host, url_util::HostFromURL(from));
+            blocked += IsBlocking(path.filters.Match(ctx)) ? 1 : 0;
+        }
+        auto t1 = Clock::now();
+        const size_t copy_allocs = ThreadAllocations() - before;
+        before = ThreadAllocations();
+        for (size_t i = 0; i < query_count; ++i)
+            blocked += path.Allow(urls[i % urls.size()], origin) ? 0 : 1;
+        auto t2 = Clock::now();
+        const size_t view_allocs = ThreadAllocations() - before;
+
+        std::printf("reqpath copies=%7.1f ns %4.1f allocs  views=%7.1f ns %4.1f allocs  (per request, blocked=%zu)\n",
+                    std::chrono::duration<double, std::nano>(t1 - t0).count() / (double)query_count,
+                    (double)copy_allocs / (double)query_count,
+                    std::chrono::duration<double, std::nano>(t2 - t1).count() / (double)query_count,
+                    (double)view_allocs / (double)query_count, blocked);
+    }
+
+    void BenchPublicSuffix(size_t query_count)
+    {
+        std::mt19937_64 rng(53);
+        std::vector<std::string> hosts = MakeQueries(rng, {"example.com", "user.github.io"}, query_count);
+        size_t bytes = 0;
+        auto t0 = Clock::now();
+        for (const auto &h : hosts)
+            bytes += psl::RegistrableDomain(h).size();
+        auto t1 = Clock::now();
+        std::printf("psl    hosts=%-8zu lookup=%6.1f ns  (%zu bytes)\n", hosts.size(),
+                    std::chrono::duration<double, std::nano>(t1 - t0).count() / (double)hosts.size(), bytes);
+    }
+
+    // Cost of logging a decision on the request path, with the writer draining
+    // to a file meanwhile.
+    void BenchRequestLog(size_t query_count)
+    {
+        const std::string path = (std::filesystem::temp_directory_path() / "adblock_bench_requests.log").string();
+        RequestLog log;
+        log.Start(path, 1 << 20, 1);
+        const std::string url = "https://ads.example.com/banner/300x250.gif?cb=123456";
+        auto t0 = Clock::now();
+        for (size_t i = 0; i < query_count; ++i)
+            log.Push(RequestLog::Decision::Blocked, RuleKind::Host, "ads.example.com", url);
+        auto t1 = Clock::now();
+        log.Stop();
+        std::printf("log    pushes=%-8zu push=%6.1f ns  dropped=%llu\n", query_count,
+                    std::chrono::duration<double, std::nano>(t1 - t0).count() / (double)query_count,
+                    (unsigned long long)log.dropped());
+        std::filesystem::remove(path);
+        std::filesystem::remove(path + ".1");
+    }
+
+    // Trusted-site lookup: the cost every request pays while a site is allowed.
+    void BenchAllowlist(size_t site_count, size_t query_count)
+    {
+        std::mt19937_64 rng(site_count + 41);
+        SiteAllowlist list;
+        std::vector<std::string> sites;
+        for (size_t i = 0; i < site_count; ++i)
+        {
+            sites.push_back(RandomDomain(rng));
+            list.Add(sites.back());
+        }
+        std::vector<std::string> hosts = MakeQueries(rng, sites, query_count);
+        size_t hits = 0;
+        auto t0 = Clock::now();
+        for (const auto &h : hosts)
+            hits += list.Contains(h) ? 1 : 0;
+        auto t1 = Clock::now();
+        std::printf("allow  sites=%-8zu lookup=%6.1f ns  hits=%zu/%zu\n", site_count,
+                    std::chrono::duration<double, std::nano>(t1 - t0).count() / (double)hosts.size(), hits,
+                    hosts.size());
+    }
+
+    // Heap bytes a built engine holds per rule, for a hosts file and for a
+    // list mixing every rule kind.
+    void BenchMemory(size_t rule_count)
+    {
+        std::mt19937_64 rng(rule_count + 43);
+        std::vector<std::string> targets;
+        std::string hosts;
+        for (size_t i = 0; i < rule_count; ++i)
+            hosts += "0.0.0.0 " + RandomLabel(rng, 3, 8) + "." + RandomDomain(rng) + "\n";
+        const std::string mixed = MixedList(rng, rule_count, targets);
+
+        for (const std::string *list : {(const std::string *)&hosts, &mixed})
+        {
+            const int64_t before = LiveHeapBytes();
+            auto engine = std::make_unique<FilterEngine>();
+            engine->LoadBuffer(*list);
+            engine->Build();
+            const int64_t bytes = LiveHeapBytes() - before;
+            std::printf("memory %-6s rules=%-8zu heap=%8.1f MB  %6.1f bytes/rule  (list %5.1f bytes/line)\n",
+                        list == &hosts ? "hosts" : "mixed", engine->rule_count(), (double)bytes / (1024.0 * 1024.0),
+                        (double)bytes / (double)engine->rule_count(), (double)list->size() / (double)rule_count);
+        }
+    }
+
+    // Reloading one small list: a new layer versus rebuilding every rule.
+    void BenchReload(size_t host_lines)
+    {
+        std::vector<std::string> targets;
+        auto paths = WriteLists("adblock_bench",host_lines, targets); // {mixed, hosts}
+
+        FilterEngine everything;
+        FilterLoader().Load(paths, everything);
+        everything.Build();
+        FilterSet set(std::make_shared<FilterEngine>(std::move(everything)), paths);
+
+        auto t0 = Clock::now();
+        FilterEngine full;
+        FilterLoader().Load(paths, full);
+        full.Build();
+        auto t1 = Clock::now();
+        auto layer = std::make_shared<FilterEngine>();
+        FilterLoader().Load({paths[0]}, *layer);
+        layer->Build();
+        FilterSet next = set.WithLayer(paths[0], layer);
+        auto t2 = Clock::now();
+
+        std::printf("reload hosts=%-8zu full=%8.2f ms  one list=%8.2f ms  layers=%zu\n", host_lines,
+                    std::chrono::duration<double, std::milli>(t1 - t0).count(),
+                    std::chrono::duration<double, std::milli>(t2 - t1).count(), next.layers().size());
+        for (const auto &p : paths)
+            std::filesystem::remove(p);
+    }
+
+    // Splitting one rule set into an ads and a trackers engine behind the site
+    // policy, against one engine holding both lists.
+    void BenchPipeline(size_t query_count)
+    {
+        std::mt19937_64 rng(59);
+        std::vector<std::string> targets;
+        const std::string dir = std::filesystem::temp_directory_path().string();
+        const std::string ads_list = dir + "/adblock_bench_ads.txt";
+        const std::string tracker_list = dir + "/adblock_bench_trackers.txt";
+        std::ofstream(ads_list) << MixedList(rng, 10000, targets);
+        {
+            std::ofstream out(tracker_list);
+            for (size_t i = 0; i < 2000; ++i)
+            {
+                targets.push_back(RandomDomain(rng));
+                out << "||" << targets.back() << "^\n";
+            }
+        }
+        std::vector<std::string> urls = RequestURLs(rng, targets, 4096);
+        const std::string origin = "https://News.Site.ORG";
+
+        FilterPipeline single;
+        AdBlocker *all = single.AddBlocker(std::make_unique<AdBlocker>("all"));
+        all->LoadBlocklist(ads_list);
+        all->LoadBlocklist(tracker_list, true);
+        FilterPipeline split;
+        split.AddPolicy(std::make_unique<SitePolicy>())->SetSiteAllowed("trusted.org", true);
+        split.AddBlocker(std::make_unique<AdBlocker>("ads"))->LoadBlocklist(ads_list);
+        split.AddBlocker(std::make_unique<AdBlocker>("trackers"))->LoadBlocklist(tracker_list);
+        std::filesystem::remove(ads_list);
+        std::filesystem::remove(tracker_list);
+
+        double ns[2];
+        size_t blocked[2] = {0, 0};
+        FilterPipeline *pipelines[2] = {&single, &split};
+        for (int k = 0; k < 2; ++k)
+        {
+            for (const auto &u : urls)
+                PipelineAllows(*pipelines[k], u, origin);
+            auto t0 = Clock::now();
+            for (size_t i = 0; i < query_count; ++i)
+                blocked[k] += PipelineAllows(*pipelines[k], urls[i % urls.size()], origin) ? 0 : 1;
+            auto t1 = Clock::now();
+            ns[k] = std::chrono::duration<double, std::nano>(t1 - t0).count() / (double)query_count;
+        }
+        std::string order;
+        for (const auto &stage : split.Profile())
+        {
+            if (!stage.policy)
+                order += (order.empty() ? "" : ",") + stage.name;
+        }
+        std::printf("pipeln one engine=%6.1f ns  ads+trackers+policy=%6.1f ns  order=%s  blocked=%zu/%zu\n", ns[0],
+                    ns[1], order.c_str(), blocked[0], blocked[1]);
+    }
+
+    // Cost of shadow-evaluating a candidate list next to the active rules.
+    void BenchShadow(size_t query_count)
+    {
+        std::mt19937_64 rng(61);
+        std::vector<std::string> targets;
+        const std::string dir = std::filesystem::temp_directory_path().string();
+        const std::string active_list = dir + "/adblock_bench_active.txt";
+        const std::string candidate_list = dir + "/adblock_bench_candidate.txt";
+        std::ofstream(active_list) << MixedList(rng, 10000, targets);
+        std::ofstream(candidate_list) << MixedList(rng, 2000, targets);
+        // Requests for both lists' targets
+        std::shuffle(targets.begin(), targets.end(), rng);
+        std::vector<std::string> urls = RequestURLs(rng, targets, 4096);
+        const std::string origin = "https://News.Site.ORG";
+
+        FilterPipeline pipeline;
+        AdBlocker *ads = pipeline.AddBlocker(std::make_unique<AdBlocker>("ads"));
+        ads->LoadBlocklist(active_list);
+        double ns[2];
+        for (int k = 0; k < 2; ++k)
+        {
+            if (k == 1)
+                ads->LoadShadowList(candidate_list);
+            for (const auto &u : urls)
+                PipelineAllows(pipeline, u, origin);
+            auto t0 = Clock::now();
+            for (size_t i = 0; i < query_count; ++i)
+                PipelineAllows(pipeline, urls[i % urls.size()], origin);
+            auto t1 = Clock::now();
+            ns[k] = std::chrono::duration<double, std::nano>(t1 - t0).count() / (double)query_count;
+        }
+        std::filesystem::remove(active_list);
+        std::filesystem::remove(candidate_list);
+        const std::string json = ads->ShadowReportJSON();
+        auto field = [&](const char *name)
+        {
+            const size_t at = json.find(name);
+            return at == std::string::npos ? 0ull : std::strtoull(json.c_str() + at + std::strlen(name), nullptr, 10);
+        };
+        std::printf("shadow 10k active=%6.1f ns  +2k candidate=%6.1f ns  (%llu ns matching)  newly blocked=%llu "
+                    "allowed=%llu\n",
+                    ns[0], ns[1], field("\"extra_ns_per_request\":"), field("\"newly_blocked\":"),
+                    field("\"newly_allowed\":"));
+    }
+
+    void BenchViewTraffic(size_t query_count)
+    {
+        ViewTraffic traffic;
+        int views[8];
+        std::mt19937_64 rng(67);
+        std::vector<std::string> hosts;
+        for (int i = 0; i < 256; ++i)
+            hosts.push_back(RandomDomain(rng));
+        for (auto &v : views)
+            traffic.Open(&v);
+        auto t0 = Clock::now();
+        for (size_t i = 0; i < query_count; ++i)
+            traffic.Record(&views[i % 8], hosts[(i * 7) % hosts.size()], i % 10 == 0);
+        auto t1 = Clock::now();
+        const double ns = std::chrono::duration<double, std::nano>(t1 - t0).count() / (double)query_count;
+        const ViewTraffic::Report r = traffic.Collect(&views[0]);
+        std::printf("traffic views=8 hosts=256 record=%6.1f ns  view0 hosts=%zu (+%llu untracked requests)\n", ns,
+                    r.hosts.size(), (unsigned long long)r.untracked_hosts);
+    }
+
+    // Recording visits into a full history, against the vector scans it replaced.
+    void BenchHistory(size_t capacity, size_t visits)
+    {
+        std::mt19937_64 rng(71);
+        std::vector<std::string> urls;
+        for (size_t i = 0; i < capacity * 2; ++i)
+            urls.push_back("https://" + RandomDomain(rng) + "/" + RandomLabel(rng, 4, 12));
+        std::vector<std::string> titles;
+        for (const auto &u : urls)
+            titles.push_back("Title of " + u);
+
+        HistoryStore store(capacity);
+        auto t0 = Clock::now();
+        for (size_t i = 0; i < visits; ++i)
+            store.Visit(urls[(i * 7) % urls.size()], titles[(i * 7) % urls.size()], i);
+        auto t1 = Clock::now();
+
+        struct Entry
+        {
+            std::string url, title;
+            uint64_t timestamp_ms;
+            uint32_t visit_count;
+        };
+        std::vector<Entry> vec;
+        for (size_t i = 0; i < visits; ++i)
+        {
+            const std::string &u = urls[(i * 7) % urls.size()];
+            bool found = false;
+            for (auto &e : vec)
+            {
+                if (e.url == u)
+                {
+                    e.title = titles[(i * 7) % urls.size()];
+                    e.timestamp_ms = i;
+                    ++e.visit_count;
+                    found = true;
+                    break;
+                }
+            }
+            if (!found)
+                vec.push_back({u, titles[(i * 7) % urls.size()], i, 1});
+            if (vec.size() > capacity)
+            {
+                size_t oldest = 0;
+                for (size_t j = 1; j < vec.size(); ++j)
+                {
+                    if (vec[j].timestamp_ms < vec[oldest].timestamp_ms)
+                        oldest = j;
+                }
+                vec.erase(vec.begin() + oldest);
+            }
+        }
+        auto t2 = Clock::now();
+        std::printf("histry entries=%-7zu visit=%8.1f ns  vector scans=%10.1f ns  (%zu/%zu kept)\n", capacity,
+                    std::chrono::duration<double, std::nano>(t1 - t0).count() / (double)visits,
+                    std::chrono::duration<double, std::nano>(t2 - t1).count() / (double)visits, store.size(),
+                    vec.size());
+    }
+
+    // A visit appended to the log, against rewriting the whole snapshot.
+    void BenchHistoryLog(size_t capacity, size_t visits)
+    {
+        const auto dir = std::filesystem::temp_directory_path() / "adblock_bench_history";
+        std::filesystem::remove_all(dir);
+        std::mt19937_64 rng(73);
+        std::vector<std::string> urls;
+        for (size_t i = 0; i < capacity; ++i)
+            urls.push_back("https://" + RandomDomain(rng) + "/" + RandomLabel(rng, 4, 12));
+
+        double ns[2];
+        for (int k = 0; k < 2; ++k)
+        {
+            HistoryStore history(capacity);
+            HistoryLog log(dir / "history.json");
+            for (const auto &u : urls)
+                history.Visit(u, "Title of " + u, 0);
+            log.Compact(history);
+            auto t0 = Clock::now();
+            for (size_t i = 0; i < visits; ++i)
+            {
+                const HistoryStore::Entry &e = history.Visit(urls[(i * 7) % urls.size()], "", i);
+                if (k == 0)
+                    log.Record(e, history);
+                else
+                    log.Compact(history);
+            }
+            log.WaitForCompaction();
+            auto t1 = Clock::now();
+            ns[k] = std::chrono::duration<double, std::nano>(t1 - t0).count() / (double)visits;
+        }
+        std::filesystem::remove_all(dir);
+        std::printf("histlg entries=%-7zu append=%8.1f us  rewrite=%10.1f us\n", capacity, ns[0] / 1000.0,
+                    ns[1] / 1000.0);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    bool quick = argc > 1 && std::strcmp(argv[1], "--quick") == 0;
+    const size_t queries = quick ? 10000 : 1000000;
+    BenchHosts(1000, queries);
+    BenchHosts(quick ? 10000 : 100000, queries);
+    if (!quick)
+        BenchHosts(1000000, queries);
+
+    BenchHostCache(quick ? 10000 : 1000000, queries);
+
+    BenchSubstrings(100, queries);
+    BenchSubstrings(quick ? 1000 : 10000, queries);
+
+    BenchGlobs(100, queries);
+    BenchGlobs(quick ? 1000 : 10000, queries);
+    BenchPathologicalGlob();
+    BenchRegex(100, queries);
+    BenchRegex(quick ? 1000 : 10000, queries);
+    BenchRegexThreads(quick ? 1000 : 10000, queries);
+
+    BenchFilters(1000, queries);
+    BenchFilters(quick ? 10000 : 100000, queries);
+
+    BenchLoader(quick ? 200000 : 2000000);
+
+    BenchSnapshot(1000);
+    BenchSnapshot(quick ? 10000 : 100000);
+    if (!quick)
+        BenchSnapshot(1000000);
+
+    BenchReload(quick ? 200000 : 2000000);
+    BenchOptimize(quick ? 10000 : 100000, queries);
+
+    BenchCosmetic(quick ? 10000 : 100000, queries);
+
+    BenchStats(queries);
+    BenchRequestPath(queries);
+    BenchMemory(quick ? 100000 : 1000000);
+    BenchAllowlist(10, queries);
+    BenchAllowlist(10000, queries);
+    BenchPublicSuffix(queries);
+    BenchRequestLog(queries);
+    BenchPipeline(queries);
+    BenchShadow(queries);
+    BenchViewTraffic(queries);
+    BenchHistory(500, quick ? 20000 : 200000);
+    BenchHistory(quick ? 5000 : 50000, quick ? 20000 : 200000);
+    BenchHistoryLog(500, quick ? 500 : 5000);
+    BenchHistoryLog(quick ? 5000 : 50000, quick ? 200 : 1000);
+    return 0;
+}
@@ -0,0 +1,194 @@
+#pragma once
+// Rule lists, URLs and request paths shared by adblock_bench and adblock_tests.
+#include "FilterEngine.h"
+#include "FilterPipeline.h"
+#include "FilterSet.h"
+#include "FilterStats.h"
+#include "HostVerdictCache.h"
+#include "NetworkFilter.h"
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+inline const char *kTlds[] = {"com", "net", "org", "io", "de", "co.uk", "info", "biz"};
+
+inline std::string RandomLabel(std::mt19937_64 &rng, size_t min_len, size_t max_len)
+{
+    std::uniform_int_distribution<size_t> len(min_len, max_len);
+    std::uniform_int_distribution<int> ch(0, 25);
+    std::string s(len(rng), 'a');
+    for (auto &c : s)
+        c = (char)('a' + ch(rng));
+    return s;
+}
+
+inline std::string RandomDomain(std::mt19937_64 &rng)
+{
+    std::uniform_int_distribution<size_t> tld(0, sizeof(kTlds) / sizeof(kTlds[0]) - 1);
+    return RandomLabel(rng, 4, 12) + "." + kTlds[tld(rng)];
+}
+
+inline std::string RandomURL(std::mt19937_64 &rng)
+{
+    return "https://www." + RandomDomain(rng) + "/" + RandomLabel(rng, 3, 10) + "/" +
+           RandomLabel(rng, 4, 16) + ".js?v=" + RandomLabel(rng, 4, 8);
+}
+
+inline FilterVerdict Verdict(const FilterEngine &engine, const std::string &url, const std::string &origin)
+{
+    std::string_view host = url_util::HostFromURL(url);
+    return engine.Match(RequestContext::Make(url, host, url_util::HostFromURL(origin)));
+}
+
+// A mixed list in every syntax FilterEngine accepts.
+inline std::string MixedList(std::mt19937_64 &rng, size_t rule_count, std::vector<std::string> &targets)
+{
+    std::string list;
+    for (size_t i = 0; i < rule_count; ++i)
+    {
+        std::string host = RandomDomain(rng);
+        switch (i % 10)
+        {
+        case 0:
+            list += "/" + RandomLabel(rng, 4, 8) + "/ad\n";
+            break;
+        case 1:
+            list += "*" + RandomLabel(rng, 4, 8) + "*.gif\n";
+            break;
+        case 2:
+            list += "||" + host + "/" + RandomLabel(rng, 3, 6) + "^$third-party\n";
+            break;
+        case 3:
+            list += "@@||" + host + "^$script\n";
+            targets.push_back("https://" + host + "/lib.js");
+            break;
+        default:
+            list += (i % 2 ? "0.0.0.0 " : "") + host + "\n";
+            targets.push_back("https://cdn." + host + "/x.png");
+            break;
+        }
+    }
+    return list;
+}
+
+// name.snapshot in the temp directory; each test names its own, so they can run at once.
+inline std::string TempSnapshotPath(const std::string &name)
+{
+    return (std::filesystem::temp_directory_path() / (name + ".snapshot")).string();
+}
+
+// A mixed list plus rules the optimizer should find redundant: subdomains
+// of its hosts, substrings extending its substrings, and "*text*" globs.
+inline std::string RedundantList(std::mt19937_64 &rng, size_t rule_count, std::vector<std::string> &targets)
+{
+    std::string list = MixedList(rng, rule_count, targets);
+    for (size_t i = 0; i < rule_count / 2; ++i)
+    {
+        const std::string label = RandomLabel(rng, 4, 8);
+        switch (i % 4)
+        {
+        case 0:
+        {
+            std::string_view host = url_util::HostFromURL(targets[i % targets.size()]);
+            if (host.rfind("cdn.", 0) == 0)
+                host.remove_prefix(4);
+            list += "ads." + std::string(host) + "\n";
+            break;
+        }
+        case 1:
+            list += "/" + label + "/ad\n/" + label + "/ad/x\n";
+            break;
+        case 2:
+            list += "*" + label + "*\n";
+            targets.push_back("https://" + RandomDomain(rng) + "/a/" + label + ".png");
+            break;
+        default:
+            list += "*://*/" + label + "/ad*\n";
+            break;
+        }
+    }
+    return list;
+}
+
+// Write a mixed list plus a large hosts file, named after prefix; returns their paths.
+inline std::vector<std::string> WriteLists(const std::string &prefix, size_t host_lines,
+                                           std::vector<std::string> &targets)
+{
+    std::mt19937_64 rng(host_lines);
+    auto dir = std::filesystem::temp_directory_path();
+    std::vector<std::string> paths = {(dir / (prefix + "_mixed.txt")).string(),
+                                      (dir / (prefix + "_hosts.txt")).string()};
+    std::ofstream(paths[0]) << MixedList(rng, 5000, targets);
+    std::ofstream hosts(paths[1]);
+    for (size_t i = 0; i < host_lines; ++i)
+        hosts << "0.0.0.0 " << RandomDomain(rng) << "\n";
+    return paths;
+}
+
+inline FilterSet::EnginePtr BuiltEngine(std::string_view list)
+{
+    auto engine = std::make_shared<FilterEngine>();
+    engine->LoadBuffer(list);
+    engine->Build();
+    return engine;
+}
+
+// What one AdBlocker stage does between receiving the URL and returning
+// its verdict, without the pipeline around it.
+struct RequestPath
+{
+    explicit RequestPath(FilterSet set) : filters(std::move(set)) {}
+
+    FilterSet filters;
+    HostVerdictCache cache;
+    FilterStats stats;
+
+    bool Allow(std::string_view url, std::string_view origin)
+    {
+        const auto start = Clock::now();
+        thread_local RequestBuffer buffer;
+        const RequestContext &ctx = buffer.Parse(url, origin);
+        bool host_blocked = false;
+        if (!ctx.host.empty() && !cache.Lookup(ctx.host, 1, host_blocked))
+        {
+            host_blocked = filters.IsBlockedHost(ctx.host);
+            cache.Insert(ctx.host, 1, host_blocked);
+        }
+        const FilterVerdict verdict = filters.Match(ctx, host_blocked);
+        MatchedRule rule;
+        if (verdict != FilterVerdict::Allow && filters.Explain(ctx, verdict, rule))
+            stats.RecordHit(rule);
+        stats.RecordRequest((uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count(),
+                            IsBlocking(verdict));
+        return !IsBlocking(verdict);
+    }
+};
+
+// Request URLs as a page would issue them: mixed case, some blocked.
+inline std::vector<std::string> RequestURLs(std::mt19937_64 &rng, const std::vector<std::string> &targets, size_t count)
+{
+    std::vector<std::string> urls;
+    for (size_t i = 0; i < count; ++i)
+    {
+        std::string url = i % 4 == 0 ? targets[i % targets.size()] : RandomURL(rng);
+        url += "&Session=" + RandomLabel(rng, 8, 16) + "&Ref=HTTPS%3A%2F%2FWWW.Example.COM%2FPage";
+        urls.push_back(std::move(url));
+    }
+    return urls;
+}
+
+// Parse url and origin and ask pipeline, as ContentBlocker does.
+inline bool PipelineAllows(FilterPipeline &pipeline, std::string_view url, std::string_view origin,
+                    std::string_view page_host = std::string_view())
+{
+    thread_local RequestBuffer buffer;
+    return pipeline.Allow(FilterRequest(buffer.Parse(url, origin), page_host));
+}
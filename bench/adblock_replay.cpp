@@ -0,0 +1,307 @@
+// Replays a recorded request corpus through the ad blocker's request path.
+//
+// Usage: adblock_replay [--repeat N] [--shadow <list> [--shadow-report <out.json>]]
+//                       <corpus.txt> <list.txt | directory>...
+//        adblock_replay [--repeat N] --synthetic <rules>
+//
+// The corpus holds one request per line: the URL, optionally followed by
+// whitespace and the requesting document's origin. Blank lines and lines
+// starting with '#' are skipped. Lists are loaded the way the browser loads
+// them (FilterLoader over the expanded sources), then every request goes
+// through the same steps as AdBlocker::Evaluate: RequestBuffer, host verdict
+// cache, FilterSet::Match.
+//
+// --shadow evaluates a candidate list next to the loaded ones without
+// enforcing it (see ShadowList) and reports how many verdicts it would change
+// and the time it would add; --shadow-report writes the full per-rule report.
+//
+// --synthetic writes a generated list of the given size and a matching
+// corpus to the temp directory and replays those, so the harness runs on a
+// machine without any recorded traffic or network access.
+//
+// Reports load time, throughput, per-request latency percentiles and the
+// resident memory the rules added (Linux only).
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "FilterEngine.h"
+#include "FilterLoader.h"
+#include "FilterSet.h"
+#include "FilterSnapshot.h"
+#include "HostVerdictCache.h"
+#include "ShadowList.h"
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    struct Request
+    {
+        std::string url;
+        std::string origin;
+    };
+
+    int Usage()
+    {
+        std::fprintf(stderr, "usage: adblock_replay [--repeat N] [--shadow <list> [--shadow-report <out.json>]]\n"
+                             "                      <corpus.txt> <list.txt | directory>...\n"
+                             "       adblock_replay [--repeat N] --synthetic <rules>\n");
+        return 2;
+    }
+
+    // Resident and peak resident set size in KB; 0 where /proc is unavailable.
+    size_t ReadStatusKB(const char *field)
+    {
+        std::ifstream status("/proc/self/status");
+        std::string line;
+        const size_t len = std::strlen(field);
+        while (std::getline(status, line))
+        {
+            if (line.compare(0, len, field) == 0)
+                return (size_t)std::strtoull(line.c_str() + len, nullptr, 10);
+        }
+        return 0;
+    }
+
+    bool ReadCorpus(const std::string &path, std::vector<Request> &out)
+    {
+        std::ifstream in(path);
+        if (!in.is_open())
+            return false;
+        std::string line;
+        while (std::getline(in, line))
+        {
+            std::string_view l = FilterEngine::Trim(line);
+            if (l.empty() || l[0] == '#')
+                continue;
+            size_t ws = l.find_first_of(" \t");
+            Request r;
+            r.url.assign(l.substr(0, ws));
+            if (ws != std::string_view::npos)
+                r.origin.assign(FilterEngine::Trim(l.substr(ws)));
+            out.push_back(std::move(r));
+        }
+        return true;
+    }
+
+    std::string RandomLabel(std::mt19937_64 &rng, size_t min_len, size_t max_len)
+    {
+        std::uniform_int_distribution<size_t> len(min_len, max_len);
+        std::uniform_int_distribution<int> ch(0, 25);
+        std::string s(len(rng), 'a');
+        for (auto &c : s)
+            c = (char)('a' + ch(rng));
+        return s;
+    }
+
+    // A list of hosts, substrings, globs and Adblock Plus rules, and a corpus
+    // in which about one request in ten hits a rule.
+    bool WriteSynthetic(size_t rule_count, const std::string &list_path, const std::string &corpus_path)
+    {
+        const char *tlds[] = {"com", "net", "org", "io", "de", "co.uk"};
+        std::mt19937_64 rng(rule_count);
+        std::uniform_int_distribution<size_t> tld(0, 5);
+        auto domain = [&]()
+        { return RandomLabel(rng, 4, 12) + "." + tlds[tld(rng)]; };
+
+        std::ofstream list(list_path, std::ios::binary | std::ios::trunc);
+        std::vector<std::string> hits;
+        for (size_t i = 0; i < rule_count; ++i)
+        {
+            std::string host = domain();
+            switch (i % 10)
+            {
+            case 0:
+                list << "/" << RandomLabel(rng, 4, 8) << "/ad\n";
+                break;
+            case 1:
+                list << "*" << RandomLabel(rng, 4, 8) << "*.gif\n";
+                break;
+            case 2:
+                list << "||" << host << "/" << RandomLabel(rng, 3, 6) << "^$third-party\n";
+                break;
+            case 3:
+                list << "@@||" << host << "^$script\n";
+                break;
+            default:
+                list << (i % 2 ? "0.0.0.0 " : "") << host << "\n";
+                hits.push_back("https://cdn." + host + "/x.png");
+                break;
+            }
+        }
+
+        std::ofstream corpus(corpus_path, std::ios::binary | std::ios::trunc);
+        std::uniform_int_distribution<int> pct(0, 99);
+        std::vector<std::string> sites;
+        for (int i = 0; i < 50; ++i)
+            sites.push_back("https://www." + domain());
+        for (size_t i = 0; i < 100000; ++i)
+        {
+            const std::string &site = sites[i % sites.size()];
+            if (pct(rng) < 10 && !hits.empty())
+                corpus << hits[i % hits.size()];
+            else if (pct(rng) < 50)
+                corpus << site << "/" << RandomLabel(rng, 3, 10) << "/" << RandomLabel(rng, 4, 16) << ".js?v="
+                       << RandomLabel(rng, 4, 8);
+            else
+                corpus << "https://static." << domain() << "/img/" << RandomLabel(rng, 4, 16) << ".png";
+            corpus << ' ' << site << '\n';
+        }
+        return (bool)list && (bool)corpus;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    size_t repeat = 1;
+    size_t synthetic = 0;
+    std::string shadow_path, shadow_report;
+    std::vector<std::string> args;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::strcmp(argv[i], "--repeat") == 0 && i + 1 < argc)
+            repeat = std::max<size_t>(1, std::strtoull(argv[++i], nullptr, 10));
+        else if (std::strcmp(argv[i], "--synthetic") == 0 && i + 1 < argc)
+            synthetic = std::strtoull(argv[++i], nullptr, 10);
+        else if (std::strcmp(argv[i], "--shadow") == 0 && i + 1 < argc)
+            shadow_path = argv[++i];
+        else if (std::strcmp(argv[i], "--shadow-report") == 0 && i + 1 < argc)
+            shadow_report = argv[++i];
+        else if (argv[i][0] == '-')
+            return Usage();
+        else
+            args.push_back(argv[i]);
+    }
+
+    std::string corpus_path;
+    std::vector<std::string> inputs;
+    if (synthetic > 0)
+    {
+        auto dir = std::filesystem::temp_directory_path();
+        corpus_path = (dir / "adblock_replay_corpus.txt").string();
+        inputs.push_back((dir / "adblock_replay_list.txt").string());
+        if (!args.empty() || !WriteSynthetic(synthetic, inputs[0], corpus_path))
+            return Usage();
+    }
+    else
+    {
+        if (args.size() < 2)
+            return Usage();
+        corpus_path = args[0];
+        inputs.assign(args.begin() + 1, args.end());
+    }
+
+    std::vector<Request> corpus;
+    if (!ReadCorpus(corpus_path, corpus) || corpus.empty())
+    {
+        std::fprintf(stderr, "adblock_replay: cannot read requests from %s\n", corpus_path.c_str());
+        return 1;
+    }
+
+    const size_t rss_before = ReadStatusKB("VmRSS:");
+    auto t0 = Clock::now();
+    const std::vector<std::string> sources = FilterSnapshot::ExpandSources(inputs);
+    auto engine = std::make_shared<FilterEngine>();
+    if (FilterLoader().Load(sources, *engine) != sources.size())
+    {
+        std::fprintf(stderr, "adblock_replay: cannot read all of the lists\n");
+        return 1;
+    }
+    auto t1 = Clock::now();
+    engine->Build();
+    auto t2 = Clock::now();
+    const size_t rss_rules = ReadStatusKB("VmRSS:");
+    const FilterSet filters(std::move(engine), sources);
+
+    std::printf("load    lists=%-4zu rules=%-9zu parse=%8.2f ms  build=%8.2f ms\n", sources.size(),
+                filters.rule_count(), std::chrono::duration<double, std::milli>(t1 - t0).count(),
+                std::chrono::duration<double, std::milli>(t2 - t1).count());
+
+    std::unique_ptr<ShadowList> shadow;
+    if (!shadow_path.empty())
+    {
+        auto candidate = std::make_shared<FilterEngine>();
+        const std::vector<std::string> candidate_sources = FilterSnapshot::ExpandSources({shadow_path});
+        if (FilterLoader().Load(candidate_sources, *candidate) != candidate_sources.size())
+        {
+            std::fprintf(stderr, "adblock_replay: cannot read %s\n", shadow_path.c_str());
+            return 1;
+        }
+        candidate->Build();
+        shadow = std::make_unique<ShadowList>(shadow_path, std::move(candidate));
+    }
+
+    HostVerdictCache cache;
+    RequestBuffer buffer;
+    std::vector<uint32_t> latency_ns;
+    latency_ns.reserve(corpus.size() * repeat);
+    size_t blocked = 0;
+    auto r0 = Clock::now();
+    for (size_t pass = 0; pass < repeat; ++pass)
+    {
+        for (const auto &r : corpus)
+        {
+            auto start = Clock::now();
+            const RequestContext &ctx = buffer.Parse(r.url, r.origin);
+            bool host_blocked = false;
+            if (!ctx.host.empty() && !cache.Lookup(ctx.host, 1, host_blocked))
+            {
+                host_blocked = filters.IsBlockedHost(ctx.host);
+                cache.Insert(ctx.host, 1, host_blocked);
+            }
+            const FilterVerdict verdict = filters.Match(ctx, host_blocked);
+            blocked += IsBlocking(verdict) ? 1 : 0;
+            const int64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+            latency_ns.push_back((uint32_t)std::min<int64_t>(UINT32_MAX, ns));
+            // Outside the latency sample: the report times the candidate itself
+            if (shadow)
+                shadow->Evaluate(ctx, filters, verdict, (uint64_t)ns);
+        }
+    }
+    auto r1 = Clock::now();
+
+    const size_t requests = latency_ns.size();
+    auto percentile = [&](double p)
+    {
+        size_t i = std::min(requests - 1, (size_t)(p * (double)requests));
+        std::nth_element(latency_ns.begin(), latency_ns.begin() + i, latency_ns.end());
+        return latency_ns[i];
+    };
+    const double seconds = std::chrono::duration<double>(r1 - r0).count();
+    std::printf("replay  requests=%-9zu blocked=%-8zu throughput=%10.0f req/s\n", requests, blocked,
+                (double)requests / seconds);
+    const uint32_t p50 = percentile(0.50), p90 = percentile(0.90), p99 = percentile(0.99);
+    std::printf("latency p50=%8u ns  p90=%8u ns  p99=%8u ns  max=%8u ns\n", p50, p90, p99,
+                *std::max_element(latency_ns.begin(), latency_ns.end()));
+    if (rss_before)
+        std::printf("memory  rules=%8.1f MB  rss=%8.1f MB  peak=%8.1f MB\n", (double)(rss_rules > rss_before ? rss_rules - rss_before : 0) / 1024.0,
+                    (double)ReadStatusKB("VmRSS:") / 1024.0, (double)ReadStatusKB("VmHWM:") / 1024.0);
+    else
+        std::printf("memory  n/a (no /proc on this platform)\n");
+    if (shadow)
+    {
+        const ShadowList::Report report = shadow->Collect();
+        std::printf("shadow  rules=%-9zu newly_blocked=%-8llu newly_allowed=%-8llu extra=%6llu ns/req\n",
+                    report.candidate_rules, (unsigned long long)report.newly_blocked,
+                    (unsigned long long)report.newly_allowed,
+                    (unsigned long long)(report.requests ? report.shadow_ns / report.requests : 0));
+        if (!shadow_report.empty() && !shadow->WriteReport(shadow_report))
+            std::fprintf(stderr, "adblock_replay: cannot write %s\n", shadow_report.c_str());
+    }
+
+    if (synthetic > 0)
+    {
+        std::filesystem::remove(corpus_path);
+        std::filesystem::remove(inputs[0]);
+    }
+    return 0;
+}
@@ -0,0 +1,1385 @@
+// Tests of the ad blocker: the matchers, filter engines and snapshots, the
+// request path and pipeline, the site allowlist, shadow lists and per-view
+// traffic. Each test checks one structure and returns false (after saying why)
+// when it fails; adblock_tests runs them all, or the ones named on the command
+// line (CTest registers each on its own).
+//
+// Links alloc_counter, so tests can check that the request path allocates nothing.
+#include "adblock_fixtures.h"
+#include "alloc_counter.h"
+
+#include "AdBlocker.h"
+#include "AhoCorasick.h"
+#include "BloomFilter.h"
+#include "CosmeticFilter.h"
+#include "DirectoryWatcher.h"
+#include "FilterEngine.h"
+#include "FilterLoader.h"
+#include "FilterPipeline.h"
+#include "FilterSet.h"
+#include "FilterSnapshot.h"
+#include "FilterStats.h"
+#include "GlobIndex.h"
+#include "HostMatcher.h"
+#include "HostVerdictCache.h"
+#include "NetworkFilter.h"
+#include "PublicSuffix.h"
+#include "RegexSet.h"
+#include "RequestLog.h"
+#include "SiteAllowlist.h"
+#include "SitePolicy.h"
+#include "StringArena.h"
+#include "TokenIndex.h"
+#include "ViewTraffic.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <regex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    bool TestHostMatcher()
+    {
+        HostMatcher m;
+        m.Add("example.com");
+        m.Add("ads.tracker.net");
+        bool ok = m.Matches("example.com") && m.Matches("a.b.example.com") &&
+                  !m.Matches("badexample.com") && !m.Matches("com") &&
+                  m.Matches("x.ads.tracker.net") && !m.Matches("tracker.net") &&
+                  !m.Add("example.com") && m.size() == 2;
+        if (!ok)
+            std::fprintf(stderr, "HostMatcher semantics check FAILED\n");
+        return ok;
+    }
+
+    bool NaiveContainsAny(const std::string &text, const std::vector<std::string> &needles)
+    {
+        for (const auto &n : needles)
+        {
+            if (text.find(n) != std::string::npos)
+                return true;
+        }
+        return false;
+    }
+
+    bool TestSubstrings()
+    {
+        std::mt19937_64 rng(7);
+        std::vector<std::string> needles = {"/ads/", "adserver", "banner", "pixel.gif", "track", "s/ad"};
+        for (int i = 0; i < 200; ++i)
+            needles.push_back(RandomLabel(rng, 3, 6));
+        AhoCorasick ac;
+        ac.Build(needles);
+        for (int i = 0; i < 20000; ++i)
+        {
+            std::string url = RandomURL(rng);
+            if (ac.Matches(url) != NaiveContainsAny(url, needles))
+            {
+                std::fprintf(stderr, "AhoCorasick mismatch on %s\n", url.c_str());
+                return false;
+            }
+        }
+        return ac.Matches("http://x.com/s/ads/1") && !ac.Matches("");
+    }
+
+    // Reference backtracking matcher (the pre-index implementation).
+    bool BacktrackingGlob(const char *t, const char *p)
+    {
+        const char *star = nullptr;
+        const char *star_text = nullptr;
+        while (*t)
+        {
+            if (*p == '?' || *p == *t)
+            {
+                ++p;
+                ++t;
+                continue;
+            }
+            if (*p == '*')
+            {
+                star = p++;
+                star_text = t;
+                continue;
+            }
+            if (star)
+            {
+                p = star + 1;
+                t = ++star_text;
+                continue;
+            }
+            return false;
+        }
+        while (*p == '*')
+            ++p;
+        return *p == '\0';
+    }
+
+    // A repeated URL token visits its rules once, and rules added after a
+    // Build() are filed by the next one.
+    bool TestTokenIndex()
+    {
+        TokenIndex::Tokens tokens;
+        TokenIndex::TokenizeURL("https://ads.example.com/ads/ads.js?ads=1", tokens);
+        bool ok = tokens.size() == 6 && tokens[1] == TokenIndex::Hash("ads") && tokens[3] == TokenIndex::Hash("com");
+
+        TokenIndex index;
+        index.Add(1, {TokenIndex::Hash("ads")});
+        index.Add(2, {});
+        index.Build();
+        index.Add(3, {TokenIndex::Hash("example")});
+        index.Build();
+        std::vector<uint32_t> visited;
+        index.ForEachCandidate(tokens, [&](uint32_t id)
+                               { visited.push_back(id); return false; });
+        ok = ok && index.size() == 3 && index.generic_count() == 1 && visited == std::vector<uint32_t>{1, 3, 2};
+        if (!ok)
+            std::fprintf(stderr, "token index check failed (%zu tokens, %zu visits)\n", tokens.size(),
+                         visited.size());
+        return ok;
+    }
+
+    bool TestGlobs()
+    {
+        std::mt19937_64 rng(11);
+        std::vector<std::string> globs = {"*/ads/*", "*ads.js", "*/pixel?gif*", "https://*.tracker.*/*", "*a*b*c*",
+                                          "*?ad=*", "*banner*.png", "*/adframe/*", "*" + RandomLabel(rng, 70, 90) + "*"};
+        for (int i = 0; i < 100; ++i)
+            globs.push_back("*/" + RandomLabel(rng, 2, 4) + "*" + RandomLabel(rng, 1, 2) + "?" + "*");
+        GlobIndex index;
+        for (const auto &g : globs)
+            index.Add(g);
+        index.Build();
+        for (int i = 0; i < 20000; ++i)
+        {
+            std::string url = RandomURL(rng);
+            bool expected = false;
+            for (const auto &g : globs)
+                expected = expected || BacktrackingGlob(url.c_str(), g.c_str());
+            if (index.Matches(url) != expected)
+            {
+                std::fprintf(stderr, "GlobIndex mismatch on %s\n", url.c_str());
+                return false;
+            }
+            for (size_t g = 0; g < 5; ++g)
+            {
+                if (GlobIndex::GlobMatch(url, globs[g]) != BacktrackingGlob(url.c_str(), globs[g].c_str()))
+                {
+                    std::fprintf(stderr, "GlobMatch mismatch on %s / %s\n", url.c_str(), globs[g].c_str());
+                    return false;
+                }
+            }
+        }
+        return GlobIndex::GlobMatch("abc", "abc") && !GlobIndex::GlobMatch("abcd", "abc") &&
+               GlobIndex::GlobMatch("x/ads/y", "*/ads/*") && GlobIndex::GlobMatch("aXc", "a?c");
+    }
+
+    bool TestFilters()
+    {
+        FilterEngine e;
+        const char *lines[] = {
+            "||ads.example.com^",
+            "||example.org/banner/*.gif$image",
+            "|https://evil.com/track",
+            "swf|",
+            "||tracker.net^$third-party",
+            "/adframe^$domain=news.com|~sports.news.com",
+            "/ads/",
+            "@@||example.com/ads/allowed^",
+            "||foo.com^$script",
+            "/ads.js",
+        };
+        for (const char *l : lines)
+        {
+            if (!e.AddRule(l))
+            {
+                std::fprintf(stderr, "rule rejected: %s\n", l);
+                return false;
+            }
+        }
+        if (e.AddRule("||popup.com^$popup") || e.AddRule("example.com#?#.ad:has-text(x)") || e.AddRule("! comment"))
+        {
+            std::fprintf(stderr, "unsupported rule accepted\n");
+            return false;
+        }
+        e.Build();
+
+        struct Case
+        {
+            const char *url;
+            const char *origin;
+            FilterVerdict expected;
+        } cases[] = {
+            {"https://x.ads.example.com/a", "", FilterVerdict::BlockedHost},
+            {"https://cdn.example.org/banner/x/1.gif", "https://site.com", FilterVerdict::BlockedFilter},
+            {"https://example.org/banner/a.js", "https://site.com", FilterVerdict::Allow},
+            {"https://evil.com/track?x=1", "", FilterVerdict::BlockedFilter},
+            {"http://a.com/?r=https://evil.com/track", "", FilterVerdict::Allow},
+            {"http://a.com/x.swf", "", FilterVerdict::BlockedFilter},
+            {"http://a.com/x.swf?1", "", FilterVerdict::Allow},
+            {"https://tracker.net/p", "https://site.com", FilterVerdict::BlockedFilter},
+            {"https://cdn.tracker.net/p", "https://www.tracker.net", FilterVerdict::Allow},
+            {"http://x.com/adframe/1", "https://news.com", FilterVerdict::BlockedFilter},
+            {"http://x.com/adframe", "https://www.news.com", FilterVerdict::BlockedFilter},
+            {"http://x.com/adframe/1", "https://sports.news.com", FilterVerdict::Allow},
+            {"http://x.com/adframe/1", "https://other.com", FilterVerdict::Allow},
+            {"https://example.com/ads/allowed/x", "", FilterVerdict::Exception},
+            {"https://example.com/ads/other", "", FilterVerdict::BlockedURL},
+            {"https://foo.com/x.js", "", FilterVerdict::BlockedFilter},
+            {"https://foo.com.evil.net/x.js", "", FilterVerdict::Allow},
+            {"https://foo.com/x.png", "", FilterVerdict::Allow},
+            {"https://site.com/static/ads.js", "", FilterVerdict::BlockedURL},
+        };
+        bool ok = true;
+        for (const auto &c : cases)
+        {
+            FilterVerdict v = Verdict(e, c.url, c.origin);
+            if (v != c.expected)
+            {
+                std::fprintf(stderr, "filter mismatch: %s (origin %s): got %d want %d\n", c.url, c.origin, (int)v,
+                             (int)c.expected);
+                ok = false;
+            }
+        }
+        return ok;
+    }
+
+    bool TestSnapshot()
+    {
+        std::mt19937_64 rng(11);
+        std::vector<std::string> targets;
+        std::istringstream list(MixedList(rng, 2000, targets));
+        FilterEngine engine;
+        engine.LoadStream(list);
+        engine.Build();
+
+        const std::string path = TempSnapshotPath("adblock_tests_snapshot");
+        std::string error;
+        FilterEngine loaded;
+        if (!engine.SaveSnapshot(path, 42, &error) || !loaded.LoadSnapshot(FilterSnapshot::Open(path, &error)))
+        {
+            std::fprintf(stderr, "snapshot round trip failed: %s\n", error.c_str());
+            return false;
+        }
+        bool ok = loaded.rule_count() == engine.rule_count();
+        for (size_t i = 0; ok && i < 4000; ++i)
+        {
+            std::string url = i % 2 ? targets[i % targets.size()] : RandomURL(rng);
+            std::string origin = "https://" + RandomDomain(rng);
+            if (Verdict(engine, url, origin) != Verdict(loaded, url, origin))
+            {
+                std::fprintf(stderr, "snapshot verdict mismatch on %s\n", url.c_str());
+                ok = false;
+            }
+        }
+        // Adding to a snapshot-backed engine must copy, not write into the mapping.
+        loaded.AddBlockedHost("added-after-load.example");
+        ok = ok && loaded.IsBlockedHost("x.added-after-load.example");
+        for (const auto &url : targets)
+        {
+            std::string_view host = url_util::HostFromURL(url);
+            ok = ok && loaded.IsBlockedHost(host) == engine.IsBlockedHost(host);
+        }
+        std::filesystem::remove(path);
+        return ok;
+    }
+
+    bool TestOptimize()
+    {
+        FilterEngine e;
+        for (const char *line : {"example.com", "ads.example.com", "a.b.example.com", "other.org", "x.y.other.net",
+                                 "/ads/", "/ads/banner", "x/ads/y", "/banner.gif", "*tracker*", "*tracker*.js",
+                                 "*://*/ads/*.js", "*pixel?.gif", "*.example.net/*"})
+            e.AddRule(line);
+        FilterEngine::OptimizeStats stats = e.Optimize();
+        e.Build();
+        MatchedRule rule;
+        const RequestContext ctx = RequestContext::Make("https://cdn.ads.example.com/x", "cdn.ads.example.com", "");
+        bool ok = stats.hosts == 2 && stats.substrings == 2 && stats.globs_to_substrings == 2 && stats.globs == 2 &&
+                  stats.removed() == 6 && e.host_rule_count() == 3 && e.url_rule_count() == 5 &&
+                  e.IsBlockedHost("a.b.example.com") && e.IsBlockedURL("https://x.org/x/ads/y") &&
+                  e.IsBlockedURL("https://x.org/tracker.js") && e.IsBlockedURL("https://x.org/pixel1.gif") &&
+                  !e.IsBlockedURL("https://x.org/pixel.gif") &&
+                  e.Explain(ctx, e.Match(ctx), rule) && rule.text == "example.com";
+        ok = ok && e.Optimize().removed() == 0;
+        if (!ok)
+            std::fprintf(stderr, "optimizer check failed: %zu hosts, %zu substrings, %zu globs, %zu converted\n",
+                         stats.hosts, stats.substrings, stats.globs, stats.globs_to_substrings);
+
+        // Verdicts must not change.
+        std::mt19937_64 rng(61);
+        std::vector<std::string> targets;
+        const std::string list = RedundantList(rng, 4000, targets);
+        FilterEngine plain, optimized;
+        plain.LoadBuffer(list);
+        plain.Build();
+        optimized.LoadBuffer(list);
+        ok = ok && optimized.Optimize().removed() > 0;
+        optimized.Build();
+        ok = ok && optimized.rule_count() < plain.rule_count();
+        for (size_t i = 0; ok && i < 8000; ++i)
+        {
+            std::string url = i % 2 ? targets[i % targets.size()] : RandomURL(rng);
+            std::string origin = "https://" + RandomDomain(rng);
+            if (Verdict(plain, url, origin) != Verdict(optimized, url, origin))
+            {
+                std::fprintf(stderr, "optimizer changed the verdict on %s\n", url.c_str());
+                ok = false;
+            }
+        }
+        return ok;
+    }
+
+    // URLs over a small alphabet, so the regex rules below both match and miss often.
+    std::string RandomRegexURL(std::mt19937_64 &rng)
+    {
+        static const char kChars[] = "ab0129/.-_xAB";
+        std::uniform_int_distribution<size_t> len(0, 40), pick(0, sizeof(kChars) - 2);
+        std::string url = rng() % 4 ? "https://" : "";
+        for (size_t n = len(rng); n > 0; --n)
+            url += kChars[pick(rng)];
+        return FilterEngine::ToLower(url);
+    }
+
+    bool TestRegex()
+    {
+        // RegexSet against std::regex (a backtracking ECMAScript matcher).
+        const std::vector<std::string> rules = {
+            "/a[0-9]+b/",    "/^https:\\/\\/x/", "/b$/",          "/(ab|ba){2}/",   "/a.{3}b/",
+            "/[^/]+\\.x/",   "/\\d{2,3}-/",      "/(?:a|0)+_b?x/", "/^[a-z]+:\\/\\/[^\\/]*a\\//",
+            "/x\\/(a|b)*$/", "/A0B+/",           "/\\w-\\W/",     "/a.{12}b/",      "/[\\x41-C]9|_{2}$/"};
+        std::vector<std::regex> reference;
+        RegexSet all;
+        std::vector<RegexSet> single(rules.size());
+        for (size_t i = 0; i < rules.size(); ++i)
+        {
+            const std::string body = rules[i].substr(1, rules[i].size() - 2);
+            reference.emplace_back(body, std::regex::ECMAScript | std::regex::icase);
+            if (!RegexSet::IsRegexRule(rules[i]) || !all.Add(rules[i]) || !single[i].Add(rules[i]))
+            {
+                std::fprintf(stderr, "regex rule rejected: %s\n", rules[i].c_str());
+                return false;
+            }
+            single[i].Build();
+        }
+        all.Build();
+        std::mt19937_64 rng(23);
+        for (int n = 0; n < 20000; ++n)
+        {
+            const std::string url = RandomRegexURL(rng);
+            bool any = false;
+            for (size_t i = 0; i < rules.size(); ++i)
+            {
+                const bool expected = std::regex_search(url, reference[i]);
+                any = any || expected;
+                if (single[i].Matches(url) != expected)
+                {
+                    std::fprintf(stderr, "RegexSet mismatch: %s on %s\n", rules[i].c_str(), url.c_str());
+                    return false;
+                }
+            }
+            const uint32_t id = all.Find(url);
+            if ((id != 0) != any || (id != 0 && !std::regex_search(url, reference[id - 1])))
+            {
+                std::fprintf(stderr, "RegexSet set mismatch on %s\n", url.c_str());
+                return false;
+            }
+        }
+        // "/a.{12}b/" needs thousands of DFA states, so the cache was refilled.
+        bool ok = single[12].cache_flushes() > 0 && single[12].cached_states() <= RegexSet::kMaxCachedStates;
+
+        // Threads matching the same set at once each get the answers of one thread alone.
+        std::vector<std::string> urls;
+        std::vector<uint32_t> expected;
+        for (int n = 0; n < 5000; ++n)
+        {
+            urls.push_back(RandomRegexURL(rng));
+            expected.push_back(all.Find(urls.back()));
+        }
+        std::atomic<size_t> mismatches{0};
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 4; ++t)
+            threads.emplace_back([&, t]()
+                                 {
+                for (size_t i = 0; i < urls.size(); ++i)
+                {
+                    const size_t k = (i + (size_t)t * 1237) % urls.size();
+                    if (all.Find(urls[k]) != expected[k])
+                        mismatches.fetch_add(1, std::memory_order_relaxed);
+                } });
+        for (auto &t : threads)
+            t.join();
+        ok = ok && mismatches.load() == 0;
+
+        // Unsupported syntax and rules matching every URL are rejected.
+        RegexSet rejected;
+        for (const char *bad : {"/(a)\\1/", "/a(?=b)/", "/\\bads/", "/a**/", "/(ads/", "/ads?|/", "/x*/", "/^/",
+                                "/a{2,1}/", "/[z-a]/", "/\\u00e9/"})
+            ok = ok && !rejected.Add(bad);
+        ok = ok && rejected.empty() && !RegexSet::IsRegexRule("/ads/") && !RegexSet::IsRegexRule("/ad.js/");
+
+        // Engine: "/.../" with regex syntax is a regex rule, plain "/path/" stays a substring.
+        FilterEngine engine;
+        ok = ok && engine.AddRule("/banner\\d+\\.gif/") && engine.AddRule("/ads/") && !engine.AddRule("/ad(?!x)/") &&
+             !engine.AddRule("@@/track\\d/") && !engine.AddRule("/track\\d/$script") &&
+             engine.AddRule("/banner\\d+\\.gif/");
+        engine.Build();
+        const RequestContext hit =
+            RequestContext::Make("https://cdn.site.com/img/banner42.gif", "cdn.site.com", "site.com");
+        MatchedRule rule;
+        ok = ok && engine.url_rule_count() == 2 && engine.Match(hit) == FilterVerdict::BlockedURL &&
+             engine.Explain(hit, FilterVerdict::BlockedURL, rule) && rule.kind == RuleKind::Regex &&
+             rule.text == "/banner\\d+\\.gif/" && Verdict(engine, "https://site.com/banner.gif", "") == FilterVerdict::Allow &&
+             Verdict(engine, "https://site.com/ads/x", "") == FilterVerdict::BlockedURL;
+
+        // Copies and snapshots carry the rules.
+        FilterEngine copy = engine;
+        const std::string path = TempSnapshotPath("adblock_tests_regex");
+        FilterEngine loaded;
+        ok = ok && copy.Match(hit) == FilterVerdict::BlockedURL && engine.SaveSnapshot(path, 3) &&
+             loaded.LoadSnapshot(FilterSnapshot::Open(path)) && loaded.Match(hit) == FilterVerdict::BlockedURL &&
+             loaded.url_rule_count() == 2;
+        std::filesystem::remove(path);
+        if (!ok)
+            std::fprintf(stderr, "regex rule check failed\n");
+        return ok;
+    }
+
+    bool TestBloom()
+    {
+        std::mt19937_64 rng(5);
+        bool ok = true;
+        for (double target : {0.01, 0.001})
+        {
+            BloomFilter bloom;
+            bloom.Init(100000, target);
+            std::vector<uint64_t> keys(100000);
+            for (auto &k : keys)
+            {
+                k = rng();
+                bloom.Insert(k);
+            }
+            for (uint64_t k : keys)
+                ok = ok && bloom.MayContain(k);
+            size_t fp = 0, trials = 1000000;
+            for (size_t i = 0; i < trials; ++i)
+                fp += bloom.MayContain(rng()) ? 1 : 0;
+            double rate = (double)fp / (double)trials;
+            std::printf("bloom  target=%.3f%%  measured=%.3f%%  k=%u  %zu KB\n", target * 100, rate * 100,
+                        bloom.hash_count(), bloom.memory_bytes() / 1024);
+            ok = ok && rate < target * 2;
+        }
+        if (!ok)
+            std::fprintf(stderr, "BloomFilter check failed\n");
+        return ok;
+    }
+
+    bool TestHostCache()
+    {
+        HostVerdictCache cache(64);
+        bool blocked = false;
+        bool ok = !cache.Lookup("a.com", 1, blocked);
+        cache.Insert("a.com", 1, true);
+        cache.Insert("b.com", 1, false);
+        ok = ok && cache.Lookup("a.com", 1, blocked) && blocked;
+        ok = ok && cache.Lookup("b.com", 1, blocked) && !blocked;
+        // A new rule-set generation sees none of the old verdicts
+        ok = ok && !cache.Lookup("a.com", 2, blocked);
+        // Overfilling stays bounded and keeps answering correctly for what it holds
+        std::mt19937_64 rng(3);
+        for (int i = 0; i < 10000; ++i)
+        {
+            std::string h = RandomDomain(rng);
+            cache.Insert(h, 2, h.size() % 2 == 0);
+            if (!cache.Lookup(h, 2, blocked) || blocked != (h.size() % 2 == 0))
+                ok = false;
+        }
+        HostVerdictCache::Stats st = cache.stats();
+        ok = ok && st.hits == 10002 && st.misses == 2;
+
+        // Two hosts whose key tags collide (found by a birthday search over
+        // "h<n>.com") do not share a verdict.
+        const std::string first = "h2605073.com", second = "h3772809.com";
+        HostVerdictCache one_shard(8);
+        one_shard.Insert(first, 1, true);
+        ok = ok && HostMatcher::HashHost(first) >> 24 == HostMatcher::HashHost(second) >> 24 &&
+             one_shard.Lookup(first, 1, blocked) && blocked && !one_shard.Lookup(second, 1, blocked);
+
+        // Generations are stored modulo 2^kGenerationBits; passing a wrap clears the table.
+        const uint32_t wrap = 1u << HostVerdictCache::kGenerationBits;
+        HostVerdictCache wrapping(64);
+        wrapping.Insert("a.com", 7, true);
+        ok = ok && wrapping.Lookup("a.com", 7, blocked) && !wrapping.Lookup("a.com", wrap + 7, blocked);
+        // Late inserts and lookups of the older wrap do not bring it back.
+        wrapping.Insert("b.com", 7, true);
+        ok = ok && !wrapping.Lookup("b.com", 7, blocked) && !wrapping.Lookup("b.com", wrap + 7, blocked);
+        wrapping.Insert("b.com", wrap + 7, false);
+        ok = ok && wrapping.Lookup("b.com", wrap + 7, blocked) && !blocked;
+        if (!ok)
+            std::fprintf(stderr, "HostVerdictCache check failed\n");
+        return ok;
+    }
+
+    bool TestLoader()
+    {
+        std::vector<std::string> targets;
+        auto paths = WriteLists("adblock_tests",200000, targets); // several chunks
+        FilterEngine serial, parallel;
+        for (const auto &p : paths)
+            serial.LoadFile(p);
+        serial.Build();
+        bool ok = FilterLoader(4).Load(paths, parallel) == paths.size();
+        parallel.Build();
+        ok = ok && serial.host_rule_count() == parallel.host_rule_count() &&
+             serial.url_rule_count() == parallel.url_rule_count() &&
+             serial.filter_rule_count() == parallel.filter_rule_count();
+        std::mt19937_64 rng(9);
+        for (size_t i = 0; ok && i < 2000; ++i)
+        {
+            std::string url = i % 2 ? targets[i % targets.size()] : RandomURL(rng);
+            std::string origin = "https://" + RandomDomain(rng);
+            ok = Verdict(serial, url, origin) == Verdict(parallel, url, origin);
+        }
+        for (const auto &p : paths)
+            std::filesystem::remove(p);
+        if (!ok)
+            std::fprintf(stderr, "FilterLoader result differs from serial parsing\n");
+        return ok;
+    }
+
+    // The rule Explain() names for a request, as "kind:text" ("" for none).
+    std::string Explained(const FilterEngine &engine, const std::string &url, const std::string &origin)
+    {
+        std::string host(url_util::HostFromURL(url));
+        RequestContext ctx = RequestContext::Make(url, host, url_util::HostFromURL(origin));
+        MatchedRule rule;
+        if (!engine.Explain(ctx, engine.Match(ctx), rule))
+            return "";
+        return std::string(FilterStats::KindName(rule.kind)) + ":" + std::string(rule.text);
+    }
+
+    bool TestStats()
+    {
+        FilterEngine engine;
+        engine.LoadBuffer("ads.example.com\n/banner/\n*/pixel?id=*\n||tracker.net^$third-party\n"
+                          "@@||tracker.net/ok^\n");
+        engine.Build();
+        const std::string origin = "https://site.org/";
+        bool ok = Explained(engine, "https://cdn.ads.example.com/x.js", origin) == "host:ads.example.com" &&
+                  Explained(engine, "https://a.com/banner/1.png", origin) == "substring:/banner/" &&
+                  Explained(engine, "https://a.com/pixel?id=3", origin) == "glob:*/pixel?id=*" &&
+                  Explained(engine, "https://tracker.net/t.js", origin) == "filter:||tracker.net^$third-party" &&
+                  Explained(engine, "https://tracker.net/ok/t.js", origin) == "exception:@@||tracker.net/ok^" &&
+                  Explained(engine, "https://a.com/index.html", origin).empty();
+
+        // Substring ids survive a snapshot round trip
+        const std::string path = TempSnapshotPath("adblock_tests_stats");
+        FilterEngine loaded;
+        ok = ok && engine.SaveSnapshot(path, 1) && loaded.LoadSnapshot(FilterSnapshot::Open(path)) &&
+             Explained(loaded, "https://a.com/banner/1.png", origin) == "substring:/banner/";
+        std::filesystem::remove(path);
+
+        // Latency buckets are contiguous and each bound maps to its own bucket
+        for (size_t b = 0; b < FilterStats::kLatencyBuckets; ++b)
+            ok = ok && FilterStats::LatencyBucket(FilterStats::LatencyBucketLowerBound(b)) == b;
+        ok = ok && FilterStats::LatencyBucket(UINT64_MAX) == FilterStats::kLatencyBuckets - 1;
+
+        // Per-thread counters add up across threads
+        FilterStats stats;
+        const MatchedRule hot{RuleKind::Glob, "*/pixel?id=*"};
+        const MatchedRule cold{RuleKind::Host, "ads.example.com"};
+        std::vector<std::thread> workers;
+        for (int t = 0; t < 4; ++t)
+            workers.emplace_back([&]()
+                                 {
+                for (int i = 0; i < 1000; ++i)
+                {
+                    stats.RecordRequest(100 + i, i % 4 == 0);
+                    stats.RecordHit(i % 10 ? hot : cold);
+                }
+                stats.RecordCost(hot, 5000); });
+        for (auto &w : workers)
+            w.join();
+        FilterStats::Report report = stats.Collect();
+        ok = ok && report.requests == 4000 && report.blocked == 1000 && report.rules.size() == 2 &&
+             report.rules[0].rule == std::string(hot.text) && report.rules[0].hits == 3600 && report.rules[0].expensive() &&
+             report.rules[1].hits == 400 && !report.rules[1].expensive();
+        uint64_t p50 = report.LatencyPercentile(0.5);
+        ok = ok && p50 >= 550 && p50 <= 700 && report.LatencyPercentile(1.0) >= 1099;
+        std::string json = report.ToJSON();
+        ok = ok && json.find("\"expensive_rules\":[{\"kind\":\"glob\"") != std::string::npos &&
+             json.find("\"requests\":4000") != std::string::npos;
+        if (!ok)
+            std::fprintf(stderr, "FilterStats check failed\n");
+        return ok;
+    }
+
+    bool TestFilterSet()
+    {
+        std::mt19937_64 rng(21);
+        std::vector<std::string> targets;
+        std::string lists[3];
+        for (auto &l : lists)
+            l = MixedList(rng, 3000, targets);
+        // An exception in one list must override a block from another
+        lists[1] += "||excepted.com^\n";
+        lists[2] += "@@||excepted.com/ok/\n";
+        targets.push_back("https://excepted.com/ok/a.js");
+        targets.push_back("https://excepted.com/no/a.js");
+
+        FilterEngine merged;
+        for (const auto &l : lists)
+            merged.LoadBuffer(l);
+        merged.Build();
+        FilterSet set = FilterSet(BuiltEngine(lists[0]), {"a.txt"})
+                            .WithLayer("b.txt", BuiltEngine(lists[1]))
+                            .WithLayer("c.txt", BuiltEngine(lists[2]));
+        bool ok = set.layers().size() == 2 && set.rule_count() == merged.rule_count();
+        for (size_t i = 0; ok && i < 6000; ++i)
+        {
+            std::string url = i % 2 ? targets[i % targets.size()] : RandomURL(rng);
+            std::string host(url_util::HostFromURL(url));
+            RequestContext ctx = RequestContext::Make(url, host, "site.org");
+            ok = merged.Match(ctx) == set.Match(ctx);
+        }
+        RequestContext excepted = RequestContext::Make("https://excepted.com/ok/a.js", "excepted.com", "site.org");
+        MatchedRule rule;
+        ok = ok && set.Match(excepted) == FilterVerdict::Exception && set.Explain(excepted, FilterVerdict::Exception, rule) &&
+             rule.text == "@@||excepted.com/ok/";
+
+        // Replacing and removing a layer leaves the others alone
+        FilterSet replaced = set.WithLayer("b.txt", BuiltEngine("||excepted.com^\n"));
+        FilterSet removed = replaced.WithLayer("b.txt", nullptr);
+        ok = ok && replaced.layers().size() == 2 && replaced.layers()[1].engine == set.layers()[1].engine &&
+             replaced.Match(excepted) == FilterVerdict::Exception && removed.layers().size() == 1 &&
+             removed.Match(excepted) == FilterVerdict::Allow;
+        if (!ok)
+            std::fprintf(stderr, "FilterSet check failed\n");
+        return ok;
+    }
+
+    bool TestWatcher()
+    {
+        auto dir = std::filesystem::temp_directory_path() / "adblock_tests_watch";
+        std::filesystem::remove_all(dir);
+        std::filesystem::create_directories(dir);
+        std::ofstream(dir / "old.txt") << "old.com\n";
+
+        std::mutex mtx;
+        std::condition_variable cv;
+        std::vector<std::string> seen;
+        DirectoryWatcher watcher;
+        bool ok = watcher.Start(dir.string(), [&](const std::vector<std::string> &changed)
+                                {
+            std::lock_guard<std::mutex> lock(mtx);
+            seen.insert(seen.end(), changed.begin(), changed.end());
+            cv.notify_all(); });
+        // Give the polling fallback a baseline to compare against
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        std::ofstream(dir / "list.txt") << "example.com\n";
+        std::ofstream(dir / "notes.md") << "ignored\n";
+        std::filesystem::remove(dir / "old.txt");
+        {
+            std::unique_lock<std::mutex> lock(mtx);
+            cv.wait_for(lock, std::chrono::seconds(5), [&]()
+                        { return seen.size() >= 2; });
+            std::sort(seen.begin(), seen.end());
+            ok = ok && seen == std::vector<std::string>{(dir / "list.txt").string(), (dir / "old.txt").string()};
+        }
+        watcher.Stop();
+        std::filesystem::remove_all(dir);
+        if (!ok)
+            std::fprintf(stderr, "DirectoryWatcher check failed\n");
+        return ok;
+    }
+
+    bool SameSelectors(std::vector<std::string_view> got, std::vector<std::string_view> want)
+    {
+        std::sort(got.begin(), got.end());
+        std::sort(want.begin(), want.end());
+        return got == want;
+    }
+
+    bool TestCosmetic()
+    {
+        FilterEngine engine;
+        bool ok = engine.AddRule("##.ad-banner") && engine.AddRule("###sponsored") &&
+                  engine.AddRule("example.com,~shop.example.com##.promo") && engine.AddRule("~news.org##.popup") &&
+                  engine.AddRule("##.cookie") && engine.AddRule("example.com#@#.cookie") &&
+                  engine.AddRule("news.org#@#.ad-banner") && engine.AddRule("Example.COM##DIV[data-Ad]");
+        // Comments and extended syntax are not element hiding rules
+        ok = ok && !engine.AddRule("## Title: hosts") && !engine.AddRule("### ---") &&
+             !engine.AddRule("example.com#?#div:has-text(Ad)") && !engine.AddRule("example.com##div:style(color:red)") &&
+             !engine.AddRule("example.*##.ad") && !engine.AddRule("##a{color:red}");
+        engine.AddRule("||tracker.net^");
+        engine.Build();
+        ok = ok && engine.cosmetic_rule_count() == 8 && engine.host_rule_count() == 1 &&
+             engine.Match(RequestContext::Make("https://example.com/.ad-banner", "example.com", "")) ==
+                 FilterVerdict::Allow;
+
+        // .ad-banner and .cookie have exceptions somewhere, so they stay out of the shared sheet
+        FilterSet set(std::make_shared<FilterEngine>(engine), {});
+        ok = ok && SameSelectors(set.GenericHidingSelectors(), {"#sponsored"});
+        ok = ok && SameSelectors(set.HidingSelectorsForHost("www.example.com"),
+                                 {".promo", ".popup", "DIV[data-Ad]", ".ad-banner"});
+        ok = ok && SameSelectors(set.HidingSelectorsForHost("shop.example.com"),
+                                 {".popup", "DIV[data-Ad]", ".ad-banner"});
+        ok = ok && SameSelectors(set.HidingSelectorsForHost("news.org"), {".cookie"});
+        ok = ok && SameSelectors(set.HidingSelectorsForHost("other.net"), {".popup", ".ad-banner", ".cookie"});
+        // An exception in another layer applies too
+        FilterSet layered = set.WithLayer("b.txt", BuiltEngine("other.net#@#.popup\n##.late\n"));
+        ok = ok && SameSelectors(layered.GenericHidingSelectors(), {"#sponsored", ".late"}) &&
+             SameSelectors(layered.HidingSelectorsForHost("other.net"), {".ad-banner", ".cookie"});
+
+        // A copied engine does not share the original's selector views
+        FilterEngine copy = engine;
+        engine.Clear();
+        ok = ok && copy.cosmetic().HasGeneric(".cookie") && !copy.cosmetic().HasGeneric(".promo");
+
+        const std::string path = TempSnapshotPath("adblock_tests_cosmetic");
+        FilterEngine loaded;
+        ok = ok && copy.SaveSnapshot(path, 1) && loaded.LoadSnapshot(FilterSnapshot::Open(path)) &&
+             loaded.cosmetic_rule_count() == copy.cosmetic_rule_count() &&
+             SameSelectors(FilterSet(std::make_shared<FilterEngine>(std::move(loaded)), {})
+                               .HidingSelectorsForHost("shop.example.com"),
+                           {".popup", "DIV[data-Ad]", ".ad-banner"});
+        std::filesystem::remove(path);
+        ok = ok && CosmeticFilterIndex::Stylesheet({".a", "#b"}) ==
+                       ".a { display: none !important; }\n#b { display: none !important; }\n";
+        if (!ok)
+            std::fprintf(stderr, "cosmetic filter check failed\n");
+        return ok;
+    }
+
+    bool TestLowerASCII()
+    {
+        std::mt19937_64 rng(3);
+        std::uniform_int_distribution<int> byte(0, 255);
+        bool ok = true;
+        for (size_t len = 0; ok && len < 100; ++len)
+        {
+            std::string in(len, '\0');
+            for (auto &c : in)
+                c = (char)byte(rng);
+            std::string out(len, '\0');
+            url_util::LowerASCII(in, &out[0]);
+            for (size_t i = 0; ok && i < len; ++i)
+                ok = out[i] == ((in[i] >= 'A' && in[i] <= 'Z') ? (char)(in[i] + 32) : in[i]);
+        }
+        if (!ok)
+            std::fprintf(stderr, "LowerASCII check failed\n");
+        return ok;
+    }
+
+    bool TestRequestPath()
+    {
+        std::mt19937_64 rng(31);
+        std::vector<std::string> targets;
+        RequestPath path(FilterSet(BuiltEngine(MixedList(rng, 5000, targets)), {}));
+        std::vector<std::string> urls = RequestURLs(rng, targets, 2000);
+        const std::string origin = "https://News.Site.ORG";
+        // The first pass warms this thread's buffers, the stats block and the
+        // rule-name table; after that nothing may allocate.
+        size_t blocked = 0;
+        for (const auto &u : urls)
+            path.Allow(u, origin);
+        const size_t before = ThreadAllocations();
+        for (const auto &u : urls)
+            blocked += path.Allow(u, origin) ? 0 : 1;
+        const size_t allocations = ThreadAllocations() - before;
+        bool ok = allocations == 0 && blocked > 0;
+        if (!ok)
+            std::fprintf(stderr, "request path check failed: %zu allocations over %zu requests (%zu blocked)\n",
+                         allocations, urls.size(), blocked);
+        return ok;
+    }
+
+    bool TestAllowlist()
+    {
+        SiteAllowlist list;
+        bool ok = list.Add("WWW.Example.com") && !list.Add("shop.example.com") && list.Add("news.co.uk") &&
+                  list.size() == 2 && list.Contains("example.com") && list.Contains("a.b.example.com") &&
+                  !list.Contains("badexample.com") && !list.Contains("example.org") &&
+                  list.Contains("www.news.co.uk") && !list.Contains("other.co.uk") && !list.Contains("");
+        const std::string path = (std::filesystem::temp_directory_path() / "adblock_tests_allow.txt").string();
+        SiteAllowlist loaded;
+        ok = ok && list.Save(path) && loaded.Load(path) && loaded.sites() == list.sites();
+        ok = ok && loaded.Remove("cdn.example.com") && !loaded.Remove("example.com") && !loaded.Contains("example.com") &&
+             loaded.Contains("news.co.uk");
+        std::filesystem::remove(path);
+        if (!ok)
+            std::fprintf(stderr, "SiteAllowlist check failed\n");
+        return ok;
+    }
+
+    bool TestPublicSuffix()
+    {
+        struct Case
+        {
+            const char *host, *suffix, *site;
+        };
+        const Case cases[] = {
+            {"example.com", "com", "example.com"},
+            {"a.b.example.co.uk", "co.uk", "example.co.uk"},
+            {"co.uk", "co.uk", ""},
+            {"user.github.io", "github.io", "user.github.io"},
+            {"cdn.user.github.io", "github.io", "user.github.io"},
+            {"a.b.c.ck", "c.ck", "b.c.ck"}, // *.ck
+            {"www.ck", "ck", "www.ck"},     // !www.ck
+            {"a.www.ck", "ck", "www.ck"},
+            {"city.kawasaki.jp", "kawasaki.jp", "city.kawasaki.jp"},
+            {"x.foo.kawasaki.jp", "foo.kawasaki.jp", "x.foo.kawasaki.jp"},
+            {"shop.example.xn--fiqs8s", "xn--fiqs8s", "example.xn--fiqs8s"}, // 中国
+            {"www.example.unknowntld", "unknowntld", "example.unknowntld"},
+            {"example.com.", "com", "example.com"},
+            {"localhost", "localhost", ""},
+            {"192.168.0.1", "", ""},
+            {"[::1]", "", ""},
+            {"", "", ""},
+        };
+        bool ok = true;
+        for (const Case &c : cases)
+        {
+            if (psl::PublicSuffix(c.host) != c.suffix || psl::RegistrableDomain(c.host) != c.site)
+            {
+                std::fprintf(stderr, "public suffix check failed for \"%s\": \"%.*s\" / \"%.*s\"\n", c.host,
+                             (int)psl::PublicSuffix(c.host).size(), psl::PublicSuffix(c.host).data(),
+                             (int)psl::RegistrableDomain(c.host).size(), psl::RegistrableDomain(c.host).data());
+                ok = false;
+            }
+        }
+        ok = ok && psl::IsPublicSuffix("github.io") && !psl::IsPublicSuffix("example.com") &&
+             url_util::BaseDomain("co.uk") == "co.uk" && url_util::BaseDomain("10.0.0.1") == "10.0.0.1" &&
+             RequestContext::Make("https://a.github.io/x.js", "a.github.io", "b.github.io").third_party &&
+             !RequestContext::Make("https://img.example.co.uk/x.js", "img.example.co.uk", "www.example.co.uk")
+                  .third_party;
+        const size_t before = ThreadAllocations();
+        for (const Case &c : cases)
+            psl::RegistrableDomain(c.host);
+        ok = ok && ThreadAllocations() == before;
+        if (!ok)
+            std::fprintf(stderr, "public suffix check failed\n");
+        return ok;
+    }
+
+    bool TestRequestLog()
+    {
+        namespace fs = std::filesystem;
+        const std::string path = (fs::temp_directory_path() / "adblock_tests_requests.log").string();
+        for (const char *suffix : {"", ".1", ".2"})
+            fs::remove(path + suffix);
+
+        RequestLog log;
+        bool ok = !log.Push(RequestLog::Decision::Blocked, RuleKind::Host, "early.com", "https://early.com/") &&
+                  log.dropped() == 1;
+        // Rotate every ~4 KB so a few thousand lines go through both old files.
+        log.Start(path, 4096, 2);
+
+        // Four threads push without the writer keeping up: every push is
+        // either queued or counted as dropped, and none allocates.
+        const size_t per_thread = 3000;
+        std::atomic<size_t> queued{0}, allocations{0};
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 4; ++t)
+        {
+            threads.emplace_back([&, t]()
+                                 {
+                const std::string url = "https://ads.example.com/t" + std::to_string(t) + "/" + std::string(300, 'x');
+                const size_t before = ThreadAllocations();
+                size_t n = 0;
+                for (size_t i = 0; i < per_thread; ++i)
+                    n += log.Push(i % 3 ? RequestLog::Decision::Blocked : RequestLog::Decision::Allowed,
+                                  i % 3 ? RuleKind::Host : RuleKind::Exception, "example.com", url) ? 1 : 0;
+                allocations += ThreadAllocations() - before;
+                queued += n; });
+        }
+        for (auto &t : threads)
+            t.join();
+        log.Flush();
+        ok = ok && allocations == 0 && queued + log.dropped() == 4 * per_thread + 1 && log.written() == queued &&
+             queued >= RequestLog::kCapacity;
+
+        std::vector<RequestLog::Entry> recent = log.Recent();
+        ok = ok && recent.size() == RequestLog::kRecent && recent.back().rule == "example.com" &&
+             recent.back().url.size() == RequestLog::kMaxURLBytes &&
+             recent.back().url.compare(0, 25, "https://ads.example.com/t") == 0;
+        ok = ok && log.RecentJSON(1).find("\"decision\":") != std::string::npos;
+
+        log.Push(RequestLog::Decision::SiteAllowed, RuleKind::Host, "news.org", "https://cdn.news.org/a.js");
+        log.Stop();
+        std::ifstream in(path);
+        std::string line, last;
+        while (std::getline(in, line))
+            last = line;
+        ok = ok && last.find(" site-allowed site news.org https://cdn.news.org/a.js") == 24 && fs::exists(path + ".1") &&
+             fs::exists(path + ".2") && fs::file_size(path + ".1") <= 4096 &&
+             !log.Push(RequestLog::Decision::Blocked, RuleKind::Host, "late.com", "https://late.com/");
+        for (const char *suffix : {"", ".1", ".2"})
+            fs::remove(path + suffix);
+        if (!ok)
+            std::fprintf(stderr, "request log check failed (%zu queued, %llu dropped)\n", (size_t)queued,
+                         (unsigned long long)log.dropped());
+        return ok;
+    }
+
+    // Reference for PatternSegment::MatchesAt, one byte at a time.
+    bool NaiveSegmentAt(std::string_view text, std::string_view seg, size_t pos, bool end_ok)
+    {
+        size_t k = 0;
+        while (k < seg.size() && pos + k < text.size() &&
+               (seg[k] == '^' ? PatternSegment::IsSeparator((unsigned char)text[pos + k]) : seg[k] == text[pos + k]))
+            ++k;
+        return k == seg.size() || (end_ok && k + 1 == seg.size() && seg.back() == '^' && pos + k == text.size());
+    }
+
+    // Reference for PatternSegment::FindEnd: every start position in turn.
+    size_t NaiveSegmentEnd(std::string_view text, std::string_view seg, size_t from, bool end_ok)
+    {
+        for (size_t pos = from; pos <= text.size(); ++pos)
+        {
+            if (NaiveSegmentAt(text, seg, pos, false))
+                return pos + seg.size();
+        }
+        for (size_t pos = from; pos <= text.size(); ++pos)
+        {
+            if (NaiveSegmentAt(text, seg, pos, end_ok))
+                return text.size();
+        }
+        return std::string_view::npos;
+    }
+
+    bool TestArena()
+    {
+        StringArena arena;
+        bool added = false;
+        bool ok = arena.Intern("ads", &added) == 0 && added && arena.Intern("track") == 1 &&
+                  arena.Intern("ads", &added) == 0 && !added && arena.Intern("") == 2 && arena.size() == 3 &&
+                  arena.Find("track") == 1 && arena.Find("tracker") == StringArena::kNone;
+        for (int i = 0; i < 1000; ++i)
+            arena.Intern("rule" + std::to_string(i));
+        std::string_view view = arena.Get(1);
+        StringArena moved = std::move(arena);
+        ok = ok && moved.size() == 1003 && view == "track" && moved.Get(1).data() == view.data() &&
+             moved.Find("rule999") == 1002;
+
+        // Literal segments (KMP) against a byte-by-byte reference, on a small
+        // alphabet so self-overlapping patterns and separators are common.
+        std::mt19937_64 rng(17);
+        std::uniform_int_distribution<int> pick(0, 3);
+        const char alphabet[] = {'a', 'b', '/', '^'};
+        for (int i = 0; ok && i < 20000; ++i)
+        {
+            std::string seg(1 + i % 6, 'a'), text(i % 24, 'a');
+            for (auto &c : seg)
+                c = alphabet[pick(rng) % 2];
+            if (i % 3 == 0)
+                seg.back() = '^';
+            for (auto &c : text)
+                c = alphabet[pick(rng) % 3];
+            PatternSegment compiled(seg, PatternSegment::kAdblock);
+            const bool end_ok = i % 2 == 0;
+            const size_t from = text.empty() ? 0 : (size_t)i % text.size();
+            ok = compiled.FindEnd(text, from, end_ok) == NaiveSegmentEnd(text, seg, from, end_ok) &&
+                 compiled.MatchesAt(text, from, end_ok) == NaiveSegmentAt(text, seg, from, end_ok);
+            if (!ok)
+                std::fprintf(stderr, "literal segment mismatch: %s in %s from %zu\n", seg.c_str(), text.c_str(), from);
+        }
+
+        // A rule repeated across lists is stored once and still explained.
+        FilterEngine engine;
+        engine.LoadBuffer("/ads/\n/ads/\n*pixel*.gif\n*pixel*.gif\n||ads.example.com/x^$script\n"
+                          "||ads.example.com/x^$script\n##.banner\n##.banner\n");
+        engine.Build();
+        const RequestContext ctx = RequestContext::Make("https://ads.example.com/x/y.js", "ads.example.com", "site.com");
+        MatchedRule rule;
+        ok = ok && engine.rule_count() == 4 && engine.Match(ctx) == FilterVerdict::BlockedFilter &&
+             engine.Explain(ctx, FilterVerdict::BlockedFilter, rule) && rule.text == "||ads.example.com/x^$script";
+        if (!ok)
+            std::fprintf(stderr, "StringArena check failed\n");
+        return ok;
+    }
+
+    // A pipeline stage that blocks URLs containing needle after spinning for
+    // a while, and counts its calls.
+    class FixedStage : public RequestFilter
+    {
+    public:
+        FixedStage(const char *name, std::string needle, unsigned spin)
+            : name_(name), needle_(std::move(needle)), spin_(spin) {}
+
+        const char *name() const override { return name_; }
+        FilterAction Evaluate(const FilterRequest &request, MatchedRule &rule) override
+        {
+            calls.fetch_add(1, std::memory_order_relaxed);
+            volatile unsigned sink = 0;
+            for (unsigned i = 0; i < spin_; ++i)
+                sink = sink + i;
+            if (request.ctx.url.find(needle_) == std::string_view::npos)
+                return FilterAction::None;
+            rule.kind = RuleKind::Substring;
+            rule.text = needle_;
+            return FilterAction::Block;
+        }
+
+        std::atomic<uint64_t> calls{0};
+
+    private:
+        const char *name_;
+        std::string needle_;
+        unsigned spin_;
+    };
+
+    // An ads and a trackers engine plus the site policy, blockers added in
+    // either order.
+    struct TestPipeline
+    {
+        FilterPipeline pipeline;
+        SitePolicy *policy;
+        AdBlocker *ads;
+        AdBlocker *trackers;
+
+        TestPipeline(const std::string &tracker_list, bool trackers_first)
+        {
+            policy = pipeline.AddPolicy(std::make_unique<SitePolicy>());
+            auto a = std::make_unique<AdBlocker>("ads");
+            auto t = std::make_unique<AdBlocker>("trackers");
+            a->AddBlockedHost("ads.example.com");
+            a->AddURLSubstring("/banner.");
+            t->LoadBlocklist(tracker_list);
+            if (trackers_first)
+            {
+                trackers = pipeline.AddBlocker(std::move(t));
+                ads = pipeline.AddBlocker(std::move(a));
+            }
+            else
+            {
+                ads = pipeline.AddBlocker(std::move(a));
+                trackers = pipeline.AddBlocker(std::move(t));
+            }
+            policy->SetSiteAllowed("www.trusted.org", true);
+        }
+    };
+
+    bool TestFilterPipeline()
+    {
+        const std::string list = (std::filesystem::temp_directory_path() / "adblock_tests_trackers.txt").string();
+        std::ofstream(list) << "||tracker.net^\n@@||tracker.net/consent^\n";
+        const std::string page = "https://news.site.org/";
+        bool ok = true;
+        for (bool trackers_first : {false, true})
+        {
+            TestPipeline p(list, trackers_first);
+            FilterPipeline &pipeline = p.pipeline;
+            // Each engine blocks its own; a tracker exception does not lift an ad block.
+            ok = ok && !PipelineAllows(pipeline, "https://ads.example.com/x.js", page) &&
+                 !PipelineAllows(pipeline, "https://tracker.net/t.gif", page) &&
+                 PipelineAllows(pipeline, "https://tracker.net/consent/ok.js", page) &&
+                 !PipelineAllows(pipeline, "https://tracker.net/consent/banner.gif", page) &&
+                 PipelineAllows(pipeline, "https://cdn.site.org/app.js", page);
+            // The site policy wins over every engine, for the document's site and the tab's.
+            ok = ok && PipelineAllows(pipeline, "https://ads.example.com/x.js", "https://trusted.org") &&
+                 PipelineAllows(pipeline, "https://tracker.net/t.gif", page, "shop.trusted.org") &&
+                 !PipelineAllows(pipeline, "https://tracker.net/t.gif", page, "other.org");
+            // Without an origin or a page, a request's own host does not exempt it;
+            // the tab's top-level load reports its own host as the page.
+            ok = ok && !PipelineAllows(pipeline, "https://www.trusted.org/banner.gif", "") &&
+                 PipelineAllows(pipeline, "https://www.trusted.org/banner.gif", "", "www.trusted.org");
+            // Engines toggle on their own, and the pipeline as a whole.
+            p.trackers->set_enabled(false);
+            ok = ok && PipelineAllows(pipeline, "https://tracker.net/t.gif", page) &&
+                 !PipelineAllows(pipeline, "https://ads.example.com/x.js", page);
+            p.trackers->set_enabled(true);
+            p.policy->set_enabled(false);
+            ok = ok && !PipelineAllows(pipeline, "https://ads.example.com/x.js", "https://trusted.org");
+            p.policy->set_enabled(true);
+            pipeline.set_enabled(false);
+            ok = ok && PipelineAllows(pipeline, "https://ads.example.com/x.js", page);
+            pipeline.set_enabled(true);
+            const FilterStats::Report report = pipeline.stats();
+            ok = ok && report.requests == 13 && report.blocked == 7 && pipeline.stage("trackers") == p.trackers &&
+                 pipeline.StatsJSON().find("\"stages\":[{\"name\":\"site-policy\"") != std::string::npos;
+        }
+        std::filesystem::remove(list);
+        if (!ok)
+        {
+            std::fprintf(stderr, "pipeline verdict check failed\n");
+            return false;
+        }
+
+        // A slow stage added first gives way to a cheap one that blocks the
+        // same requests; after that the slow one only runs on sampled requests.
+        FilterPipeline pipeline;
+        FixedStage *slow = pipeline.AddBlocker(std::make_unique<FixedStage>("slow", "/ad", 5000));
+        FixedStage *fast = pipeline.AddBlocker(std::make_unique<FixedStage>("fast", "/ad", 0));
+        const size_t warmup = (size_t)FilterStats::kSampleInterval * FilterPipeline::kReorderInterval * 2;
+        for (size_t i = 0; i < warmup; ++i)
+            PipelineAllows(pipeline, "https://x.com/ad/" + std::to_string(i % 97), "https://x.com");
+        std::vector<FilterPipeline::StageProfile> profile = pipeline.Profile();
+        ok = profile.size() == 2 && profile[0].name == "fast" && profile[1].name == "slow" &&
+             profile[0].mean_cost_ns() < profile[1].mean_cost_ns();
+        slow->calls = 0;
+        fast->calls = 0;
+        const size_t runs = (size_t)FilterStats::kSampleInterval * 100;
+        size_t blocked = 0;
+        for (size_t i = 0; i < runs; ++i)
+            blocked += PipelineAllows(pipeline, "https://x.com/ad/1", "https://x.com") ? 0 : 1;
+        ok = ok && blocked == runs && slow->calls <= runs / FilterStats::kSampleInterval + 1 &&
+             fast->calls >= runs;
+        if (!ok)
+        {
+            std::fprintf(stderr, "pipeline order check failed: first=%s slow calls=%llu of %zu\n",
+                         profile.empty() ? "?" : profile[0].name.c_str(), (unsigned long long)slow->calls.load(),
+                         runs);
+            return false;
+        }
+
+        // The request path through real engines allocates nothing once warm.
+        std::mt19937_64 rng(53);
+        std::vector<std::string> targets;
+        const std::string mixed = (std::filesystem::temp_directory_path() / "adblock_tests_pipeline.txt").string();
+        std::ofstream(mixed) << MixedList(rng, 5000, targets);
+        FilterPipeline real;
+        real.AddPolicy(std::make_unique<SitePolicy>())->SetSiteAllowed("trusted.org", true);
+        real.AddBlocker(std::make_unique<AdBlocker>("ads"))->LoadBlocklist(mixed);
+        real.AddBlocker(std::make_unique<AdBlocker>("trackers"))->AddBlockedHost("tracker.net");
+        std::filesystem::remove(mixed);
+        std::vector<std::string> urls = RequestURLs(rng, targets, 2000);
+        for (const auto &u : urls)
+            PipelineAllows(real, u, "https://News.Site.ORG");
+        const size_t before = ThreadAllocations();
+        blocked = 0;
+        for (const auto &u : urls)
+            blocked += PipelineAllows(real, u, "https://News.Site.ORG") ? 0 : 1;
+        const size_t allocations = ThreadAllocations() - before;
+        ok = allocations == 0 && blocked > 0;
+        if (!ok)
+            std::fprintf(stderr, "pipeline request path check failed: %zu allocations (%zu blocked)\n", allocations,
+                         blocked);
+        return ok;
+    }
+
+    // A list edited while the background load parses ends up in exactly one
+    // place: the watcher starts once the load has published and catches up.
+    bool TestBackgroundWatch()
+    {
+        auto dir = std::filesystem::temp_directory_path() / "adblock_tests_bgwatch";
+        std::filesystem::remove_all(dir);
+        std::filesystem::create_directories(dir);
+        std::ofstream(dir / "list.txt") << "old.com\n";
+        FilterPipeline pipeline;
+        AdBlocker *ads = pipeline.AddBlocker(std::make_unique<AdBlocker>("ads"));
+        ads->LoadBlocklistsInBackground({dir.string()});
+        bool ok = ads->WatchBlocklistDirectory(dir.string());
+        std::ofstream(dir / "list.txt") << "new.com\n";
+        const auto deadline = Clock::now() + std::chrono::seconds(5);
+        while (Clock::now() < deadline && (PipelineAllows(pipeline, "https://new.com/", "") ||
+                                           !PipelineAllows(pipeline, "https://old.com/", "")))
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        ok = ok && !PipelineAllows(pipeline, "https://new.com/", "") && PipelineAllows(pipeline, "https://old.com/", "");
+        std::filesystem::remove_all(dir);
+        if (!ok)
+            std::fprintf(stderr, "background load and watch check failed\n");
+        return ok;
+    }
+
+    bool TestShadow()
+    {
+        const std::string dir = std::filesystem::temp_directory_path().string();
+        const std::string active_list = dir + "/adblock_tests_active.txt";
+        const std::string candidate_list = dir + "/adblock_tests_candidate.txt";
+        std::ofstream(active_list) << "||ads.example.com^\n||tracker.net^\n@@||cdn.site.org/pixel/ok^\n";
+        std::ofstream(candidate_list) << "||ads.example.com^\n||cdn.site.org/pixel^\n@@||tracker.net/consent^\n";
+        FilterPipeline pipeline;
+        AdBlocker *ads = pipeline.AddBlocker(std::make_unique<AdBlocker>("ads"));
+        ads->LoadBlocklist(active_list);
+        bool ok = ads->LoadShadowList(candidate_list) && ads->has_shadow_list();
+        // A reload keeps the candidate; the active rules stay the ones enforced.
+        ads->LoadBlocklist(active_list);
+        const std::string page = "https://news.site.org/";
+        ok = ok && ads->has_shadow_list() && !PipelineAllows(pipeline, "https://ads.example.com/x.js", page) &&
+             PipelineAllows(pipeline, "https://cdn.site.org/pixel/1.gif", page) &&
+             PipelineAllows(pipeline, "https://cdn.site.org/pixel/2.gif", page) &&
+             !PipelineAllows(pipeline, "https://tracker.net/consent/ok.js", page) &&
+             PipelineAllows(pipeline, "https://cdn.site.org/pixel/ok/1.gif", page) &&
+             PipelineAllows(pipeline, "https://cdn.site.org/app.js", page);
+        const std::string json = ads->ShadowReportJSON();
+        ok = ok && json.find("\"requests\":6,") != std::string::npos &&
+             json.find("\"active_blocked\":2,") != std::string::npos &&
+             json.find("\"newly_blocked\":2,") != std::string::npos &&
+             json.find("\"newly_allowed\":1,") != std::string::npos &&
+             json.find("\"rule\":\"||cdn.site.org/pixel^\",\"blocked\":2,\"unblocked\":0,\"examples\":["
+                       "\"https://cdn.site.org/pixel/1.gif\",\"https://cdn.site.org/pixel/2.gif\"]") !=
+                 std::string::npos &&
+             json.find("\"rule\":\"@@||tracker.net/consent^\",\"blocked\":0,\"unblocked\":1") != std::string::npos;
+        ads->ClearShadowList();
+        ok = ok && !ads->has_shadow_list() && ads->ShadowReportJSON() == "{}";
+        std::filesystem::remove(active_list);
+        std::filesystem::remove(candidate_list);
+        if (!ok)
+            std::fprintf(stderr, "shadow list check failed: %s\n", json.c_str());
+        return ok;
+    }
+
+    bool TestViewTraffic()
+    {
+        ViewTraffic traffic;
+        int views[ViewTraffic::kMaxViews + 1];
+        const void *a = &views[0], *b = &views[1];
+        traffic.Open(a);
+        traffic.Open(b);
+        traffic.Open(b); // opening twice keeps one slot
+        traffic.Record(a, "cdn.site.org", false);
+        traffic.Record(a, "ads.example.com", true);
+        traffic.Record(a, "cdn.site.org", false);
+        traffic.Record(a, "", false);
+        traffic.Record(b, "cdn.site.org", true);
+        ViewTraffic::Report ra = traffic.Collect(a);
+        ViewTraffic::Report rb = traffic.Collect(b);
+        bool ok = traffic.open_views() == 2 && ra.requests == 4 && ra.blocked == 1 && ra.allowed() == 3 &&
+                  ra.hosts.size() == 2 && ra.hosts[0].host == "cdn.site.org" && ra.hosts[0].requests == 2 &&
+                  ra.hosts[1].blocked == 1 && rb.requests == 1 && rb.blocked == 1 &&
+                  traffic.Collect(&views[2]).requests == 0 &&
+                  ra.ToJSON(1) == "{\"requests\":4,\"allowed\":3,\"blocked\":1,\"host_count\":2,"
+                                  "\"untracked_hosts\":0,\"hosts\":[{\"host\":\"cdn.site.org\",\"requests\":2,"
+                                  "\"blocked\":0}]}";
+        // A request still in flight when its view is released takes no slot...
+        traffic.Release(a);
+        traffic.Record(a, "late.org", false);
+        ok = ok && traffic.open_views() == 1 && traffic.Collect(a).requests == 0 && traffic.untracked_views() == 1;
+        // ...and a later view at the same address starts over.
+        traffic.Open(a);
+        traffic.Record(a, "other.org", false);
+        ra = traffic.Collect(a);
+        ok = ok && ra.requests == 1 && ra.hosts.size() == 1 && ra.hosts[0].host == "other.org" &&
+             traffic.Collect(b).requests == 1;
+        // Hosts and views beyond the tables only count in totals; long names are cut.
+        for (size_t i = 0; i < ViewTraffic::kMaxHosts + 10; ++i)
+            traffic.Record(b, "host" + std::to_string(i) + ".example.com", false);
+        traffic.Record(b, std::string(100, 'x') + ".com", false);
+        rb = traffic.Collect(b);
+        ok = ok && rb.requests == ViewTraffic::kMaxHosts + 12 && rb.hosts.size() == ViewTraffic::kMaxHosts &&
+             rb.untracked_hosts == 12;
+        for (auto &v : views)
+            traffic.Open(&v);
+        for (auto &v : views)
+            traffic.Record(&v, "x.org", false);
+        ok = ok && traffic.open_views() == ViewTraffic::kMaxViews && traffic.untracked_views() == 2;
+        traffic.Release(b);
+        traffic.Open(b);
+        traffic.Record(b, std::string(100, 'x') + ".com", false);
+        rb = traffic.Collect(b);
+        ok = ok && rb.requests == 1 && rb.hosts.size() == 1 &&
+             rb.hosts[0].host == std::string(ViewTraffic::kMaxHostLength, 'x');
+        for (auto &v : views)
+            traffic.Release(&v);
+        traffic.Record(b, "late.org", false);
+        ok = ok && traffic.open_views() == 0;
+        if (!ok)
+        {
+            std::fprintf(stderr, "view traffic check failed: %s\n", traffic.Collect(b).ToJSON().c_str());
+            return false;
+        }
+
+        // Concurrent network threads lose no count, and recording allocates nothing.
+        ViewTraffic shared;
+        shared.Open(&views[0]);
+        shared.Open(&views[1]);
+        constexpr size_t kThreads = 4, kPerThread = 20000;
+        std::vector<std::thread> threads;
+        std::atomic<size_t> allocations{0};
+        for (size_t t = 0; t < kThreads; ++t)
+        {
+            threads.emplace_back([&, t]()
+                                 {
+                const char *hosts[] = {"a.com", "b.com", "c.com"};
+                const size_t before = ThreadAllocations();
+                for (size_t i = 0; i < kPerThread; ++i)
+                    shared.Record(&views[i % 2], hosts[(i + t) % 3], i % 4 == 0);
+                allocations += ThreadAllocations() - before; });
+        }
+        for (auto &t : threads)
+            t.join();
+        ra = shared.Collect(&views[0]);
+        rb = shared.Collect(&views[1]);
+        uint64_t host_requests = 0;
+        for (const auto &h : ra.hosts)
+            host_requests += h.requests;
+        ok = ra.requests + rb.requests == kThreads * kPerThread && ra.blocked == kThreads * kPerThread / 4 &&
+             rb.blocked == 0 && ra.hosts.size() == 3 && host_requests == ra.requests && allocations == 0;
+        if (!ok)
+            std::fprintf(stderr, "view traffic concurrency check failed: %s (%zu allocations)\n",
+                         ra.ToJSON().c_str(), allocations.load());
+        return ok;
+    }
+
+    struct Test
+    {
+        const char *name;
+        bool (*run)();
+    };
+
+    const Test kTests[] = {
+        {"host_matcher", TestHostMatcher},
+        {"substrings", TestSubstrings},
+        {"token_index", TestTokenIndex},
+        {"globs", TestGlobs},
+        {"regex", TestRegex},
+        {"filters", TestFilters},
+        {"snapshot", TestSnapshot},
+        {"optimize", TestOptimize},
+        {"host_cache", TestHostCache},
+        {"bloom", TestBloom},
+        {"loader", TestLoader},
+        {"stats", TestStats},
+        {"filter_set", TestFilterSet},
+        {"watcher", TestWatcher},
+        {"cosmetic", TestCosmetic},
+        {"lower_ascii", TestLowerASCII},
+        {"request_path", TestRequestPath},
+        {"allowlist", TestAllowlist},
+        {"public_suffix", TestPublicSuffix},
+        {"request_log", TestRequestLog},
+        {"arena", TestArena},
+        {"pipeline", TestFilterPipeline},
+        {"background_watch", TestBackgroundWatch},
+        {"shadow", TestShadow},
+        {"view_traffic", TestViewTraffic},
+    };
+}
+
+int main(int argc, char **argv)
+{
+    int failed = 0, ran = 0;
+    for (const Test &test : kTests)
+    {
+        bool selected = argc < 2;
+        for (int i = 1; i < argc; ++i)
+            selected = selected || std::strcmp(argv[i], test.name) == 0;
+        if (!selected)
+            continue;
+        ++ran;
+        const bool ok = test.run();
+        std::printf("%s %s\n", ok ? "ok  " : "FAIL", test.name);
+        failed += ok ? 0 : 1;
+    }
+    if (ran == 0)
+    {
+        std::fprintf(stderr, "no such test\n");
+        return 2;
+    }
+    return failed == 0 ? 0 : 1;
+}
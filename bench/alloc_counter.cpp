@@ -0,0 +1,49 @@
+#include "alloc_counter.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace
+{
+    thread_local size_t g_allocations = 0;
+    std::atomic<int64_t> g_live_bytes{0};
+
+    // Every replaced operator new and delete goes through these two, so the
+    // block layout is the same for all forms: the malloc'd pointer and the
+    // requested size sit right before the returned (aligned) pointer.
+    void *CountedAlloc(size_t size, size_t align)
+    {
+        ++g_allocations;
+        constexpr size_t kHeader = 2 * sizeof(void *);
+        align = std::max(align, alignof(std::max_align_t));
+        void *raw = std::malloc(size + kHeader + align);
+        if (!raw)
+            throw std::bad_alloc();
+        const uintptr_t p = ((uintptr_t)raw + kHeader + align - 1) & ~(uintptr_t)(align - 1);
+        reinterpret_cast<void **>(p)[-1] = reinterpret_cast<void *>(size);
+        reinterpret_cast<void **>(p)[-2] = raw;
+        g_live_bytes.fetch_add((int64_t)size, std::memory_order_relaxed);
+        return reinterpret_cast<void *>(p);
+    }
+
+    void CountedFree(void *p) noexcept
+    {
+        if (!p)
+            return;
+        void **header = static_cast<void **>(p);
+        g_live_bytes.fetch_sub((int64_t) reinterpret_cast<uintptr_t>(header[-1]), std::memory_order_relaxed);
+        std::free(header[-2]);
+    }
+}
+
+void *operator new(size_t size) { return CountedAlloc(size, alignof(std::max_align_t)); }
+void *operator new(size_t size, std::align_val_t align) { return CountedAlloc(size, (size_t)align); }
+void operator delete(void *p) noexcept { CountedFree(p); }
+void operator delete(void *p, size_t) noexcept { CountedFree(p); }
+void operator delete(void *p, std::align_val_t) noexcept { CountedFree(p); }
+void operator delete(void *p, size_t, std::align_val_t) noexcept { CountedFree(p); }
+
+size_t ThreadAllocations() { return g_allocations; }
+int64_t LiveHeapBytes() { return g_live_bytes.load(); }
@@ -0,0 +1,11 @@
+#pragma once
+// Counts heap allocations. Linking alloc_counter.cpp replaces the global
+// operator new and delete of the program, so tests can check that a path
+// allocates nothing and benchmarks can report what a structure costs.
+#include <cstddef>
+#include <cstdint>
+
+// Allocations made by the calling thread so far.
+size_t ThreadAllocations();
+// Bytes currently allocated on the heap by all threads.
+int64_t LiveHeapBytes();
@@ -0,0 +1,380 @@
+// Tests of the browser history: HistoryStore and its on-disk HistoryLog. Each
+// test checks one behavior and returns false (after saying why) when it fails;
+// history_tests runs them all, or the ones named on the command line (CTest
+// registers each on its own).
+#include "HistoryLog.h"
+#include "HistoryStore.h"
+
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    // "a2b1": first letter of each host and its visit count, oldest first.
+    std::string Order(const HistoryStore &history)
+    {
+        std::string order;
+        for (const auto &e : history)
+            order += e.url.substr(8, 1) + std::to_string(e.visit_count);
+        return order;
+    }
+
+    // "url:title:count;" per entry, oldest first: everything a reload must restore.
+    std::string Contents(const HistoryStore &history)
+    {
+        std::string out;
+        for (const auto &e : history)
+            out += e.url + ":" + e.title + ":" + std::to_string(e.visit_count) + ";";
+        return out;
+    }
+
+    bool Expect(bool ok, const char *what, const std::string &got)
+    {
+        if (!ok)
+            std::fprintf(stderr, "  %s (got %s)\n", what, got.c_str());
+        return ok;
+    }
+
+    // An empty directory of the test's own.
+    fs::path TestDir(const char *name)
+    {
+        const fs::path dir = fs::temp_directory_path() / (std::string("history_tests_") + name);
+        fs::remove_all(dir);
+        fs::create_directories(dir);
+        return dir;
+    }
+
+    std::string ReadAll(const fs::path &path)
+    {
+        std::ifstream in(path, std::ios::binary);
+        return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+
+    // Visit each URL in turn at times from start_ms on, logging every visit.
+    void VisitAll(HistoryStore &history, HistoryLog &log, const std::vector<std::string> &urls, uint64_t start_ms)
+    {
+        for (const auto &url : urls)
+            log.Record(history.Visit(url, "T " + url.substr(8, 1), start_ms++), history);
+    }
+
+    // Over capacity the least recently visited entry goes, not the first recorded.
+    bool TestStoreLRUOrder()
+    {
+        HistoryStore history(3);
+        history.Visit("https://a.org/", "A", 10);
+        history.Visit("https://b.org/", "B", 20);
+        history.Visit("https://c.org/", "C", 30);
+        history.Visit("https://a.org/", "A", 40);
+        history.Visit("https://d.org/", "D", 50);
+        bool ok = Expect(Order(history) == "c1a2d1", "b.org, the least recent, is evicted", Order(history));
+        ok = Expect(history.size() == 3 && !history.Find("https://b.org/") && history.Find("https://c.org/"),
+                    "the index follows the list", Order(history)) && ok;
+        history.Visit("https://e.org/", "E", 60);
+        history.Visit("https://f.org/", "F", 70);
+        ok = Expect(Order(history) == "d1e1f1", "each new URL pushes out the oldest", Order(history)) && ok;
+        return ok;
+    }
+
+    // A visit to a known URL moves it to the newest end and updates it in place.
+    bool TestStoreRevisitMovesToFront()
+    {
+        HistoryStore history(10);
+        history.Visit("https://a.org/", "A", 10);
+        history.Visit("https://b.org/", "B", 20);
+        history.Visit("https://c.org/", "C", 30);
+        const HistoryStore::Entry &a = history.Visit("https://a.org/", "", 40);
+        bool ok = Expect(Order(history) == "b1c1a2", "a.org moves to the newest end", Order(history));
+        ok = Expect(&a == &*history.rbegin() && a.title == "A" && a.timestamp_ms == 40 && a.visit_count == 2,
+                    "an empty title keeps the old one; time and count update", a.title) && ok;
+        history.Visit("https://b.org/", "B2", 50);
+        ok = Expect(Order(history) == "c1a2b2" && history.rbegin()->title == "B2" &&
+                        history.Find("https://b.org/") == &*history.rbegin(),
+                    "a new title replaces the old one", Order(history)) && ok;
+        return ok;
+    }
+
+    // Assign() orders by time, keeps the input order of equal times, and lets
+    // the latest copy of a URL win.
+    bool TestStoreAssignStableSort()
+    {
+        HistoryStore history(10);
+        history.Assign({{"https://p.org/", "P", 50, 1},
+                        {"https://q.org/", "Q", 50, 1},
+                        {"https://r.org/", "R", 50, 1},
+                        {"https://o.org/", "O", 10, 1}});
+        bool ok = Expect(Order(history) == "o1p1q1r1", "equal times keep their input order", Order(history));
+        history.Assign({{"https://r.org/", "R", 50, 1},
+                        {"https://q.org/", "Q", 50, 1},
+                        {"https://p.org/", "P", 50, 1}});
+        ok = Expect(Order(history) == "r1q1p1", "reversed input, reversed order", Order(history)) && ok;
+
+        history.Assign({{"https://x.org/", "X2", 70, 5},
+                        {"https://y.org/", "Y", 60, 1},
+                        {"https://x.org/", "X1", 55, 4},
+                        {"https://x.org/", "X3", 70, 6},
+                        {"", "empty", 90, 1}});
+        const HistoryStore::Entry *x = history.Find("https://x.org/");
+        ok = Expect(Order(history) == "y1x6" && x && x->title == "X3",
+                    "the latest copy wins, the later one on a tie; empty URLs are dropped", Order(history)) && ok;
+
+        HistoryStore small(2);
+        small.Assign({{"https://c.org/", "C", 30, 1}, {"https://a.org/", "A", 10, 1}, {"https://b.org/", "B", 20, 1}});
+        ok = Expect(Order(small) == "b1c1" && !small.Find("https://a.org/"), "beyond capacity the oldest go",
+                    Order(small)) && ok;
+        return ok;
+    }
+
+    // Visits come back from the log alone, titles and all, before any snapshot exists.
+    bool TestLogReplaysVisits()
+    {
+        const fs::path dir = TestDir("replay");
+        HistoryStore history(100);
+        {
+            HistoryLog log(dir / "history.json");
+            log.Load(history);
+            for (const char *url : {"https://a.org/", "https://b.org/", "https://a.org/", "https://c.org/"})
+                log.Record(history.Visit(url, "T \"quoted\"\n", 0), history);
+            if (!Expect(log.log_records() == 4 && !fs::exists(dir / "history.json"), "four records, no snapshot",
+                        std::to_string(log.log_records())))
+                return false;
+        }
+        HistoryStore reloaded(100);
+        HistoryLog log(dir / "history.json");
+        const size_t records = log.Load(reloaded);
+        const bool ok = Expect(records == 4 && Contents(reloaded) == Contents(history) &&
+                                   reloaded.Find("https://a.org/")->title == "T \"quoted\"\n",
+                               "the reload matches what was recorded", Contents(reloaded));
+        fs::remove_all(dir);
+        return ok;
+    }
+
+    // A record cut short by a crash mid-append is dropped and cut off the
+    // log, so the next record lands where it began.
+    bool TestLogTornTailTruncated()
+    {
+        const fs::path dir = TestDir("torn");
+        HistoryStore history(100);
+        {
+            HistoryLog log(dir / "history.json");
+            VisitAll(history, log, {"https://a.org/", "https://b.org/", "https://c.org/"}, 10);
+        }
+        const uintmax_t good_size = fs::file_size(dir / "history.log");
+        std::ofstream(dir / "history.log", std::ios::app | std::ios::binary) << "0badc0de {\"url\":\"https://x";
+        bool ok;
+        {
+            HistoryStore reloaded(100);
+            HistoryLog log(dir / "history.json");
+            ok = Expect(log.Load(reloaded) == 3 && Contents(reloaded) == Contents(history),
+                        "the three whole records replay", Contents(reloaded));
+            ok = Expect(fs::file_size(dir / "history.log") == good_size, "the torn tail is truncated",
+                        std::to_string(fs::file_size(dir / "history.log"))) && ok;
+            log.Record(reloaded.Visit("https://d.org/", "D", 20), reloaded);
+            history.Visit("https://d.org/", "D", 20);
+        }
+        HistoryStore again(100);
+        HistoryLog log(dir / "history.json");
+        ok = Expect(log.Load(again) == 4 && Contents(again) == Contents(history),
+                    "a record appended after the cut replays", Contents(again)) && ok;
+        fs::remove_all(dir);
+        return ok;
+    }
+
+    // A record whose bytes changed fails its checksum; replay stops there.
+    bool TestLogChecksumStopsReplay()
+    {
+        const fs::path dir = TestDir("crc");
+        {
+            HistoryStore history(100);
+            HistoryLog log(dir / "history.json");
+            VisitAll(history, log, {"https://a.org/", "https://b.org/", "https://c.org/", "https://d.org/"}, 10);
+        }
+        std::string content = ReadAll(dir / "history.log");
+        content[content.find("https://c.org/") + 8] = 'q';
+        std::ofstream(dir / "history.log", std::ios::binary | std::ios::trunc) << content;
+        HistoryStore reloaded(100);
+        HistoryLog log(dir / "history.json");
+        const size_t records = log.Load(reloaded);
+        const bool ok = Expect(records == 2 && Order(reloaded) == "a1b1",
+                               "the records before the corrupt one replay, none after", Order(reloaded));
+        fs::remove_all(dir);
+        return ok;
+    }
+
+    // Enough visits start a background compaction into the snapshot; what it
+    // folds in and what is logged meanwhile both come back.
+    bool TestLogBackgroundCompaction()
+    {
+        const fs::path dir = TestDir("compact");
+        HistoryStore history(50);
+        HistoryLog log(dir / "history.json");
+        for (size_t i = 0; i < HistoryLog::kMinCompactRecords + 20; ++i)
+            log.Record(history.Visit("https://h" + std::to_string(i % 60) + ".org/", "", 10 + i), history);
+        log.WaitForCompaction();
+        bool ok = Expect(fs::exists(dir / "history.json") && !fs::exists(dir / "history.log.1") &&
+                             log.log_records() == 20,
+                         "a snapshot, no pending log, and the 20 later records", std::to_string(log.log_records()));
+        HistoryStore reloaded(50);
+        HistoryLog again(dir / "history.json");
+        again.Load(reloaded);
+        ok = Expect(reloaded.size() == 50 && Contents(reloaded) == Contents(history), "the reload matches",
+                    Contents(reloaded)) && ok;
+        fs::remove_all(dir);
+        return ok;
+    }
+
+    // A compaction interrupted after the snapshot was renamed into place can
+    // leave a pending log older than it; its states do not win.
+    bool TestLogStalePendingLoses()
+    {
+        const fs::path dir = TestDir("stale");
+        HistoryStore history(10);
+        {
+            HistoryLog log(dir / "history.json");
+            VisitAll(history, log, {"https://a.org/", "https://b.org/", "https://a.org/"}, 10);
+            log.Compact(history);
+        }
+        {
+            // An older state of a.org, as a pending log holds it.
+            HistoryStore old(10);
+            HistoryLog writer(dir / "old.json");
+            writer.Record(old.Visit("https://a.org/", "old", 1), old);
+        }
+        fs::rename(dir / "old.log", dir / "history.log.1");
+        HistoryStore reloaded(10);
+        HistoryLog log(dir / "history.json");
+        log.Load(reloaded);
+        const bool ok = Expect(Contents(reloaded) == Contents(history) && !fs::exists(dir / "history.log.1"),
+                               "the snapshot's state wins and the pending log is folded in", Contents(reloaded));
+        fs::remove_all(dir);
+        return ok;
+    }
+
+    // A compaction that cannot write its snapshot leaves its pending log, which
+    // may end in a record torn by an earlier crash. The next compaction adds
+    // the active log behind the pending log's last whole record, so replay,
+    // which stops at the first bad record, still reaches the new ones.
+    bool TestLogTornPendingTrimmed()
+    {
+        const fs::path dir = TestDir("torn_pending");
+        std::ofstream(dir / "history.log.1", std::ios::binary) << "0badc0de {\"url\":\"https://x.o";
+        // The temporary snapshot's name is taken, so the compaction fails.
+        fs::create_directories(dir / "history.json.tmp" / "blocker");
+        HistoryStore history(10);
+        {
+            HistoryLog log(dir / "history.json");
+            std::vector<std::string> urls;
+            for (size_t i = 0; i < HistoryLog::kMinCompactRecords; ++i)
+                urls.push_back(std::string("https://") + (char)('a' + i % 5) + ".org/");
+            VisitAll(history, log, urls, 10);
+            log.WaitForCompaction();
+        }
+        bool ok = Expect(fs::exists(dir / "history.log.1") && !fs::exists(dir / "history.json"),
+                         "the failed compaction keeps its pending log", "");
+        fs::remove_all(dir / "history.json.tmp");
+
+        HistoryStore reloaded(10);
+        HistoryLog log(dir / "history.json");
+        const size_t records = log.Load(reloaded);
+        ok = Expect(records == HistoryLog::kMinCompactRecords, "every record behind the torn one replays",
+                    std::to_string(records)) && ok;
+        ok = Expect(Contents(reloaded) == Contents(history), "no visit lost", Order(reloaded)) && ok;
+        fs::remove_all(dir);
+        return ok;
+    }
+
+    // The process dies after the compaction wrote the snapshot but before it
+    // removed the pending log, with newer visits in the active log. Load
+    // replays snapshot, pending and active log in turn and ends up with every
+    // visit exactly once.
+    bool TestLogCrashBeforePendingRemoved()
+    {
+        const fs::path dir = TestDir("crash");
+        HistoryStore history(100);
+        {
+            HistoryLog log(dir / "history.json");
+            VisitAll(history, log, {"https://a.org/", "https://b.org/", "https://a.org/", "https://c.org/"}, 10);
+        }
+        // What Record() does when it starts a compaction: the log becomes the
+        // pending log, and the compactor writes the snapshot of that moment.
+        fs::rename(dir / "history.log", dir / "history.log.1");
+        {
+            HistoryLog writer(dir / "compacted.json");
+            writer.Compact(history);
+        }
+        fs::rename(dir / "compacted.json", dir / "history.json");
+        // Visits logged while it ran, some to URLs the snapshot already holds.
+        {
+            HistoryLog log(dir / "history.json");
+            VisitAll(history, log, {"https://b.org/", "https://d.org/", "https://a.org/"}, 20);
+        }
+        bool ok = Expect(fs::exists(dir / "history.log.1") && fs::exists(dir / "history.log"),
+                         "snapshot, pending and active log all present", "");
+
+        HistoryStore reloaded(100);
+        HistoryLog log(dir / "history.json");
+        const size_t records = log.Load(reloaded);
+        ok = Expect(records == 7, "the pending log's 4 records and the active log's 3 replay",
+                    std::to_string(records)) && ok;
+        ok = Expect(Order(reloaded) == "c1b2d1a3" && Contents(reloaded) == Contents(history),
+                    "no visit lost or counted twice", Order(reloaded)) && ok;
+        ok = Expect(!fs::exists(dir / "history.log.1") && !fs::exists(dir / "history.log"),
+                    "the interrupted compaction is finished", "") && ok;
+
+        // The finished snapshot alone gives the same history.
+        HistoryStore from_snapshot(100);
+        HistoryLog again(dir / "history.json");
+        ok = Expect(again.Load(from_snapshot) == 0 && Contents(from_snapshot) == Contents(history),
+                    "the new snapshot holds it all", Contents(from_snapshot)) && ok;
+        fs::remove_all(dir);
+        return ok;
+    }
+
+    struct Test
+    {
+        const char *name;
+        bool (*run)();
+    };
+
+    const Test kTests[] = {
+        {"store_lru_order", TestStoreLRUOrder},
+        {"store_revisit_moves_to_front", TestStoreRevisitMovesToFront},
+        {"store_assign_stable_sort", TestStoreAssignStableSort},
+        {"log_replays_visits", TestLogReplaysVisits},
+        {"log_torn_tail_truncated", TestLogTornTailTruncated},
+        {"log_checksum_stops_replay", TestLogChecksumStopsReplay},
+        {"log_background_compaction", TestLogBackgroundCompaction},
+        {"log_stale_pending_loses", TestLogStalePendingLoses},
+        {"log_torn_pending_trimmed", TestLogTornPendingTrimmed},
+        {"log_crash_before_pending_removed", TestLogCrashBeforePendingRemoved},
+    };
+}
+
+int main(int argc, char **argv)
+{
+    int failed = 0, ran = 0;
+    for (const Test &test : kTests)
+    {
+        bool selected = argc < 2;
+        for (int i = 1; i < argc; ++i)
+            selected = selected || std::strcmp(argv[i], test.name) == 0;
+        if (!selected)
+            continue;
+        ++ran;
+        const bool ok = test.run();
+        std::printf("%s %s\n", ok ? "ok  " : "FAIL", test.name);
+        failed += ok ? 0 : 1;
+    }
+    if (ran == 0)
+    {
+        std::fprintf(stderr, "no such test\n");
+        return 2;
+    }
+    return failed == 0 ? 0 : 1;
+}
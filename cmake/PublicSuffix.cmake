@@ -0,0 +1,26 @@
+# Public Suffix List lookups (src/PublicSuffix.cpp) as the static library
+# adblock_psl. tools/psl_compile compiles tools/public_suffix_list.dat into the
+# table the library includes, so editing the list only needs a rebuild.
+#
+# Included by the top-level project, bench/ and tools/; the first include
+# defines the targets and the others link against them.
+if(NOT TARGET adblock_psl)
+  set(ADBLOCK_PSL_SRC_DIR "${CMAKE_CURRENT_LIST_DIR}/../src")
+  set(ADBLOCK_PSL_LIST "${CMAKE_CURRENT_LIST_DIR}/../tools/public_suffix_list.dat")
+  set(ADBLOCK_PSL_TABLE "${CMAKE_CURRENT_BINARY_DIR}/psl/PublicSuffixTable.inc")
+
+  add_executable(psl_compile "${CMAKE_CURRENT_LIST_DIR}/../tools/psl_compile.cpp")
+  target_include_directories(psl_compile PRIVATE "${ADBLOCK_PSL_SRC_DIR}")
+
+  file(MAKE_DIRECTORY "${CMAKE_CURRENT_BINARY_DIR}/psl")
+  add_custom_command(
+    OUTPUT "${ADBLOCK_PSL_TABLE}"
+    COMMAND $<TARGET_FILE:psl_compile> -o "${ADBLOCK_PSL_TABLE}" "${ADBLOCK_PSL_LIST}"
+    DEPENDS psl_compile "${ADBLOCK_PSL_LIST}"
+    COMMENT "Compiling the Public Suffix List"
+    VERBATIM
+  )
+
+  add_library(adblock_psl STATIC "${ADBLOCK_PSL_SRC_DIR}/PublicSuffix.cpp" "${ADBLOCK_PSL_TABLE}")
+  target_include_directories(adblock_psl PUBLIC "${ADBLOCK_PSL_SRC_DIR}" PRIVATE "${CMAKE_CURRENT_BINARY_DIR}/psl")
+endif()
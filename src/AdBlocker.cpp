@@ -1,273 +1,412 @@
 #include "AdBlocker.h"
+#include "FilterLoader.h"
+#include "FilterStats.h"
 
-#include <Ultralight/Ultralight.h>
-#include <fstream>
-#include <sstream>
 #include <algorithm>
+#include <chrono>
 #include <filesystem>
 #include <cstdio>
 
-using namespace ultralight;
-
 namespace
 {
-    bool ends_with_dot_or_exact(const std::string &host, const std::string &rule)
+    // Drop redundant rules from a freshly loaded engine, then compile it.
+    void OptimizeAndBuild(FilterEngine &engine)
     {
-        // Match exact domain or subdomain ("example.com" matches example.com and a.example.com but not badexample.com)
-        if (host == rule)
-            return true;
-        if (host.size() <= rule.size())
-            return false;
-        // Ensure boundary on the left is a dot
-        size_t pos = host.size() - rule.size();
-        if (host.compare(pos, std::string::npos, rule) == 0 && pos > 0 && host[pos - 1] == '.')
-            return true;
-        return false;
+        const FilterEngine::OptimizeStats removed = engine.Optimize();
+        if (removed.removed() || removed.globs_to_substrings)
+            std::fprintf(stderr,
+                         "AdBlock: optimizer dropped %zu redundant rule(s) (%zu hosts, %zu substrings, %zu globs), "
+                         "turned %zu glob(s) into substrings\n",
+                         removed.removed(), removed.hosts, removed.substrings, removed.globs,
+                         removed.globs_to_substrings);
+        engine.Build();
     }
 }
 
+AdBlocker::~AdBlocker()
+{
+    // The load may start the watcher when it finishes.
+    if (background_load_.joinable())
+        background_load_.join();
+    watcher_.Stop();
+}
+
 bool AdBlocker::LoadBlocklist(const std::string &path, bool append)
 {
-    std::ifstream in(path);
-    if (!in.is_open())
+    uint64_t epoch = CurrentEpoch();
+    // Large files are split into chunks and parsed in parallel, outside the lock
+    FilterEngine parsed;
+    if (FilterLoader().Load({path}, parsed) == 0)
         return false;
+    MergeParsed(std::move(parsed), {path}, !append, epoch);
+    return true;
+}
 
-    std::lock_guard<std::mutex> lock(mtx_);
-    if (!append)
-    {
-        blocked_hosts_.clear();
-        url_substrings_.clear();
-        url_globs_.clear();
-    }
+int AdBlocker::LoadBlocklistsInDirectory(const std::string &dir_path)
+{
+    std::error_code ec;
+    if (!std::filesystem::is_directory(dir_path, ec))
+        return 0;
+    uint64_t epoch = CurrentEpoch();
+    const std::vector<std::string> files = FilterSnapshot::ExpandSources({dir_path});
 
-    std::string line;
-    while (std::getline(in, line))
-    {
-        line = Trim(line);
-        if (line.empty())
-            continue;
-        if (line[0] == '#')
-            continue;
+    FilterEngine parsed;
+    int count = (int)FilterLoader().Load(files, parsed);
+    // Publish every list at once
+    MergeParsed(std::move(parsed), files, false, epoch);
+    return count;
+}
 
-        // Adblock-style domain pattern: ||example.com^
-        if (line.rfind("||", 0) == 0)
+void AdBlocker::LoadBlocklistsInBackground(const std::vector<std::string> &sources)
+{
+    if (background_load_.joinable())
+        background_load_.join();
+    uint64_t epoch;
+    {
+        // A running watcher pauses until the load has published (see WatchBlocklistDirectory()).
+        std::lock_guard<std::mutex> watch_lock(watch_mtx_);
+        std::lock_guard<std::mutex> lock(write_mtx_);
+        epoch = clear_epoch_;
+        background_loading_ = true;
+        if (watcher_.running())
         {
-            std::string dom = line.substr(2);
-            // Trim at first '^' if present
-            auto hat = dom.find('^');
-            if (hat != std::string::npos)
-                dom = dom.substr(0, hat);
-            dom = Trim(dom);
-            if (!dom.empty())
-                AddBlockedHost(dom);
-            continue;
+            watcher_.Stop();
+            deferred_watch_ = watched_dir_;
         }
-
-        // Hosts-file style: IP then domain
+    }
+    background_load_ = std::thread([this, sources, epoch]()
+                                   {
+        const auto started = std::filesystem::file_time_type::clock::now();
+        FilterEngine parsed;
+        std::vector<std::string> files = FilterSnapshot::ExpandSources(sources);
+        FilterLoader().Load(files, parsed);
+        MergeParsed(std::move(parsed), std::move(files), false, epoch);
+        std::string dir;
         {
-            std::istringstream iss(line);
-            std::string tok1, tok2;
-            if (iss >> tok1)
-            {
-                if (tok1.find('.') != std::string::npos || tok1 == "::1")
-                {
-                    if (iss >> tok2)
-                    {
-                        AddBlockedHost(tok2);
-                        continue;
-                    }
-                }
-            }
+            std::lock_guard<std::mutex> lock(write_mtx_);
+            background_loading_ = false;
+            dir.swap(deferred_watch_);
         }
+        if (!dir.empty())
+        {
+            std::lock_guard<std::mutex> watch_lock(watch_mtx_);
+            StartWatching(dir, started);
+        } });
+}
+
+uint64_t AdBlocker::CurrentEpoch()
+{
+    std::lock_guard<std::mutex> lock(write_mtx_);
+    return clear_epoch_;
+}
+
+void AdBlocker::MergeParsed(FilterEngine &&parsed, std::vector<std::string> sources, bool from_empty,
+                            uint64_t epoch)
+{
+    std::lock_guard<std::mutex> lock(write_mtx_);
+    if (epoch != clear_epoch_)
+        return; // cleared while parsing
+    auto next = std::make_shared<RuleSet>();
+    if (from_empty)
+    {
+        auto base = std::make_shared<FilterEngine>(std::move(parsed));
+        OptimizeAndBuild(*base);
+        next->filters = FilterSet(std::move(base), std::move(sources));
+    }
+    else
+    {
+        const FilterSet &current = rules()->filters;
+        auto base = std::make_shared<FilterEngine>(current.base());
+        base->Merge(std::move(parsed));
+        OptimizeAndBuild(*base);
+        std::vector<std::string> base_sources = current.base_sources();
+        base_sources.insert(base_sources.end(), sources.begin(), sources.end());
+        next->filters = current.WithBase(std::move(base), std::move(base_sources));
+    }
+    Publish(std::move(next));
+}
 
-        // Plain domain without IP
-        if (line.find('.') != std::string::npos && line.find(' ') == std::string::npos)
+bool AdBlocker::LoadSnapshot(const std::string &snapshot_path, const std::vector<std::string> &sources)
+{
+    std::string error;
+    auto snapshot = FilterSnapshot::Open(snapshot_path, &error);
+    if (!snapshot)
+    {
+        std::fprintf(stderr, "AdBlock: snapshot not used: %s\n", error.c_str());
+        return false;
+    }
+    if (snapshot->fingerprint() != FilterSnapshot::Fingerprint(FilterSnapshot::ExpandSources(sources)))
+    {
+        std::fprintf(stderr, "AdBlock: snapshot %s is stale, parsing lists\n", snapshot_path.c_str());
+        return false;
+    }
+
+    auto base = std::make_shared<FilterEngine>();
+    if (!base->LoadSnapshot(std::move(snapshot)))
+    {
+        std::fprintf(stderr, "AdBlock: snapshot %s is corrupt, parsing lists\n", snapshot_path.c_str());
+        return false;
+    }
+    auto next = std::make_shared<RuleSet>();
+    next->filters = FilterSet(std::move(base), FilterSnapshot::ExpandSources(sources));
+    std::lock_guard<std::mutex> lock(write_mtx_);
+    Publish(std::move(next));
+    return true;
+}
+
+bool AdBlocker::WatchBlocklistDirectory(const std::string &dir)
+{
+    std::lock_guard<std::mutex> watch_lock(watch_mtx_);
+    watcher_.Stop();
+    {
+        // A reload before the background load merges its lists would layer
+        // files the merge then adds to the base again, so the load starts the
+        // watcher once it has published.
+        std::lock_guard<std::mutex> lock(write_mtx_);
+        if (background_loading_)
         {
-            AddBlockedHost(line);
-            continue;
+            deferred_watch_ = dir;
+            std::error_code ec;
+            return std::filesystem::is_directory(dir, ec);
         }
-
-        // If contains wildcard, treat as glob, else as substring
-        if (line.find('*') != std::string::npos || line.find('?') != std::string::npos)
-            AddURLGlob(line);
-        else
-            AddURLSubstring(line);
     }
+    return StartWatching(dir, std::filesystem::file_time_type::max());
+}
 
+bool AdBlocker::StartWatching(const std::string &dir, std::filesystem::file_time_type changed_since)
+{
+    namespace fs = std::filesystem;
+    watched_dir_ = dir;
+    if (!watcher_.Start(dir, [this](const std::vector<std::string> &changed)
+                        { ReloadLists(changed); }))
+        return false;
+    if (changed_since == fs::file_time_type::max())
+        return true;
+    // Lists written while the load was parsing may have been read before the
+    // change; reload them now that the watcher reports later ones.
+    std::vector<std::string> changed;
+    std::error_code ec;
+    for (const std::string &path : FilterSnapshot::ExpandSources({dir}))
+    {
+        if (fs::last_write_time(path, ec) >= changed_since && !ec)
+            changed.push_back(path);
+    }
+    if (!changed.empty())
+        ReloadLists(changed);
     return true;
 }
 
-int AdBlocker::LoadBlocklistsInDirectory(const std::string &dir_path)
+void AdBlocker::ReloadLists(const std::vector<std::string> &paths)
 {
-    int count = 0;
-#if __cplusplus >= 201703L
-    try
+    namespace fs = std::filesystem;
+    auto parse = [](const std::string &path) -> FilterSet::EnginePtr
+    {
+        auto engine = std::make_shared<FilterEngine>();
+        if (FilterLoader().Load({path}, *engine) == 0 || engine->rule_count() == 0)
+            return nullptr; // deleted or empty: drop the layer
+        OptimizeAndBuild(*engine);
+        return engine;
+    };
+    // Paths are formed as the watcher and FilterSnapshot::ExpandSources() form them.
+    auto in_watched_dir = [this](const std::string &path)
     {
-        for (const auto &entry : std::filesystem::directory_iterator(dir_path))
+        return !watched_dir_.empty() && fs::path(watched_dir_) / fs::path(path).filename() == fs::path(path);
+    };
+
+    const uint64_t epoch = CurrentEpoch();
+    // Parse outside the lock; retry if another writer publishes meanwhile.
+    for (;;)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        const RuleSetPtr current = rules();
+        const FilterSet &set = current->filters;
+        std::vector<std::string> layer_paths = paths;
+
+        // Rules of a changed file that sits in the merged base cannot be taken
+        // out of it: rebuild the base without the watched directory's files
+        // (once) and give each of those files its own layer.
+        FilterSet::EnginePtr new_base;
+        std::vector<std::string> kept;
+        bool split = std::any_of(paths.begin(), paths.end(), [&](const std::string &p)
+                                 { return std::find(set.base_sources().begin(), set.base_sources().end(), p) !=
+                                          set.base_sources().end(); });
+        if (split)
         {
-            if (!entry.is_regular_file())
-                continue;
-            auto path = entry.path();
-            if (path.extension() == ".txt")
+            for (const auto &src : set.base_sources())
             {
-                if (LoadBlocklist(path.string(), true))
-                    ++count;
+                if (in_watched_dir(src) || std::find(paths.begin(), paths.end(), src) != paths.end())
+                    layer_paths.push_back(src);
+                else
+                    kept.push_back(src);
             }
+            auto base = std::make_shared<FilterEngine>();
+            FilterLoader().Load(kept, *base);
+            OptimizeAndBuild(*base);
+            new_base = std::move(base);
         }
+        std::sort(layer_paths.begin(), layer_paths.end());
+        layer_paths.erase(std::unique(layer_paths.begin(), layer_paths.end()), layer_paths.end());
+        std::vector<FilterSet::EnginePtr> engines;
+        for (const auto &p : layer_paths)
+            engines.push_back(parse(p));
+
+        std::lock_guard<std::mutex> lock(write_mtx_);
+        if (epoch != clear_epoch_)
+            return; // cleared while parsing
+        if (rules() != current)
+            continue;
+        auto next = std::make_shared<RuleSet>();
+        next->filters = split ? set.WithBase(new_base, std::move(kept)) : set;
+        for (size_t i = 0; i < layer_paths.size(); ++i)
+            next->filters = next->filters.WithLayer(layer_paths[i], engines[i]);
+        Publish(std::move(next));
+        std::fprintf(stderr, "AdBlock: reloaded %zu list(s)%s in %.1f ms\n", layer_paths.size(),
+                     split ? " (split from base)" : "",
+                     std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+        return;
     }
-    catch (...)
-    {
-        // ignore directory errors
-    }
-#endif
-    return count;
 }
 
 void AdBlocker::Clear()
 {
-    std::lock_guard<std::mutex> lock(mtx_);
-    blocked_hosts_.clear();
-    url_substrings_.clear();
+    std::lock_guard<std::mutex> lock(write_mtx_);
+    ++clear_epoch_;
+    Publish(std::make_shared<RuleSet>());
 }
 
-bool AdBlocker::OnNetworkRequest(View * /*caller*/, NetworkRequest &request)
+FilterAction AdBlocker::Evaluate(const FilterRequest &request, MatchedRule &rule)
 {
-    // If disabled, allow all traffic
+    const RequestContext &ctx = request.ctx;
+    const std::string_view host = ctx.host;
+    // The snapshot stays alive for this request even if a reload publishes a new one.
+    const RuleSetPtr rules = this->rules();
+    ShadowList *shadow = request.profiling ? nullptr : rules->shadow.get();
+    const auto start = shadow ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+
+    // Most requests go to a handful of hosts; remember their host-level verdict.
+    bool host_blocked = false;
+    if (!host.empty() && !host_cache_.Lookup(host, rules->generation, host_blocked))
     {
-        std::lock_guard<std::mutex> lock(mtx_);
-        if (!enabled_)
-            return true;
+        host_blocked = rules->filters.IsBlockedHost(host);
+        host_cache_.Insert(host, rules->generation, host_blocked);
     }
-    // Always allow file/data schemes and about:blank, etc.
-    auto proto = request.urlProtocol().utf8();
-    if (proto == "file" || proto == "data" || proto == "about")
-        return true;
-
-    auto host_ul = request.urlHost();
-    auto url_ul = request.url();
-    auto host = ToLower(std::string(host_ul.utf8().data()));
-    auto url = ToLower(std::string(url_ul.utf8().data()));
 
+    const FilterVerdict verdict = rules->filters.Match(ctx, host_blocked);
+    if (shadow)
     {
-        std::lock_guard<std::mutex> lock(mtx_);
-        if (!host.empty() && IsBlockedHost(host))
-        {
-            if (log_blocked_)
-                std::fprintf(stderr, "AdBlock: blocked host: %s\n", host.c_str());
-            return false; // Block by domain
-        }
-        if (!url.empty() && IsBlockedURL(url))
-        {
-            if (log_blocked_)
-                std::fprintf(stderr, "AdBlock: blocked url: %s\n", url.c_str());
-            return false; // Block by simple substring
-        }
+        // Matched and recorded, never enforced
+        const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+        shadow->Evaluate(ctx, rules->filters, verdict, (uint64_t)ns.count());
+    }
+    if (verdict == FilterVerdict::Allow)
+        return FilterAction::None;
+    // A reload may free this rule set once we return, so hand out a copy of
+    // the rule's text, in a buffer the thread reuses.
+    rule = MatchedRule();
+    MatchedRule matched;
+    if (rules->filters.Explain(ctx, verdict, matched))
+    {
+        thread_local std::string text;
+        text.assign(matched.text.data(), matched.text.size());
+        rule.kind = matched.kind;
+        rule.text = text;
     }
+    return IsBlocking(verdict) ? FilterAction::Block : FilterAction::Excepted;
+}
+
+void AdBlocker::ProfileRules(std::string_view url, FilterStats &stats)
+{
+    const RuleSetPtr rules = this->rules();
+    rules->filters.ProfileGlobs(url, [&stats](const MatchedRule &glob, uint64_t ns)
+                                { stats.RecordCost(glob, ns); });
+}
 
-    return true; // Allow
+bool AdBlocker::LoadShadowList(const std::string &path)
+{
+    auto engine = std::make_shared<FilterEngine>();
+    if (FilterLoader().Load({path}, *engine) == 0)
+        return false;
+    OptimizeAndBuild(*engine);
+    const size_t rule_count = engine->rule_count();
+    std::lock_guard<std::mutex> lock(write_mtx_);
+    shadow_ = std::make_shared<ShadowList>(path, std::move(engine));
+    Publish(std::make_shared<RuleSet>(*rules()));
+    std::fprintf(stderr, "AdBlock: %s: shadow-evaluating %s (%zu rules, not enforced)\n", name_.c_str(), path.c_str(),
+                 rule_count);
+    return true;
 }
 
-void AdBlocker::AddBlockedHost(const std::string &host_raw)
+void AdBlocker::ClearShadowList()
 {
-    std::string h = ToLower(Trim(host_raw));
-    if (h.empty())
+    std::lock_guard<std::mutex> lock(write_mtx_);
+    if (!shadow_)
         return;
-    // strip leading dots
-    while (!h.empty() && h.front() == '.')
-        h.erase(h.begin());
-    blocked_hosts_.insert(h);
+    shadow_.reset();
+    Publish(std::make_shared<RuleSet>(*rules()));
 }
 
-void AdBlocker::AddURLSubstring(const std::string &needle_raw)
+std::string AdBlocker::ShadowReportJSON() const
 {
-    std::string n = ToLower(Trim(needle_raw));
-    if (n.empty())
-        return;
-    url_substrings_.push_back(n);
+    const RuleSetPtr rules = this->rules();
+    return rules->shadow ? rules->shadow->Collect().ToJSON() : "{}";
 }
 
-void AdBlocker::AddURLGlob(const std::string &pattern_raw)
+bool AdBlocker::WriteShadowReport(const std::string &path) const
 {
-    std::string p = ToLower(Trim(pattern_raw));
-    if (p.empty())
-        return;
-    url_globs_.push_back(p);
+    const RuleSetPtr rules = this->rules();
+    return rules->shadow && rules->shadow->WriteReport(path);
 }
 
-bool AdBlocker::IsBlockedHost(const std::string &host) const
+std::string AdBlocker::CosmeticStylesheet()
 {
-    for (const auto &rule : blocked_hosts_)
-    {
-        if (ends_with_dot_or_exact(host, rule))
-            return true;
-    }
-    return false;
+    const RuleSetPtr rules = this->rules();
+    std::vector<std::string_view> generic = rules->filters.GenericHidingSelectors();
+    std::lock_guard<std::mutex> lock(cosmetic_mtx_);
+    installed_generic_.clear();
+    for (std::string_view sel : generic)
+        installed_generic_.emplace(sel);
+    late_generic_generation_ = rules->generation;
+    late_generic_css_.clear();
+    return CosmeticFilterIndex::Stylesheet(generic);
 }
 
-bool AdBlocker::IsBlockedURL(const std::string &url) const
+std::string AdBlocker::CosmeticStylesheetForHost(const std::string &host)
 {
-    for (const auto &needle : url_substrings_)
-    {
-        if (url.find(needle) != std::string::npos)
-            return true;
-    }
-    for (const auto &glob : url_globs_)
+    if (!enabled())
+        return {};
+    const RuleSetPtr rules = this->rules();
+    std::string css = CosmeticFilterIndex::Stylesheet(rules->filters.HidingSelectorsForHost(FilterEngine::ToLower(host)));
+
+    // Generic rules from lists loaded after startup (background load, hot reload)
+    std::lock_guard<std::mutex> lock(cosmetic_mtx_);
+    if (late_generic_generation_ != rules->generation)
     {
-        if (GlobMatch(url.c_str(), glob.c_str()))
-            return true;
+        std::vector<std::string_view> late;
+        for (std::string_view sel : rules->filters.GenericHidingSelectors())
+        {
+            if (!installed_generic_.count(std::string(sel)))
+                late.push_back(sel);
+        }
+        late_generic_css_ = CosmeticFilterIndex::Stylesheet(late);
+        late_generic_generation_ = rules->generation;
     }
-    return false;
+    return late_generic_css_ + css;
 }
 
-std::string AdBlocker::ToLower(std::string s)
+void AdBlocker::AddBlockedHost(const std::string &host)
 {
-    std::transform(s.begin(), s.end(), s.begin(), [](unsigned char c)
-                   { return (char)std::tolower(c); });
-    return s;
+    Update([&](FilterEngine &engine)
+           { engine.AddBlockedHost(host); });
 }
 
-std::string AdBlocker::Trim(const std::string &s)
+void AdBlocker::AddURLSubstring(const std::string &needle)
 {
-    size_t start = s.find_first_not_of(" \t\r\n");
-    if (start == std::string::npos)
-        return "";
-    size_t end = s.find_last_not_of(" \t\r\n");
-    return s.substr(start, end - start + 1);
+    Update([&](FilterEngine &engine)
+           { engine.AddURLSubstring(needle); });
 }
 
-// Very simple glob matcher supporting '*' and '?'
-bool AdBlocker::GlobMatch(const char *text, const char *pattern)
+void AdBlocker::AddURLGlob(const std::string &pattern)
 {
-    // Based on recursive backtracking; fine for small pattern counts
-    if (!pattern || !text)
-        return false;
-    const char *p = pattern;
-    const char *t = text;
-    const char *star = nullptr;
-    const char *star_text = nullptr;
-    while (*t)
-    {
-        if (*p == '?' || *p == *t)
-        {
-            ++p;
-            ++t;
-            continue;
-        }
-        if (*p == '*')
-        {
-            star = p++;
-            star_text = t;
-            continue;
-        }
-        if (star)
-        {
-            p = star + 1;
-            t = ++star_text;
-            continue;
-        }
-        return false;
-    }
-    while (*p == '*')
-        ++p;
-    return *p == '\0';
+    Update([&](FilterEngine &engine)
+           { engine.AddURLGlob(pattern); });
 }
@@ -1,30 +1,63 @@
 #pragma once
-#include <Ultralight/Listener.h>
-#include <Ultralight/NetworkRequest.h>
-#include <unordered_set>
 #include <vector>
 #include <string>
 #include <mutex>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <unordered_set>
+#include <filesystem>
 
-// Basic ad/tracker blocker implementing Ultralight's NetworkListener.
+#include "DirectoryWatcher.h"
+#include "FilterEngine.h"
+#include "FilterSet.h"
+#include "HostVerdictCache.h"
+#include "RequestFilter.h"
+#include "ShadowList.h"
+
+// One rule-list engine of the FilterPipeline (the bundled ad lists, the
+// tracker lists), with its own rule set, lock and caches.
 //
 // Features:
-// - Domain-based blocking from a simple hosts/filter list
-// - Optional URL-substring rules (very simple)
-// - Allows file:// and data:// schemes unconditionally
+// - Domain-based blocking from hosts files and filter lists
+// - URL substring/glob rules and Adblock Plus network rules (see FilterEngine)
+//
+// Rules live in an immutable FilterSet snapshot. Requests load the current
+// snapshot pointer and match against it without taking a lock; list changes
+// build new engines off to the side and publish them with one atomic store, so
+// a reload never stalls in-flight requests. Lists are parsed in parallel by a
+// FilterLoader before the lock is taken.
+//
+// A watched directory's lists are reloaded when they change on disk. Each
+// changed file gets its own FilterSet layer, so a reload parses and indexes
+// only that file; the first change to a file that was loaded into the merged
+// base (eg, from a snapshot) splits the directory's files out once.
+//
+// Host-level verdicts are memoized in a HostVerdictCache keyed by the rule-set
+// generation, which every publish bumps, so a reload invalidates the cache.
+//
+// Element hiding rules are applied as CSS: the generic ones as one stylesheet
+// installed for every page at startup (Config::user_stylesheet), the
+// site-specific ones injected into each page once its DOM is ready.
 //
-// Blocklist format (any of the following per line):
-// - "example.com"              (blocks example.com and all subdomains)
-// - "0.0.0.0 example.com"     (hosts file style; ignores IP)
-// - "127.0.0.1 example.com"   (hosts file style; ignores IP)
-// - "||example.com^"          (Adblock-style domain rule; ^ terminator optional)
-// - "*ads.js"                 (treated as a simple URL substring match)
-// - Lines starting with '#' are comments; blank lines ignored.
-class AdBlocker : public ultralight::NetworkListener
+// On requests the pipeline samples, each candidate glob rule is timed
+// (ProfileRules()), so costly globs show up in the pipeline's report.
+//
+// A candidate list can be loaded in shadow mode (LoadShadowList()): every
+// request that reaches the engine is also matched against it, never enforced,
+// and a ShadowList records which verdicts it would change and the time it
+// would add.
+class AdBlocker : public RequestFilter
 {
 public:
-    AdBlocker() = default;
-    ~AdBlocker() override = default;
+    // name tells the engine apart in reports ("ads", "trackers").
+    explicit AdBlocker(std::string name = "ads") : name_(std::move(name)) {}
+    ~AdBlocker() override;
+
+    const char *name() const override { return name_.c_str(); }
+    // Block, or Excepted when one of this engine's "@@" rules overrides the block.
+    FilterAction Evaluate(const FilterRequest &request, MatchedRule &rule) override;
+    void ProfileRules(std::string_view url, FilterStats &stats) override;
 
     // Load a blocklist from the given file path. When append=false, clears existing rules first.
     bool LoadBlocklist(const std::string &path, bool append = false);
@@ -36,12 +69,48 @@ public:
     // Returns count of files successfully loaded.
     int LoadBlocklistsInDirectory(const std::string &dir_path);
 
+    // Parse list files and directories on a background thread and append their
+    // rules once done. Requests are filtered by the current rules meanwhile, so
+    // load the essential list synchronously first. A Clear() issued before the
+    // load finishes discards its result.
+    void LoadBlocklistsInBackground(const std::vector<std::string> &sources);
+
+    // Replace all rules with a precompiled snapshot (see tools/adblock_compile)
+    // built from sources (list files and directories, as passed to the tool).
+    // Returns false, leaving the rules untouched, when the snapshot is missing,
+    // unreadable or older than the sources; callers then load the text lists.
+    bool LoadSnapshot(const std::string &snapshot_path, const std::vector<std::string> &sources);
+
+    // Reload the .txt lists of dir whenever one of them is written, renamed
+    // into place or deleted (see DirectoryWatcher). Returns false when the
+    // directory cannot be watched. One directory at a time. While a
+    // background load is running, watching starts once it has published, and
+    // lists changed during the load are reloaded then.
+    bool WatchBlocklistDirectory(const std::string &dir);
+
+    // Re-parse the given list files of the watched directory and swap them in;
+    // a deleted file drops its rules. Called by the directory watcher.
+    void ReloadLists(const std::vector<std::string> &paths);
+
     // Clear all rules
     void Clear();
 
-    // NetworkListener override
-    bool OnNetworkRequest(ultralight::View *caller, ultralight::NetworkRequest &request) override;
+    // Evaluate the rules of the list at path on every request alongside the
+    // active ones, without enforcing them (see ShadowList); replaces any
+    // earlier candidate. Returns false when the list cannot be read.
+    bool LoadShadowList(const std::string &path);
+    // Stop shadow-evaluating; the report so far is dropped.
+    void ClearShadowList();
+    bool has_shadow_list() const { return rules()->shadow != nullptr; }
+    // The candidate's verdict differences and cost so far (see
+    // ShadowList::Report::ToJSON); "{}" without a candidate.
+    std::string ShadowReportJSON() const;
+    // Write ShadowReportJSON() to path. False without a candidate or when the
+    // file cannot be written.
+    bool WriteShadowReport(const std::string &path) const;
 
+    // Rules added below live in their own small layer, so each call rebuilds
+    // only them.
     // Add a blocked host (suffix-match, case-insensitive)
     void AddBlockedHost(const std::string &host);
 
@@ -50,39 +119,74 @@ public:
     // Add a simple glob pattern (supports '*' wildcard), case-insensitive
     void AddURLGlob(const std::string &pattern);
 
-    // Enable/disable blocking at runtime
-    void set_enabled(bool enabled)
-    {
-        std::lock_guard<std::mutex> lock(mtx_);
-        enabled_ = enabled;
-    }
-    bool enabled() const
-    {
-        std::lock_guard<std::mutex> lock(mtx_);
-        return enabled_;
-    }
-
-private:
-    bool IsBlockedHost(const std::string &host) const;
-    bool IsBlockedURL(const std::string &url) const;
-    static bool GlobMatch(const char *text, const char *pattern);
+    // CSS hiding the generic element hiding rules' selectors, for
+    // Config::user_stylesheet. That sheet is fixed once the app is created, so
+    // generic rules loaded later are served by CosmeticStylesheetForHost().
+    std::string CosmeticStylesheet();
+    // CSS to inject into a page of host: its site-specific element hiding
+    // rules, plus generic ones missing from the startup sheet. Empty while
+    // the engine is disabled.
+    std::string CosmeticStylesheetForHost(const std::string &host);
 
-    static std::string ToLower(std::string s);
-    static std::string Trim(const std::string &s);
+    // Hit/miss counts of the per-host verdict cache.
+    HostVerdictCache::Stats host_cache_stats() const { return host_cache_.stats(); }
 
-    // Data structures
-    std::unordered_set<std::string> blocked_hosts_; // host suffixes in lowercase (eg, "doubleclick.net")
-    std::vector<std::string> url_substrings_;       // lowercase substrings
-    std::vector<std::string> url_globs_;            // lowercase glob patterns with '*'
+private:
+    // A published rule set and the generation its cached verdicts are tagged with.
+    struct RuleSet
+    {
+        FilterSet filters;
+        std::shared_ptr<ShadowList> shadow; // candidate list, or null
+        uint32_t generation = 0;
+    };
+    static constexpr const char *kManualLayer = "<manual>"; // AddBlockedHost() etc.
+    using RuleSetPtr = std::shared_ptr<const RuleSet>;
 
-    mutable std::mutex mtx_;
-    bool enabled_ = true;
-    bool log_blocked_ = false;
+    RuleSetPtr rules() const { return std::atomic_load_explicit(&rules_, std::memory_order_acquire); }
+    // Caller holds write_mtx_. The current candidate list carries over.
+    void Publish(std::shared_ptr<RuleSet> next)
+    {
+        next->shadow = shadow_;
+        next->generation = ++generation_;
+        std::atomic_store_explicit(&rules_, RuleSetPtr(std::move(next)), std::memory_order_release);
+    }
+    uint64_t CurrentEpoch();
+    // Merge parsed rules (read from sources) into the base, or make them the
+    // whole rule set when from_empty, unless a Clear() happened since epoch; publishes.
+    void MergeParsed(FilterEngine &&parsed, std::vector<std::string> sources, bool from_empty, uint64_t epoch);
+    // Start watcher_ on dir and reload its lists written at or after changed_since.
+    bool StartWatching(const std::string &dir, std::filesystem::file_time_type changed_since);
 
-public:
-    void set_log_blocked(bool v)
+    // Copy the manual layer (or start empty), apply edit to it, build and publish it.
+    template <typename Fn>
+    void Update(Fn &&edit)
     {
-        std::lock_guard<std::mutex> l(mtx_);
-        log_blocked_ = v;
+        std::lock_guard<std::mutex> lock(write_mtx_);
+        RuleSetPtr current = rules();
+        const FilterEngine *manual = current->filters.layer(kManualLayer);
+        auto engine = manual ? std::make_shared<FilterEngine>(*manual) : std::make_shared<FilterEngine>();
+        edit(*engine);
+        engine->Build();
+        auto next = std::make_shared<RuleSet>();
+        next->filters = current->filters.WithLayer(kManualLayer, std::move(engine));
+        Publish(std::move(next));
     }
+
+    RuleSetPtr rules_ = std::make_shared<RuleSet>(); // read with atomic_load only
+    std::mutex write_mtx_;                           // serializes writers; never taken per request
+    uint32_t generation_ = 0;                        // guarded by write_mtx_
+    uint64_t clear_epoch_ = 0;                       // guarded by write_mtx_; bumped by Clear()
+    std::shared_ptr<ShadowList> shadow_;             // guarded by write_mtx_
+    std::thread background_load_;
+    bool background_loading_ = false;                // guarded by write_mtx_
+    std::string deferred_watch_;                     // guarded by write_mtx_; watched once the load publishes
+    std::mutex watch_mtx_;                           // serializes starting and stopping watcher_
+    DirectoryWatcher watcher_;
+    std::string watched_dir_; // guarded by watch_mtx_; set before watcher_ starts, which reads it
+    HostVerdictCache host_cache_;
+    std::mutex cosmetic_mtx_;                           // guards the members below
+    std::unordered_set<std::string> installed_generic_; // selectors in CosmeticStylesheet()
+    uint32_t late_generic_generation_ = 0;              // rule set late_generic_css_ was made for
+    std::string late_generic_css_;                      // generic selectors not in installed_generic_
+    const std::string name_;
 };
@@ -0,0 +1,186 @@
+#include "AhoCorasick.h"
+
+#include <cstring>
+
+void AhoCorasick::Clear()
+{
+    classes_ = 0;
+    std::memset(byte_class_, 0, sizeof(byte_class_));
+    table_.clear();
+    accept_.clear();
+    snap_ = {};
+    attached_ = false;
+}
+
+void AhoCorasick::Build(const std::vector<std::string> &patterns)
+{
+    Build(std::vector<std::string_view>(patterns.begin(), patterns.end()));
+}
+
+void AhoCorasick::Build(const StringArena &patterns)
+{
+    std::vector<std::string_view> views;
+    views.reserve(patterns.size());
+    for (uint32_t id = 0; id < patterns.size(); ++id)
+        views.push_back(patterns.Get(id));
+    Build(views);
+}
+
+void AhoCorasick::Build(const std::vector<std::string_view> &patterns)
+{
+    Clear();
+
+    // Assign byte classes; class 0 is shared by every byte no pattern uses.
+    classes_ = 1;
+    for (std::string_view p : patterns)
+    {
+        for (unsigned char c : p)
+        {
+            if (byte_class_[c] == 0)
+                byte_class_[c] = (uint16_t)classes_++;
+        }
+    }
+
+    // Build the trie directly into the dense table. While building, 0 means
+    // "no edge" (the root is never a trie child).
+    auto add_state = [this]() -> uint32_t
+    {
+        table_.resize(table_.size() + classes_, 0);
+        accept_.push_back(0);
+        return (uint32_t)accept_.size() - 1;
+    };
+    add_state(); // root
+    bool any = false;
+    for (size_t id = 0; id < patterns.size(); ++id)
+    {
+        std::string_view p = patterns[id];
+        if (p.empty())
+            continue;
+        any = true;
+        uint32_t s = 0;
+        for (unsigned char c : p)
+        {
+            uint32_t &next = table_[(size_t)s * classes_ + byte_class_[c]];
+            if (next == 0)
+            {
+                uint32_t created = add_state(); // may reallocate table_
+                table_[(size_t)s * classes_ + byte_class_[c]] = created;
+                s = created;
+            }
+            else
+            {
+                s = next;
+            }
+        }
+        if (accept_[s] == 0)
+            accept_[s] = (uint32_t)id + 1;
+    }
+    if (!any)
+    {
+        Clear();
+        return;
+    }
+
+    // Breadth-first pass turns the trie into a full DFA: missing edges are
+    // resolved through failure links, and accept ids are inherited from the
+    // longest proper suffix state.
+    std::vector<uint32_t> fail(accept_.size(), 0);
+    std::vector<uint32_t> queue;
+    queue.reserve(accept_.size());
+    for (uint32_t c = 0; c < classes_; ++c)
+    {
+        uint32_t t = table_[c];
+        if (t != 0)
+            queue.push_back(t); // depth-1 states fail to root
+    }
+    for (size_t qi = 0; qi < queue.size(); ++qi)
+    {
+        uint32_t s = queue[qi];
+        if (accept_[s] == 0)
+            accept_[s] = accept_[fail[s]];
+        uint32_t *row = &table_[(size_t)s * classes_];
+        const uint32_t *fail_row = &table_[(size_t)fail[s] * classes_];
+        for (uint32_t c = 0; c < classes_; ++c)
+        {
+            if (row[c] != 0)
+            {
+                fail[row[c]] = fail_row[c];
+                queue.push_back(row[c]);
+            }
+            else
+            {
+                row[c] = fail_row[c];
+            }
+        }
+    }
+}
+
+uint32_t AhoCorasick::Find(std::string_view text) const
+{
+    if (empty())
+        return 0;
+    const uint32_t *table = attached_ ? snap_.table : table_.data();
+    const uint32_t *accept = attached_ ? snap_.accept : accept_.data();
+    const size_t width = classes_;
+    uint32_t s = 0;
+    for (unsigned char c : text)
+    {
+        s = table[(size_t)s * width + byte_class_[c]];
+        if (accept[s])
+            return accept[s];
+    }
+    return 0;
+}
+
+namespace
+{
+    // Layout of the kSubstringClasses section.
+    struct ClassHeader
+    {
+        uint32_t classes;
+        uint16_t byte_class[256];
+    };
+}
+
+void AhoCorasick::Save(FilterSnapshot::Writer &out) const
+{
+    ClassHeader header = {};
+    header.classes = classes_;
+    std::memcpy(header.byte_class, byte_class_, sizeof(byte_class_));
+    out.Add(FilterSnapshot::kSubstringClasses, &header, sizeof(header));
+    const size_t states = state_count();
+    out.Add(FilterSnapshot::kSubstringTable, attached_ ? snap_.table : table_.data(),
+            states * classes_ * sizeof(uint32_t));
+    out.Add(FilterSnapshot::kSubstringAccept, attached_ ? snap_.accept : accept_.data(), states * sizeof(uint32_t));
+}
+
+bool AhoCorasick::Attach(const FilterSnapshot &snapshot)
+{
+    std::string_view head = snapshot.Bytes(FilterSnapshot::kSubstringClasses);
+    size_t cells = 0, states = 0;
+    const uint32_t *table = snapshot.Array<uint32_t>(FilterSnapshot::kSubstringTable, cells);
+    const uint32_t *accept = snapshot.Array<uint32_t>(FilterSnapshot::kSubstringAccept, states);
+    if (head.size() != sizeof(ClassHeader))
+        return false;
+    ClassHeader header;
+    std::memcpy(&header, head.data(), sizeof(header));
+    // Shape checks only (see HostMatcher::Attach).
+    if (header.classes > 257 || (size_t)states * header.classes != cells)
+        return false;
+    for (uint16_t c : header.byte_class)
+    {
+        if (c >= header.classes && states != 0)
+            return false;
+    }
+
+    Clear();
+    if (states == 0)
+        return true;
+    classes_ = header.classes;
+    std::memcpy(byte_class_, header.byte_class, sizeof(byte_class_));
+    snap_.table = table;
+    snap_.accept = accept;
+    snap_.states = states;
+    attached_ = true;
+    return true;
+}
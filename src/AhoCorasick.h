@@ -0,0 +1,63 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "FilterSnapshot.h"
+#include "StringArena.h"
+
+// Multi-pattern substring matcher (Aho-Corasick) compiled to a dense DFA.
+//
+// Input bytes are first mapped to equivalence classes (one class per distinct
+// byte used by the patterns, plus a shared class for everything else), which
+// keeps each row of the transition table small. Rows are stored back to back in
+// one flat array, so scanning a URL is a single pass of table lookups with no
+// pointer chasing, no matter how many patterns are loaded.
+//
+// The compiled table can be saved into a FilterSnapshot and later used in place
+// from the mapped file.
+//
+// Immutable after Build(); concurrent Matches() calls are safe.
+class AhoCorasick
+{
+public:
+    AhoCorasick() = default;
+
+    // Compile the automaton from lowercase patterns. Empty patterns are ignored.
+    void Build(const std::vector<std::string_view> &patterns);
+    void Build(const std::vector<std::string> &patterns);
+    // Pattern ids are the arena's string ids.
+    void Build(const StringArena &patterns);
+    void Clear();
+
+    // True when any pattern occurs in text.
+    bool Matches(std::string_view text) const { return Find(text) != 0; }
+    // 1-based index (into the Build() patterns) of the first pattern found in
+    // text, 0 when none occurs.
+    uint32_t Find(std::string_view text) const;
+
+    bool empty() const { return state_count() == 0; }
+    size_t state_count() const { return attached_ ? snap_.states : accept_.size(); }
+    size_t memory_bytes() const { return state_count() * (classes_ + 1) * sizeof(uint32_t); }
+
+    // Write the automaton into a snapshot / use a snapshot's copy in place.
+    // The snapshot must outlive this matcher or the next Build()/Clear().
+    void Save(FilterSnapshot::Writer &out) const;
+    bool Attach(const FilterSnapshot &snapshot);
+
+private:
+    uint32_t classes_ = 0;           // row width
+    uint16_t byte_class_[256] = {};  // byte -> class, 0 for bytes absent from all patterns
+    std::vector<uint32_t> table_;    // table_[state * classes_ + class] -> next state
+    std::vector<uint32_t> accept_;   // 1-based id of a pattern ending at this state (or at a suffix of it)
+
+    // Borrowed table_/accept_, used while attached_.
+    struct
+    {
+        const uint32_t *table = nullptr;
+        const uint32_t *accept = nullptr;
+        size_t states = 0;
+    } snap_;
+    bool attached_ = false;
+};
@@ -0,0 +1,100 @@
+#include "BloomFilter.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+    // Layout of the kHostBloom section: this header, then the blocks.
+    struct BloomHeader
+    {
+        uint64_t block_count;
+        uint32_t k;
+        uint32_t unused;
+    };
+}
+
+void BloomFilter::Init(size_t expected_keys, double false_positive_rate)
+{
+    Clear();
+    false_positive_rate = std::min(std::max(false_positive_rate, 1e-6), 0.5);
+    const double ln2 = 0.6931471805599453;
+    // Classic optimum bits per key, plus ~20% to make up for blocking.
+    const double bits_per_key = -std::log(false_positive_rate) / (ln2 * ln2) * 1.2;
+    const double bits = std::max(1.0, (double)expected_keys) * bits_per_key;
+
+    block_count_ = 1;
+    while ((double)(block_count_ * kWordsPerBlock * 64) < bits)
+        block_count_ <<= 1;
+    k_ = (uint32_t)std::min(16.0, std::max(1.0, std::round(bits_per_key / 1.2 * ln2)));
+    blocks_.assign(block_count_ * kWordsPerBlock, 0);
+}
+
+void BloomFilter::Clear()
+{
+    blocks_.clear();
+    block_count_ = 0;
+    k_ = 0;
+    snap_ = {};
+    attached_ = false;
+}
+
+void BloomFilter::Insert(uint64_t hash)
+{
+    Detach();
+    if (blocks_.empty())
+        return;
+    uint64_t m = Mix(hash);
+    uint64_t *block = blocks_.data() + (m & (block_count_ - 1)) * kWordsPerBlock;
+    uint32_t a = (uint32_t)(m >> 32) & kBlockMask;
+    uint32_t d = ((uint32_t)(m >> 41) & kBlockMask) | 1;
+    for (uint32_t i = 0; i < k_; ++i)
+    {
+        uint32_t bit = (a + i * d) & kBlockMask;
+        block[bit >> 6] |= 1ull << (bit & 63);
+    }
+}
+
+void BloomFilter::Save(FilterSnapshot::Writer &out) const
+{
+    BloomHeader header = {};
+    header.block_count = block_count_;
+    header.k = k_;
+    std::string bytes(reinterpret_cast<const char *>(&header), sizeof(header));
+    const uint64_t *words = attached_ ? snap_.words : blocks_.data();
+    bytes.append(reinterpret_cast<const char *>(words), memory_bytes());
+    out.Add(FilterSnapshot::kHostBloom, bytes.data(), bytes.size());
+}
+
+bool BloomFilter::Attach(const FilterSnapshot &snapshot)
+{
+    std::string_view bytes = snapshot.Bytes(FilterSnapshot::kHostBloom);
+    if (bytes.size() < sizeof(BloomHeader))
+        return false;
+    BloomHeader header;
+    std::memcpy(&header, bytes.data(), sizeof(header));
+    const size_t block_count = (size_t)header.block_count;
+    if ((block_count & (block_count - 1)) != 0 || header.k > 16 ||
+        bytes.size() != sizeof(BloomHeader) + block_count * kWordsPerBlock * sizeof(uint64_t))
+        return false;
+
+    Clear();
+    if (block_count == 0)
+        return true;
+    block_count_ = block_count;
+    k_ = header.k;
+    snap_.words = reinterpret_cast<const uint64_t *>(bytes.data() + sizeof(BloomHeader));
+    attached_ = true;
+    return true;
+}
+
+// Copy borrowed snapshot bits into owned storage before mutating.
+void BloomFilter::Detach()
+{
+    if (!attached_)
+        return;
+    blocks_.assign(snap_.words, snap_.words + block_count_ * kWordsPerBlock);
+    snap_ = {};
+    attached_ = false;
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "FilterSnapshot.h"
+
+// Blocked Bloom filter over 64-bit key hashes.
+//
+// Every key maps to one 512-bit block (a single cache line) and sets k bits
+// inside it, so a negative answer costs one line read no matter how many keys
+// were inserted. Blocking costs a little accuracy; Init() sizes the bit array
+// with that in mind. MayContain() never returns false for an inserted key.
+class BloomFilter
+{
+public:
+    // Size for expected_keys at the given false-positive rate and drop all keys.
+    void Init(size_t expected_keys, double false_positive_rate);
+    void Clear();
+
+    void Insert(uint64_t hash);
+    // An empty (uninitialized) filter answers true for everything.
+    bool MayContain(uint64_t hash) const
+    {
+        const uint64_t *words = attached_ ? snap_.words : blocks_.data();
+        if (!words)
+            return true;
+        uint64_t m = Mix(hash);
+        const uint64_t *block = words + (m & (block_count_ - 1)) * kWordsPerBlock;
+        uint32_t a = (uint32_t)(m >> 32) & kBlockMask;
+        uint32_t d = ((uint32_t)(m >> 41) & kBlockMask) | 1;
+        for (uint32_t i = 0; i < k_; ++i)
+        {
+            uint32_t bit = (a + i * d) & kBlockMask;
+            if (!((block[bit >> 6] >> (bit & 63)) & 1))
+                return false;
+        }
+        return true;
+    }
+
+    size_t memory_bytes() const { return block_count_ * kWordsPerBlock * sizeof(uint64_t); }
+    uint32_t hash_count() const { return k_; }
+
+    // Snapshot support (see HostMatcher::Save / Attach).
+    void Save(FilterSnapshot::Writer &out) const;
+    bool Attach(const FilterSnapshot &snapshot);
+    void Detach();
+
+private:
+    static constexpr size_t kWordsPerBlock = 8; // 512 bits
+    static constexpr uint32_t kBlockMask = 511;
+
+    // Spread FNV bits before deriving the block and bit positions.
+    static uint64_t Mix(uint64_t h)
+    {
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdull;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ull;
+        h ^= h >> 33;
+        return h;
+    }
+
+    std::vector<uint64_t> blocks_;
+    size_t block_count_ = 0; // power of two
+    uint32_t k_ = 0;
+
+    // Borrowed bits, used while attached_.
+    struct
+    {
+        const uint64_t *words = nullptr;
+    } snap_;
+    bool attached_ = false;
+};
@@ -5,7 +5,7 @@
 #include <Ultralight/Renderer.h>
 #include <memory>
 
-#include "AdBlocker.h"
+#include "ContentBlocker.h"
 
 #if defined(_WIN32)
 #include <windows.h>
@@ -19,6 +19,35 @@ Browser::Browser()
   Settings settings;
   Config config;
   config.scroll_timer_delay = 1.0 / 90.0;
+
+  // Initialize the content blocker: ad and tracker engines, each with its own lists
+  blocker_ = std::make_unique<ContentBlocker>();
+  AdBlocker &ads = blocker_->ads();
+  AdBlocker &trackers = blocker_->trackers();
+  // The build compiles the lists into snapshots; parse them only when one is stale.
+  if (!ads.LoadSnapshot("assets/adblock.snapshot", {"assets/blocklist.txt", "assets/filters"}))
+  {
+    // The essential list guards the first page load; the rest follows in the background.
+    ads.LoadBlocklist("assets/blocklist.txt", true);
+    ads.LoadBlocklistsInBackground({"assets/filters"});
+  }
+  if (!trackers.LoadSnapshot("assets/trackers.snapshot", {"assets/trackers"}))
+    trackers.LoadBlocklistsInBackground({"assets/trackers"});
+  // Edited filter lists take effect without a restart.
+  ads.WatchBlocklistDirectory("assets/filters");
+  trackers.WatchBlocklistDirectory("assets/trackers");
+  // Sites the user turned blocking off for (menu: "Block ads on this site").
+  blocker_->site_policy().LoadAllowlist("data/adblock_allowlist.txt");
+  // Settings > "Log blocked requests" writes decisions here (rotated to .1, .2).
+  blocker_->pipeline().SetRequestLogPath("data/adblock_requests.log");
+  // A candidate list saved as data/shadow/<engine>.txt is matched on every request
+  // but not enforced; what it would change is reported on exit.
+  for (AdBlocker *engine : {&ads, &trackers})
+    engine->LoadShadowList(std::string("data/shadow/") + engine->name() + ".txt");
+  // Generic element hiding rules apply to every page through the user stylesheet.
+  std::string cosmetic_css = blocker_->CosmeticStylesheet();
+  config.user_stylesheet = String(cosmetic_css.c_str());
+
   app_ = App::Create(settings, config);
 
   window_ = Window::Create(app_->main_monitor(), 1024, 768, false,
@@ -56,13 +85,7 @@ Browser::Browser()
 #endif
 
   // Create the UI
-  // Initialize ad/tracker blocker with default blocklist and additional filters
-  adblock_ = std::make_unique<AdBlocker>();
-  adblock_->Clear();
-  adblock_->LoadBlocklist("assets/blocklist.txt", true);
-  adblock_->LoadBlocklistsInDirectory("assets/filters");
-
-  ui_.reset(new UI(window_, adblock_.get(), adblock_.get()));
+  ui_.reset(new UI(window_, blocker_.get()));
   window_->set_listener(ui_.get());
 }
 
@@ -71,6 +94,10 @@ Browser::~Browser()
   window_->set_listener(nullptr);
 
   ui_.reset();
+  // Rule hit counts, filtering latency and per-engine costs of this session, for offline inspection.
+  blocker_->pipeline().WriteStats("data/adblock_stats.json");
+  for (AdBlocker *engine : {&blocker_->ads(), &blocker_->trackers()})
+    engine->WriteShadowReport(std::string("data/shadow/") + engine->name() + ".json");
 
   window_ = nullptr;
   app_ = nullptr;
@@ -1,8 +1,8 @@
 #include <AppCore/AppCore.h>
 #include "UI.h"
 
-// Forward-declare AdBlocker
-class AdBlocker;
+// Forward-declare ContentBlocker
+class ContentBlocker;
 
 using namespace ultralight;
 
@@ -18,5 +18,5 @@ protected:
   RefPtr<App> app_;
   RefPtr<Window> window_;
   std::unique_ptr<UI> ui_;
-  std::unique_ptr<AdBlocker> adblock_;
+  std::unique_ptr<ContentBlocker> blocker_;
 };
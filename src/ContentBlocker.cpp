@@ -0,0 +1,102 @@
+#include "ContentBlocker.h"
+
+#include <Ultralight/Ultralight.h>
+
+using namespace ultralight;
+
+ContentBlocker::ContentBlocker()
+{
+    site_policy_ = pipeline_.AddPolicy(std::make_unique<SitePolicy>());
+    ads_ = pipeline_.AddBlocker(std::make_unique<AdBlocker>("ads"));
+    trackers_ = pipeline_.AddBlocker(std::make_unique<AdBlocker>("trackers"));
+}
+
+bool ContentBlocker::OnNetworkRequest(View *caller, NetworkRequest &request)
+{
+    // Ultralight hands out one UTF-8 copy each of the URL and origin; everything
+    // below works on views of this thread's buffers and does not allocate.
+    thread_local RequestBuffer buffer;
+    const auto url_utf8 = request.url().utf8();
+    const auto origin_utf8 = request.httpOrigin().utf8();
+    const RequestContext &ctx = buffer.Parse(std::string_view(url_utf8.data(), url_utf8.length()),
+                                             std::string_view(origin_utf8.data(), origin_utf8.length()));
+    // Always allow file/data schemes and about:blank, etc.
+    const std::string_view scheme = buffer.scheme();
+    if (scheme == "file" || scheme == "data" || scheme == "about")
+        return true;
+
+    // If disabled, allow all traffic. The page host is only looked up if the
+    // site policy has to look at it.
+    const PageLookup page{this, caller, ctx, nullptr};
+    const bool allowed = !pipeline_.enabled() || pipeline_.Allow(FilterRequest(ctx, &PageHost, &page));
+    traffic_.Record(caller, ctx.host, !allowed);
+    return allowed;
+}
+
+template <typename Fn>
+void ContentBlocker::UpdatePages(Fn &&update)
+{
+    std::lock_guard<std::mutex> lock(pages_mtx_);
+    auto next = std::make_shared<PageMap>(*std::atomic_load_explicit(&pages_, std::memory_order_acquire));
+    update(*next);
+    std::atomic_store_explicit(&pages_, PageMapPtr(std::move(next)), std::memory_order_release);
+}
+
+void ContentBlocker::SetPageURL(const void *view, std::string_view url)
+{
+    const std::string_view host = url_util::HostFromURL(url);
+    std::string lower(host.size(), '\0');
+    url_util::LowerASCII(host, &lower[0]);
+    UpdatePages([&](PageMap &pages)
+                { pages[view].host = std::move(lower); });
+}
+
+void ContentBlocker::SetNavigationURL(const void *view, std::string_view url)
+{
+    // Requests carry no fragment.
+    url = url.substr(0, url.find('#'));
+    std::string lower(url.size(), '\0');
+    url_util::LowerASCII(url, &lower[0]);
+    UpdatePages([&](PageMap &pages)
+                { pages[view].navigation = std::move(lower); });
+}
+
+void ContentBlocker::OpenView(const void *view)
+{
+    traffic_.Open(view);
+}
+
+void ContentBlocker::ReleaseView(const void *view)
+{
+    UpdatePages([&](PageMap &pages)
+                { pages.erase(view); });
+    traffic_.Release(view);
+}
+
+std::string_view ContentBlocker::PageHost(const void *state)
+{
+    const PageLookup &lookup = *static_cast<const PageLookup *>(state);
+    // The snapshot stays in lookup for the rest of the request, so the host
+    // can be returned without a copy while the UI thread publishes new pages.
+    lookup.pages = std::atomic_load_explicit(&lookup.blocker->pages_, std::memory_order_acquire);
+    auto it = lookup.pages->find(lookup.view);
+    if (it == lookup.pages->end())
+        return {};
+    const Page &page = it->second;
+    // The tab's top-level load (navigations send no origin) is a page of its own host.
+    if (!lookup.ctx.has_origin && !page.navigation.empty() && page.navigation == lookup.ctx.url)
+        return lookup.ctx.host;
+    return page.host;
+}
+
+std::string ContentBlocker::CosmeticStylesheet()
+{
+    return ads_->CosmeticStylesheet() + trackers_->CosmeticStylesheet();
+}
+
+std::string ContentBlocker::CosmeticStylesheetForHost(const std::string &host)
+{
+    if (!pipeline_.enabled() || site_policy_->IsSiteAllowed(host))
+        return {};
+    return ads_->CosmeticStylesheetForHost(host) + trackers_->CosmeticStylesheetForHost(host);
+}
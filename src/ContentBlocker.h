@@ -0,0 +1,95 @@
+#pragma once
+#include <Ultralight/Listener.h>
+#include <Ultralight/NetworkRequest.h>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "AdBlocker.h"
+#include "FilterPipeline.h"
+#include "SitePolicy.h"
+#include "ViewTraffic.h"
+
+// The browser's request filter, installed as every tab's NetworkListener.
+//
+// Requests go through a FilterPipeline of independent engines, each with its
+// own rule set, lock and caches (Browser loads their lists):
+// - "site-policy" (SitePolicy): sites the user turned blocking off for
+// - "ads" (AdBlocker): ad server and URL pattern lists
+// - "trackers" (AdBlocker): analytics and tracking lists
+// The pipeline runs the two blocking engines cheapest-per-block first and
+// each can be turned off on its own (see RequestFilter::set_enabled).
+//
+// file://, data:// and about: URLs are allowed before any engine is asked.
+// Every other request is counted against the view that made it (traffic()),
+// also while filtering is off.
+//
+// Views must not be asked for their URL off the UI thread, so each Tab hands
+// its page URL over in SetPageURL() when it changes; the network threads read
+// the host from there, from an immutable snapshot of all pages that the UI
+// thread replaces on every change (as AdBlocker publishes rules), so a request
+// never waits for a lock. The URL a tab starts loading (SetNavigationURL()) tells
+// its top-level document request apart: that request's page is its own host.
+class ContentBlocker : public ultralight::NetworkListener
+{
+public:
+    ContentBlocker();
+
+    // NetworkListener override
+    bool OnNetworkRequest(ultralight::View *caller, ultralight::NetworkRequest &request) override;
+
+    FilterPipeline &pipeline() { return pipeline_; }
+    SitePolicy &site_policy() { return *site_policy_; }
+    AdBlocker &ads() { return *ads_; }
+    AdBlocker &trackers() { return *trackers_; }
+    // Requests, blocks and hosts per view.
+    ViewTraffic &traffic() { return traffic_; }
+
+    // Record the URL view now shows, and the one its main frame starts
+    // loading. Call on the UI thread.
+    void SetPageURL(const void *view, std::string_view url);
+    void SetNavigationURL(const void *view, std::string_view url);
+    // Start counting view's traffic. Tab calls it before installing the listener.
+    void OpenView(const void *view);
+    // Forget view's page and traffic. Tab calls it on close.
+    void ReleaseView(const void *view);
+
+    // CSS of the engines' generic element hiding rules, for Config::user_stylesheet.
+    std::string CosmeticStylesheet();
+    // CSS to inject into a page of host (see AdBlocker::CosmeticStylesheetForHost).
+    // Empty while filtering is off or host's site is allowed.
+    std::string CosmeticStylesheetForHost(const std::string &host);
+
+private:
+    struct Page
+    {
+        std::string host;       // lowercase host of the URL shown
+        std::string navigation; // lowercase URL being loaded, without fragment
+    };
+    using PageMap = std::unordered_map<const void *, Page>; // by view
+    using PageMapPtr = std::shared_ptr<const PageMap>;
+
+    // FilterRequest state for PageHost().
+    struct PageLookup
+    {
+        ContentBlocker *blocker;
+        const void *view;
+        const RequestContext &ctx;
+        mutable PageMapPtr pages; // keeps the returned host alive for the request
+    };
+    // FilterRequest::PageHostFn: lowercase host of the page a view shows.
+    static std::string_view PageHost(const void *state);
+    // Publish a copy of the pages with update(PageMap &) applied. UI thread.
+    template <typename Fn>
+    void UpdatePages(Fn &&update);
+
+    FilterPipeline pipeline_;
+    SitePolicy *site_policy_; // owned by pipeline_
+    AdBlocker *ads_;
+    AdBlocker *trackers_;
+    ViewTraffic traffic_;
+    std::mutex pages_mtx_; // serializes writers of pages_
+    PageMapPtr pages_ = std::make_shared<PageMap>(); // read with atomic_load only
+};
@@ -0,0 +1,190 @@
+#include "CosmeticFilter.h"
+#include "HostMatcher.h"
+#include "NetworkFilter.h"
+
+#include <algorithm>
+
+namespace
+{
+    // Procedural / scriptlet extensions that are not plain CSS selectors.
+    const char *kExtendedSyntax[] = {":-abp-", ":has-text(", ":xpath(", ":style(", ":matches-css", ":upward(",
+                                     ":remove(", ":contains(", ":if(", ":if-not(", ":min-text-length(",
+                                     ":nth-ancestor(", ":watch-attr(", ":matches-path(", ":others("};
+
+    bool IsDomainChar(char c)
+    {
+        return (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c == '.' || c == '-' || c == '_';
+    }
+
+    bool IsSelectorStart(char c)
+    {
+        return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_' || c == '-' || c == '\\' ||
+               (unsigned char)c >= 0x80;
+    }
+
+    std::string_view TrimSpaces(std::string_view s)
+    {
+        while (!s.empty() && (s.front() == ' ' || s.front() == '\t'))
+            s.remove_prefix(1);
+        while (!s.empty() && (s.back() == ' ' || s.back() == '\t' || s.back() == '\r'))
+            s.remove_suffix(1);
+        return s;
+    }
+}
+
+bool CosmeticFilterIndex::Add(std::string_view line)
+{
+    size_t mark = line.find('#');
+    if (mark == std::string_view::npos)
+        return false;
+    Rule rule;
+    size_t selector_at;
+    if (line.compare(mark, 2, "##") == 0)
+        selector_at = mark + 2;
+    else if (line.compare(mark, 3, "#@#") == 0)
+    {
+        rule.exception = true;
+        selector_at = mark + 3;
+    }
+    else
+        return false; // "#?#", "#$#", ...
+    // "## heading" and "### ---" are comments in hosts files
+    if (selector_at >= line.size() || line[selector_at] == ' ' || line[selector_at] == '\t' ||
+        (line[selector_at] == '#' && (selector_at + 1 >= line.size() || !IsSelectorStart(line[selector_at + 1]))))
+        return false;
+
+    std::string_view selector = TrimSpaces(line.substr(selector_at));
+    if (selector.empty() || selector.find_first_of("{}") != std::string_view::npos)
+        return false;
+    for (const char *ext : kExtendedSyntax)
+    {
+        if (selector.find(ext) != std::string_view::npos)
+            return false;
+    }
+    rule.selector_at = (uint32_t)(selector.data() - line.data());
+    rule.selector_size = (uint32_t)selector.size();
+
+    std::string_view domains = line.substr(0, mark);
+    while (!domains.empty())
+    {
+        size_t comma = domains.find(',');
+        std::string_view d = TrimSpaces(domains.substr(0, comma));
+        domains = comma == std::string_view::npos ? std::string_view() : domains.substr(comma + 1);
+        bool exclude = !d.empty() && d.front() == '~';
+        if (exclude)
+            d.remove_prefix(1);
+        std::string lower(d);
+        for (auto &c : lower)
+            c = (c >= 'A' && c <= 'Z') ? (char)(c - 'A' + 'a') : c;
+        if (lower.empty() || !std::all_of(lower.begin(), lower.end(), IsDomainChar))
+            return false; // eg, "example.*" entity rules
+        (exclude ? rule.exclude_domains : rule.include_domains).push_back(std::move(lower));
+    }
+
+    // A rule repeated across lists is kept once (rule ids are line ids).
+    bool added = false;
+    lines_.Intern(line, &added);
+    if (added)
+        rules_.push_back(std::move(rule));
+    return true;
+}
+
+void CosmeticFilterIndex::Merge(CosmeticFilterIndex &&other)
+{
+    for (uint32_t id = 0; id < other.rules_.size(); ++id)
+    {
+        bool added = false;
+        lines_.Intern(other.lines_.Get(id), &added);
+        if (added)
+            rules_.push_back(std::move(other.rules_[id]));
+    }
+    other.Clear();
+}
+
+void CosmeticFilterIndex::Build()
+{
+    generic_.clear();
+    generic_set_.clear();
+    unrestricted_.clear();
+    exceptions_.clear();
+    by_domain_.clear();
+    for (uint32_t id = 0; id < rules_.size(); ++id)
+    {
+        const Rule &r = rules_[id];
+        if (r.exception)
+            exceptions_.push_back(id);
+        if (!r.include_domains.empty())
+        {
+            for (const auto &d : r.include_domains)
+                by_domain_[HostMatcher::HashHost(d)].push_back(id);
+        }
+        else if (!r.exception && r.exclude_domains.empty())
+        {
+            generic_.push_back(id);
+            generic_set_.insert(Selector(id));
+        }
+        else
+        {
+            unrestricted_.push_back(id);
+        }
+    }
+}
+
+void CosmeticFilterIndex::Clear()
+{
+    lines_.Clear();
+    rules_.clear();
+    generic_.clear();
+    generic_set_.clear();
+    unrestricted_.clear();
+    exceptions_.clear();
+    by_domain_.clear();
+}
+
+bool CosmeticFilterIndex::Excluded(const Rule &rule, std::string_view host) const
+{
+    for (const auto &d : rule.exclude_domains)
+    {
+        if (url_util::IsDomainOrSubdomain(host, d))
+            return true;
+    }
+    return false;
+}
+
+void CosmeticFilterIndex::CollectForHost(std::string_view host, std::vector<std::string_view> &hide,
+                                         std::vector<std::string_view> &unhide) const
+{
+    auto collect = [&](uint32_t id)
+    {
+        const Rule &r = rules_[id];
+        if (!Excluded(r, host))
+            (r.exception ? unhide : hide).push_back(Selector(id));
+    };
+    for (uint32_t id : unrestricted_)
+        collect(id);
+    if (by_domain_.empty() || host.empty())
+        return;
+    HostMatcher::ForEachSuffix(host, [&](uint64_t h, std::string_view suffix)
+                               {
+        auto it = by_domain_.find(h);
+        if (it == by_domain_.end())
+            return false;
+        for (uint32_t id : it->second)
+        {
+            const Rule &r = rules_[id];
+            if (std::find(r.include_domains.begin(), r.include_domains.end(), suffix) != r.include_domains.end())
+                collect(id);
+        }
+        return false; });
+}
+
+std::string CosmeticFilterIndex::Stylesheet(const std::vector<std::string_view> &selectors)
+{
+    std::string css;
+    for (std::string_view s : selectors)
+    {
+        css.append(s.data(), s.size());
+        css += " { display: none !important; }\n";
+    }
+    return css;
+}
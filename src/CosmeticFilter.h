@@ -0,0 +1,105 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "StringArena.h"
+
+// Element hiding ("cosmetic") rules: "##selector" hides matching elements on
+// every site, "example.com,~shop.example.com##selector" only on the listed
+// sites, and "#@#" instead of "##" is an exception that keeps a selector from
+// applying (everywhere, or on the listed sites).
+//
+// Generic rules are meant for one shared stylesheet installed in every page;
+// the rest are looked up by the page's host, through a hash index of the
+// rules' domains probed with the host's suffixes, so a lookup does not depend
+// on the number of rules. Rule lines are kept once each in a StringArena and
+// selectors are views into them. Extended syntax ("#?#", "#$#", procedural
+// pseudo-classes such as ":has-text()") is rejected.
+//
+// Immutable after Build(); concurrent lookups are safe.
+class CosmeticFilterIndex
+{
+public:
+    CosmeticFilterIndex() = default;
+    // The indexes hold views into lines_: a copy rebuilds its own.
+    CosmeticFilterIndex(const CosmeticFilterIndex &other) : lines_(other.lines_), rules_(other.rules_) { Build(); }
+    CosmeticFilterIndex &operator=(const CosmeticFilterIndex &other)
+    {
+        if (this != &other)
+        {
+            lines_ = other.lines_;
+            rules_ = other.rules_;
+            Build();
+        }
+        return *this;
+    }
+    CosmeticFilterIndex(CosmeticFilterIndex &&) = default;
+    CosmeticFilterIndex &operator=(CosmeticFilterIndex &&) = default;
+
+    // Parse a trimmed list line. Returns false when it is not a supported
+    // element hiding rule; a rule already added is accepted and kept once.
+    bool Add(std::string_view line);
+    // Take over every rule of other (emptied).
+    void Merge(CosmeticFilterIndex &&other);
+    void Build();
+    void Clear();
+
+    size_t size() const { return rules_.size(); }
+    bool empty() const { return rules_.empty(); }
+    // Rules as added (for snapshots).
+    const StringArena &lines() const { return lines_; }
+
+    // Call fn(selector) for every generic hiding rule without exclusions.
+    template <typename Fn>
+    void ForEachGeneric(Fn &&fn) const
+    {
+        for (uint32_t id : generic_)
+            fn(Selector(id));
+    }
+    // Call fn(selector) for every exception rule.
+    template <typename Fn>
+    void ForEachException(Fn &&fn) const
+    {
+        for (uint32_t id : exceptions_)
+            fn(Selector(id));
+    }
+    bool HasGeneric(std::string_view selector) const { return generic_set_.count(selector) != 0; }
+
+    // Append the selectors of the site-specific and excluding rules that apply
+    // on host (lowercase) to hide, and those of the exceptions that apply to
+    // unhide. Generic rules without exclusions are left to the shared sheet.
+    void CollectForHost(std::string_view host, std::vector<std::string_view> &hide,
+                        std::vector<std::string_view> &unhide) const;
+
+    // CSS hiding each selector; one rule per selector so an invalid one
+    // cannot void the others.
+    static std::string Stylesheet(const std::vector<std::string_view> &selectors);
+
+private:
+    struct Rule
+    {
+        uint32_t selector_at = 0; // selector within the rule's line
+        uint32_t selector_size = 0;
+        std::vector<std::string> include_domains; // lowercase
+        std::vector<std::string> exclude_domains; // lowercase, from "~domain"
+        bool exception = false;
+    };
+
+    bool Excluded(const Rule &rule, std::string_view host) const;
+    std::string_view Selector(uint32_t id) const
+    {
+        return lines_.Get(id).substr(rules_[id].selector_at, rules_[id].selector_size);
+    }
+
+    StringArena lines_;       // rule id -> list line
+    std::vector<Rule> rules_; // parsed lines_
+    std::vector<uint32_t> generic_;                       // hiding rules with no domains at all
+    std::unordered_set<std::string_view> generic_set_;    // their selectors
+    std::vector<uint32_t> unrestricted_;                  // rules without include domains otherwise
+    std::vector<uint32_t> exceptions_;                    // every "#@#" rule
+    std::unordered_map<uint64_t, std::vector<uint32_t>> by_domain_; // included domain hash -> rule ids
+};
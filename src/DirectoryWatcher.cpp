@@ -0,0 +1,144 @@
+#include "DirectoryWatcher.h"
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <set>
+
+#if defined(__linux__)
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    bool IsListFile(const fs::path &p)
+    {
+        return p.extension() == ".txt";
+    }
+}
+
+bool DirectoryWatcher::Start(const std::string &dir, Callback on_change)
+{
+    Stop();
+    std::error_code ec;
+    if (!fs::is_directory(dir, ec))
+        return false;
+    dir_ = dir;
+    on_change_ = std::move(on_change);
+#if defined(__linux__)
+    fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd_ < 0)
+        return false;
+    if (inotify_add_watch(fd_, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE) < 0)
+    {
+        close(fd_);
+        fd_ = -1;
+        return false;
+    }
+#endif
+    stop_ = false;
+    thread_ = std::thread(&DirectoryWatcher::Run, this);
+    return true;
+}
+
+void DirectoryWatcher::Stop()
+{
+    stop_ = true;
+    if (thread_.joinable())
+        thread_.join();
+#if defined(__linux__)
+    if (fd_ >= 0)
+        close(fd_);
+    fd_ = -1;
+#endif
+}
+
+#if defined(__linux__)
+
+void DirectoryWatcher::Run()
+{
+    std::set<std::string> pending;
+    alignas(inotify_event) char buf[4096];
+    while (!stop_)
+    {
+        // Wake up regularly to notice Stop(); shorter while a burst settles
+        pollfd pfd = {fd_, POLLIN, 0};
+        int ready = poll(&pfd, 1, pending.empty() ? 250 : kSettleMs);
+        if (ready < 0)
+            continue; // EINTR
+        if (ready == 0)
+        {
+            if (!pending.empty())
+            {
+                on_change_(std::vector<std::string>(pending.begin(), pending.end()));
+                pending.clear();
+            }
+            continue;
+        }
+        ssize_t len;
+        while ((len = read(fd_, buf, sizeof(buf))) > 0)
+        {
+            for (char *p = buf; p < buf + len;)
+            {
+                const inotify_event *ev = reinterpret_cast<const inotify_event *>(p);
+                if (ev->len > 0 && IsListFile(ev->name))
+                    pending.insert((fs::path(dir_) / ev->name).string());
+                p += sizeof(inotify_event) + ev->len;
+            }
+        }
+    }
+}
+
+#else
+
+void DirectoryWatcher::Run()
+{
+    using Stamp = std::pair<uintmax_t, fs::file_time_type>;
+    auto scan = [this]()
+    {
+        std::map<std::string, Stamp> files;
+        std::error_code ec;
+        for (fs::directory_iterator it(dir_, ec), end; !ec && it != end; it.increment(ec))
+        {
+            std::error_code fec;
+            if (it->is_regular_file(fec) && IsListFile(it->path()))
+                files[it->path().string()] = {it->file_size(fec), it->last_write_time(fec)};
+        }
+        return files;
+    };
+
+    std::map<std::string, Stamp> known = scan();
+    while (!stop_)
+    {
+        for (int waited = 0; waited < kPollMs && !stop_; waited += 50)
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        if (stop_)
+            break;
+        std::map<std::string, Stamp> now = scan();
+        std::vector<std::string> changed;
+        for (const auto &f : now)
+        {
+            auto it = known.find(f.first);
+            if (it == known.end() || it->second != f.second)
+                changed.push_back(f.first);
+        }
+        for (const auto &f : known)
+        {
+            if (!now.count(f.first))
+                changed.push_back(f.first);
+        }
+        if (changed.empty())
+            continue;
+        // Let a write in progress finish before reporting it
+        std::this_thread::sleep_for(std::chrono::milliseconds(kSettleMs));
+        known = scan();
+        on_change_(changed);
+    }
+}
+
+#endif
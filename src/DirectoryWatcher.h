@@ -0,0 +1,45 @@
+#pragma once
+#include <atomic>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Watches a directory for changes to its *.txt files on a background thread.
+//
+// On Linux the directory is watched with inotify (a file is reported once the
+// writer closes it, or when it is renamed into place or deleted); elsewhere
+// it is polled for size and modification-time changes every kPollMs. Bursts
+// of events (an editor's save, a sync tool replacing several lists) are
+// collected until the directory has been quiet for kSettleMs and reported in
+// one call, with paths formed like FilterSnapshot::ExpandSources() forms them.
+//
+// The callback runs on the watcher thread.
+class DirectoryWatcher
+{
+public:
+    using Callback = std::function<void(const std::vector<std::string> &changed)>;
+
+    static constexpr int kSettleMs = 200;
+    static constexpr int kPollMs = 1000;
+
+    DirectoryWatcher() = default;
+    ~DirectoryWatcher() { Stop(); }
+    DirectoryWatcher(const DirectoryWatcher &) = delete;
+    DirectoryWatcher &operator=(const DirectoryWatcher &) = delete;
+
+    // Start watching dir (stopping any previous watch). Returns false when it
+    // cannot be watched.
+    bool Start(const std::string &dir, Callback on_change);
+    void Stop();
+    bool running() const { return thread_.joinable(); }
+
+private:
+    void Run();
+
+    std::string dir_;
+    Callback on_change_;
+    std::thread thread_;
+    std::atomic<bool> stop_{false};
+    int fd_ = -1; // inotify descriptor (Linux)
+};
@@ -0,0 +1,449 @@
+#include "FilterEngine.h"
+
+#include <algorithm>
+#include <fstream>
+
+namespace
+{
+    bool IsHostChar(char c)
+    {
+        return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '.' ||
+               c == '-' || c == '_';
+    }
+
+    bool IsHostName(std::string_view s)
+    {
+        return !s.empty() && std::all_of(s.begin(), s.end(), IsHostChar);
+    }
+
+    bool IsSpace(char c)
+    {
+        return c == ' ' || c == '\t';
+    }
+}
+
+std::string FilterEngine::ToLower(std::string_view s)
+{
+    std::string out(s.size(), '\0');
+    url_util::LowerASCII(s, &out[0]);
+    return out;
+}
+
+std::string_view FilterEngine::Trim(std::string_view s)
+{
+    size_t start = s.find_first_not_of(" \t\r\n");
+    if (start == std::string_view::npos)
+        return {};
+    size_t end = s.find_last_not_of(" \t\r\n");
+    return s.substr(start, end - start + 1);
+}
+
+void FilterEngine::LoadStream(std::istream &in)
+{
+    std::string line;
+    while (std::getline(in, line))
+        AddRule(line);
+}
+
+bool FilterEngine::LoadFile(const std::string &path)
+{
+    std::ifstream in(path);
+    if (!in.is_open())
+        return false;
+    LoadStream(in);
+    return true;
+}
+
+void FilterEngine::LoadBuffer(std::string_view text)
+{
+    while (!text.empty())
+    {
+        size_t nl = text.find('\n');
+        AddRule(text.substr(0, nl));
+        if (nl == std::string_view::npos)
+            break;
+        text.remove_prefix(nl + 1);
+    }
+}
+
+void FilterEngine::Merge(FilterEngine &&other)
+{
+    hosts_.Merge(other.hosts_);
+    for (uint32_t id = 0; id < other.substrings_.size(); ++id)
+    {
+        bool added = false;
+        substrings_.Intern(other.substrings_.Get(id), &added);
+        dirty_ |= added;
+    }
+    if (other.globs_.size() || other.regexes_.size() || other.filters_.size() || other.exceptions_.size() ||
+        other.cosmetic_.size())
+        dirty_ = true;
+    globs_.Merge(std::move(other.globs_));
+    regexes_.Merge(std::move(other.regexes_));
+    filters_.Merge(std::move(other.filters_));
+    exceptions_.Merge(std::move(other.exceptions_));
+    cosmetic_.Merge(std::move(other.cosmetic_));
+    other.Clear();
+}
+
+bool FilterEngine::AddRule(std::string_view raw)
+{
+    std::string_view line = Trim(raw);
+    if (line.empty() || line[0] == '!' || line[0] == '[')
+        return false;
+    // Element hiding rules ("##sel" would otherwise read as a comment)
+    size_t mark = line.find('#');
+    if (mark != std::string_view::npos && mark + 1 < line.size() &&
+        (line[mark + 1] == '#' || line[mark + 1] == '@' || line[mark + 1] == '?' || line[mark + 1] == '$'))
+    {
+        if (!cosmetic_.Add(line))
+            return false;
+        dirty_ = true;
+        return true;
+    }
+    if (line[0] == '#')
+        return false;
+
+    // Regular expression: /pattern/ (before the '^' / '$' checks below)
+    if (RegexSet::IsRegexRule(line))
+    {
+        bool added = false;
+        if (!regexes_.Add(line, &added))
+            return false;
+        dirty_ |= added;
+        return true;
+    }
+
+    // Adblock-style domain pattern without options: ||example.com^
+    if (line.rfind("||", 0) == 0)
+    {
+        std::string_view dom = line.substr(2);
+        if (!dom.empty() && dom.back() == '^')
+            dom.remove_suffix(1);
+        if (IsHostName(dom))
+        {
+            AddBlockedHost(dom);
+            return true;
+        }
+    }
+
+    // Exceptions, anchors, separators and options need the full filter syntax
+    if (line.rfind("@@", 0) == 0 || line.front() == '|' || line.back() == '|' ||
+        line.find('^') != std::string_view::npos || line.find('$') != std::string_view::npos)
+    {
+        NetworkFilter filter;
+        if (!NetworkFilter::Parse(line, filter))
+            return false;
+        if ((filter.is_exception() ? exceptions_ : filters_).Add(line, std::move(filter)))
+            dirty_ = true;
+        return true;
+    }
+
+    // Hosts-file style: IP then domain
+    size_t ws = std::find_if(line.begin(), line.end(), IsSpace) - line.begin();
+    if (ws < line.size())
+    {
+        std::string_view ip = line.substr(0, ws);
+        std::string_view rest = Trim(line.substr(ws));
+        std::string_view host = rest.substr(0, std::find_if(rest.begin(), rest.end(), IsSpace) - rest.begin());
+        if ((ip.find('.') != std::string_view::npos || ip.find(':') != std::string_view::npos) && !host.empty())
+        {
+            AddBlockedHost(host);
+            return true;
+        }
+    }
+
+    // Plain domain without IP
+    if (line.find('.') != std::string_view::npos && IsHostName(line))
+    {
+        AddBlockedHost(line);
+        return true;
+    }
+
+    // If contains wildcard, treat as glob, else as substring
+    if (line.find('*') != std::string_view::npos || line.find('?') != std::string_view::npos)
+        AddURLGlob(line);
+    else
+        AddURLSubstring(line);
+    return true;
+}
+
+void FilterEngine::AddBlockedHost(std::string_view host_raw)
+{
+    std::string_view trimmed = Trim(host_raw);
+    // strip leading dots
+    while (!trimmed.empty() && trimmed.front() == '.')
+        trimmed.remove_prefix(1);
+    if (!trimmed.empty())
+        hosts_.Add(ToLower(trimmed));
+}
+
+void FilterEngine::AddURLSubstring(std::string_view needle_raw)
+{
+    std::string n = ToLower(Trim(needle_raw));
+    if (n.empty())
+        return;
+    bool added = false;
+    substrings_.Intern(n, &added);
+    dirty_ |= added;
+}
+
+void FilterEngine::AddURLGlob(std::string_view pattern_raw)
+{
+    std::string p = ToLower(Trim(pattern_raw));
+    if (p.empty())
+        return;
+    dirty_ |= globs_.Add(p);
+}
+
+FilterEngine::OptimizeStats FilterEngine::Optimize()
+{
+    OptimizeStats stats;
+
+    // A host under another host rule is matched by that rule already.
+    std::vector<uint32_t> kept_hosts;
+    kept_hosts.reserve(hosts_.size());
+    for (uint32_t i = 0; i < hosts_.size(); ++i)
+    {
+        std::string_view host = hosts_.host(i);
+        size_t dot = host.find('.');
+        if (dot != std::string_view::npos && hosts_.Matches(host.substr(dot + 1)))
+            ++stats.hosts;
+        else
+            kept_hosts.push_back(i);
+    }
+    if (stats.hosts)
+    {
+        HostMatcher hosts;
+        hosts.SetFalsePositiveRate(hosts_.false_positive_rate());
+        hosts.Reserve(kept_hosts.size());
+        for (uint32_t i : kept_hosts)
+            hosts.Add(hosts_.host(i));
+        hosts_ = std::move(hosts);
+    }
+
+    // "*text*" matches exactly the URLs containing "text".
+    GlobIndex globs;
+    std::vector<std::string_view> glob_rules;
+    for (uint32_t id = 0; id < globs_.patterns().size(); ++id)
+    {
+        std::string_view glob = globs_.patterns().Get(id);
+        size_t first = glob.find_first_not_of('*');
+        size_t last = glob.find_last_not_of('*');
+        std::string_view inner = first == std::string_view::npos ? std::string_view() : glob.substr(first, last - first + 1);
+        if (first > 0 && last + 1 < glob.size() && !inner.empty() && inner.find_first_of("*?") == std::string_view::npos)
+        {
+            substrings_.Intern(inner);
+            ++stats.globs_to_substrings;
+        }
+        else
+        {
+            glob_rules.push_back(glob);
+        }
+    }
+
+    // A substring containing another one (anywhere but as the whole string,
+    // so: in the string minus its last or its first byte) adds nothing. The
+    // shortest rules are never dropped, so every dropped rule keeps a witness.
+    AhoCorasick all;
+    all.Build(substrings_);
+    StringArena substrings;
+    substrings.Reserve(substrings_.size(), 0);
+    for (uint32_t id = 0; id < substrings_.size(); ++id)
+    {
+        std::string_view s = substrings_.Get(id);
+        if (s.size() > 1 && (all.Matches(s.substr(0, s.size() - 1)) || all.Matches(s.substr(1))))
+            ++stats.substrings;
+        else
+            substrings.Intern(s);
+    }
+
+    // A glob that must contain a substring rule is covered by it.
+    AhoCorasick kept;
+    kept.Build(substrings);
+    for (std::string_view glob : glob_rules)
+    {
+        bool covered = false;
+        for (size_t i = 0; i < glob.size() && !covered;)
+        {
+            size_t end = std::min(glob.find_first_of("*?", i), glob.size());
+            covered = end > i && kept.Matches(glob.substr(i, end - i));
+            i = end + 1;
+        }
+        if (covered)
+            ++stats.globs;
+        else
+            globs.Add(glob);
+    }
+
+    if (stats.substrings || stats.globs_to_substrings)
+        substrings_ = std::move(substrings);
+    if (stats.globs || stats.globs_to_substrings)
+        globs_ = std::move(globs);
+    dirty_ |= stats.substrings || stats.globs || stats.globs_to_substrings;
+    return stats;
+}
+
+void FilterEngine::Build()
+{
+    if (!dirty_)
+        return;
+    substring_matcher_.Build(substrings_); // replaces a snapshot-backed automaton
+    globs_.Build();
+    regexes_.Build();
+    filters_.Build();
+    exceptions_.Build();
+    cosmetic_.Build();
+    dirty_ = false;
+}
+
+void FilterEngine::Clear()
+{
+    hosts_.Clear();
+    substrings_.Clear();
+    substring_matcher_.Clear();
+    globs_.Clear();
+    regexes_.Clear();
+    filters_.Clear();
+    exceptions_.Clear();
+    cosmetic_.Clear();
+    snapshot_.reset();
+    dirty_ = false;
+}
+
+bool FilterEngine::SaveSnapshot(const std::string &path, uint64_t fingerprint, std::string *error) const
+{
+    FilterSnapshot::Writer out;
+    hosts_.Save(out);
+    substring_matcher_.Save(out);
+    out.AddLines(FilterSnapshot::kSubstringRules, substrings_);
+    out.AddLines(FilterSnapshot::kGlobRules, globs_.patterns());
+    out.AddLines(FilterSnapshot::kRegexRules, regexes_.rules());
+    std::vector<std::string_view> raw;
+    raw.reserve(filters_.size() + exceptions_.size());
+    for (const auto *index : {&filters_, &exceptions_})
+    {
+        for (uint32_t id = 0; id < index->lines().size(); ++id)
+            raw.push_back(index->lines().Get(id));
+    }
+    out.AddLines(FilterSnapshot::kFilterRules, raw);
+    out.AddLines(FilterSnapshot::kCosmeticRules, cosmetic_.lines());
+    return out.Save(path, fingerprint, error);
+}
+
+bool FilterEngine::LoadSnapshot(std::shared_ptr<const FilterSnapshot> snapshot)
+{
+    Clear();
+    if (!snapshot || !hosts_.Attach(*snapshot) || !substring_matcher_.Attach(*snapshot))
+    {
+        Clear();
+        return false;
+    }
+    snapshot_ = std::move(snapshot);
+
+    // Pattern rules are few; recompiling them from normalized text is cheap.
+    snapshot_->ForEachLine(FilterSnapshot::kSubstringRules, [this](std::string_view line)
+                           { substrings_.Intern(line); });
+    snapshot_->ForEachLine(FilterSnapshot::kGlobRules, [this](std::string_view line)
+                           { globs_.Add(line); });
+    snapshot_->ForEachLine(FilterSnapshot::kRegexRules, [this](std::string_view line)
+                           { regexes_.Add(line); });
+    snapshot_->ForEachLine(FilterSnapshot::kFilterRules, [this](std::string_view line)
+                           {
+        NetworkFilter filter;
+        if (NetworkFilter::Parse(line, filter))
+            (filter.is_exception() ? exceptions_ : filters_).Add(line, std::move(filter)); });
+    snapshot_->ForEachLine(FilterSnapshot::kCosmeticRules, [this](std::string_view line)
+                           { cosmetic_.Add(line); });
+    globs_.Build();
+    regexes_.Build();
+    filters_.Build();
+    exceptions_.Build();
+    cosmetic_.Build();
+    return true;
+}
+
+bool FilterEngine::IsBlockedHost(std::string_view host) const
+{
+    // Exact domain or subdomain ("example.com" matches example.com and a.example.com but not badexample.com)
+    return hosts_.Matches(host);
+}
+
+bool FilterEngine::IsBlockedURL(std::string_view url) const
+{
+    // Single pass over the URL for all substring rules
+    if (substring_matcher_.Matches(url))
+        return true;
+    // Only globs whose index token occurs in the URL are tried
+    if (globs_.Matches(url))
+        return true;
+    // One more pass for all regex rules together
+    return regexes_.Matches(url);
+}
+
+FilterVerdict FilterEngine::Match(const RequestContext &ctx) const
+{
+    return Match(ctx, !ctx.host.empty() && IsBlockedHost(ctx.host));
+}
+
+FilterVerdict FilterEngine::Match(const RequestContext &ctx, bool host_blocked) const
+{
+    FilterVerdict verdict = MatchBlocking(ctx, host_blocked);
+    if (verdict != FilterVerdict::Allow && MatchesException(ctx))
+        return FilterVerdict::Exception;
+    return verdict;
+}
+
+FilterVerdict FilterEngine::MatchBlocking(const RequestContext &ctx, bool host_blocked) const
+{
+    if (host_blocked)
+        return FilterVerdict::BlockedHost;
+    if (!ctx.url.empty() && IsBlockedURL(ctx.url))
+        return FilterVerdict::BlockedURL;
+    if (filters_.Match(ctx))
+        return FilterVerdict::BlockedFilter;
+    return FilterVerdict::Allow;
+}
+
+bool FilterEngine::Explain(const RequestContext &ctx, FilterVerdict verdict, MatchedRule &out) const
+{
+    const NetworkFilterIndex *index = nullptr;
+    switch (verdict)
+    {
+    case FilterVerdict::BlockedHost:
+        out = {RuleKind::Host, hosts_.MatchedRule(ctx.host)};
+        return !out.text.empty();
+    case FilterVerdict::BlockedURL:
+        if (uint32_t id = substring_matcher_.Find(ctx.url))
+        {
+            out = {RuleKind::Substring, substrings_.Get(id - 1)};
+            return true;
+        }
+        if (uint32_t id = globs_.Find(ctx.url))
+        {
+            out = {RuleKind::Glob, globs_.patterns().Get(id - 1)};
+            return true;
+        }
+        if (uint32_t id = regexes_.Find(ctx.url))
+        {
+            out = {RuleKind::Regex, regexes_.rules().Get(id - 1)};
+            return true;
+        }
+        return false;
+    case FilterVerdict::BlockedFilter:
+        index = &filters_;
+        out.kind = RuleKind::Filter;
+        break;
+    case FilterVerdict::Exception:
+        index = &exceptions_;
+        out.kind = RuleKind::Exception;
+        break;
+    default:
+        return false;
+    }
+    const NetworkFilter *filter = index->Match(ctx);
+    if (!filter)
+        return false;
+    out.text = index->line(*filter);
+    return true;
+}
@@ -0,0 +1,173 @@
+#pragma once
+#include <cstdint>
+#include <istream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "AhoCorasick.h"
+#include "CosmeticFilter.h"
+#include "FilterSnapshot.h"
+#include "GlobIndex.h"
+#include "HostMatcher.h"
+#include "NetworkFilter.h"
+#include "RegexSet.h"
+#include "StringArena.h"
+
+// Outcome of matching one request against a FilterEngine.
+enum class FilterVerdict : uint8_t
+{
+    Allow,         // no rule matched
+    Exception,     // a blocking rule matched but an "@@" exception overrode it
+    BlockedHost,   // host / hosts-file / "||domain^" rule
+    BlockedURL,    // plain substring, glob or regex rule
+    BlockedFilter, // Adblock Plus rule with anchors or options
+};
+
+inline bool IsBlocking(FilterVerdict v)
+{
+    return v == FilterVerdict::BlockedHost || v == FilterVerdict::BlockedURL || v == FilterVerdict::BlockedFilter;
+}
+
+// Kind of rule that decided a verdict (see FilterEngine::Explain).
+enum class RuleKind : uint8_t
+{
+    Host,
+    Substring,
+    Glob,
+    Regex,
+    Filter,    // blocking Adblock Plus rule
+    Exception, // "@@" rule
+};
+
+// A rule of a FilterEngine, as its normalized text. The view points into the
+// engine and lives as long as the engine does.
+struct MatchedRule
+{
+    RuleKind kind = RuleKind::Host;
+    std::string_view text;
+};
+
+// Compiled network filter rules, independent of Ultralight so it can be
+// exercised by tools and benchmarks.
+//
+// List format (any of the following per line):
+// - "example.com"              (blocks example.com and all subdomains)
+// - "0.0.0.0 example.com"     (hosts file style; ignores IP)
+// - "||example.com^"          (Adblock-style domain rule)
+// - "*ads.js"                 (glob over the whole URL, '*' and '?')
+// - "/ads/"                   (URL substring)
+// - "/banner\d+\.gif/"         (regular expression, see RegexSet)
+// - Adblock Plus network rules: "@@" exceptions, "|" / "||" / "^" anchors and
+//   $third-party, $domain=, $script, $image, $stylesheet options
+// - Element hiding rules: "##selector", "domain,~domain##selector" and "#@#"
+//   exceptions (see CosmeticFilterIndex); they never affect Match()
+// - Lines starting with '#', '!' or '[' are comments
+//
+// Rules are queued by Add*/LoadFile and compiled by Build(). Not thread-safe
+// while building; Match() on a built engine may run concurrently.
+//
+// A built engine can be written to a FilterSnapshot and restored from one
+// without parsing the host and substring lists again.
+class FilterEngine
+{
+public:
+    FilterEngine() = default;
+
+    // Parse one list line. Returns false when it holds no usable network or
+    // element hiding rule.
+    bool AddRule(std::string_view line);
+    // AddRule() every line of a stream / file. LoadFile returns false when the file cannot be opened.
+    void LoadStream(std::istream &in);
+    bool LoadFile(const std::string &path);
+    // AddRule() every line of an in-memory list.
+    void LoadBuffer(std::string_view text);
+    // Take over every rule of other (emptied), eg. one parsed on another thread.
+    void Merge(FilterEngine &&other);
+
+    void AddBlockedHost(std::string_view host);
+    void ReserveHosts(size_t count) { hosts_.Reserve(count); }
+    void AddURLSubstring(std::string_view needle);
+    void AddURLGlob(std::string_view pattern);
+
+    // Rules Optimize() dropped or rewrote.
+    struct OptimizeStats
+    {
+        size_t hosts = 0;               // under a parent domain rule ("ads.example.com" with "example.com")
+        size_t substrings = 0;          // containing another substring rule
+        size_t globs_to_substrings = 0; // "*text*" turned into the substring "text"
+        size_t globs = 0;               // with a literal part containing a substring rule
+        size_t removed() const { return hosts + substrings + globs; }
+    };
+    // Drop host, substring and glob rules that cannot change a verdict because
+    // another rule blocks every URL they block, and turn globs that are plain
+    // substrings into substrings. Run after loading, before Build(). Explain()
+    // then names the remaining rule.
+    OptimizeStats Optimize();
+
+    // Compile queued substring/glob/filter rules. Cheap when nothing changed.
+    void Build();
+    void Clear();
+
+    // Write the built engine to path, tagged with the sources' fingerprint.
+    bool SaveSnapshot(const std::string &path, uint64_t fingerprint, std::string *error = nullptr) const;
+    // Replace all rules with a snapshot's. Host and substring tables are used
+    // in place from the mapping, which the engine keeps alive.
+    bool LoadSnapshot(std::shared_ptr<const FilterSnapshot> snapshot);
+
+    // Request inputs must be lowercase (see RequestContext).
+    FilterVerdict Match(const RequestContext &ctx) const;
+    // Same, with IsBlockedHost(ctx.host) already known (eg, from a HostVerdictCache).
+    FilterVerdict Match(const RequestContext &ctx, bool host_blocked) const;
+    // The two halves of Match(), for combining engines (see FilterSet): the
+    // blocking verdict before exceptions (Allow or Blocked*), and whether an
+    // "@@" rule applies to the request.
+    FilterVerdict MatchBlocking(const RequestContext &ctx, bool host_blocked) const;
+    bool MatchesException(const RequestContext &ctx) const { return !exceptions_.empty() && exceptions_.Match(ctx); }
+    bool IsBlockedHost(std::string_view host) const;
+    bool IsBlockedURL(std::string_view url) const;
+
+    // The rule behind a verdict Match(ctx) returned: the blocking rule, or the
+    // "@@" rule for Exception. False for Allow. Meant for the (rare) blocked
+    // requests, so it repeats the lookups instead of slowing down Match().
+    bool Explain(const RequestContext &ctx, FilterVerdict verdict, MatchedRule &out) const;
+    // Time every glob rule that is a candidate for url and call fn(rule, ns)
+    // for each (see GlobIndex::Profile).
+    template <typename Fn>
+    void ProfileGlobs(std::string_view url, Fn &&fn) const
+    {
+        globs_.Profile(url, [&](uint32_t g, uint64_t ns)
+                       { fn(MatchedRule{RuleKind::Glob, globs_.patterns().Get(g)}, ns); });
+    }
+
+    // False-positive target of the host Bloom prefilter (see HostMatcher).
+    void set_host_prefilter_fp_rate(double rate) { hosts_.SetFalsePositiveRate(rate); }
+
+    size_t host_rule_count() const { return hosts_.size(); }
+    size_t url_rule_count() const { return substrings_.size() + globs_.size() + regexes_.size(); }
+    size_t filter_rule_count() const { return filters_.size() + exceptions_.size(); }
+    size_t cosmetic_rule_count() const { return cosmetic_.size(); }
+    size_t rule_count() const
+    {
+        return host_rule_count() + url_rule_count() + filter_rule_count() + cosmetic_rule_count();
+    }
+
+    // Element hiding rules (built with the engine).
+    const CosmeticFilterIndex &cosmetic() const { return cosmetic_; }
+
+    static std::string ToLower(std::string_view s);
+    static std::string_view Trim(std::string_view s);
+
+private:
+    HostMatcher hosts_;                   // host suffixes in lowercase (eg, "doubleclick.net")
+    StringArena substrings_;              // lowercase substrings
+    AhoCorasick substring_matcher_;       // compiled from substrings_
+    GlobIndex globs_;                     // lowercase glob patterns with '*'/'?', token-indexed
+    RegexSet regexes_;                    // "/regex/" rules, one lazy DFA
+    NetworkFilterIndex filters_;          // blocking Adblock Plus rules
+    NetworkFilterIndex exceptions_;       // "@@" rules
+    CosmeticFilterIndex cosmetic_;        // "##" / "#@#" rules
+    std::shared_ptr<const FilterSnapshot> snapshot_; // backs hosts_/substring_matcher_ when loaded from one
+    bool dirty_ = false;                  // URL or filter rules changed since Build()
+};
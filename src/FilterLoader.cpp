@@ -0,0 +1,91 @@
+#include "FilterLoader.h"
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <iterator>
+#include <string_view>
+#include <thread>
+
+namespace
+{
+    // Run fn(i) for i in [0, count) on up to threads workers (the caller is one of them).
+    template <typename Fn>
+    void ParallelFor(size_t count, size_t threads, Fn &&fn)
+    {
+        std::atomic<size_t> next{0};
+        auto worker = [&]()
+        {
+            for (size_t i = next++; i < count; i = next++)
+                fn(i);
+        };
+        std::vector<std::thread> pool;
+        for (size_t t = 1; t < std::min(threads, count); ++t)
+            pool.emplace_back(worker);
+        worker();
+        for (auto &th : pool)
+            th.join();
+    }
+
+    bool ReadFile(const std::string &path, std::string &out)
+    {
+        std::ifstream in(path, std::ios::binary);
+        if (!in.is_open())
+            return false;
+        out.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        return true;
+    }
+}
+
+FilterLoader::FilterLoader(size_t threads)
+    : threads_(threads ? threads : std::max(1u, std::thread::hardware_concurrency()))
+{
+}
+
+size_t FilterLoader::Load(const std::vector<std::string> &paths, FilterEngine &engine) const
+{
+    std::vector<std::string> texts(paths.size());
+    std::vector<char> ok(paths.size(), 0);
+    ParallelFor(paths.size(), threads_, [&](size_t i)
+                { ok[i] = ReadFile(paths[i], texts[i]); });
+
+    // One worker gains nothing from chunking; parse straight into the engine.
+    if (threads_ == 1)
+    {
+        for (const auto &text : texts)
+            engine.LoadBuffer(text);
+        return (size_t)std::count(ok.begin(), ok.end(), 1);
+    }
+
+    // Newline-aligned chunks, in file order.
+    std::vector<std::string_view> chunks;
+    for (const auto &text : texts)
+    {
+        std::string_view rest = text;
+        while (rest.size() > kChunkBytes)
+        {
+            size_t nl = rest.find('\n', kChunkBytes);
+            if (nl == std::string_view::npos)
+                break;
+            chunks.push_back(rest.substr(0, nl + 1));
+            rest.remove_prefix(nl + 1);
+        }
+        if (!rest.empty())
+            chunks.push_back(rest);
+    }
+
+    std::vector<FilterEngine> parts(chunks.size());
+    ParallelFor(chunks.size(), threads_, [&](size_t i)
+                { parts[i].LoadBuffer(chunks[i]); });
+    size_t first = 0;
+    if (engine.rule_count() == 0 && !parts.empty())
+        engine = std::move(parts[first++]); // nothing to merge into yet
+    size_t hosts = engine.host_rule_count();
+    for (size_t i = first; i < parts.size(); ++i)
+        hosts += parts[i].host_rule_count();
+    engine.ReserveHosts(hosts); // one table resize instead of one per merge
+    for (size_t i = first; i < parts.size(); ++i)
+        engine.Merge(std::move(parts[i]));
+
+    return (size_t)std::count(ok.begin(), ok.end(), 1);
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "FilterEngine.h"
+
+// Parses filter lists on a pool of worker threads.
+//
+// Files are read in parallel, then cut into newline-aligned chunks of about
+// kChunkBytes so one multi-megabyte hosts file spreads over every worker.
+// Each chunk is parsed into its own FilterEngine (no shared state, no locks)
+// and the partial engines are merged into the target once, in file order, so
+// the result is the same as parsing the files one after another.
+class FilterLoader
+{
+public:
+    static constexpr size_t kChunkBytes = 256 * 1024;
+
+    // threads = 0 uses the hardware concurrency.
+    explicit FilterLoader(size_t threads = 0);
+
+    // Parse paths into engine (appending; engine.Build() is left to the
+    // caller). Returns the number of files that could be read.
+    size_t Load(const std::vector<std::string> &paths, FilterEngine &engine) const;
+
+    size_t threads() const { return threads_; }
+
+private:
+    size_t threads_;
+};
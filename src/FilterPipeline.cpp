@@ -0,0 +1,265 @@
+#include "FilterPipeline.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+
+namespace
+{
+    uint64_t ElapsedNs(std::chrono::steady_clock::time_point start)
+    {
+        return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() -
+                                                                              start)
+            .count();
+    }
+
+    // Take half of a counter away, keeping what other threads add meanwhile.
+    void Halve(std::atomic<uint64_t> &counter)
+    {
+        counter.fetch_sub(counter.load(std::memory_order_relaxed) / 2, std::memory_order_relaxed);
+    }
+}
+
+RequestFilter *FilterPipeline::Add(std::unique_ptr<RequestFilter> filter, bool policy)
+{
+    if (!filter || stages_.size() >= kMaxStages)
+        return nullptr;
+    const size_t index = stages_.size();
+    auto stage = std::make_unique<Stage>();
+    stage->filter = std::move(filter);
+    stage->policy = policy;
+    stages_.push_back(std::move(stage));
+    if (policy)
+    {
+        policy_.push_back(index);
+    }
+    else
+    {
+        uint64_t order = order_.load(std::memory_order_relaxed);
+        const size_t count = OrderSize(order);
+        order |= (uint64_t)index << (4 + 4 * count);
+        order_.store((order & ~(uint64_t)0xf) | (count + 1), std::memory_order_release);
+    }
+    return stages_.back()->filter.get();
+}
+
+RequestFilter *FilterPipeline::stage(std::string_view name) const
+{
+    for (const auto &stage : stages_)
+    {
+        if (name == stage->filter->name())
+            return stage->filter.get();
+    }
+    return nullptr;
+}
+
+bool FilterPipeline::Allow(const FilterRequest &request)
+{
+    if (!enabled_.load(std::memory_order_relaxed))
+        return true;
+    const auto start = std::chrono::steady_clock::now();
+    const bool log = log_requests_.load(std::memory_order_relaxed);
+    MatchedRule rule;
+    bool decided = false;
+    bool blocked = false;
+
+    for (size_t index : policy_)
+    {
+        RequestFilter &filter = *stages_[index]->filter;
+        if (filter.enabled() && filter.Evaluate(request, rule) == FilterAction::Allow)
+        {
+            if (log)
+                Log(RequestLog::Decision::SiteAllowed, rule, request.ctx.url);
+            decided = true;
+            break;
+        }
+    }
+    if (!decided)
+    {
+        const uint64_t order = order_.load(std::memory_order_acquire);
+        for (size_t i = 0, n = OrderSize(order); i < n; ++i)
+        {
+            RequestFilter &filter = *stages_[OrderAt(order, i)]->filter;
+            if (!filter.enabled())
+                continue;
+            const FilterAction action = filter.Evaluate(request, rule);
+            if (action == FilterAction::None)
+                continue;
+            if (action == FilterAction::Allow)
+                break;
+            blocked = action == FilterAction::Block;
+            if (!rule.text.empty())
+            {
+                stats_.RecordHit(rule);
+                if (log)
+                    Log(blocked ? RequestLog::Decision::Blocked : RequestLog::Decision::Allowed, rule,
+                        request.ctx.url);
+            }
+            if (blocked)
+                break;
+        }
+    }
+    stats_.RecordRequest(ElapsedNs(start), blocked);
+
+    // Profiling runs after the request is timed so it does not skew the histogram
+    if (stats_.ShouldSample())
+        Sample(request);
+    return !blocked;
+}
+
+void FilterPipeline::Sample(const FilterRequest &decided)
+{
+    FilterRequest request = decided;
+    request.profiling = true;
+    MatchedRule rule;
+    for (const auto &stage : stages_)
+    {
+        if (!stage->filter->enabled())
+            continue;
+        const auto start = std::chrono::steady_clock::now();
+        const FilterAction action = stage->filter->Evaluate(request, rule);
+        stage->cost_ns.fetch_add(ElapsedNs(start), std::memory_order_relaxed);
+        stage->samples.fetch_add(1, std::memory_order_relaxed);
+        if (action == FilterAction::Block || action == FilterAction::Allow)
+            stage->hits.fetch_add(1, std::memory_order_relaxed);
+        stage->filter->ProfileRules(request.ctx.url, stats_);
+    }
+    if (samples_.fetch_add(1, std::memory_order_relaxed) % kReorderInterval == kReorderInterval - 1)
+    {
+        std::unique_lock<std::mutex> lock(reorder_mtx_, std::try_to_lock);
+        if (lock.owns_lock())
+            ReorderLocked();
+    }
+}
+
+void FilterPipeline::Reorder()
+{
+    std::lock_guard<std::mutex> lock(reorder_mtx_);
+    ReorderLocked();
+}
+
+void FilterPipeline::ReorderLocked()
+{
+    // Runs on a request thread now and then: fixed arrays, no allocation.
+    const uint64_t current = order_.load(std::memory_order_relaxed);
+    const size_t count = OrderSize(current);
+    size_t order[kMaxStages];
+    double score[kMaxStages] = {};
+    for (size_t i = 0; i < count; ++i)
+    {
+        const size_t index = OrderAt(current, i);
+        const Stage &stage = *stages_[index];
+        const double samples = (double)stage.samples.load(std::memory_order_relaxed);
+        const double hits = (double)stage.hits.load(std::memory_order_relaxed);
+        const double cost = (double)stage.cost_ns.load(std::memory_order_relaxed);
+        // Expected time spent in the stage per request it blocks; the +1s keep
+        // stages that were never sampled or never block comparable.
+        score[index] = (cost / (samples + 1.0)) * (samples + 2.0) / (hits + 1.0);
+        order[i] = index;
+    }
+    // Insertion sort, stable: ties keep their current order.
+    for (size_t i = 1; i < count; ++i)
+    {
+        const size_t index = order[i];
+        size_t j = i;
+        for (; j > 0 && score[order[j - 1]] > score[index]; --j)
+            order[j] = order[j - 1];
+        order[j] = index;
+    }
+
+    uint64_t next = count;
+    for (size_t i = 0; i < count; ++i)
+        next |= (uint64_t)order[i] << (4 + 4 * i);
+    order_.store(next, std::memory_order_release);
+
+    for (const auto &stage : stages_)
+    {
+        Halve(stage->samples);
+        Halve(stage->hits);
+        Halve(stage->cost_ns);
+    }
+}
+
+std::vector<FilterPipeline::StageProfile> FilterPipeline::Profile() const
+{
+    auto report = [&](size_t index, size_t position)
+    {
+        const Stage &stage = *stages_[index];
+        StageProfile p;
+        p.name = stage.filter->name();
+        p.policy = stage.policy;
+        p.enabled = stage.filter->enabled();
+        p.position = position;
+        p.samples = stage.samples.load(std::memory_order_relaxed);
+        p.hits = std::min(stage.hits.load(std::memory_order_relaxed), p.samples);
+        p.cost_ns = stage.cost_ns.load(std::memory_order_relaxed);
+        return p;
+    };
+    std::vector<StageProfile> out;
+    for (size_t i = 0; i < policy_.size(); ++i)
+        out.push_back(report(policy_[i], i));
+    const uint64_t order = order_.load(std::memory_order_acquire);
+    for (size_t i = 0, n = OrderSize(order); i < n; ++i)
+        out.push_back(report(OrderAt(order, i), i));
+    return out;
+}
+
+void FilterPipeline::Log(RequestLog::Decision decision, const MatchedRule &rule, std::string_view url)
+{
+    log_.Push(decision, rule.kind, rule.text, url);
+}
+
+void FilterPipeline::set_log_requests(bool v)
+{
+    std::lock_guard<std::mutex> lock(log_mtx_);
+    if (v && !log_.running())
+        log_.Start(log_path_);
+    log_requests_.store(v, std::memory_order_relaxed);
+    if (!v && log_.running())
+        log_.Stop();
+}
+
+void FilterPipeline::SetRequestLogPath(const std::string &path)
+{
+    std::lock_guard<std::mutex> lock(log_mtx_);
+    log_path_ = path;
+    if (log_.running())
+        log_.Start(log_path_);
+}
+
+std::string FilterPipeline::StatsJSON() const
+{
+    std::string json = stats_.Collect().ToJSON();
+    if (json.empty() || json.back() != '}')
+        return json;
+    json.pop_back();
+    json += ",\"stages\":[";
+    const std::vector<StageProfile> stages = Profile();
+    for (size_t i = 0; i < stages.size(); ++i)
+    {
+        const StageProfile &s = stages[i];
+        json += i ? ",{" : "{";
+        json += "\"name\":\"";
+        FilterStats::AppendEscaped(json, s.name);
+        json += "\",\"policy\":";
+        json += s.policy ? "true" : "false";
+        json += ",\"enabled\":";
+        json += s.enabled ? "true" : "false";
+        json += ",\"position\":" + std::to_string(s.position);
+        json += ",\"samples\":" + std::to_string(s.samples);
+        json += ",\"hits\":" + std::to_string(s.hits);
+        json += ",\"mean_cost_ns\":" + std::to_string(s.mean_cost_ns());
+        json += "}";
+    }
+    json += "]}";
+    return json;
+}
+
+bool FilterPipeline::WriteStats(const std::string &path) const
+{
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out.is_open())
+        return false;
+    out << StatsJSON() << '\n';
+    return (bool)out;
+}
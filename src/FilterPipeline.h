@@ -0,0 +1,134 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "FilterStats.h"
+#include "RequestFilter.h"
+#include "RequestLog.h"
+
+// Runs a request past independent RequestFilter stages and stops at the first
+// decisive one.
+//
+// Policy stages (the site allowlist) run first, in the order they were added,
+// and may Allow a request outright. Blocking stages (ads, trackers) run after
+// them; the first Block cancels the request and the rest are skipped. A
+// stage's "@@" exception only overrides that stage's own blocking rules, so
+// the verdict does not depend on the order blocking stages run in, only the
+// cost does: they run cheapest-per-block first. The order is learned online.
+// One request in FilterStats::kSampleInterval, after it has been decided and
+// timed, is run past every enabled stage with each stage timed on its own;
+// every kReorderInterval such samples the blocking stages are sorted by mean
+// cost over block rate (the expected cost of reaching a verdict through them)
+// and the new order is published with one atomic store. The counters are
+// halved at each reorder so the order follows changes in browsing and lists.
+//
+// Each stage can be turned off on its own (RequestFilter::set_enabled) and
+// reports its own cost and block rate (Profile()). The pipeline as a whole
+// keeps the request latency histogram and rule hits (FilterStats) and, while
+// logging is on, queues decisions in a RequestLog: requests a policy stage
+// allowed, and requests a blocking stage blocked or excepted by a rule with
+// text. Requests no stage decided on are not logged.
+class FilterPipeline
+{
+public:
+    static constexpr size_t kMaxStages = 15;          // stage indices are packed in 4 bits
+    static constexpr uint32_t kReorderInterval = 64;  // samples between reorders
+
+    struct StageProfile
+    {
+        std::string name;
+        bool policy = false;
+        bool enabled = true;
+        size_t position = 0; // evaluation order among the stages of its kind
+        uint64_t samples = 0; // recent sampled evaluations (halved at each reorder)
+        uint64_t hits = 0;    // of which decisive
+        uint64_t cost_ns = 0; // total over samples
+        double hit_rate() const { return samples ? (double)hits / (double)samples : 0.0; }
+        uint64_t mean_cost_ns() const { return samples ? cost_ns / samples : 0; }
+    };
+
+    FilterPipeline() = default;
+    FilterPipeline(const FilterPipeline &) = delete;
+    FilterPipeline &operator=(const FilterPipeline &) = delete;
+
+    // Add a stage that may Allow requests, or one that may Block them. Stages
+    // are added before the first request and live as long as the pipeline.
+    // Returns the stage, or nullptr once kMaxStages are in.
+    template <typename T>
+    T *AddPolicy(std::unique_ptr<T> stage) { return static_cast<T *>(Add(std::move(stage), true)); }
+    template <typename T>
+    T *AddBlocker(std::unique_ptr<T> stage) { return static_cast<T *>(Add(std::move(stage), false)); }
+    // The stage called name, or nullptr.
+    RequestFilter *stage(std::string_view name) const;
+
+    // Decide on request: true lets it through. Thread-safe and lock-free.
+    bool Allow(const FilterRequest &request);
+
+    // Turn all filtering off (every request allowed) or back on.
+    void set_enabled(bool enabled) { enabled_.store(enabled, std::memory_order_relaxed); }
+    bool enabled() const { return enabled_.load(std::memory_order_relaxed); }
+
+    // Sort the blocking stages by their measured cost per block now, rather
+    // than at the next kReorderInterval samples.
+    void Reorder();
+    // Per-stage counters, policy stages first, then blocking stages in the
+    // order they currently run.
+    std::vector<StageProfile> Profile() const;
+
+    // Log every decision (see RequestLog).
+    void set_log_requests(bool v);
+    // Where logged decisions are written, rotated at 1 MiB. Without a path they
+    // are only kept for RecentRequestsJSON().
+    void SetRequestLogPath(const std::string &path);
+    // The latest logged decisions, for the quick inspector (see RequestLog::RecentJSON).
+    std::string RecentRequestsJSON() const { return log_.RecentJSON(); }
+
+    // Request latency histogram and per-rule hits/costs since startup.
+    FilterStats::Report stats() const { return stats_.Collect(); }
+    // The same as JSON (see FilterStats::Report::ToJSON), plus a "stages" array
+    // of Profile(), for the quick inspector.
+    std::string StatsJSON() const;
+    // Write StatsJSON() to path. Returns false when the file cannot be written.
+    bool WriteStats(const std::string &path) const;
+
+private:
+    struct Stage
+    {
+        std::unique_ptr<RequestFilter> filter;
+        bool policy = false;
+        alignas(64) std::atomic<uint64_t> samples{0};
+        std::atomic<uint64_t> hits{0};
+        std::atomic<uint64_t> cost_ns{0};
+    };
+
+    RequestFilter *Add(std::unique_ptr<RequestFilter> stage, bool policy);
+    // Run request past every enabled stage, timing each one, then reorder
+    // when kReorderInterval samples have accumulated.
+    void Sample(const FilterRequest &request);
+    // Caller holds reorder_mtx_.
+    void ReorderLocked();
+    void Log(RequestLog::Decision decision, const MatchedRule &rule, std::string_view url);
+
+    // Blocking stage indices in run order, 4 bits each from bit 4 up; the
+    // count in bits 0-3.
+    static size_t OrderSize(uint64_t order) { return (size_t)(order & 0xf); }
+    static size_t OrderAt(uint64_t order, size_t i) { return (size_t)((order >> (4 + 4 * i)) & 0xf); }
+
+    std::vector<std::unique_ptr<Stage>> stages_; // fixed once requests start
+    std::vector<size_t> policy_;                 // policy stage indices, in order added
+    std::atomic<uint64_t> order_{0};
+    std::atomic<uint32_t> samples_{0};
+    std::mutex reorder_mtx_; // one reorder at a time; never taken per request
+    FilterStats stats_;
+    RequestLog log_;
+    std::mutex log_mtx_;   // guards log_path_, starting and stopping log_
+    std::string log_path_;
+    std::atomic<bool> log_requests_{false};
+    std::atomic<bool> enabled_{true};
+};
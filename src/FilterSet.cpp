@@ -0,0 +1,144 @@
+#include "FilterSet.h"
+
+#include <algorithm>
+#include <unordered_set>
+
+FilterSet::FilterSet() : base_(std::make_shared<FilterEngine>()) {}
+
+FilterSet::FilterSet(EnginePtr base, std::vector<std::string> base_sources)
+    : base_(base ? std::move(base) : std::make_shared<FilterEngine>()), base_sources_(std::move(base_sources))
+{
+}
+
+const FilterEngine *FilterSet::layer(std::string_view source) const
+{
+    for (const auto &l : layers_)
+    {
+        if (l.source == source)
+            return l.engine.get();
+    }
+    return nullptr;
+}
+
+FilterSet FilterSet::WithBase(EnginePtr base, std::vector<std::string> base_sources) const
+{
+    FilterSet next(std::move(base), std::move(base_sources));
+    next.layers_ = layers_;
+    return next;
+}
+
+FilterSet FilterSet::WithLayer(const std::string &source, EnginePtr engine) const
+{
+    FilterSet next = *this; // shares every engine
+    auto it = std::find_if(next.layers_.begin(), next.layers_.end(), [&](const Layer &l)
+                           { return l.source == source; });
+    if (!engine)
+    {
+        if (it != next.layers_.end())
+            next.layers_.erase(it);
+    }
+    else if (it != next.layers_.end())
+    {
+        it->engine = std::move(engine);
+    }
+    else
+    {
+        next.layers_.push_back({source, std::move(engine)});
+    }
+    return next;
+}
+
+FilterVerdict FilterSet::Match(const RequestContext &ctx) const
+{
+    return Match(ctx, !ctx.host.empty() && IsBlockedHost(ctx.host));
+}
+
+FilterVerdict FilterSet::Match(const RequestContext &ctx, bool host_blocked) const
+{
+    if (layers_.empty())
+        return base_->Match(ctx, host_blocked);
+
+    FilterVerdict verdict = FilterVerdict::Allow;
+    AnyEngine([&](const FilterEngine &e)
+              {
+        verdict = e.MatchBlocking(ctx, host_blocked);
+        return verdict != FilterVerdict::Allow; });
+    if (verdict == FilterVerdict::Allow)
+        return verdict;
+    // An exception in any list overrides a block from any other
+    if (MatchesException(ctx))
+        return FilterVerdict::Exception;
+    return verdict;
+}
+
+bool FilterSet::IsBlockedHost(std::string_view host) const
+{
+    return AnyEngine([&](const FilterEngine &e)
+                     { return e.IsBlockedHost(host); });
+}
+
+bool FilterSet::MatchesException(const RequestContext &ctx) const
+{
+    return AnyEngine([&](const FilterEngine &e)
+                     { return e.MatchesException(ctx); });
+}
+
+bool FilterSet::Explain(const RequestContext &ctx, FilterVerdict verdict, MatchedRule &out) const
+{
+    return AnyEngine([&](const FilterEngine &e)
+                     { return e.Explain(ctx, verdict, out); });
+}
+
+std::vector<std::string_view> FilterSet::GenericHidingSelectors() const
+{
+    std::unordered_set<std::string_view> skip;
+    AnyEngine([&](const FilterEngine &e)
+              {
+        e.cosmetic().ForEachException([&](std::string_view sel)
+                                       { skip.insert(sel); });
+        return false; });
+    std::vector<std::string_view> out;
+    AnyEngine([&](const FilterEngine &e)
+              {
+        e.cosmetic().ForEachGeneric([&](std::string_view sel)
+                                    {
+            if (skip.insert(sel).second)
+                out.push_back(sel); });
+        return false; });
+    return out;
+}
+
+std::vector<std::string_view> FilterSet::HidingSelectorsForHost(std::string_view host) const
+{
+    std::vector<std::string_view> hide, unhide;
+    AnyEngine([&](const FilterEngine &e)
+              {
+        e.cosmetic().CollectForHost(host, hide, unhide);
+        return false; });
+    // Generic rules that some exception kept out of the shared sheet
+    AnyEngine([&](const FilterEngine &e)
+              {
+        e.cosmetic().ForEachException([&](std::string_view sel)
+                                      {
+            if (AnyEngine([&](const FilterEngine &g)
+                          { return g.cosmetic().HasGeneric(sel); }))
+                hide.push_back(sel); });
+        return false; });
+
+    std::unordered_set<std::string_view> skip(unhide.begin(), unhide.end());
+    std::vector<std::string_view> out;
+    for (std::string_view sel : hide)
+    {
+        if (skip.insert(sel).second)
+            out.push_back(sel);
+    }
+    return out;
+}
+
+size_t FilterSet::rule_count() const
+{
+    size_t n = base_->rule_count();
+    for (const auto &l : layers_)
+        n += l.engine->rule_count();
+    return n;
+}
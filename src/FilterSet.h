@@ -0,0 +1,93 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "FilterEngine.h"
+
+// Immutable set of built FilterEngines matched as one rule set.
+//
+// The base engine holds the lists loaded in bulk (a snapshot, or every file
+// merged by FilterLoader) and remembers which files went into it. Layers hold
+// one engine per source file that has to be replaceable on its own, such as a
+// list that changed on disk; swapping a layer re-parses only that file and
+// shares every other engine with the previous set.
+//
+// A request is blocked when any engine blocks it and excepted when any
+// engine's "@@" rules apply, exactly as if all rules lived in one engine.
+// Each layer adds one pass over the request, so layers are meant to stay few.
+class FilterSet
+{
+public:
+    using EnginePtr = std::shared_ptr<const FilterEngine>;
+
+    struct Layer
+    {
+        std::string source; // file path, or another caller-chosen name
+        EnginePtr engine;
+    };
+
+    FilterSet();
+    FilterSet(EnginePtr base, std::vector<std::string> base_sources);
+
+    const FilterEngine &base() const { return *base_; }
+    const EnginePtr &base_ptr() const { return base_; }
+    // Files merged into the base engine, in load order.
+    const std::vector<std::string> &base_sources() const { return base_sources_; }
+    const std::vector<Layer> &layers() const { return layers_; }
+    // The layer engine for source, or nullptr.
+    const FilterEngine *layer(std::string_view source) const;
+
+    // Copy with a different base; layers are kept.
+    FilterSet WithBase(EnginePtr base, std::vector<std::string> base_sources) const;
+    // Copy with source's layer set to engine: replaced in place, appended when
+    // new, removed when engine is null.
+    FilterSet WithLayer(const std::string &source, EnginePtr engine) const;
+
+    FilterVerdict Match(const RequestContext &ctx) const;
+    // Same, with IsBlockedHost(ctx.host) already known.
+    FilterVerdict Match(const RequestContext &ctx, bool host_blocked) const;
+    bool IsBlockedHost(std::string_view host) const;
+    // True when an "@@" rule of any engine applies to ctx.
+    bool MatchesException(const RequestContext &ctx) const;
+    // See FilterEngine::Explain.
+    bool Explain(const RequestContext &ctx, FilterVerdict verdict, MatchedRule &out) const;
+    // See FilterEngine::ProfileGlobs.
+    template <typename Fn>
+    void ProfileGlobs(std::string_view url, Fn &&fn) const
+    {
+        base_->ProfileGlobs(url, fn);
+        for (const auto &l : layers_)
+            l.engine->ProfileGlobs(url, fn);
+    }
+
+    // Selectors of the generic element hiding rules that no exception in the
+    // set suppresses anywhere, deduplicated: what every page can share.
+    std::vector<std::string_view> GenericHidingSelectors() const;
+    // Selectors to hide on host (lowercase) on top of GenericHidingSelectors():
+    // site-specific rules, and generic rules held back from the shared sheet
+    // by an exception that does not apply on host.
+    std::vector<std::string_view> HidingSelectorsForHost(std::string_view host) const;
+
+    size_t rule_count() const;
+
+private:
+    // Call fn(engine) for the base and each layer, stopping when it returns true.
+    template <typename Fn>
+    bool AnyEngine(Fn &&fn) const
+    {
+        if (fn(*base_))
+            return true;
+        for (const auto &l : layers_)
+        {
+            if (fn(*l.engine))
+                return true;
+        }
+        return false;
+    }
+
+    EnginePtr base_;
+    std::vector<std::string> base_sources_;
+    std::vector<Layer> layers_;
+};
@@ -0,0 +1,298 @@
+#include "FilterSnapshot.h"
+#include "StringArena.h"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <system_error>
+
+#if defined(_WIN32)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+    const char kMagic[8] = {'U', 'L', 'A', 'D', 'S', 'N', 'A', 'P'};
+    constexpr uint32_t kByteOrderMark = 0x01020304;
+    constexpr size_t kAlign = 8;
+
+    struct FileHeader
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t byte_order;
+        uint64_t fingerprint;
+        uint64_t file_size;
+        uint64_t offsets[FilterSnapshot::kSectionCount];
+        uint64_t sizes[FilterSnapshot::kSectionCount];
+    };
+
+    size_t AlignUp(size_t n)
+    {
+        return (n + kAlign - 1) & ~(kAlign - 1);
+    }
+
+    void SetError(std::string *error, std::string message)
+    {
+        if (error)
+            *error = std::move(message);
+    }
+
+    uint64_t HashBytes(uint64_t h, const void *data, size_t size)
+    {
+        const unsigned char *p = static_cast<const unsigned char *>(data);
+        for (size_t i = 0; i < size; ++i)
+            h = (h ^ p[i]) * 1099511628211ull;
+        return h;
+    }
+}
+
+// --- Writer ---
+
+void FilterSnapshot::Writer::Add(Section section, const void *data, size_t size)
+{
+    sections_[section].assign(static_cast<const char *>(data), size);
+}
+
+void FilterSnapshot::Writer::AddLines(Section section, const std::vector<std::string_view> &lines)
+{
+    std::string &out = sections_[section];
+    out.clear();
+    for (std::string_view line : lines)
+    {
+        if (!out.empty())
+            out += '\n';
+        out += line;
+    }
+}
+
+void FilterSnapshot::Writer::AddLines(Section section, const StringArena &lines)
+{
+    std::vector<std::string_view> views;
+    views.reserve(lines.size());
+    for (uint32_t id = 0; id < lines.size(); ++id)
+        views.push_back(lines.Get(id));
+    AddLines(section, views);
+}
+
+bool FilterSnapshot::Writer::Save(const std::string &path, uint64_t fingerprint, std::string *error) const
+{
+    FileHeader header = {};
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kVersion;
+    header.byte_order = kByteOrderMark;
+    header.fingerprint = fingerprint;
+
+    size_t offset = AlignUp(sizeof(FileHeader));
+    for (size_t s = 0; s < kSectionCount; ++s)
+    {
+        header.offsets[s] = offset;
+        header.sizes[s] = sections_[s].size();
+        offset = AlignUp(offset + sections_[s].size());
+    }
+    header.file_size = offset;
+
+    // Write next to the target and rename, so a reader never maps a half-written file.
+    const std::string tmp = path + ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        if (!out.is_open())
+        {
+            SetError(error, "cannot open " + tmp + " for writing");
+            return false;
+        }
+        const char zeros[kAlign] = {};
+        out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        out.write(zeros, AlignUp(sizeof(header)) - sizeof(header));
+        for (const auto &section : sections_)
+        {
+            out.write(section.data(), (std::streamsize)section.size());
+            out.write(zeros, AlignUp(section.size()) - section.size());
+        }
+        if (!out.good())
+        {
+            SetError(error, "failed writing " + tmp);
+            return false;
+        }
+    }
+    std::error_code ec;
+    std::filesystem::rename(tmp, path, ec);
+    if (ec)
+    {
+        SetError(error, "cannot replace " + path + ": " + ec.message());
+        std::filesystem::remove(tmp, ec);
+        return false;
+    }
+    return true;
+}
+
+// --- Reader ---
+
+FilterSnapshot::~FilterSnapshot()
+{
+#if defined(_WIN32)
+    if (data_)
+        UnmapViewOfFile(data_);
+    if (mapping_)
+        CloseHandle(mapping_);
+    if (file_ && file_ != INVALID_HANDLE_VALUE)
+        CloseHandle(file_);
+#else
+    if (data_)
+        munmap(const_cast<char *>(data_), size_);
+#endif
+}
+
+std::shared_ptr<const FilterSnapshot> FilterSnapshot::Open(const std::string &path, std::string *error)
+{
+    std::shared_ptr<FilterSnapshot> snap(new FilterSnapshot());
+
+#if defined(_WIN32)
+    snap->file_ = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (snap->file_ == INVALID_HANDLE_VALUE)
+    {
+        SetError(error, "cannot open " + path);
+        return nullptr;
+    }
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(snap->file_, &size) || size.QuadPart < (LONGLONG)sizeof(FileHeader))
+    {
+        SetError(error, path + " is too small to be a snapshot");
+        return nullptr;
+    }
+    snap->mapping_ = CreateFileMappingA(snap->file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!snap->mapping_)
+    {
+        SetError(error, "cannot map " + path);
+        return nullptr;
+    }
+    snap->data_ = static_cast<const char *>(MapViewOfFile(snap->mapping_, FILE_MAP_READ, 0, 0, 0));
+    if (!snap->data_)
+    {
+        SetError(error, "cannot map " + path);
+        return nullptr;
+    }
+    snap->size_ = (size_t)size.QuadPart;
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        SetError(error, "cannot open " + path);
+        return nullptr;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(FileHeader))
+    {
+        ::close(fd);
+        SetError(error, path + " is too small to be a snapshot");
+        return nullptr;
+    }
+    void *mapped = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd); // the mapping keeps the file alive
+    if (mapped == MAP_FAILED)
+    {
+        SetError(error, "cannot map " + path);
+        return nullptr;
+    }
+    snap->data_ = static_cast<const char *>(mapped);
+    snap->size_ = (size_t)st.st_size;
+#endif
+
+    FileHeader header;
+    std::memcpy(&header, snap->data_, sizeof(header));
+    if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 || header.byte_order != kByteOrderMark)
+    {
+        SetError(error, path + " is not a filter snapshot");
+        return nullptr;
+    }
+    if (header.version != kVersion)
+    {
+        SetError(error, path + " was written by snapshot version " + std::to_string(header.version));
+        return nullptr;
+    }
+    if (header.file_size != snap->size_)
+    {
+        SetError(error, path + " is truncated");
+        return nullptr;
+    }
+    for (size_t s = 0; s < kSectionCount; ++s)
+    {
+        if (header.offsets[s] % kAlign != 0 || header.offsets[s] > snap->size_ ||
+            header.sizes[s] > snap->size_ - header.offsets[s])
+        {
+            SetError(error, path + " has a corrupt section table");
+            return nullptr;
+        }
+        snap->offsets_[s] = header.offsets[s];
+        snap->sizes_[s] = header.sizes[s];
+    }
+    snap->fingerprint_ = header.fingerprint;
+    return snap;
+}
+
+std::string_view FilterSnapshot::Bytes(Section section) const
+{
+    if (section >= kSectionCount || !data_)
+        return {};
+    return std::string_view(data_ + offsets_[section], (size_t)sizes_[section]);
+}
+
+// --- Sources ---
+
+std::vector<std::string> FilterSnapshot::ExpandSources(const std::vector<std::string> &inputs)
+{
+    namespace fs = std::filesystem;
+    std::vector<std::string> out;
+    for (const auto &input : inputs)
+    {
+        std::error_code ec;
+        if (!fs::is_directory(input, ec))
+        {
+            out.push_back(input);
+            continue;
+        }
+        // Same selection as AdBlocker::LoadBlocklistsInDirectory, in a stable order
+        std::vector<std::string> files;
+        for (fs::directory_iterator it(input, ec), end; !ec && it != end; it.increment(ec))
+        {
+            if (it->is_regular_file(ec) && it->path().extension() == ".txt")
+                files.push_back(it->path().string());
+        }
+        std::sort(files.begin(), files.end());
+        out.insert(out.end(), files.begin(), files.end());
+    }
+    return out;
+}
+
+uint64_t FilterSnapshot::Fingerprint(const std::vector<std::string> &sources)
+{
+    namespace fs = std::filesystem;
+    uint64_t h = HashBytes(14695981039346656037ull, &kVersion, sizeof(kVersion));
+    for (const auto &path : sources)
+    {
+        h = HashBytes(h, path.data(), path.size() + 1);
+        std::error_code ec;
+        uint64_t size = fs::file_size(path, ec);
+        if (ec)
+            size = UINT64_MAX; // missing source: never matches a snapshot built with it
+        int64_t mtime = (int64_t)fs::last_write_time(path, ec).time_since_epoch().count();
+        if (ec)
+            mtime = 0;
+        h = HashBytes(h, &size, sizeof(size));
+        h = HashBytes(h, &mtime, sizeof(mtime));
+    }
+    return h;
+}
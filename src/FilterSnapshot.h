@@ -0,0 +1,117 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class StringArena;
+
+// Versioned binary image of a compiled FilterEngine.
+//
+// The file is a fixed header followed by 8-byte aligned sections holding the
+// engine's tables exactly as they sit in memory (host hash table and string
+// pool, substring automaton) plus the normalized text of the few pattern rules
+// that are cheap to recompile. Open() maps the file read-only and the engine
+// points its indexes straight into the mapping, so loading costs a page-in
+// instead of a parse.
+//
+// The header records a fingerprint of the source lists (path, size and
+// modification time of each); a snapshot whose fingerprint differs from the
+// lists on disk is stale and callers fall back to parsing the text.
+class FilterSnapshot
+{
+public:
+    static constexpr uint32_t kVersion = 5;
+
+    enum Section : uint32_t
+    {
+        kHostSlots,
+        kHostOffsets,
+        kHostPool,
+        kHostBloom,
+        kSubstringClasses,
+        kSubstringTable,
+        kSubstringAccept,
+        kSubstringRules, // '\n'-separated
+        kGlobRules,      // '\n'-separated
+        kFilterRules,    // '\n'-separated raw Adblock Plus lines
+        kCosmeticRules,  // '\n'-separated element hiding lines
+        kRegexRules,     // '\n'-separated "/regex/" lines
+        kSectionCount,
+    };
+
+    // Collects sections and writes them out in the snapshot layout.
+    class Writer
+    {
+    public:
+        void Add(Section section, const void *data, size_t size);
+        template <typename T>
+        void Add(Section section, const std::vector<T> &items)
+        {
+            Add(section, items.data(), items.size() * sizeof(T));
+        }
+        // Join lines with '\n' into one section.
+        void AddLines(Section section, const std::vector<std::string_view> &lines);
+        void AddLines(Section section, const StringArena &lines);
+
+        bool Save(const std::string &path, uint64_t fingerprint, std::string *error = nullptr) const;
+
+    private:
+        std::string sections_[kSectionCount];
+    };
+
+    ~FilterSnapshot();
+    FilterSnapshot(const FilterSnapshot &) = delete;
+    FilterSnapshot &operator=(const FilterSnapshot &) = delete;
+
+    // Map a snapshot file. Returns nullptr when it is missing, truncated or
+    // written by another version.
+    static std::shared_ptr<const FilterSnapshot> Open(const std::string &path, std::string *error = nullptr);
+
+    uint64_t fingerprint() const { return fingerprint_; }
+    size_t size_bytes() const { return size_; }
+
+    std::string_view Bytes(Section section) const;
+    template <typename T>
+    const T *Array(Section section, size_t &count) const
+    {
+        std::string_view bytes = Bytes(section);
+        count = bytes.size() / sizeof(T);
+        return reinterpret_cast<const T *>(bytes.data());
+    }
+    // Call fn(line) for each line of a '\n'-separated section.
+    template <typename Fn>
+    void ForEachLine(Section section, Fn &&fn) const
+    {
+        std::string_view text = Bytes(section);
+        while (!text.empty())
+        {
+            size_t nl = text.find('\n');
+            fn(text.substr(0, nl));
+            if (nl == std::string_view::npos)
+                break;
+            text.remove_prefix(nl + 1);
+        }
+    }
+
+    // Expand list files and directories (their *.txt files, sorted) into the
+    // ordered source list a snapshot is built from.
+    static std::vector<std::string> ExpandSources(const std::vector<std::string> &inputs);
+    // Fingerprint of the sources' paths, sizes and modification times.
+    static uint64_t Fingerprint(const std::vector<std::string> &sources);
+
+private:
+    FilterSnapshot() = default;
+
+    const char *data_ = nullptr;
+    size_t size_ = 0;
+    uint64_t fingerprint_ = 0;
+    uint64_t offsets_[kSectionCount] = {};
+    uint64_t sizes_[kSectionCount] = {};
+#if defined(_WIN32)
+    void *file_ = nullptr;
+    void *mapping_ = nullptr;
+#endif
+};
@@ -0,0 +1,296 @@
+#include "FilterStats.h"
+
+#include <algorithm>
+#include <cstdio>
+
+namespace
+{
+    constexpr size_t kMaxProbes = 16;
+
+    // Counters have a single writer, so a load and a store replace fetch_add.
+    inline void Bump(std::atomic<uint64_t> &counter, uint64_t n = 1)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    inline int Log2(uint64_t v)
+    {
+#if defined(__GNUC__)
+        return 63 - __builtin_clzll(v);
+#else
+        int r = 0;
+        while (v >>= 1)
+            ++r;
+        return r;
+#endif
+    }
+
+    uint64_t RuleKey(const MatchedRule &rule)
+    {
+        uint64_t h = 14695981039346656037ull;
+        for (unsigned char c : rule.text)
+            h = (h ^ c) * 1099511628211ull;
+        h ^= ((uint64_t)rule.kind + 1) * 0x9E3779B97F4A7C15ull;
+        return h ? h : 1;
+    }
+
+    std::atomic<uint64_t> g_next_id{1};
+
+    void AppendRule(std::string &out, const FilterStats::RuleReport &r)
+    {
+        out += "{\"kind\":\"";
+        out += FilterStats::KindName(r.kind);
+        out += "\",\"rule\":\"";
+        FilterStats::AppendEscaped(out, r.rule);
+        out += "\",\"hits\":" + std::to_string(r.hits);
+        out += ",\"cost_samples\":" + std::to_string(r.cost_samples);
+        out += ",\"mean_cost_ns\":" + std::to_string(r.mean_cost_ns());
+        out += std::string(",\"expensive\":") + (r.expensive() ? "true" : "false") + "}";
+    }
+}
+
+FilterStats::FilterStats() : id_(g_next_id++) {}
+
+void FilterStats::AppendEscaped(std::string &out, std::string_view s)
+{
+    for (char c : s)
+    {
+        switch (c)
+        {
+        case '"':
+            out += "\\\"";
+            break;
+        case '\\':
+            out += "\\\\";
+            break;
+        default:
+            if ((unsigned char)c < 0x20)
+            {
+                char buf[8];
+                std::snprintf(buf, sizeof(buf), "\\u%04x", (unsigned)c);
+                out += buf;
+            }
+            else
+            {
+                out += c;
+            }
+        }
+    }
+}
+
+FilterStats::~FilterStats() = default;
+
+FilterStats::ThreadStats &FilterStats::Local()
+{
+    // (instance id, block) pairs of the calling thread; ids are never reused,
+    // so entries of destroyed instances simply never match again.
+    thread_local std::vector<std::pair<uint64_t, ThreadStats *>> mine;
+    for (auto it = mine.rbegin(); it != mine.rend(); ++it)
+    {
+        if (it->first == id_)
+            return *it->second;
+    }
+    std::lock_guard<std::mutex> lock(mtx_);
+    threads_.push_back(std::make_unique<ThreadStats>());
+    mine.emplace_back(id_, threads_.back().get());
+    return *threads_.back();
+}
+
+FilterStats::RuleSlot *FilterStats::Slot(ThreadStats &local, const MatchedRule &rule)
+{
+    const uint64_t key = RuleKey(rule);
+    for (size_t probe = 0, i = key & (kRuleSlots - 1); probe < kMaxProbes; ++probe, i = (i + 1) & (kRuleSlots - 1))
+    {
+        RuleSlot &slot = local.rules[i];
+        uint64_t k = slot.key.load(std::memory_order_relaxed);
+        if (k == key)
+            return &slot;
+        if (k != 0)
+            continue;
+        {
+            // First time this thread sees the rule: make sure it has a name
+            // before Collect() can find its key.
+            std::lock_guard<std::mutex> lock(mtx_);
+            names_.emplace(key, std::make_pair(rule.kind, std::string(rule.text)));
+        }
+        slot.key.store(key, std::memory_order_release);
+        return &slot;
+    }
+    return nullptr;
+}
+
+void FilterStats::RecordRequest(uint64_t ns, bool blocked)
+{
+    ThreadStats &local = Local();
+    Bump(local.requests);
+    if (blocked)
+        Bump(local.blocked);
+    Bump(local.latency[LatencyBucket(ns)]);
+}
+
+void FilterStats::RecordHit(const MatchedRule &rule)
+{
+    ThreadStats &local = Local();
+    if (RuleSlot *slot = Slot(local, rule))
+        Bump(slot->hits);
+    else
+        Bump(local.untracked);
+}
+
+void FilterStats::RecordCost(const MatchedRule &rule, uint64_t ns)
+{
+    ThreadStats &local = Local();
+    if (RuleSlot *slot = Slot(local, rule))
+    {
+        Bump(slot->cost_ns, ns);
+        Bump(slot->cost_samples);
+    }
+}
+
+bool FilterStats::ShouldSample()
+{
+    return ++Local().sample_tick % kSampleInterval == 0;
+}
+
+FilterStats::Report FilterStats::Collect() const
+{
+    Report report;
+    report.latency.assign(kLatencyBuckets, 0);
+    std::unordered_map<uint64_t, RuleReport> rules;
+
+    std::lock_guard<std::mutex> lock(mtx_);
+    for (const auto &t : threads_)
+    {
+        report.requests += t->requests.load(std::memory_order_relaxed);
+        report.blocked += t->blocked.load(std::memory_order_relaxed);
+        report.untracked_hits += t->untracked.load(std::memory_order_relaxed);
+        for (size_t b = 0; b < kLatencyBuckets; ++b)
+            report.latency[b] += t->latency[b].load(std::memory_order_relaxed);
+        for (const RuleSlot &slot : t->rules)
+        {
+            uint64_t key = slot.key.load(std::memory_order_acquire);
+            if (key == 0)
+                continue;
+            RuleReport &r = rules[key];
+            r.hits += slot.hits.load(std::memory_order_relaxed);
+            r.cost_ns += slot.cost_ns.load(std::memory_order_relaxed);
+            r.cost_samples += slot.cost_samples.load(std::memory_order_relaxed);
+        }
+    }
+
+    report.rules.reserve(rules.size());
+    for (auto &entry : rules)
+    {
+        auto name = names_.find(entry.first);
+        if (name == names_.end())
+            continue;
+        entry.second.kind = name->second.first;
+        entry.second.rule = name->second.second;
+        report.rules.push_back(std::move(entry.second));
+    }
+    std::sort(report.rules.begin(), report.rules.end(), [](const RuleReport &a, const RuleReport &b)
+              { return a.hits != b.hits ? a.hits > b.hits : a.rule < b.rule; });
+    return report;
+}
+
+uint64_t FilterStats::Report::LatencyPercentile(double p) const
+{
+    uint64_t total = 0;
+    for (uint64_t n : latency)
+        total += n;
+    if (total == 0)
+        return 0;
+    uint64_t rank = (uint64_t)(p * (double)(total - 1)) + 1;
+    uint64_t seen = 0;
+    for (size_t b = 0; b < latency.size(); ++b)
+    {
+        seen += latency[b];
+        if (seen >= rank)
+            return b + 1 < kLatencyBuckets ? LatencyBucketLowerBound(b + 1) - 1 : UINT64_MAX;
+    }
+    return UINT64_MAX;
+}
+
+std::string FilterStats::Report::ToJSON(size_t max_rules) const
+{
+    std::string out = "{";
+    out += "\"requests\":" + std::to_string(requests);
+    out += ",\"blocked\":" + std::to_string(blocked);
+    out += ",\"untracked_hits\":" + std::to_string(untracked_hits);
+    out += ",\"latency_ns\":{\"p50\":" + std::to_string(LatencyPercentile(0.5));
+    out += ",\"p90\":" + std::to_string(LatencyPercentile(0.9));
+    out += ",\"p99\":" + std::to_string(LatencyPercentile(0.99));
+    out += ",\"max\":" + std::to_string(LatencyPercentile(1.0));
+    out += ",\"histogram\":[";
+    bool first = true;
+    for (size_t b = 0; b < latency.size(); ++b)
+    {
+        if (latency[b] == 0)
+            continue;
+        out += first ? "" : ",";
+        out += "[" + std::to_string(LatencyBucketLowerBound(b)) + "," + std::to_string(latency[b]) + "]";
+        first = false;
+    }
+    out += "]}";
+
+    out += ",\"top_rules\":[";
+    for (size_t i = 0; i < rules.size() && i < max_rules && rules[i].hits > 0; ++i)
+    {
+        out += i ? "," : "";
+        AppendRule(out, rules[i]);
+    }
+    out += "]";
+
+    std::vector<const RuleReport *> expensive;
+    for (const auto &r : rules)
+    {
+        if (r.expensive())
+            expensive.push_back(&r);
+    }
+    std::sort(expensive.begin(), expensive.end(), [](const RuleReport *a, const RuleReport *b)
+              { return a->mean_cost_ns() > b->mean_cost_ns(); });
+    out += ",\"expensive_rules\":[";
+    for (size_t i = 0; i < expensive.size(); ++i)
+    {
+        out += i ? "," : "";
+        AppendRule(out, *expensive[i]);
+    }
+    out += "]}";
+    return out;
+}
+
+size_t FilterStats::LatencyBucket(uint64_t ns)
+{
+    if (ns < 4)
+        return (size_t)ns;
+    int msb = Log2(ns);
+    return (size_t)(msb - 1) * 4 + (size_t)((ns >> (msb - 2)) & 3);
+}
+
+uint64_t FilterStats::LatencyBucketLowerBound(size_t bucket)
+{
+    if (bucket < 4)
+        return bucket;
+    int msb = (int)(bucket / 4) + 1;
+    return (uint64_t)(4 + bucket % 4) << (msb - 2);
+}
+
+const char *FilterStats::KindName(RuleKind kind)
+{
+    switch (kind)
+    {
+    case RuleKind::Host:
+        return "host";
+    case RuleKind::Substring:
+        return "substring";
+    case RuleKind::Glob:
+        return "glob";
+    case RuleKind::Regex:
+        return "regex";
+    case RuleKind::Filter:
+        return "filter";
+    case RuleKind::Exception:
+        return "exception";
+    }
+    return "unknown";
+}
@@ -0,0 +1,114 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "FilterEngine.h"
+
+// Request and per-rule counters for the ad blocker.
+//
+// Every thread that records gets its own counter block (registered once,
+// under a mutex, the first time it records). Its counters are written by
+// that thread alone with plain relaxed loads and stores, so recording never
+// takes a lock, never contends on a shared cache line and costs a handful of
+// instructions. Collect() sums the blocks of all threads; counts a thread is
+// writing at that instant may be missed until the next Collect().
+//
+// Tracked per thread:
+// - requests and blocked requests, and a log-linear histogram of request
+//   latency (4 buckets per power of two, so bucket bounds are within 25%)
+// - per-rule hits and sampled evaluation cost, in a fixed-size hash table of
+//   kRuleSlots rules; hits on rules that do not fit are only counted in total.
+//
+// Rules are keyed by kind and text rather than by position, so counts carry
+// over when the lists are reloaded.
+class FilterStats
+{
+public:
+    static constexpr size_t kRuleSlots = 4096;       // distinct rules tracked per thread
+    static constexpr size_t kLatencyBuckets = 252;   // covers the whole uint64_t range
+    static constexpr uint32_t kSampleInterval = 64;  // ShouldSample() is true for 1 request in this many
+    static constexpr uint64_t kExpensiveRuleNs = 1000; // mean cost above which a rule is flagged
+
+    struct RuleReport
+    {
+        RuleKind kind = RuleKind::Host;
+        std::string rule;
+        uint64_t hits = 0;
+        uint64_t cost_samples = 0;
+        uint64_t cost_ns = 0; // total over cost_samples
+        uint64_t mean_cost_ns() const { return cost_samples ? cost_ns / cost_samples : 0; }
+        bool expensive() const { return mean_cost_ns() > kExpensiveRuleNs; }
+    };
+
+    struct Report
+    {
+        uint64_t requests = 0;
+        uint64_t blocked = 0;
+        uint64_t untracked_hits = 0;   // hits on rules beyond a thread's kRuleSlots
+        std::vector<uint64_t> latency; // request count per LatencyBucket()
+        std::vector<RuleReport> rules; // most hits first
+
+        // Upper bound of the bucket holding the p-th quantile (p in [0, 1]).
+        uint64_t LatencyPercentile(double p) const;
+        // max_rules caps the "top_rules" list; expensive rules are always listed.
+        std::string ToJSON(size_t max_rules = 100) const;
+    };
+
+    FilterStats();
+    ~FilterStats();
+    FilterStats(const FilterStats &) = delete;
+    FilterStats &operator=(const FilterStats &) = delete;
+
+    // One request finished after ns nanoseconds.
+    void RecordRequest(uint64_t ns, bool blocked);
+    // rule decided a request.
+    void RecordHit(const MatchedRule &rule);
+    // rule took ns to evaluate on a sampled request.
+    void RecordCost(const MatchedRule &rule, uint64_t ns);
+    // True for one call in kSampleInterval on the calling thread.
+    bool ShouldSample();
+
+    Report Collect() const;
+
+    static size_t LatencyBucket(uint64_t ns);
+    static uint64_t LatencyBucketLowerBound(size_t bucket);
+    static const char *KindName(RuleKind kind);
+    // Append s to out escaped for a JSON string literal.
+    static void AppendEscaped(std::string &out, std::string_view s);
+
+private:
+    struct RuleSlot
+    {
+        std::atomic<uint64_t> key{0}; // 0 = empty
+        std::atomic<uint64_t> hits{0};
+        std::atomic<uint64_t> cost_ns{0};
+        std::atomic<uint64_t> cost_samples{0};
+    };
+
+    struct alignas(64) ThreadStats
+    {
+        std::atomic<uint64_t> requests{0};
+        std::atomic<uint64_t> blocked{0};
+        std::atomic<uint64_t> untracked{0};
+        std::atomic<uint64_t> latency[kLatencyBuckets] = {};
+        RuleSlot rules[kRuleSlots];
+        uint32_t sample_tick = 0; // owner thread only
+    };
+
+    ThreadStats &Local();
+    // Slot for rule in the calling thread's table, or nullptr when it is full.
+    RuleSlot *Slot(ThreadStats &local, const MatchedRule &rule);
+
+    const uint64_t id_; // tells instances apart in the thread-local lookup
+    mutable std::mutex mtx_; // guards threads_ and names_; never taken once a thread and rule are known
+    std::vector<std::unique_ptr<ThreadStats>> threads_;
+    std::unordered_map<uint64_t, std::pair<RuleKind, std::string>> names_; // key -> rule
+};
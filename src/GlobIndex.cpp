@@ -0,0 +1,129 @@
+#include "GlobIndex.h"
+
+#include <algorithm>
+
+bool GlobIndex::Add(std::string_view pattern)
+{
+    bool added = false;
+    if (!pattern.empty())
+        patterns_.Intern(pattern, &added);
+    return added;
+}
+
+void GlobIndex::Merge(GlobIndex &&other)
+{
+    for (uint32_t g = 0; g < other.patterns_.size(); ++g)
+        patterns_.Intern(other.patterns_.Get(g));
+    other.Clear();
+}
+
+void GlobIndex::Clear()
+{
+    patterns_.Clear();
+    compiled_.clear();
+    index_.Clear();
+}
+
+void GlobIndex::Build()
+{
+    compiled_.clear();
+    index_.Clear();
+    compiled_.reserve(patterns_.size());
+    for (size_t g = 0; g < patterns_.size(); ++g)
+    {
+        std::string_view p = patterns_.Get((uint32_t)g);
+        compiled_.push_back(Compile(p));
+        // A glob without a leading/trailing '*' spans the whole URL, so its
+        // boundary runs are complete tokens too.
+        index_.Add((uint32_t)g, TokenIndex::PatternTokens(p, "*?", true, true));
+    }
+    index_.Build();
+}
+
+uint32_t GlobIndex::Find(std::string_view url) const
+{
+    if (compiled_.empty())
+        return 0;
+
+    thread_local TokenIndex::Tokens tokens;
+    TokenIndex::TokenizeURL(url, tokens);
+    uint32_t found = 0;
+    index_.ForEachCandidate(tokens, [&](uint32_t g)
+                            {
+        if (!MatchCompiled(compiled_[g], url))
+            return false;
+        found = g + 1;
+        return true; });
+    return found;
+}
+
+bool GlobIndex::GlobMatch(std::string_view text, std::string_view pattern)
+{
+    if (pattern.empty())
+        return text.empty();
+    return MatchCompiled(Compile(pattern), text);
+}
+
+GlobIndex::Compiled GlobIndex::Compile(std::string_view pattern)
+{
+    Compiled out;
+    out.anchored_start = pattern.empty() || pattern.front() != '*';
+    out.anchored_end = pattern.empty() || pattern.back() != '*';
+
+    size_t i = 0;
+    while (i < pattern.size())
+    {
+        size_t star = pattern.find('*', i);
+        if (star == std::string_view::npos)
+            star = pattern.size();
+        if (star > i)
+            out.segments.emplace_back(pattern.substr(i, star - i), PatternSegment::kGlob);
+        i = star + 1;
+    }
+    return out;
+}
+
+bool GlobIndex::MatchCompiled(const Compiled &glob, std::string_view text)
+{
+    const auto &segs = glob.segments;
+    if (segs.empty())
+        return !glob.anchored_start || text.empty(); // "*" matches anything
+
+    if (glob.anchored_start && glob.anchored_end && segs.size() == 1)
+        return text.size() == segs[0].size() && segs[0].MatchesAt(text, 0);
+
+    size_t first = 0;
+    size_t last = segs.size();
+    size_t pos = 0;
+    size_t limit = text.size();
+
+    if (glob.anchored_start)
+    {
+        if (!segs[0].MatchesAt(text, 0))
+            return false;
+        pos = segs[0].size();
+        first = 1;
+    }
+    if (glob.anchored_end)
+    {
+        const PatternSegment &tail = segs.back();
+        if (tail.size() > text.size() || text.size() - tail.size() < pos)
+            return false;
+        limit = text.size() - tail.size();
+        if (!tail.MatchesAt(text, limit))
+            return false;
+        last = segs.size() - 1;
+    }
+
+    // Unanchored middle segments: the leftmost match of each leaves the most
+    // room for the rest, so no backtracking is ever needed.
+    std::string_view window = text.substr(0, limit);
+    for (size_t s = first; s < last; ++s)
+    {
+        size_t end = segs[s].FindEnd(window, pos);
+        if (end == std::string_view::npos)
+            return false;
+        pos = end;
+    }
+    return true;
+}
@@ -0,0 +1,85 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "PatternSegment.h"
+#include "StringArena.h"
+#include "TokenIndex.h"
+
+// Token-indexed set of URL glob rules ('*' matches any run, '?' any one char).
+//
+// A glob matches the whole URL, as the original backtracking matcher did.
+// Each glob is filed under its rarest literal token (a maximal run of
+// [a-z0-9%] that must appear in any matching URL as a complete token). A URL
+// is tokenized once and only the globs filed under its tokens are tried, plus
+// the few globs that have no usable token.
+//
+// Matching splits the glob at '*' and finds each segment with a bit-parallel
+// Shift-And scan (PatternSegment), taking the leftmost match greedily. Every
+// URL byte is read a bounded number of times per glob, so matching is linear
+// in the URL length and cannot go quadratic on adversarial patterns.
+//
+// Immutable after Build(); concurrent Matches() calls are safe.
+class GlobIndex
+{
+public:
+    GlobIndex() = default;
+
+    // Queue a lowercase glob. Takes effect after the next Build(). Returns
+    // false for an empty pattern or one already queued.
+    bool Add(std::string_view pattern);
+    // Queue every pattern of other (emptied).
+    void Merge(GlobIndex &&other);
+    // (Re)compile all queued globs and the token index.
+    void Build();
+    void Clear();
+
+    // True when any glob matches the whole (lowercase) URL.
+    bool Matches(std::string_view url) const { return Find(url) != 0; }
+    // 1-based id (arena id in patterns(), plus one) of a glob matching url, 0 when none does.
+    uint32_t Find(std::string_view url) const;
+
+    // Try every candidate glob for url, without stopping at the first match,
+    // and call fn(id, nanoseconds) with the time each one took. Used to sample
+    // per-rule cost; much slower than Find().
+    template <typename Fn>
+    void Profile(std::string_view url, Fn &&fn) const
+    {
+        if (compiled_.empty())
+            return;
+        thread_local TokenIndex::Tokens tokens;
+        TokenIndex::TokenizeURL(url, tokens);
+        index_.ForEachCandidate(tokens, [&](uint32_t g)
+                                {
+            auto start = std::chrono::steady_clock::now();
+            MatchCompiled(compiled_[g], url);
+            auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+            fn(g, (uint64_t)ns.count());
+            return false; });
+    }
+
+    // Linear-time match of a single glob against text (exposed for tests/bench).
+    static bool GlobMatch(std::string_view text, std::string_view pattern);
+
+    size_t size() const { return patterns_.size(); }
+    size_t untokenized_count() const { return index_.generic_count(); }
+    const StringArena &patterns() const { return patterns_; }
+
+private:
+    struct Compiled
+    {
+        bool anchored_start = true; // no leading '*'
+        bool anchored_end = true;   // no trailing '*'
+        std::vector<PatternSegment> segments;
+    };
+
+    static Compiled Compile(std::string_view pattern);
+    static bool MatchCompiled(const Compiled &glob, std::string_view text);
+
+    StringArena patterns_; // glob id -> pattern text
+    std::vector<Compiled> compiled_;
+    TokenIndex index_; // rarest literal token -> glob ids
+};
@@ -0,0 +1,540 @@
+#include "HistoryLog.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string_view>
+
+#if defined(_WIN32)
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    using Entry = HistoryStore::Entry;
+
+    uint32_t Crc32(std::string_view data)
+    {
+        static const std::array<uint32_t, 256> table = []
+        {
+            std::array<uint32_t, 256> t{};
+            for (uint32_t i = 0; i < 256; ++i)
+            {
+                uint32_t c = i;
+                for (int k = 0; k < 8; ++k)
+                    c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+                t[i] = c;
+            }
+            return t;
+        }();
+        uint32_t crc = 0xFFFFFFFFu;
+        for (char ch : data)
+            crc = table[(crc ^ (uint8_t)ch) & 0xFF] ^ (crc >> 8);
+        return crc ^ 0xFFFFFFFFu;
+    }
+
+    void AppendEscaped(std::string &out, std::string_view s)
+    {
+        for (char c : s)
+        {
+            switch (c)
+            {
+            case '\\':
+                out += "\\\\";
+                break;
+            case '"':
+                out += "\\\"";
+                break;
+            case '\n':
+                out += "\\n";
+                break;
+            case '\r':
+                out += "\\r";
+                break;
+            case '\t':
+                out += "\\t";
+                break;
+            default:
+                if ((uint8_t)c < 0x20)
+                {
+                    char buf[8];
+                    std::snprintf(buf, sizeof(buf), "\\u%04x", (unsigned)(uint8_t)c);
+                    out += buf;
+                }
+                else
+                {
+                    out += c;
+                }
+                break;
+            }
+        }
+    }
+
+    // {"url":"...","title":"...","time":N,"count":N}, the snapshot's element format.
+    void AppendEntry(std::string &out, const Entry &e)
+    {
+        out += "{\"url\":\"";
+        AppendEscaped(out, e.url);
+        out += "\",\"title\":\"";
+        AppendEscaped(out, e.title);
+        out += "\",\"time\":" + std::to_string(e.timestamp_ms);
+        out += ",\"count\":" + std::to_string(e.visit_count) + "}";
+    }
+
+    void SkipSpace(std::string_view s, size_t &pos)
+    {
+        while (pos < s.size() && (s[pos] == ' ' || s[pos] == '\t' || s[pos] == '\n' || s[pos] == '\r'))
+            ++pos;
+    }
+
+    void AppendUTF8(std::string &out, uint32_t cp)
+    {
+        if (cp < 0x80)
+            out += (char)cp;
+        else if (cp < 0x800)
+        {
+            out += (char)(0xC0 | (cp >> 6));
+            out += (char)(0x80 | (cp & 0x3F));
+        }
+        else
+        {
+            out += (char)(0xE0 | (cp >> 12));
+            out += (char)(0x80 | ((cp >> 6) & 0x3F));
+            out += (char)(0x80 | (cp & 0x3F));
+        }
+    }
+
+    bool ParseString(std::string_view s, size_t &pos, std::string &out)
+    {
+        if (pos >= s.size() || s[pos] != '"')
+            return false;
+        out.clear();
+        for (++pos; pos < s.size(); ++pos)
+        {
+            char c = s[pos];
+            if (c == '"')
+            {
+                ++pos;
+                return true;
+            }
+            if (c != '\\')
+            {
+                out += c;
+                continue;
+            }
+            if (++pos >= s.size())
+                return false;
+            switch (s[pos])
+            {
+            case 'n':
+                out += '\n';
+                break;
+            case 'r':
+                out += '\r';
+                break;
+            case 't':
+                out += '\t';
+                break;
+            case 'b':
+                out += '\b';
+                break;
+            case 'f':
+                out += '\f';
+                break;
+            case 'u':
+            {
+                if (pos + 4 >= s.size())
+                    return false;
+                uint32_t cp = 0;
+                for (int i = 1; i <= 4; ++i)
+                {
+                    const char h = s[pos + i];
+                    cp <<= 4;
+                    if (h >= '0' && h <= '9')
+                        cp |= (uint32_t)(h - '0');
+                    else if (h >= 'a' && h <= 'f')
+                        cp |= (uint32_t)(h - 'a' + 10);
+                    else if (h >= 'A' && h <= 'F')
+                        cp |= (uint32_t)(h - 'A' + 10);
+                    else
+                        return false;
+                }
+                AppendUTF8(out, cp);
+                pos += 4;
+                break;
+            }
+            default: // \" \\ \/
+                out += s[pos];
+                break;
+            }
+        }
+        return false;
+    }
+
+    bool ParseNumber(std::string_view s, size_t &pos, uint64_t &out)
+    {
+        const size_t start = pos;
+        out = 0;
+        while (pos < s.size() && s[pos] >= '0' && s[pos] <= '9')
+            out = out * 10 + (uint64_t)(s[pos++] - '0');
+        return pos > start;
+    }
+
+    // One entry object at pos; unknown keys are skipped.
+    bool ParseEntry(std::string_view s, size_t &pos, Entry &e)
+    {
+        SkipSpace(s, pos);
+        if (pos >= s.size() || s[pos] != '{')
+            return false;
+        ++pos;
+        e = Entry();
+        e.visit_count = 1;
+        std::string key, text;
+        for (;;)
+        {
+            SkipSpace(s, pos);
+            if (pos < s.size() && s[pos] == '}')
+            {
+                ++pos;
+                return true;
+            }
+            if (!ParseString(s, pos, key))
+                return false;
+            SkipSpace(s, pos);
+            if (pos >= s.size() || s[pos++] != ':')
+                return false;
+            SkipSpace(s, pos);
+            if (pos < s.size() && s[pos] == '"')
+            {
+                if (!ParseString(s, pos, text))
+                    return false;
+                if (key == "url")
+                    e.url = std::move(text);
+                else if (key == "title")
+                    e.title = std::move(text);
+            }
+            else
+            {
+                uint64_t n = 0;
+                if (!ParseNumber(s, pos, n))
+                    return false;
+                if (key == "time")
+                    e.timestamp_ms = n;
+                else if (key == "count")
+                    e.visit_count = (uint32_t)std::max<uint64_t>(1, std::min<uint64_t>(n, UINT32_MAX));
+            }
+            SkipSpace(s, pos);
+            if (pos < s.size() && s[pos] == ',')
+                ++pos;
+        }
+    }
+
+    bool ReadFile(const fs::path &path, std::string &out)
+    {
+        std::ifstream in(path, std::ios::in | std::ios::binary);
+        if (!in.is_open())
+            return false;
+        std::ostringstream ss;
+        ss << in.rdbuf();
+        out = ss.str();
+        return true;
+    }
+
+    void ReadSnapshot(const fs::path &path, std::vector<Entry> &out)
+    {
+        std::string content;
+        if (!ReadFile(path, content))
+            return;
+        size_t pos = content.find('[');
+        if (pos == std::string::npos)
+            return;
+        ++pos;
+        Entry e;
+        for (;;)
+        {
+            SkipSpace(content, pos);
+            if (pos >= content.size() || content[pos] == ']' || !ParseEntry(content, pos, e))
+                break;
+            if (!e.url.empty())
+                out.push_back(std::move(e));
+            SkipSpace(content, pos);
+            if (pos < content.size() && content[pos] == ',')
+                ++pos;
+        }
+    }
+
+    // "<crc32 as 8 hex digits> <entry>\n"
+    std::string LogRecord(const Entry &e)
+    {
+        std::string json;
+        AppendEntry(json, e);
+        char crc[10];
+        std::snprintf(crc, sizeof(crc), "%08x ", (unsigned)Crc32(json));
+        return crc + json + "\n";
+    }
+
+    // Append path's records to out up to the first one that is cut short or
+    // fails its checksum; good_bytes receives where that is.
+    size_t ReplayLog(const fs::path &path, std::vector<Entry> &out, uint64_t &good_bytes)
+    {
+        good_bytes = 0;
+        std::string content;
+        if (!ReadFile(path, content))
+            return 0;
+        size_t records = 0;
+        size_t pos = 0;
+        Entry e;
+        while (pos < content.size())
+        {
+            const size_t nl = content.find('\n', pos);
+            if (nl == std::string::npos || nl - pos < 10 || content[pos + 8] != ' ')
+                break;
+            const std::string_view json(content.data() + pos + 9, nl - pos - 9);
+            char *end = nullptr;
+            const std::string hex = content.substr(pos, 8);
+            const unsigned long crc = std::strtoul(hex.c_str(), &end, 16);
+            size_t at = 0;
+            if (end != hex.c_str() + 8 || crc != Crc32(json) || !ParseEntry(json, at, e) || at != json.size())
+                break;
+            if (!e.url.empty())
+                out.push_back(std::move(e));
+            ++records;
+            pos = nl + 1;
+            good_bytes = pos;
+        }
+        return records;
+    }
+
+    // Flush file's buffered writes and have the OS put them on the disk.
+    bool SyncFile(std::FILE *file)
+    {
+        if (std::fflush(file) != 0)
+            return false;
+#if defined(_WIN32)
+        return _commit(_fileno(file)) == 0;
+#else
+        return fsync(fileno(file)) == 0;
+#endif
+    }
+
+    // Put a rename in dir on the disk. Windows commits renames with the file.
+    void SyncDirectory(const fs::path &dir)
+    {
+#if !defined(_WIN32)
+        const int fd = open(dir.empty() ? "." : dir.c_str(), O_RDONLY);
+        if (fd < 0)
+            return;
+        fsync(fd);
+        close(fd);
+#else
+        (void)dir;
+#endif
+    }
+
+    // Write entries to path through a temporary file, synced before it is
+    // renamed over the old one, so a crash or power loss leaves either the old
+    // snapshot or the whole new one.
+    bool WriteSnapshot(const fs::path &path, const std::vector<Entry> &entries)
+    {
+        std::string out = "[";
+        for (size_t i = 0; i < entries.size(); ++i)
+        {
+            if (i)
+                out += ",";
+            AppendEntry(out, entries[i]);
+        }
+        out += "]";
+
+        fs::path tmp = path;
+        tmp += ".tmp";
+        std::FILE *file = std::fopen(tmp.string().c_str(), "wb");
+        if (!file)
+            return false;
+        const bool written = std::fwrite(out.data(), 1, out.size(), file) == out.size() && SyncFile(file);
+        if (std::fclose(file) != 0 || !written)
+            return false;
+        std::error_code ec;
+        fs::rename(tmp, path, ec);
+        if (ec)
+            return false;
+        // The caller deletes the logs next; the new snapshot must be there first
+        SyncDirectory(path.parent_path());
+        return true;
+    }
+}
+
+HistoryLog::HistoryLog(fs::path snapshot_path)
+    : snapshot_path_(std::move(snapshot_path)),
+      log_path_(fs::path(snapshot_path_).replace_extension(".log")),
+      pending_path_(fs::path(snapshot_path_).replace_extension(".log.1"))
+{
+}
+
+HistoryLog::~HistoryLog()
+{
+    WaitForCompaction();
+    CloseLog();
+}
+
+size_t HistoryLog::Load(HistoryStore &store)
+{
+    WaitForCompaction();
+    CloseLog();
+    std::vector<Entry> entries;
+    ReadSnapshot(snapshot_path_, entries);
+    uint64_t good = 0;
+    std::error_code ec;
+    const bool pending = fs::exists(pending_path_, ec);
+    size_t records = ReplayLog(pending_path_, entries, good);
+    const size_t active = ReplayLog(log_path_, entries, good);
+    records += active;
+    // Drop a torn tail, so new records do not land behind it
+    if (fs::exists(log_path_, ec) && fs::file_size(log_path_, ec) > good)
+        fs::resize_file(log_path_, good, ec);
+    log_bytes_ = good;
+    log_records_ = active;
+    // In time order; of two states of a URL the later wins
+    store.Assign(std::move(entries));
+    // A compaction was cut short; finish it
+    if (pending)
+        Compact(store);
+    return records;
+}
+
+void HistoryLog::Record(const Entry &entry, const HistoryStore &store)
+{
+    if (!log_ && !OpenLog())
+        return;
+    const std::string record = LogRecord(entry);
+    if (std::fwrite(record.data(), 1, record.size(), log_) != record.size() || std::fflush(log_) != 0)
+    {
+        // Cut a partial record off so the next one replays
+        CloseLog();
+        std::error_code ec;
+        fs::resize_file(log_path_, log_bytes_, ec);
+        return;
+    }
+    log_bytes_ += record.size();
+    ++log_records_;
+    if (log_records_ < std::max(kMinCompactRecords, store.size()))
+        return;
+
+    // Fold the log into a new snapshot in the background. The records written
+    // so far move to the pending log; new ones start a fresh log.
+    if (compacting())
+        return;
+    if (compactor_.joinable())
+        compactor_.join();
+    CloseLog();
+    if (!RetireLog())
+        return;
+    log_records_ = 0;
+    std::vector<Entry> entries(store.begin(), store.end());
+    compacting_.store(true, std::memory_order_release);
+    compactor_ = std::thread([this, entries = std::move(entries)]()
+                             {
+        std::error_code ec;
+        if (WriteSnapshot(snapshot_path_, entries))
+            fs::remove(pending_path_, ec);
+        compacting_.store(false, std::memory_order_release); });
+}
+
+bool HistoryLog::Compact(const HistoryStore &store)
+{
+    WaitForCompaction();
+    CloseLog();
+    std::error_code ec;
+    fs::create_directories(snapshot_path_.parent_path(), ec);
+    if (!WriteSnapshot(snapshot_path_, std::vector<Entry>(store.begin(), store.end())))
+        return false;
+    fs::remove(pending_path_, ec);
+    fs::remove(log_path_, ec);
+    log_bytes_ = 0;
+    log_records_ = 0;
+    return true;
+}
+
+void HistoryLog::Remove()
+{
+    WaitForCompaction();
+    CloseLog();
+    std::error_code ec;
+    fs::remove(snapshot_path_, ec);
+    fs::remove(pending_path_, ec);
+    fs::remove(log_path_, ec);
+    log_bytes_ = 0;
+    log_records_ = 0;
+}
+
+void HistoryLog::WaitForCompaction()
+{
+    if (compactor_.joinable())
+        compactor_.join();
+}
+
+bool HistoryLog::OpenLog()
+{
+    std::error_code ec;
+    fs::create_directories(log_path_.parent_path(), ec);
+    log_ = std::fopen(log_path_.string().c_str(), "ab");
+    if (!log_)
+        return false;
+    log_bytes_ = fs::file_size(log_path_, ec);
+    if (ec)
+        log_bytes_ = 0;
+    return true;
+}
+
+void HistoryLog::CloseLog()
+{
+    if (log_)
+    {
+        std::fclose(log_);
+        log_ = nullptr;
+    }
+}
+
+bool HistoryLog::RetireLog()
+{
+    std::error_code ec;
+    if (!fs::exists(log_path_, ec))
+        return true;
+    if (!fs::exists(pending_path_, ec))
+    {
+        fs::rename(log_path_, pending_path_, ec);
+        log_bytes_ = 0;
+        return !ec;
+    }
+    // An earlier compaction failed and left its pending log: add to it, behind
+    // its last whole record, as replay stops at the first bad one
+    std::string records;
+    if (!ReadFile(log_path_, records))
+        return false;
+    std::vector<Entry> pending;
+    uint64_t good = 0;
+    ReplayLog(pending_path_, pending, good);
+    if (fs::file_size(pending_path_, ec) > good)
+        fs::resize_file(pending_path_, good, ec);
+    if (ec)
+        return false;
+    std::FILE *out = std::fopen(pending_path_.string().c_str(), "ab");
+    if (!out)
+        return false;
+    const bool written = std::fwrite(records.data(), 1, records.size(), out) == records.size() && SyncFile(out);
+    if (std::fclose(out) != 0 || !written)
+    {
+        fs::resize_file(pending_path_, good, ec);
+        return false;
+    }
+    fs::remove(log_path_, ec);
+    log_bytes_ = 0;
+    return true;
+}
@@ -0,0 +1,89 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "HistoryStore.h"
+
+// On-disk browsing history: a snapshot plus an append-only visit log.
+//
+// The snapshot (e.g. data/history.json) is the JSON array of entries the
+// browser always wrote. Every visit then appends one line to the log next to
+// it (data/history.log): the entry's new state as a JSON object behind a CRC-32
+// of it. A visit therefore costs one small append and a flush, however large
+// the history. Once the log holds as many records as the history has entries
+// (at least kMinCompactRecords), it is retired to a pending log
+// (history.log.1) and a background thread folds the history into a new
+// snapshot, written to a temporary file and renamed over the old one, and
+// then deletes the pending log.
+//
+// Load() reads the snapshot, then the pending and the active log. Records
+// carry the whole entry, so replaying one twice is harmless and the latest
+// state of a URL wins. A record cut short or corrupted by a crash fails its
+// checksum; replay stops there and the log is truncated to its last good
+// record. A pending log left behind by an interrupted compaction is folded in
+// right away.
+//
+// Appends are flushed to the OS on every visit, so they survive the browser
+// crashing, though not the machine losing power before the OS writes them.
+// Snapshots are synced to disk before they replace the old one and before
+// the logs they fold in are deleted, so a power loss never costs more than
+// the visits not yet written back.
+//
+// Not thread-safe: call it from one thread (the UI thread). Only the
+// compaction runs elsewhere, on its own copy of the entries.
+class HistoryLog
+{
+public:
+    static constexpr size_t kMinCompactRecords = 256;
+
+    explicit HistoryLog(std::filesystem::path snapshot_path);
+    ~HistoryLog();
+    HistoryLog(const HistoryLog &) = delete;
+    HistoryLog &operator=(const HistoryLog &) = delete;
+
+    // Replace store's contents with the history on disk. Returns the number of
+    // log records replayed.
+    size_t Load(HistoryStore &store);
+
+    // Append entry, the state of a URL store just recorded a visit to, and
+    // start a background compaction of store when the log has grown enough.
+    void Record(const HistoryStore::Entry &entry, const HistoryStore &store);
+
+    // Write store as the snapshot now and drop the logs. False when the
+    // snapshot cannot be written; the logs are kept then.
+    bool Compact(const HistoryStore &store);
+
+    // Delete the snapshot and the logs.
+    void Remove();
+
+    // Wait for a background compaction to finish.
+    void WaitForCompaction();
+    bool compacting() const { return compacting_.load(std::memory_order_acquire); }
+
+    // Records appended since the last compaction started.
+    size_t log_records() const { return log_records_; }
+
+    const std::filesystem::path &snapshot_path() const { return snapshot_path_; }
+    const std::filesystem::path &log_path() const { return log_path_; }
+
+private:
+    bool OpenLog();
+    void CloseLog();
+    // Move the active log's records behind the pending log's.
+    bool RetireLog();
+
+    const std::filesystem::path snapshot_path_;
+    const std::filesystem::path log_path_;
+    const std::filesystem::path pending_path_;
+    std::FILE *log_ = nullptr;
+    uint64_t log_bytes_ = 0; // end of the last whole record in the active log
+    size_t log_records_ = 0;
+    std::thread compactor_;
+    std::atomic<bool> compacting_{false};
+};
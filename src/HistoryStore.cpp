@@ -0,0 +1,67 @@
+#include "HistoryStore.h"
+
+#include <algorithm>
+
+const HistoryStore::Entry &HistoryStore::Visit(const std::string &url, const std::string &title, uint64_t now_ms)
+{
+    auto it = index_.find(url);
+    if (it != index_.end())
+    {
+        Entry &e = *it->second;
+        if (!title.empty())
+            e.title = title;
+        e.timestamp_ms = now_ms;
+        ++e.visit_count;
+        // Newest last; splicing keeps the node, so the index stays valid.
+        entries_.splice(entries_.end(), entries_, it->second);
+        return e;
+    }
+    entries_.push_back({url, title, now_ms, 1});
+    index_.emplace(entries_.back().url, std::prev(entries_.end()));
+    Evict();
+    return entries_.back();
+}
+
+void HistoryStore::Assign(std::vector<Entry> entries)
+{
+    Clear();
+    std::stable_sort(entries.begin(), entries.end(), [](const Entry &a, const Entry &b)
+                     { return a.timestamp_ms < b.timestamp_ms; });
+    for (Entry &e : entries)
+    {
+        if (e.url.empty())
+            continue;
+        auto it = index_.find(e.url);
+        if (it != index_.end())
+        {
+            // A later copy of the URL wins
+            const auto node = it->second;
+            index_.erase(it);
+            entries_.erase(node);
+        }
+        entries_.push_back(std::move(e));
+        index_.emplace(entries_.back().url, std::prev(entries_.end()));
+    }
+    Evict();
+}
+
+const HistoryStore::Entry *HistoryStore::Find(std::string_view url) const
+{
+    auto it = index_.find(url);
+    return it == index_.end() ? nullptr : &*it->second;
+}
+
+void HistoryStore::Clear()
+{
+    index_.clear();
+    entries_.clear();
+}
+
+void HistoryStore::Evict()
+{
+    while (entries_.size() > capacity_)
+    {
+        index_.erase(entries_.front().url);
+        entries_.pop_front();
+    }
+}
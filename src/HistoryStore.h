@@ -0,0 +1,64 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Browsing history: one entry per URL with its latest title, last visit time
+// and visit count, capped at a number of entries.
+//
+// Entries sit in a list ordered by last visit, oldest first, with a hash index
+// from URL to list node. A visit finds its entry through the index and moves
+// it to the newest end; once over capacity the oldest entry is dropped from
+// the front. Visit() is O(1) whatever the size of the history.
+//
+// Iteration runs oldest to newest (rbegin() for newest first).
+class HistoryStore
+{
+public:
+    struct Entry
+    {
+        std::string url;
+        std::string title;
+        uint64_t timestamp_ms = 0;
+        uint32_t visit_count = 0;
+    };
+
+    using const_iterator = std::list<Entry>::const_iterator;
+    using const_reverse_iterator = std::list<Entry>::const_reverse_iterator;
+
+    explicit HistoryStore(size_t capacity = 500) : capacity_(capacity ? capacity : 1) {}
+    HistoryStore(const HistoryStore &) = delete;
+    HistoryStore &operator=(const HistoryStore &) = delete;
+
+    // Count a visit to url at now_ms. An empty title keeps the one recorded before.
+    const Entry &Visit(const std::string &url, const std::string &title, uint64_t now_ms);
+
+    // Replace the whole history with entries (as saved), ordered by time. Of
+    // duplicate URLs the latest is kept; beyond capacity the oldest are dropped.
+    void Assign(std::vector<Entry> entries);
+
+    // The entry for url, or nullptr.
+    const Entry *Find(std::string_view url) const;
+    void Clear();
+
+    size_t size() const { return entries_.size(); }
+    bool empty() const { return entries_.empty(); }
+    size_t capacity() const { return capacity_; }
+
+    const_iterator begin() const { return entries_.begin(); }
+    const_iterator end() const { return entries_.end(); }
+    const_reverse_iterator rbegin() const { return entries_.rbegin(); }
+    const_reverse_iterator rend() const { return entries_.rend(); }
+
+private:
+    void Evict();
+
+    size_t capacity_;
+    std::list<Entry> entries_; // oldest visit first
+    // Keys view the url of their list node, which never moves in memory.
+    std::unordered_map<std::string_view, std::list<Entry>::iterator> index_;
+};
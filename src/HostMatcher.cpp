@@ -0,0 +1,210 @@
+#include "HostMatcher.h"
+
+namespace
+{
+    // Keep the table at most half full so probe sequences stay short.
+    constexpr size_t kMinCapacity = 16;
+
+    size_t NextPow2(size_t n)
+    {
+        size_t cap = kMinCapacity;
+        while (cap < n)
+            cap <<= 1;
+        return cap;
+    }
+}
+
+uint64_t HostMatcher::Hash(std::string_view s)
+{
+    uint64_t h = kHashSeed;
+    for (size_t i = s.size(); i-- > 0;)
+        h = HashStep(h, s[i]);
+    return h;
+}
+
+bool HostMatcher::Add(std::string_view host)
+{
+    if (host.empty())
+        return false;
+    return AddHashed(Hash(host), host);
+}
+
+void HostMatcher::Merge(const HostMatcher &other)
+{
+    if (other.count_ == 0)
+        return;
+    Reserve(count_ + other.count_);
+    const Slot *slots = other.attached_ ? other.snap_.slots : other.slots_.data();
+    size_t slot_count = other.attached_ ? other.snap_.slot_count : other.slots_.size();
+    for (size_t i = 0; i < slot_count; ++i)
+    {
+        if (slots[i].index != 0)
+            AddHashed(slots[i].hash, other.host(slots[i].index - 1));
+    }
+}
+
+bool HostMatcher::AddHashed(uint64_t h, std::string_view host)
+{
+    Detach();
+    if (Find(h, host) != 0)
+        return false;
+    if ((count_ + 1) * 2 > slots_.size())
+        Rehash(NextPow2((count_ + 1) * 2));
+
+    pool_.append(host.data(), host.size());
+    offsets_.push_back((uint32_t)pool_.size());
+    ++count_;
+    size_t mask = slots_.size() - 1;
+    size_t i = (size_t)h & mask;
+    while (slots_[i].index != 0)
+        i = (i + 1) & mask;
+    slots_[i].hash = h;
+    slots_[i].index = (uint32_t)count_;
+    bloom_.Insert(h);
+    return true;
+}
+
+bool HostMatcher::Matches(std::string_view host) const
+{
+    if (count_ == 0 || host.empty())
+        return false;
+
+    // Walk right to left; at each label boundary the running hash covers exactly
+    // the suffix host[i..], i.e. "com", "example.com", "a.example.com", ...
+    return ForEachSuffix(host, [this](uint64_t h, std::string_view suffix)
+                         { return bloom_.MayContain(h) && Find(h, suffix) != 0; });
+}
+
+std::string_view HostMatcher::MatchedRule(std::string_view host) const
+{
+    std::string_view rule;
+    if (count_ == 0 || host.empty())
+        return rule;
+    ForEachSuffix(host, [&](uint64_t h, std::string_view suffix)
+                  {
+        uint32_t index = bloom_.MayContain(h) ? Find(h, suffix) : 0;
+        if (index != 0)
+            rule = this->host(index - 1);
+        return index != 0; });
+    return rule;
+}
+
+uint32_t HostMatcher::Find(uint64_t hash, std::string_view suffix) const
+{
+    const Slot *slots = attached_ ? snap_.slots : slots_.data();
+    size_t slot_count = attached_ ? snap_.slot_count : slots_.size();
+    if (slot_count == 0)
+        return 0;
+    size_t mask = slot_count - 1;
+    for (size_t i = (size_t)hash & mask;; i = (i + 1) & mask)
+    {
+        const Slot &slot = slots[i];
+        if (slot.index == 0)
+            return 0;
+        if (slot.hash == hash && host(slot.index - 1) == suffix)
+            return slot.index;
+    }
+}
+
+void HostMatcher::Rehash(size_t capacity)
+{
+    std::vector<Slot> slots(capacity);
+    size_t mask = capacity - 1;
+    for (const Slot &s : slots_)
+    {
+        if (s.index == 0)
+            continue;
+        size_t i = (size_t)s.hash & mask;
+        while (slots[i].index != 0)
+            i = (i + 1) & mask;
+        slots[i] = s;
+    }
+    slots_.swap(slots);
+    RebuildBloom();
+}
+
+void HostMatcher::RebuildBloom()
+{
+    // Size for the most rules the table holds before it grows again.
+    bloom_.Init(slots_.size() / 2, fp_rate_);
+    for (const Slot &s : slots_)
+    {
+        if (s.index != 0)
+            bloom_.Insert(s.hash);
+    }
+}
+
+void HostMatcher::SetFalsePositiveRate(double rate)
+{
+    fp_rate_ = rate;
+    Detach();
+    RebuildBloom();
+}
+
+void HostMatcher::Reserve(size_t count)
+{
+    Detach();
+    offsets_.reserve(count + 1);
+    if (count * 2 > slots_.size())
+        Rehash(NextPow2(count * 2));
+}
+
+void HostMatcher::Clear()
+{
+    slots_.clear();
+    pool_.clear();
+    offsets_.assign(1, 0);
+    count_ = 0;
+    bloom_.Clear();
+    snap_ = {};
+    attached_ = false;
+}
+
+void HostMatcher::Save(FilterSnapshot::Writer &out) const
+{
+    const Slot *slots = attached_ ? snap_.slots : slots_.data();
+    size_t slot_count = attached_ ? snap_.slot_count : slots_.size();
+    const uint32_t *offsets = attached_ ? snap_.offsets : offsets_.data();
+    out.Add(FilterSnapshot::kHostSlots, slots, slot_count * sizeof(Slot));
+    out.Add(FilterSnapshot::kHostOffsets, offsets, (count_ + 1) * sizeof(uint32_t));
+    out.Add(FilterSnapshot::kHostPool, attached_ ? snap_.pool : pool_.data(), offsets[count_]);
+    bloom_.Save(out);
+}
+
+bool HostMatcher::Attach(const FilterSnapshot &snapshot)
+{
+    size_t slot_count = 0, offset_count = 0;
+    const Slot *slots = snapshot.Array<Slot>(FilterSnapshot::kHostSlots, slot_count);
+    const uint32_t *offsets = snapshot.Array<uint32_t>(FilterSnapshot::kHostOffsets, offset_count);
+    std::string_view pool = snapshot.Bytes(FilterSnapshot::kHostPool);
+
+    // The snapshot is a build artifact shipped next to the binary, so only its
+    // shape is checked here; touching every entry would defeat mapping it.
+    if (offset_count == 0 || (slot_count & (slot_count - 1)) != 0 || offset_count - 1 > slot_count / 2 ||
+        offsets[0] != 0 || offsets[offset_count - 1] != pool.size())
+        return false;
+
+    Clear();
+    if (!bloom_.Attach(snapshot))
+        return false;
+    snap_.slots = slots;
+    snap_.slot_count = slot_count;
+    snap_.pool = pool.data();
+    snap_.offsets = offsets;
+    count_ = offset_count - 1;
+    attached_ = true;
+    return true;
+}
+
+// Copy borrowed snapshot tables into owned storage before mutating.
+void HostMatcher::Detach()
+{
+    if (!attached_)
+        return;
+    slots_.assign(snap_.slots, snap_.slots + snap_.slot_count);
+    offsets_.assign(snap_.offsets, snap_.offsets + count_ + 1);
+    pool_.assign(snap_.pool, offsets_.back());
+    bloom_.Detach();
+    snap_ = {};
+    attached_ = false;
+}
@@ -0,0 +1,119 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "BloomFilter.h"
+#include "FilterSnapshot.h"
+
+// Suffix index over blocked host rules.
+//
+// A rule "example.com" matches "example.com" and any subdomain of it
+// ("a.b.example.com") but not "badexample.com". Lookups hash the request host
+// once from right to left and probe the table at every label boundary, so the
+// cost is proportional to the number of labels in the host, independent of the
+// number of rules loaded.
+//
+// A blocked Bloom filter over the rule hashes sits in front of the table. Most
+// request hosts are not blocked, and for those every suffix is rejected by a
+// single cache-line read. The filter is sized from the table capacity and the
+// false-positive target, and rebuilt whenever the table grows.
+//
+// Host names live back to back in one string pool. The table and pool can also
+// be borrowed from a mapped FilterSnapshot; the first Add() after that copies
+// them into owned storage.
+//
+// Not thread-safe; callers synchronize access.
+class HostMatcher
+{
+public:
+    HostMatcher() = default;
+
+    // Add a lowercase host rule (no leading dots). Returns false for duplicates.
+    bool Add(std::string_view host);
+    // Add every rule of other, reusing its hashes.
+    void Merge(const HostMatcher &other);
+
+    // True when host or one of its parent domains is a rule. Host must be lowercase.
+    bool Matches(std::string_view host) const;
+    // The rule Matches() would find for host, or an empty view.
+    std::string_view MatchedRule(std::string_view host) const;
+
+    void Clear();
+    void Reserve(size_t count);
+
+    // Target false-positive rate of the Bloom prefilter (default 1%). Rebuilds it.
+    void SetFalsePositiveRate(double rate);
+    double false_positive_rate() const { return fp_rate_; }
+    size_t prefilter_bytes() const { return bloom_.memory_bytes(); }
+
+    // Call fn(hash, suffix) for host and each of its parent domains, shortest
+    // suffix first, stopping early when fn returns true. Hashes are consistent
+    // with HashHost(), so other indexes can key host rules the same way.
+    template <typename Fn>
+    static bool ForEachSuffix(std::string_view host, Fn &&fn)
+    {
+        uint64_t h = kHashSeed;
+        for (size_t i = host.size(); i-- > 0;)
+        {
+            h = HashStep(h, host[i]);
+            if ((i == 0 || host[i - 1] == '.') && fn(h, host.substr(i)))
+                return true;
+        }
+        return false;
+    }
+    static uint64_t HashHost(std::string_view host) { return Hash(host); }
+
+    size_t size() const { return count_; }
+    bool empty() const { return count_ == 0; }
+    std::string_view host(size_t i) const
+    {
+        const uint32_t *offsets = attached_ ? snap_.offsets : offsets_.data();
+        return std::string_view((attached_ ? snap_.pool : pool_.data()) + offsets[i], offsets[i + 1] - offsets[i]);
+    }
+
+    // Write the table and pool into a snapshot / use a snapshot's copy in place.
+    // The snapshot must outlive this matcher or the next Add()/Clear().
+    void Save(FilterSnapshot::Writer &out) const;
+    bool Attach(const FilterSnapshot &snapshot);
+
+private:
+    struct Slot
+    {
+        uint64_t hash = 0;
+        uint32_t index = 0;  // 1-based host number, 0 = empty
+        uint32_t unused = 0; // explicit padding keeps snapshot bytes deterministic
+    };
+
+    // Hash a host suffix right-to-left; HashStep lets Matches() extend one hash
+    // across all suffixes of the request host in a single pass.
+    static constexpr uint64_t kHashSeed = 14695981039346656037ull;
+    static uint64_t HashStep(uint64_t h, char c) { return (h ^ (uint8_t)c) * 1099511628211ull; }
+    static uint64_t Hash(std::string_view s);
+
+    bool AddHashed(uint64_t hash, std::string_view host);
+    // 1-based host number of suffix, 0 when it is not a rule.
+    uint32_t Find(uint64_t hash, std::string_view suffix) const;
+    void Rehash(size_t capacity);
+    void Detach();
+    void RebuildBloom();
+
+    std::vector<Slot> slots_;             // open addressing, power-of-two size
+    std::string pool_;                    // host names back to back
+    std::vector<uint32_t> offsets_ = {0}; // host i is pool_[offsets_[i], offsets_[i + 1])
+    size_t count_ = 0;
+    BloomFilter bloom_; // rule hashes, sized for half the table capacity
+    double fp_rate_ = 0.01;
+
+    // Borrowed tables, used instead of the vectors above while attached_.
+    struct
+    {
+        const Slot *slots = nullptr;
+        size_t slot_count = 0;
+        const char *pool = nullptr;
+        const uint32_t *offsets = nullptr;
+    } snap_;
+    bool attached_ = false;
+};
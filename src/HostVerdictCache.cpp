@@ -0,0 +1,145 @@
+#include "HostVerdictCache.h"
+#include "HostMatcher.h"
+
+#include <cstring>
+
+HostVerdictCache::HostVerdictCache(size_t capacity)
+{
+    shard_count_ = 1;
+    while (shard_count_ * kWays < capacity)
+        shard_count_ <<= 1;
+    shards_.reset(new Shard[shard_count_]);
+    Clear();
+}
+
+bool HostVerdictCache::Lookup(std::string_view host, uint32_t generation, bool &blocked)
+{
+    if (!SameWrap(generation))
+    {
+        misses_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    const uint64_t hash = HostMatcher::HashHost(host);
+    const uint64_t key = Key(hash, generation);
+    Shard &shard = shards_[hash & (shard_count_ - 1)];
+    for (size_t w = 0; w < kWays; ++w)
+    {
+        uint64_t entry = shard.entries[w].load(std::memory_order_acquire);
+        if (!SameKey(entry, key))
+            continue;
+        // Seqlock-style: the check counts only if the key did not change around it.
+        const uint64_t check = shard.checks[w].load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (!SameKey(shard.entries[w].load(std::memory_order_relaxed), entry) || check != CheckHash(host))
+            continue;
+        if (!(entry & kReferenced))
+            shard.entries[w].fetch_or(kReferenced, std::memory_order_relaxed);
+        blocked = (entry & kBlocked) != 0;
+        hits_.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+    misses_.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+void HostVerdictCache::Insert(std::string_view host, uint32_t generation, bool blocked)
+{
+    // A verdict of an older wrap could outlive the clear; drop it.
+    if (!SameWrap(generation))
+        return;
+    const uint64_t hash = HostMatcher::HashHost(host);
+    const uint64_t key = Key(hash, generation);
+    const uint64_t generation_bits = kGenerationMask << kGenerationShift;
+    Shard &shard = shards_[hash & (shard_count_ - 1)];
+
+    // Prefer an empty or outdated entry; otherwise sweep the CLOCK hand from a
+    // hash-derived start, clearing reference bits until an unreferenced entry
+    // turns up. Concurrent hits may set bits again, so the sweep is bounded.
+    const size_t start = (hash >> kTagShift) % kWays;
+    size_t victim = kWays;
+    for (size_t w = 0; w < kWays && victim == kWays; ++w)
+    {
+        uint64_t entry = shard.entries[w].load(std::memory_order_relaxed);
+        if (!(entry & kValid) || (entry & generation_bits) != (key & generation_bits))
+            victim = w;
+    }
+    for (size_t i = 0; i < 2 * kWays && victim == kWays; ++i)
+    {
+        size_t w = (start + i) % kWays;
+        uint64_t entry = shard.entries[w].fetch_and(~kReferenced, std::memory_order_relaxed);
+        if (!(entry & kReferenced))
+            victim = w;
+    }
+    if (victim == kWays)
+        victim = start;
+    // Invalidate the key before the check changes, so no lookup pairs them up.
+    shard.entries[victim].store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    shard.checks[victim].store(CheckHash(host), std::memory_order_relaxed);
+    shard.entries[victim].store(key | kReferenced | (blocked ? kBlocked : 0), std::memory_order_release);
+    // A wrap that cleared the table meanwhile may have missed this entry.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (wrap_.load(std::memory_order_relaxed) != generation >> kGenerationBits)
+        shard.entries[victim].store(0, std::memory_order_relaxed);
+}
+
+void HostVerdictCache::Clear()
+{
+    ClearEntries();
+    hits_.store(0, std::memory_order_relaxed);
+    misses_.store(0, std::memory_order_relaxed);
+}
+
+void HostVerdictCache::ClearEntries()
+{
+    for (size_t s = 0; s < shard_count_; ++s)
+    {
+        for (size_t w = 0; w < kWays; ++w)
+        {
+            shards_[s].entries[w].store(0, std::memory_order_relaxed);
+            shards_[s].checks[w].store(0, std::memory_order_relaxed);
+        }
+    }
+}
+
+bool HostVerdictCache::SameWrap(uint32_t generation)
+{
+    const uint32_t wrap = generation >> kGenerationBits;
+    uint32_t current = wrap_.load(std::memory_order_acquire);
+    if (wrap == current)
+        return true;
+    // Generations only grow (modulo 2^32), so a lagging request must not turn the table back.
+    if ((int32_t)(wrap - current) < 0)
+        return false;
+    if (wrap_.compare_exchange_strong(current, wrap, std::memory_order_seq_cst))
+        ClearEntries();
+    return wrap_.load(std::memory_order_acquire) == wrap;
+}
+
+uint64_t HostVerdictCache::CheckHash(std::string_view host)
+{
+    // Eight bytes at a time with a multiply-xorshift step, where HashHost()
+    // is FNV-1a byte by byte from the right.
+    uint64_t h = 0x243F6A8885A308D3ull ^ host.size();
+    size_t i = 0;
+    for (; i + 8 <= host.size(); i += 8)
+    {
+        uint64_t word;
+        std::memcpy(&word, host.data() + i, 8);
+        h = (h ^ word) * 0x9E3779B97F4A7C15ull;
+        h ^= h >> 29;
+    }
+    uint64_t tail = 0;
+    for (; i < host.size(); ++i)
+        tail = tail << 8 | (unsigned char)host[i];
+    h = (h ^ tail) * 0xBF58476D1CE4E5B9ull;
+    return h ^ (h >> 32);
+}
+
+HostVerdictCache::Stats HostVerdictCache::stats() const
+{
+    Stats s;
+    s.hits = hits_.load(std::memory_order_relaxed);
+    s.misses = misses_.load(std::memory_order_relaxed);
+    return s;
+}
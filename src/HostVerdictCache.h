@@ -0,0 +1,81 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+
+// Bounded cache of host-level verdicts (is this host on the block list?).
+//
+// The cache is split into shards of eight entries; a host hashes to one
+// shard, so a lookup is one hash plus a probe of two adjacent cache lines.
+// Each entry is two 64-bit words: a key (hash tag, rule-set generation,
+// verdict and a CLOCK reference bit) and a check, a second hash of the host
+// computed independently of the first. A hit needs both to match, so two
+// hosts share a verdict only if 104 bits of two unrelated hashes collide.
+// The words are read and written atomically and an insert clears the key
+// while it writes the check, so lookups and inserts take no lock and a racing
+// insert can only lose an entry, never pair one host's key with another's
+// check. Eviction is CLOCK within the shard.
+//
+// Entries carry the generation of the rule set that produced them; bumping the
+// generation on every rule change invalidates the whole cache at once. Only
+// the low kGenerationBits are stored, so the first lookup or insert once the
+// generation passes a multiple of 2^kGenerationBits clears the table, and an
+// old entry cannot pass for a new generation with the same low bits.
+class HostVerdictCache
+{
+public:
+    static constexpr int kGenerationBits = 21;
+
+    struct Stats
+    {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+    };
+
+    explicit HostVerdictCache(size_t capacity = 4096);
+
+    // True on a hit, with the cached verdict in blocked.
+    bool Lookup(std::string_view host, uint32_t generation, bool &blocked);
+    void Insert(std::string_view host, uint32_t generation, bool blocked);
+    void Clear();
+
+    Stats stats() const;
+    size_t capacity() const { return shard_count_ * kWays; }
+
+private:
+    static constexpr size_t kWays = 8;
+
+    struct alignas(64) Shard
+    {
+        std::atomic<uint64_t> entries[kWays];
+        std::atomic<uint64_t> checks[kWays]; // second hash of each entry's host
+    };
+
+    // Entry layout, low to high: valid, reference, verdict, generation (21 bits), tag (40 bits).
+    static constexpr uint64_t kValid = 1ull << 0;
+    static constexpr uint64_t kReferenced = 1ull << 1;
+    static constexpr uint64_t kBlocked = 1ull << 2;
+    static constexpr int kGenerationShift = 3;
+    static constexpr uint64_t kGenerationMask = (1ull << kGenerationBits) - 1;
+    static constexpr int kTagShift = 24;
+
+    static uint64_t Key(uint64_t hash, uint32_t generation)
+    {
+        return kValid | (((uint64_t)generation & kGenerationMask) << kGenerationShift) | (hash >> kTagShift << kTagShift);
+    }
+    static bool SameKey(uint64_t entry, uint64_t key) { return ((entry ^ key) & ~(kReferenced | kBlocked)) == 0; }
+    // Hash of host unrelated to HostMatcher::HashHost().
+    static uint64_t CheckHash(std::string_view host);
+    // False when generation belongs to an older wrap than the table; clears
+    // the table when it belongs to a newer one.
+    bool SameWrap(uint32_t generation);
+    void ClearEntries();
+
+    std::unique_ptr<Shard[]> shards_;
+    size_t shard_count_ = 0; // power of two
+    std::atomic<uint32_t> wrap_{0}; // generation >> kGenerationBits of the entries
+    std::atomic<uint64_t> hits_{0};
+    std::atomic<uint64_t> misses_{0};
+};
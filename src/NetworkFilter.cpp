@@ -0,0 +1,577 @@
+#include "NetworkFilter.h"
+#include "HostMatcher.h"
+#include "PublicSuffix.h"
+#include "RegexSet.h"
+
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define URL_UTIL_SSE2 1
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define URL_UTIL_NEON 1
+#endif
+
+namespace
+{
+    char LowerASCII(char c)
+    {
+        return (c >= 'A' && c <= 'Z') ? (char)(c - 'A' + 'a') : c;
+    }
+
+    std::string ToLowerCopy(std::string_view s)
+    {
+        std::string out(s.size(), '\0');
+        url_util::LowerASCII(s, &out[0]);
+        return out;
+    }
+
+    bool IsOptionChar(char c)
+    {
+        c = LowerASCII(c);
+        return (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c == '~' || c == '=' || c == ',' ||
+               c == '|' || c == '.' || c == '_' || c == '-';
+    }
+
+    bool IsHostChar(char c)
+    {
+        return (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c == '.' || c == '-';
+    }
+
+    uint8_t TypeFromOption(std::string_view name)
+    {
+        if (name == "script")
+            return kResourceScript;
+        if (name == "image")
+            return kResourceImage;
+        if (name == "stylesheet")
+            return kResourceStylesheet;
+        return 0;
+    }
+}
+
+// --- URL helpers ---
+
+std::string_view url_util::HostFromURL(std::string_view url)
+{
+    size_t start = url.find("://");
+    start = (start == std::string_view::npos) ? 0 : start + 3;
+    size_t end = url.find_first_of("/?#", start);
+    if (end == std::string_view::npos)
+        end = url.size();
+    std::string_view authority = url.substr(start, end - start);
+    size_t at = authority.rfind('@');
+    if (at != std::string_view::npos)
+        authority.remove_prefix(at + 1);
+    if (!authority.empty() && authority.front() == '[')
+    {
+        size_t close = authority.find(']');
+        return close == std::string_view::npos ? authority : authority.substr(0, close + 1);
+    }
+    size_t colon = authority.find(':');
+    return colon == std::string_view::npos ? authority : authority.substr(0, colon);
+}
+
+std::string_view url_util::BaseDomain(std::string_view host)
+{
+    std::string_view site = psl::RegistrableDomain(host);
+    return site.empty() ? host : site;
+}
+
+bool url_util::IsDomainOrSubdomain(std::string_view host, std::string_view domain)
+{
+    if (host.size() < domain.size() || host.compare(host.size() - domain.size(), domain.size(), domain) != 0)
+        return false;
+    return host.size() == domain.size() || host[host.size() - domain.size() - 1] == '.';
+}
+
+uint8_t url_util::InferResourceType(std::string_view url)
+{
+    size_t end = url.find_first_of("?#");
+    std::string_view path = url.substr(0, end);
+    size_t slash = path.rfind('/');
+    size_t dot = path.rfind('.');
+    if (dot == std::string_view::npos || (slash != std::string_view::npos && dot < slash))
+        return kResourceOther;
+    std::string_view ext = path.substr(dot + 1);
+    if (ext == "js" || ext == "mjs")
+        return kResourceScript;
+    if (ext == "css")
+        return kResourceStylesheet;
+    if (ext == "png" || ext == "jpg" || ext == "jpeg" || ext == "gif" || ext == "webp" || ext == "svg" ||
+        ext == "ico" || ext == "bmp" || ext == "avif")
+        return kResourceImage;
+    return kResourceOther;
+}
+
+void url_util::LowerASCII(std::string_view in, char *out)
+{
+    const char *src = in.data();
+    size_t n = in.size(), i = 0;
+#if defined(URL_UTIL_SSE2)
+    // Signed compares: bytes >= 0x80 count as negative and stay untouched
+    const __m128i before_a = _mm_set1_epi8('A' - 1);
+    const __m128i after_z = _mm_set1_epi8('Z' + 1);
+    const __m128i bit = _mm_set1_epi8(0x20);
+    for (; i + 16 <= n; i += 16)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+        __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(v, before_a), _mm_cmplt_epi8(v, after_z));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), _mm_or_si128(v, _mm_and_si128(upper, bit)));
+    }
+#elif defined(URL_UTIL_NEON)
+    const uint8x16_t a = vdupq_n_u8('A');
+    const uint8x16_t z = vdupq_n_u8('Z');
+    const uint8x16_t bit = vdupq_n_u8(0x20);
+    for (; i + 16 <= n; i += 16)
+    {
+        uint8x16_t v = vld1q_u8(reinterpret_cast<const uint8_t *>(src + i));
+        uint8x16_t upper = vandq_u8(vcgeq_u8(v, a), vcleq_u8(v, z));
+        vst1q_u8(reinterpret_cast<uint8_t *>(out + i), vorrq_u8(v, vandq_u8(upper, bit)));
+    }
+#endif
+    for (; i < n; ++i)
+    {
+        char c = src[i];
+        out[i] = (c >= 'A' && c <= 'Z') ? (char)(c - 'A' + 'a') : c;
+    }
+}
+
+RequestContext RequestContext::Make(std::string_view url, std::string_view host, std::string_view origin_host)
+{
+    RequestContext ctx;
+    ctx.url = url;
+    ctx.host = host;
+    ctx.origin_host = origin_host.empty() ? host : origin_host;
+    ctx.has_origin = !origin_host.empty();
+    ctx.type = url_util::InferResourceType(url);
+    ctx.third_party = url_util::BaseDomain(ctx.host) != url_util::BaseDomain(ctx.origin_host);
+    return ctx;
+}
+
+// --- RequestBuffer ---
+
+RequestBuffer::RequestBuffer()
+{
+    url_.resize(kInitialCapacity);
+    origin_.resize(kInitialCapacity);
+}
+
+std::string_view RequestBuffer::Lower(std::string_view in, std::string &buf)
+{
+    if (buf.size() < in.size())
+        buf.resize(in.size());
+    url_util::LowerASCII(in, &buf[0]);
+    return std::string_view(buf.data(), in.size());
+}
+
+const RequestContext &RequestBuffer::Parse(std::string_view url_raw, std::string_view origin_raw)
+{
+    std::string_view url = Lower(url_raw, url_);
+    std::string_view origin = Lower(origin_raw, origin_);
+    size_t colon = url.find(':');
+    scheme_ = colon == std::string_view::npos ? std::string_view() : url.substr(0, colon);
+    ctx_ = RequestContext::Make(url, url_util::HostFromURL(url),
+                                origin.empty() ? std::string_view() : url_util::HostFromURL(origin));
+    return ctx_;
+}
+
+// --- NetworkFilter ---
+
+bool NetworkFilter::Parse(std::string_view line, NetworkFilter &out)
+{
+    NetworkFilter f;
+    std::string_view s = line;
+
+    if (s.substr(0, 2) == "@@")
+    {
+        f.exception_ = true;
+        s.remove_prefix(2);
+    }
+
+    // Options follow the last '$' when what comes after it looks like an option list.
+    bool has_options = false;
+    size_t dollar = s.rfind('$');
+    if (dollar != std::string_view::npos && dollar + 1 < s.size() &&
+        std::all_of(s.begin() + dollar + 1, s.end(), IsOptionChar))
+    {
+        has_options = true;
+        std::string options = ToLowerCopy(s.substr(dollar + 1));
+        s = s.substr(0, dollar);
+
+        uint8_t allow_types = 0, deny_types = 0;
+        size_t i = 0;
+        while (i <= options.size())
+        {
+            size_t comma = options.find(',', i);
+            if (comma == std::string::npos)
+                comma = options.size();
+            std::string_view opt(options.data() + i, comma - i);
+            i = comma + 1;
+            if (opt.empty())
+                continue;
+
+            bool negated = opt.front() == '~';
+            std::string_view name = negated ? opt.substr(1) : opt;
+            if (name == "third-party" || name == "3p")
+                f.party_ = negated ? kFirstParty : kThirdParty;
+            else if (name == "first-party" || name == "1p")
+                f.party_ = negated ? kThirdParty : kFirstParty;
+            else if (name == "match-case")
+                continue;
+            else if (!negated && name.substr(0, 7) == "domain=")
+            {
+                std::string_view list = name.substr(7);
+                size_t j = 0;
+                while (j <= list.size())
+                {
+                    size_t bar = list.find('|', j);
+                    if (bar == std::string_view::npos)
+                        bar = list.size();
+                    std::string_view d = list.substr(j, bar - j);
+                    j = bar + 1;
+                    if (!d.empty() && d.front() == '~')
+                    {
+                        if (d.size() > 1)
+                            f.exclude_domains_.emplace_back(d.substr(1));
+                    }
+                    else if (!d.empty())
+                    {
+                        f.include_domains_.emplace_back(d);
+                    }
+                }
+            }
+            else if (uint8_t t = TypeFromOption(name))
+            {
+                (negated ? deny_types : allow_types) |= t;
+            }
+            else
+            {
+                return false; // unsupported option
+            }
+        }
+        f.types_ = (allow_types ? allow_types : (uint8_t)kResourceAll) & (uint8_t)~deny_types;
+        if (f.types_ == 0)
+            return false;
+    }
+
+    // Regex rules with options or as exceptions are not supported; rejecting
+    // them beats matching their pattern as literal text.
+    if (RegexSet::IsRegexRule(s))
+        return false;
+
+    std::string pattern = ToLowerCopy(s);
+    std::string_view p = pattern;
+    if (p.substr(0, 2) == "||")
+    {
+        f.host_anchor_ = true;
+        p.remove_prefix(2);
+    }
+    else if (p.substr(0, 1) == "|")
+    {
+        f.start_anchor_ = true;
+        p.remove_prefix(1);
+    }
+    if (!p.empty() && p.back() == '|')
+    {
+        f.end_anchor_ = true;
+        p.remove_suffix(1);
+    }
+    // An empty pattern blocks everything; only accept it when options narrow it down.
+    if (p.empty() && !has_options)
+        return false;
+
+    f.leading_wildcard_ = !p.empty() && p.front() == '*';
+    f.trailing_wildcard_ = !p.empty() && p.back() == '*';
+    size_t i = 0;
+    while (i < p.size())
+    {
+        size_t star = p.find('*', i);
+        if (star == std::string_view::npos)
+            star = p.size();
+        if (star > i)
+            f.segments_.emplace_back(p.substr(i, star - i), PatternSegment::kAdblock);
+        i = star + 1;
+    }
+
+    if (f.host_anchor_ && !f.leading_wildcard_)
+    {
+        size_t n = 0;
+        while (n < p.size() && IsHostChar(p[n]))
+            ++n;
+        if (n > 0 && n < p.size() && (p[n] == '^' || p[n] == '/'))
+            f.anchored_host_ = std::string(p.substr(0, n));
+    }
+    // "||" starts at a host label boundary, which is also a token boundary.
+    f.tokens_ = TokenIndex::PatternTokens(p, "*", f.host_anchor_ || f.start_anchor_, f.end_anchor_);
+
+    out = std::move(f);
+    return true;
+}
+
+bool NetworkFilter::Matches(const RequestContext &ctx) const
+{
+    if (!(types_ & ctx.type))
+        return false;
+    if (party_ == kThirdParty && !ctx.third_party)
+        return false;
+    if (party_ == kFirstParty && ctx.third_party)
+        return false;
+    if (!MatchesDomain(ctx.origin_host))
+        return false;
+    return MatchesURL(ctx.url);
+}
+
+bool NetworkFilter::MatchesDomain(std::string_view origin_host) const
+{
+    for (const auto &d : exclude_domains_)
+    {
+        if (url_util::IsDomainOrSubdomain(origin_host, d))
+            return false;
+    }
+    if (include_domains_.empty())
+        return true;
+    for (const auto &d : include_domains_)
+    {
+        if (url_util::IsDomainOrSubdomain(origin_host, d))
+            return true;
+    }
+    return false;
+}
+
+bool NetworkFilter::MatchesURL(std::string_view url) const
+{
+    if (segments_.empty())
+        return true;
+
+    if (host_anchor_ && !leading_wildcard_)
+    {
+        // "||" matches at the start of the host or at any of its label boundaries.
+        size_t scheme = url.find("://");
+        size_t hb = scheme == std::string_view::npos ? 0 : scheme + 3;
+        size_t he = url.find_first_of("/?#", hb);
+        if (he == std::string_view::npos)
+            he = url.size();
+        if (MatchesFrom(url, hb, true))
+            return true;
+        for (size_t i = hb; i < he; ++i)
+        {
+            if (url[i] == '.' && MatchesFrom(url, i + 1, true))
+                return true;
+        }
+        return false;
+    }
+    if (start_anchor_ && !leading_wildcard_)
+        return MatchesFrom(url, 0, true);
+    return MatchesFrom(url, 0, false);
+}
+
+// Match segments_ against url from pos. With anchored_first the first
+// segment must start exactly at pos; later segments are found greedily.
+bool NetworkFilter::MatchesFrom(std::string_view url, size_t pos, bool anchored_first) const
+{
+    const size_t n = segments_.size();
+    const bool end_anchored = end_anchor_ && !trailing_wildcard_;
+    size_t first = 0;
+    size_t last = n;
+    size_t limit = url.size();
+
+    if (anchored_first)
+    {
+        const PatternSegment &head = segments_[0];
+        if (n == 1 && end_anchored)
+        {
+            size_t end = pos + head.size();
+            return (end == url.size() || end == url.size() + 1) && head.MatchesAt(url, pos, true);
+        }
+        if (!head.MatchesAt(url, pos, n == 1))
+            return false;
+        if (n == 1)
+            return true;
+        pos += head.size();
+        first = 1;
+    }
+
+    if (end_anchored)
+    {
+        // The last segment must end at the end of the URL; a trailing '^' may
+        // stand for the end itself.
+        const PatternSegment &tail = segments_[n - 1];
+        size_t m = tail.size();
+        if (m <= url.size() + 1 && url.size() + 1 - m >= pos && tail.MatchesAt(url, url.size() + 1 - m, true))
+            limit = url.size() + 1 - m;
+        else if (m <= url.size() && url.size() - m >= pos && tail.MatchesAt(url, url.size() - m))
+            limit = url.size() - m;
+        else
+            return false;
+        last = n - 1;
+    }
+
+    std::string_view window = url.substr(0, std::min(limit, url.size()));
+    for (size_t s = first; s < last; ++s)
+    {
+        bool is_last = s == n - 1;
+        size_t end = segments_[s].FindEnd(is_last ? url : window, pos, is_last);
+        if (end == std::string_view::npos)
+            return false;
+        pos = end;
+    }
+    return true;
+}
+
+// --- NetworkFilterIndex ---
+
+size_t NetworkFilterIndex::TypeSlot(uint8_t type)
+{
+    switch (type)
+    {
+    case kResourceScript:
+        return 2;
+    case kResourceImage:
+        return 3;
+    case kResourceStylesheet:
+        return 4;
+    default:
+        return 1;
+    }
+}
+
+bool NetworkFilterIndex::Add(std::string_view line, NetworkFilter filter)
+{
+    bool added = false;
+    const uint32_t id = lines_.Intern(line, &added);
+    if (!added)
+        return false;
+    filters_.push_back(std::move(filter));
+    NetworkFilter &f = filters_.back();
+    TokenIndex::Tokens tokens = std::move(f.tokens_);
+    f.tokens_ = {};
+
+    // $domain= rules only apply on their listed sites; index them by those.
+    if (!f.include_domains().empty())
+    {
+        for (const auto &d : f.include_domains())
+            by_domain_[HostMatcher::HashHost(d)].push_back(id);
+        return true;
+    }
+
+    auto file = [&](Bucket &bucket)
+    {
+        if (!f.anchored_host().empty())
+            bucket.by_host[HostMatcher::HashHost(f.anchored_host())].push_back(id);
+        else
+            bucket.by_token.Add(id, tokens);
+    };
+    auto &by_type = buckets_[f.party()];
+    if (f.types() == kResourceAll)
+    {
+        file(by_type[0]);
+        return true;
+    }
+    for (uint8_t t : {kResourceOther, kResourceScript, kResourceImage, kResourceStylesheet})
+    {
+        if (f.types() & t)
+            file(by_type[TypeSlot(t)]);
+    }
+    return true;
+}
+
+void NetworkFilterIndex::Merge(NetworkFilterIndex &&other)
+{
+    for (uint32_t id = 0; id < other.filters_.size(); ++id)
+        Add(other.lines_.Get(id), std::move(other.filters_[id]));
+    other.Clear();
+}
+
+void NetworkFilterIndex::Build()
+{
+    for (auto &by_type : buckets_)
+    {
+        for (auto &bucket : by_type)
+            bucket.by_token.Build();
+    }
+}
+
+void NetworkFilterIndex::Clear()
+{
+    lines_.Clear();
+    filters_.clear();
+    by_domain_.clear();
+    for (auto &by_type : buckets_)
+    {
+        for (auto &bucket : by_type)
+        {
+            bucket.by_host.clear();
+            bucket.by_token.Clear();
+        }
+    }
+}
+
+const NetworkFilter *NetworkFilterIndex::MatchList(const std::vector<uint32_t> &ids, const RequestContext &ctx) const
+{
+    for (uint32_t id : ids)
+    {
+        if (filters_[id].Matches(ctx))
+            return &filters_[id];
+    }
+    return nullptr;
+}
+
+const NetworkFilter *NetworkFilterIndex::MatchBucket(const Bucket &bucket, const RequestContext &ctx,
+                                                     const TokenIndex::Tokens &url_tokens) const
+{
+    const NetworkFilter *hit = nullptr;
+    if (!bucket.by_host.empty())
+    {
+        HostMatcher::ForEachSuffix(ctx.host, [&](uint64_t h, std::string_view)
+                                   {
+            auto it = bucket.by_host.find(h);
+            if (it != bucket.by_host.end())
+                hit = MatchList(it->second, ctx);
+            return hit != nullptr; });
+        if (hit)
+            return hit;
+    }
+    if (bucket.by_token.empty())
+        return nullptr;
+    bucket.by_token.ForEachCandidate(url_tokens, [&](uint32_t id)
+                                     {
+        if (filters_[id].Matches(ctx))
+            hit = &filters_[id];
+        return hit != nullptr; });
+    return hit;
+}
+
+const NetworkFilter *NetworkFilterIndex::Match(const RequestContext &ctx) const
+{
+    if (filters_.empty())
+        return nullptr;
+
+    const size_t parties[2] = {NetworkFilter::kAnyParty,
+                               ctx.third_party ? NetworkFilter::kThirdParty : NetworkFilter::kFirstParty};
+    const size_t slots[2] = {0, TypeSlot(ctx.type)};
+    // Tokenize the URL once for all buckets.
+    thread_local TokenIndex::Tokens url_tokens;
+    TokenIndex::TokenizeURL(ctx.url, url_tokens);
+    for (size_t party : parties)
+    {
+        for (size_t slot : slots)
+        {
+            if (const NetworkFilter *hit = MatchBucket(buckets_[party][slot], ctx, url_tokens))
+                return hit;
+        }
+    }
+
+    const NetworkFilter *hit = nullptr;
+    if (!by_domain_.empty())
+    {
+        HostMatcher::ForEachSuffix(ctx.origin_host, [&](uint64_t h, std::string_view)
+                                   {
+            auto it = by_domain_.find(h);
+            if (it != by_domain_.end())
+                hit = MatchList(it->second, ctx);
+            return hit != nullptr; });
+    }
+    return hit;
+}
@@ -0,0 +1,190 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "PatternSegment.h"
+#include "StringArena.h"
+#include "TokenIndex.h"
+
+// Resource types a filter can be restricted to. Ultralight does not report the
+// request type, so it is inferred from the URL's file extension.
+enum ResourceType : uint8_t
+{
+    kResourceOther = 1 << 0,
+    kResourceScript = 1 << 1,
+    kResourceImage = 1 << 2,
+    kResourceStylesheet = 1 << 3,
+    kResourceAll = kResourceOther | kResourceScript | kResourceImage | kResourceStylesheet,
+};
+
+// Everything the filters need to know about one request. All strings are
+// lowercase views owned by the caller.
+struct RequestContext
+{
+    std::string_view url;
+    std::string_view host;
+    std::string_view origin_host; // host of the requesting document; equals host when unknown
+    uint8_t type = kResourceOther;
+    bool third_party = false;
+    bool has_origin = false; // origin_host is known, not defaulted to host
+
+    // Fill in type, third_party and has_origin from url/host/origin_host.
+    static RequestContext Make(std::string_view url, std::string_view host, std::string_view origin_host);
+};
+
+// Lowercase copies of one request's URL and origin, and the RequestContext
+// parsed from them, in buffers reused from request to request (they grow to
+// the longest URL seen and never shrink). Kept thread_local on the request
+// path, classification does not touch the heap once a thread has warmed up.
+class RequestBuffer
+{
+public:
+    static constexpr size_t kInitialCapacity = 2048; // longer URLs are rare
+
+    RequestBuffer();
+
+    // Lowercase url and origin as the network layer reports them and parse
+    // the scheme and both hosts out of them. The context's views stay valid
+    // until the next Parse().
+    const RequestContext &Parse(std::string_view url, std::string_view origin);
+    const RequestContext &context() const { return ctx_; }
+    // "https", "data", ...; empty when the URL has none.
+    std::string_view scheme() const { return scheme_; }
+
+private:
+    static std::string_view Lower(std::string_view in, std::string &buf);
+
+    std::string url_;
+    std::string origin_;
+    std::string_view scheme_;
+    RequestContext ctx_;
+};
+
+// URL helpers shared by the filter engine.
+namespace url_util
+{
+    // Host part of an absolute URL or origin ("https://a.b.com:443/x" -> "a.b.com").
+    std::string_view HostFromURL(std::string_view url);
+    // Registrable domain per the Public Suffix List ("a.b.example.co.uk" ->
+    // "example.co.uk"); host itself for IP literals and public suffixes.
+    std::string_view BaseDomain(std::string_view host);
+    // True when host is domain or one of its subdomains ("a.b.com" under "b.com", not "ab.com").
+    bool IsDomainOrSubdomain(std::string_view host, std::string_view domain);
+    uint8_t InferResourceType(std::string_view url);
+    // Write in with ASCII 'A'-'Z' lowercased to out (in.size() bytes; may be
+    // in.data() itself). Other bytes, including UTF-8 sequences, are copied.
+    void LowerASCII(std::string_view in, char *out);
+}
+
+// One compiled Adblock Plus / EasyList network rule.
+//
+// Supported syntax:
+// - "@@" exception prefix
+// - "||" domain anchor, "|" start/end anchors, "^" separator, "*" wildcard
+// - options after "$": third-party / first-party (and "~" negations),
+//   domain=a.com|~b.com, script, image, stylesheet (and "~" negations),
+//   match-case (ignored, matching is case-insensitive)
+//
+// Rules with any other option are rejected rather than applied more broadly
+// than their authors intended.
+class NetworkFilter
+{
+public:
+    enum Party : uint8_t
+    {
+        kAnyParty,
+        kFirstParty,
+        kThirdParty,
+    };
+
+    // Parse a trimmed list line. Returns false for lines this engine cannot honour.
+    static bool Parse(std::string_view line, NetworkFilter &out);
+
+    bool Matches(const RequestContext &ctx) const;
+
+    bool is_exception() const { return exception_; }
+    uint8_t types() const { return types_; }
+    Party party() const { return party_; }
+    const std::vector<std::string> &include_domains() const { return include_domains_; }
+    const std::vector<std::string> &exclude_domains() const { return exclude_domains_; }
+    // Hostname of a "||host^..." / "||host/..." rule, empty otherwise. Used for indexing.
+    std::string_view anchored_host() const { return anchored_host_; }
+    // Literal tokens every matching URL contains (see TokenIndex). Handed
+    // over to the index's TokenIndex when the filter is added to one.
+    const TokenIndex::Tokens &tokens() const { return tokens_; }
+
+private:
+    friend class NetworkFilterIndex;
+
+    bool MatchesURL(std::string_view url) const;
+    bool MatchesFrom(std::string_view url, size_t pos, bool anchored_first) const;
+    bool MatchesDomain(std::string_view origin_host) const;
+
+    std::vector<PatternSegment> segments_;
+    std::string anchored_host_;
+    TokenIndex::Tokens tokens_;
+    bool exception_ = false;
+    bool host_anchor_ = false;
+    bool start_anchor_ = false;
+    bool end_anchor_ = false;
+    bool leading_wildcard_ = false;
+    bool trailing_wildcard_ = false;
+    uint8_t types_ = kResourceAll;
+    Party party_ = kAnyParty;
+    std::vector<std::string> include_domains_;
+    std::vector<std::string> exclude_domains_;
+};
+
+// Filters partitioned so a request only tests the buckets that can apply:
+// by party and resource type, then by the anchored host (probed with the
+// request host's suffixes), by the rarest literal token (probed with the
+// URL's tokens) or, for $domain= rules, by the including domain (probed with
+// the document host's suffixes).
+//
+// The rules' list lines live in a StringArena, which also drops a line added
+// twice; filter ids are line ids.
+class NetworkFilterIndex
+{
+public:
+    // Queue the filter parsed from line. Takes effect after the next Build().
+    // Returns false, keeping the index as it was, when line was already added.
+    bool Add(std::string_view line, NetworkFilter filter);
+    // Queue every filter of other (emptied).
+    void Merge(NetworkFilterIndex &&other);
+    void Build();
+    void Clear();
+
+    // First matching filter, or nullptr.
+    const NetworkFilter *Match(const RequestContext &ctx) const;
+
+    size_t size() const { return filters_.size(); }
+    bool empty() const { return filters_.empty(); }
+    const std::vector<NetworkFilter> &filters() const { return filters_; }
+    // List line of a filter of this index, and all of them in id order.
+    std::string_view line(const NetworkFilter &filter) const { return lines_.Get((uint32_t)(&filter - filters_.data())); }
+    const StringArena &lines() const { return lines_; }
+
+private:
+    using HashedList = std::unordered_map<uint64_t, std::vector<uint32_t>>;
+
+    struct Bucket
+    {
+        HashedList by_host;  // anchored host hash -> filter ids
+        TokenIndex by_token; // everything else
+    };
+
+    static constexpr size_t kTypeSlots = 5; // any, other, script, image, stylesheet
+    static size_t TypeSlot(uint8_t type);
+
+    const NetworkFilter *MatchBucket(const Bucket &bucket, const RequestContext &ctx,
+                                     const TokenIndex::Tokens &url_tokens) const;
+    const NetworkFilter *MatchList(const std::vector<uint32_t> &ids, const RequestContext &ctx) const;
+
+    StringArena lines_;                  // filter id -> list line
+    std::vector<NetworkFilter> filters_;
+    Bucket buckets_[3][kTypeSlots]; // [party][type slot]
+    HashedList by_domain_;          // $domain= include hash -> filter ids
+};
@@ -0,0 +1,153 @@
+#include "PatternSegment.h"
+
+#include <algorithm>
+
+PatternSegment::PatternSegment(std::string_view text, Syntax syntax) : text_(text), syntax_(syntax)
+{
+    const size_t literal = TrailingCaret() ? text_.size() - 1 : text_.size();
+    bool has_class = false;
+    for (size_t k = 0; k < literal && !has_class; ++k)
+        has_class = IsClass(text_[k]);
+    if (!has_class)
+    {
+        fail_.assign(literal, 0);
+        for (size_t k = 1, b = 0; k < literal; ++k)
+        {
+            while (b > 0 && text_[k] != text_[b])
+                b = fail_[b - 1];
+            if (text_[k] == text_[b])
+                ++b;
+            fail_[k] = (uint32_t)b;
+        }
+        return;
+    }
+
+    words_ = (text_.size() + 63) / 64;
+    masks_.assign(words_ * 256, 0);
+    for (size_t k = 0; k < text_.size(); ++k)
+    {
+        const uint64_t bit = 1ull << (k % 64);
+        const size_t word = k / 64;
+        const unsigned char pc = (unsigned char)text_[k];
+        if (syntax_ == kGlob && pc == '?')
+        {
+            for (size_t c = 0; c < 256; ++c)
+                masks_[c * words_ + word] |= bit;
+        }
+        else if (syntax_ == kAdblock && pc == '^')
+        {
+            for (size_t c = 0; c < 256; ++c)
+            {
+                if (IsSeparator((unsigned char)c))
+                    masks_[c * words_ + word] |= bit;
+            }
+        }
+        else
+        {
+            masks_[(size_t)pc * words_ + word] |= bit;
+        }
+    }
+}
+
+bool PatternSegment::MatchesAt(std::string_view text, size_t pos, bool end_ok) const
+{
+    size_t m = text_.size();
+    if (end_ok && TrailingCaret() && pos + m == text.size() + 1)
+        --m; // the trailing '^' stands for the end of the address
+    else if (pos > text.size() || text.size() - pos < m)
+        return false;
+    if (words_ == 0)
+    {
+        // Literal text, then the trailing '^' unless it stands for the end.
+        const size_t n = std::min(m, fail_.size());
+        if (text.compare(pos, n, text_.data(), n) != 0)
+            return false;
+        return n == m || IsSeparator((unsigned char)text[pos + n]);
+    }
+    for (size_t k = 0; k < m; ++k)
+    {
+        if (!Accepts(k, (unsigned char)text[pos + k]))
+            return false;
+    }
+    return true;
+}
+
+size_t PatternSegment::FindEnd(std::string_view text, size_t from, bool end_ok) const
+{
+    const size_t m = text_.size();
+    if (m == 0)
+        return from;
+    if (from > text.size())
+        return std::string_view::npos;
+    if (words_ == 0)
+        return FindLiteralEnd(text, from, end_ok);
+
+    if (words_ == 1)
+    {
+        const uint64_t accept = 1ull << (m - 1);
+        uint64_t d = 0;
+        for (size_t i = from; i < text.size(); ++i)
+        {
+            d = ((d << 1) | 1) & masks_[(unsigned char)text[i]];
+            if (d & accept)
+                return i + 1;
+        }
+        // A prefix ending at the text end, followed only by a trailing '^'.
+        if (end_ok && TrailingCaret() && (m == 1 || (d >> (m - 2)) & 1))
+            return text.size();
+        return std::string_view::npos;
+    }
+
+    // Multi-word Shift-And for segments longer than 64 characters.
+    std::vector<uint64_t> d(words_, 0);
+    const size_t last_word = (m - 1) / 64;
+    const uint64_t accept = 1ull << ((m - 1) % 64);
+    for (size_t i = from; i < text.size(); ++i)
+    {
+        const uint64_t *mask = &masks_[(unsigned char)text[i] * words_];
+        uint64_t carry = 1;
+        for (size_t w = 0; w < words_; ++w)
+        {
+            uint64_t next_carry = d[w] >> 63;
+            d[w] = ((d[w] << 1) | carry) & mask[w];
+            carry = next_carry;
+        }
+        if (d[last_word] & accept)
+            return i + 1;
+    }
+    if (end_ok && TrailingCaret() && ((d[(m - 2) / 64] >> ((m - 2) % 64)) & 1))
+        return text.size();
+    return std::string_view::npos;
+}
+
+// Knuth-Morris-Pratt over the literal text. With a trailing '^', every
+// occurrence of the literal is checked for a separator right after it; the
+// first to have one is the leftmost match.
+size_t PatternSegment::FindLiteralEnd(std::string_view text, size_t from, bool end_ok) const
+{
+    const size_t n = fail_.size();
+    const bool caret = n < text_.size();
+    size_t q = 0; // length of the literal prefix matched so far
+    for (size_t i = from; i < text.size(); ++i)
+    {
+        const char c = text[i];
+        if (q == n) // only reached with a caret pending
+        {
+            if (IsSeparator((unsigned char)c))
+                return i + 1;
+            q = n > 0 ? fail_[n - 1] : 0;
+        }
+        if (n == 0)
+            continue;
+        while (q > 0 && text_[q] != c)
+            q = fail_[q - 1];
+        if (text_[q] == c)
+            ++q;
+        if (q == n && !caret)
+            return i + 1;
+    }
+    // A literal ending at the text end, followed only by a trailing '^'.
+    if (end_ok && caret && q == n)
+        return text.size();
+    return std::string_view::npos;
+}
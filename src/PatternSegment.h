@@ -0,0 +1,63 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// A wildcard-free run of a URL pattern (the text between two '*'), compiled for
+// linear-time search. Two single-character classes are supported:
+//
+// - glob syntax: '?' accepts any byte
+// - Adblock Plus syntax: '^' accepts any separator byte (anything except
+//   letters, digits and "_-.%")
+//
+// Segments with a class inside them are searched with bit-parallel Shift-And,
+// whose table holds the set of bytes each position accepts (2 KB per 64
+// characters). Most segments are plain text, at most ending in '^'; those
+// keep a Knuth-Morris-Pratt failure table instead, 4 bytes per character.
+//
+// Either way searching reads every text byte once, so matching a whole pattern
+// segment by segment stays linear in the URL length.
+class PatternSegment
+{
+public:
+    enum Syntax : uint8_t
+    {
+        kGlob,     // '?' is a single-character wildcard
+        kAdblock,  // '^' is a separator placeholder, '?' is literal
+    };
+
+    PatternSegment(std::string_view text, Syntax syntax);
+
+    size_t size() const { return text_.size(); }
+    const std::string &text() const { return text_; }
+
+    // True when the segment matches text starting at pos. With end_ok, a
+    // trailing '^' may also match the end of the text (Adblock Plus semantics).
+    bool MatchesAt(std::string_view text, size_t pos, bool end_ok = false) const;
+
+    // Leftmost match starting at or after from; returns the offset just past
+    // it, or npos. end_ok as for MatchesAt.
+    size_t FindEnd(std::string_view text, size_t from, bool end_ok = false) const;
+
+    static bool IsSeparator(unsigned char c)
+    {
+        return !((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+                 c == '_' || c == '-' || c == '.' || c == '%');
+    }
+
+private:
+    bool IsClass(char c) const { return (syntax_ == kGlob && c == '?') || (syntax_ == kAdblock && c == '^'); }
+    bool Accepts(size_t k, unsigned char c) const
+    {
+        return (masks_[(size_t)c * words_ + k / 64] >> (k % 64)) & 1;
+    }
+    bool TrailingCaret() const { return syntax_ == kAdblock && !text_.empty() && text_.back() == '^'; }
+    size_t FindLiteralEnd(std::string_view text, size_t from, bool end_ok) const;
+
+    std::string text_;
+    std::vector<uint64_t> masks_; // words_ * 256; bit k set when position k accepts the byte; empty for literals
+    std::vector<uint32_t> fail_;  // literals: longest proper border of text_[0, k], over text_ minus a trailing '^'
+    size_t words_ = 0;            // 0 for literals
+    Syntax syntax_;
+};
@@ -0,0 +1,94 @@
+#include "PublicSuffix.h"
+#include "HostMatcher.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+    // kSeeds, kSlots and kText, written by psl_compile.
+#include "PublicSuffixTable.inc"
+
+    // A kSlots entry: flags in bits 0-2, key length in bits 3-9, key offset in
+    // kText above that. Empty slots are 0.
+    constexpr int kFlagBits = 3;
+    constexpr int kLengthBits = 7;
+
+    // Flags of suffix, or -1 when it is neither a rule nor the parent of one.
+    int Find(uint64_t h, std::string_view suffix)
+    {
+        uint32_t seed = kSeeds[psl::Bucket(h, kBucketCount)];
+        uint32_t entry = kSlots[psl::Slot(h, seed, kSlotCount)];
+        size_t length = (entry >> kFlagBits) & ((1u << kLengthBits) - 1);
+        if (length != suffix.size() || length == 0 ||
+            std::memcmp(kText + (entry >> (kFlagBits + kLengthBits)), suffix.data(), length) != 0)
+            return -1;
+        return (int)(entry & ((1u << kFlagBits) - 1));
+    }
+
+    bool IsIPLiteral(std::string_view host)
+    {
+        return host.front() == '[' || std::all_of(host.begin(), host.end(), [](char c)
+                                                  { return (c >= '0' && c <= '9') || c == '.'; });
+    }
+
+    std::string_view StripTrailingDot(std::string_view host)
+    {
+        if (!host.empty() && host.back() == '.')
+            host.remove_suffix(1);
+        return host;
+    }
+
+    // Offset in host where its public suffix starts, npos for IP literals.
+    size_t SuffixStart(std::string_view host)
+    {
+        if (host.empty() || IsIPLiteral(host))
+            return std::string_view::npos;
+
+        // The implicit "*" rule: the last label.
+        size_t dot = host.rfind('.');
+        size_t start = dot == std::string_view::npos ? 0 : dot + 1;
+        bool wildcard = false;
+        HostMatcher::ForEachSuffix(host, [&](uint64_t h, std::string_view suffix)
+                                   {
+            size_t at = host.size() - suffix.size();
+            if (wildcard)
+                start = at;
+            int flags = Find(h, suffix);
+            if (flags < 0)
+                return true;
+            if (flags & psl::kException)
+            {
+                start = at + suffix.find('.') + 1;
+                return true;
+            }
+            if (flags & psl::kRule)
+                start = at;
+            wildcard = (flags & psl::kWildcard) != 0;
+            return false; });
+        return start;
+    }
+}
+
+std::string_view psl::PublicSuffix(std::string_view host)
+{
+    host = StripTrailingDot(host);
+    size_t start = SuffixStart(host);
+    return start == std::string_view::npos ? std::string_view() : host.substr(start);
+}
+
+std::string_view psl::RegistrableDomain(std::string_view host)
+{
+    host = StripTrailingDot(host);
+    size_t start = SuffixStart(host);
+    if (start == std::string_view::npos || start < 2)
+        return std::string_view();
+    size_t dot = host.rfind('.', start - 2);
+    return dot == std::string_view::npos ? host : host.substr(dot + 1);
+}
+
+bool psl::IsPublicSuffix(std::string_view host)
+{
+    host = StripTrailingDot(host);
+    return !host.empty() && SuffixStart(host) == 0;
+}
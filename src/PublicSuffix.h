@@ -0,0 +1,51 @@
+#pragma once
+#include <cstdint>
+#include <string_view>
+
+// Public Suffix List lookups ("a.b.example.co.uk" -> "example.co.uk").
+//
+// tools/public_suffix_list.dat is compiled at build time (tools/psl_compile)
+// into a static perfect hash table: every rule, and every parent domain of a
+// rule, owns exactly one slot. A lookup hashes the host once from right to
+// left, as HostMatcher does, and at each label boundary reads one seed and one
+// slot and compares one string. It stops at the first suffix that is not in
+// the table, so the cost is bounded by the number of labels of the host and
+// nothing is allocated.
+//
+// Both ICANN and private rules apply: "user.github.io" and "other.github.io"
+// are different sites. Hosts must be lowercase ASCII (IDN labels in punycode);
+// a trailing dot is ignored.
+namespace psl
+{
+    // Public suffix of host ("co.uk" for "a.example.co.uk"; the last label when
+    // no rule matches). Empty for IP literals.
+    std::string_view PublicSuffix(std::string_view host);
+    // Public suffix plus one label ("example.co.uk"). Empty for IP literals and
+    // for hosts that are themselves a public suffix.
+    std::string_view RegistrableDomain(std::string_view host);
+    // True when host is a public suffix, such as "com" or "github.io".
+    bool IsPublicSuffix(std::string_view host);
+
+    // Slot flags of the compiled table.
+    enum : uint8_t
+    {
+        kRule = 1,      // "co.uk"
+        kWildcard = 2,  // "*.ck": every child is a public suffix
+        kException = 4, // "!www.ck": not a public suffix despite a wildcard
+    };
+
+    // Placement shared by psl_compile and the lookup. h is the HostMatcher hash
+    // of a suffix; it picks a bucket, and the bucket's seed picks the slot.
+    inline uint32_t Bucket(uint64_t h, uint32_t buckets)
+    {
+        return (uint32_t)(((h >> 32) * buckets) >> 32);
+    }
+    inline uint32_t Slot(uint64_t h, uint32_t seed, uint32_t slots)
+    {
+        uint64_t x = h ^ (seed * 0x9e3779b97f4a7c15ull);
+        x ^= x >> 31;
+        x *= 0xbf58476d1ce4e5b9ull;
+        x ^= x >> 29;
+        return (uint32_t)(((x & 0xffffffffu) * slots) >> 32);
+    }
+}
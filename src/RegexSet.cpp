@@ -0,0 +1,928 @@
+#include "RegexSet.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+namespace
+{
+    constexpr uint32_t kUnknown = UINT32_MAX; // transition not computed yet
+    constexpr int kMaxDepth = 64;             // nested groups
+    constexpr int kMaxRepeat = 1000;          // {n,m} bounds
+    constexpr size_t kMaxRuleNodes = 20000;   // NFA states one rule may take
+    constexpr size_t kThreadCaches = 16;      // sets a thread keeps a DFA for
+
+    std::atomic<uint64_t> g_next_id{1};
+
+    uint64_t NextId() { return g_next_id.fetch_add(1, std::memory_order_relaxed); }
+
+    // Parsed pattern.
+    struct Ast
+    {
+        enum Kind : uint8_t
+        {
+            kEmpty,
+            kSet,
+            kBegin,
+            kEnd,
+            kConcat,
+            kAlt,
+            kRepeat,
+        };
+        Kind kind = kEmpty;
+        std::bitset<256> set; // kSet
+        int min = 0;          // kRepeat
+        int max = 0;          // kRepeat; -1 is unbounded
+        std::vector<Ast> kids;
+    };
+
+    // Rules match lowercase URLs case-insensitively.
+    std::bitset<256> Fold(std::bitset<256> set)
+    {
+        for (int c = 'a'; c <= 'z'; ++c)
+        {
+            if (set[c] || set[c - 'a' + 'A'])
+            {
+                set.set(c);
+                set.set(c - 'a' + 'A');
+            }
+        }
+        return set;
+    }
+
+    std::bitset<256> Range(int lo, int hi)
+    {
+        std::bitset<256> set;
+        for (int c = lo; c <= hi; ++c)
+            set.set(c);
+        return set;
+    }
+
+    int HexDigit(char c)
+    {
+        if (c >= '0' && c <= '9')
+            return c - '0';
+        if (c >= 'a' && c <= 'f')
+            return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F')
+            return c - 'A' + 10;
+        return -1;
+    }
+
+    // Recursive descent over the JavaScript regex subset RegexSet supports.
+    class Parser
+    {
+    public:
+        explicit Parser(std::string_view pattern) : p_(pattern) {}
+
+        bool Parse(Ast &out) { return Alternation(out, 0) && pos_ == p_.size(); }
+
+    private:
+        bool More() const { return pos_ < p_.size(); }
+        char Peek() const { return p_[pos_]; }
+
+        bool Alternation(Ast &out, int depth)
+        {
+            Ast first;
+            if (!Concatenation(first, depth))
+                return false;
+            if (!More() || Peek() != '|')
+            {
+                out = std::move(first);
+                return true;
+            }
+            out.kind = Ast::kAlt;
+            out.kids.push_back(std::move(first));
+            while (More() && Peek() == '|')
+            {
+                ++pos_;
+                Ast next;
+                if (!Concatenation(next, depth))
+                    return false;
+                out.kids.push_back(std::move(next));
+            }
+            return true;
+        }
+
+        bool Concatenation(Ast &out, int depth)
+        {
+            out.kind = Ast::kConcat;
+            while (More() && Peek() != '|' && Peek() != ')')
+            {
+                Ast item;
+                if (!Repetition(item, depth))
+                    return false;
+                out.kids.push_back(std::move(item));
+            }
+            return true;
+        }
+
+        bool Repetition(Ast &out, int depth)
+        {
+            Ast atom;
+            if (!Atom(atom, depth))
+                return false;
+            if (!More())
+            {
+                out = std::move(atom);
+                return true;
+            }
+            int min = 0, max = 0;
+            switch (Peek())
+            {
+            case '*':
+                min = 0, max = -1, ++pos_;
+                break;
+            case '+':
+                min = 1, max = -1, ++pos_;
+                break;
+            case '?':
+                min = 0, max = 1, ++pos_;
+                break;
+            case '{':
+                if (!Bounds(min, max))
+                    return false;
+                break;
+            default:
+                out = std::move(atom);
+                return true;
+            }
+            if (atom.kind == Ast::kBegin || atom.kind == Ast::kEnd)
+                return false;
+            // A lazy quantifier accepts the same URLs; possessive ones and
+            // stacked quantifiers are errors.
+            if (More() && Peek() == '?')
+                ++pos_;
+            if (More() && (Peek() == '*' || Peek() == '+' || Peek() == '?' || Peek() == '{'))
+                return false;
+            out.kind = Ast::kRepeat;
+            out.min = min;
+            out.max = max;
+            out.kids.push_back(std::move(atom));
+            return true;
+        }
+
+        // "{n}", "{n,}" or "{n,m}".
+        bool Bounds(int &min, int &max)
+        {
+            ++pos_;
+            auto number = [&](int &n)
+            {
+                size_t start = pos_;
+                n = 0;
+                while (More() && Peek() >= '0' && Peek() <= '9' && n <= kMaxRepeat)
+                    n = n * 10 + (p_[pos_++] - '0');
+                return pos_ > start && n <= kMaxRepeat;
+            };
+            if (!number(min))
+                return false;
+            max = min;
+            if (More() && Peek() == ',')
+            {
+                ++pos_;
+                max = -1;
+                if (More() && Peek() != '}' && (!number(max) || max < min))
+                    return false;
+            }
+            if (!More() || Peek() != '}')
+                return false;
+            ++pos_;
+            return true;
+        }
+
+        bool Atom(Ast &out, int depth)
+        {
+            const char c = p_[pos_++];
+            switch (c)
+            {
+            case '(':
+                if (depth >= kMaxDepth)
+                    return false;
+                if (More() && Peek() == '?')
+                {
+                    if (p_.substr(pos_, 2) != "?:")
+                        return false; // lookaround, named groups
+                    pos_ += 2;
+                }
+                if (!Alternation(out, depth + 1) || !More() || Peek() != ')')
+                    return false;
+                ++pos_;
+                return true;
+            case '[':
+                out.kind = Ast::kSet;
+                return Class(out.set);
+            case '.':
+                out.kind = Ast::kSet;
+                out.set.set();
+                out.set.reset('\n');
+                out.set.reset('\r');
+                return true;
+            case '^':
+                out.kind = Ast::kBegin;
+                return true;
+            case '$':
+                out.kind = Ast::kEnd;
+                return true;
+            case '\\':
+                out.kind = Ast::kSet;
+                return Escape(out.set, false);
+            case '*':
+            case '+':
+            case '?':
+            case '{':
+            case '}':
+            case ']':
+            case ')':
+                return false;
+            default:
+                out.kind = Ast::kSet;
+                out.set.set((unsigned char)c);
+                out.set = Fold(out.set);
+                return true;
+            }
+        }
+
+        // After '\': one byte or a class escape, folded.
+        bool Escape(std::bitset<256> &set, bool in_class)
+        {
+            if (!More())
+                return false;
+            const char c = p_[pos_++];
+            std::bitset<256> word = Range('a', 'z') | Range('A', 'Z') | Range('0', '9');
+            word.set('_');
+            std::bitset<256> space;
+            for (char s : {' ', '\t', '\n', '\r', '\f', '\v'})
+                space.set((unsigned char)s);
+            switch (c)
+            {
+            case 'd':
+                set = Range('0', '9');
+                return true;
+            case 'D':
+                set = ~Range('0', '9');
+                return true;
+            case 'w':
+                set = word;
+                return true;
+            case 'W':
+                set = ~word;
+                return true;
+            case 's':
+                set = space;
+                return true;
+            case 'S':
+                set = ~space;
+                return true;
+            case 't':
+                set.set('\t');
+                return true;
+            case 'n':
+                set.set('\n');
+                return true;
+            case 'r':
+                set.set('\r');
+                return true;
+            case 'f':
+                set.set('\f');
+                return true;
+            case 'v':
+                set.set('\v');
+                return true;
+            case '0':
+                set.set(0);
+                return true;
+            case 'b':
+                if (!in_class)
+                    return false; // word boundary
+                set.set('\b');
+                return true;
+            case 'x':
+            case 'u':
+            {
+                const size_t digits = c == 'x' ? 2 : 4;
+                int value = 0;
+                for (size_t i = 0; i < digits; ++i)
+                {
+                    int d = More() ? HexDigit(p_[pos_++]) : -1;
+                    if (d < 0)
+                        return false;
+                    value = value * 16 + d;
+                }
+                if (value > 0x7f)
+                    return false; // URLs are matched as bytes
+                set.set(value);
+                if (!in_class)
+                    set = Fold(set); // a class folds once it is complete
+                return true;
+            }
+            default:
+                // \1 backreferences, \B, \p{...} and other letter escapes
+                if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9'))
+                    return false;
+                set.set((unsigned char)c);
+                return true;
+            }
+        }
+
+        // After '[': up to and including ']'.
+        bool Class(std::bitset<256> &set)
+        {
+            bool negated = More() && Peek() == '^';
+            if (negated)
+                ++pos_;
+            while (More() && Peek() != ']')
+            {
+                std::bitset<256> item;
+                int lo = -1;
+                if (!ClassAtom(item, lo))
+                    return false;
+                // A range needs single bytes on both sides; '-' elsewhere is literal.
+                if (lo >= 0 && pos_ + 1 < p_.size() && Peek() == '-' && p_[pos_ + 1] != ']')
+                {
+                    ++pos_;
+                    std::bitset<256> end;
+                    int hi = -1;
+                    if (!ClassAtom(end, hi) || hi < lo)
+                        return false;
+                    item = Range(lo, hi);
+                }
+                set |= item;
+            }
+            if (!More())
+                return false;
+            ++pos_;
+            set = Fold(set);
+            if (negated)
+                set.flip();
+            return true;
+        }
+
+        // One class member; lo is its byte when it is a single one.
+        bool ClassAtom(std::bitset<256> &item, int &lo)
+        {
+            const char c = p_[pos_++];
+            if (c != '\\')
+            {
+                item.set((unsigned char)c);
+                lo = (unsigned char)c;
+                return true;
+            }
+            if (!Escape(item, true))
+                return false;
+            if (item.count() == 1)
+            {
+                for (int b = 0; b < 256; ++b)
+                {
+                    if (item[b])
+                        lo = b;
+                }
+            }
+            return true;
+        }
+
+        std::string_view p_;
+        size_t pos_ = 0;
+    };
+}
+
+// Thompson construction of one rule into RegexSet::nodes_.
+class RegexCompiler
+{
+public:
+    explicit RegexCompiler(RegexSet &set) : set_(set), base_(set.nodes_.size()) {}
+
+    // Compile ast for rule id (0-based) and return its start state.
+    bool Compile(const Ast &ast, uint32_t id, uint32_t &start)
+    {
+        Frag f;
+        if (!Emit(ast, f))
+            return false;
+        uint32_t match = NewNode(RegexSet::kMatch);
+        set_.nodes_[match].arg = id + 1;
+        Patch(f.holes, match);
+        start = f.start;
+        return set_.nodes_.size() - base_ <= kMaxRuleNodes;
+    }
+
+    // Drop whatever a failed Compile() left behind.
+    void Rollback() { set_.nodes_.resize(base_); }
+
+private:
+    // A partial automaton: its entry state and the dangling exits (node * 2,
+    // plus one for out1) that the next piece is patched into.
+    struct Frag
+    {
+        uint32_t start = 0;
+        std::vector<uint32_t> holes;
+    };
+
+    uint32_t NewNode(RegexSet::Op op)
+    {
+        set_.nodes_.push_back({op, 0, 0, 0});
+        return (uint32_t)set_.nodes_.size() - 1;
+    }
+
+    void Patch(const std::vector<uint32_t> &holes, uint32_t target)
+    {
+        for (uint32_t h : holes)
+            (h & 1 ? set_.nodes_[h / 2].out1 : set_.nodes_[h / 2].out) = target;
+    }
+
+    // One-state fragment whose only exit is out.
+    Frag Single(RegexSet::Op op)
+    {
+        Frag f;
+        f.start = NewNode(op);
+        f.holes.push_back(f.start * 2);
+        return f;
+    }
+
+    uint32_t SetId(const std::bitset<256> &set)
+    {
+        auto it = set_.set_ids_.find(set);
+        if (it != set_.set_ids_.end())
+            return it->second;
+        set_.sets_.push_back(set);
+        set_.set_ids_.emplace(set, (uint32_t)set_.sets_.size() - 1);
+        return (uint32_t)set_.sets_.size() - 1;
+    }
+
+    void Append(Frag &f, Frag next)
+    {
+        Patch(f.holes, next.start);
+        f.holes = std::move(next.holes);
+    }
+
+    bool Emit(const Ast &ast, Frag &out)
+    {
+        if (set_.nodes_.size() - base_ > kMaxRuleNodes)
+            return false;
+        switch (ast.kind)
+        {
+        case Ast::kEmpty:
+            out = Single(RegexSet::kEmpty);
+            return true;
+        case Ast::kSet:
+            out = Single(RegexSet::kByte);
+            set_.nodes_[out.start].arg = SetId(ast.set);
+            return true;
+        case Ast::kBegin:
+            out = Single(RegexSet::kBegin);
+            return true;
+        case Ast::kEnd:
+            out = Single(RegexSet::kEnd);
+            return true;
+        case Ast::kConcat:
+        {
+            out = Single(RegexSet::kEmpty);
+            for (const Ast &kid : ast.kids)
+            {
+                Frag next;
+                if (!Emit(kid, next))
+                    return false;
+                Append(out, std::move(next));
+            }
+            return true;
+        }
+        case Ast::kAlt:
+        {
+            if (!Emit(ast.kids[0], out))
+                return false;
+            for (size_t i = 1; i < ast.kids.size(); ++i)
+            {
+                Frag next;
+                if (!Emit(ast.kids[i], next))
+                    return false;
+                uint32_t split = NewNode(RegexSet::kSplit);
+                set_.nodes_[split].out = out.start;
+                set_.nodes_[split].out1 = next.start;
+                out.start = split;
+                out.holes.insert(out.holes.end(), next.holes.begin(), next.holes.end());
+            }
+            return true;
+        }
+        case Ast::kRepeat:
+        {
+            const Ast &kid = ast.kids[0];
+            out = Single(RegexSet::kEmpty);
+            for (int i = 0; i < ast.min; ++i)
+            {
+                Frag next;
+                if (!Emit(kid, next))
+                    return false;
+                Append(out, std::move(next));
+            }
+            if (ast.max < 0)
+            {
+                // Loop: split -> kid -> split, leaving through out1.
+                Frag body;
+                if (!Emit(kid, body))
+                    return false;
+                uint32_t split = NewNode(RegexSet::kSplit);
+                set_.nodes_[split].out = body.start;
+                Patch(body.holes, split);
+                Frag loop;
+                loop.start = split;
+                loop.holes.push_back(split * 2 + 1);
+                Append(out, std::move(loop));
+                return true;
+            }
+            // Each optional copy may be skipped: x{1,3} is x x? x?.
+            for (int i = ast.min; i < ast.max; ++i)
+            {
+                Frag body;
+                if (!Emit(kid, body))
+                    return false;
+                uint32_t split = NewNode(RegexSet::kSplit);
+                set_.nodes_[split].out = body.start;
+                Frag optional;
+                optional.start = split;
+                optional.holes = std::move(body.holes);
+                optional.holes.push_back(split * 2 + 1);
+                Append(out, std::move(optional));
+            }
+            return true;
+        }
+        }
+        return false;
+    }
+
+    RegexSet &set_;
+    size_t base_;
+};
+
+// Lazily built DFA. A state is a sorted set of NFA states (kByte and pending
+// kEnd ones) plus the rule it accepts, if any.
+struct RegexSet::Cache
+{
+    struct KeyHash
+    {
+        size_t operator()(const std::vector<uint32_t> &key) const
+        {
+            uint64_t h = 14695981039346656037ull;
+            for (uint32_t v : key)
+                h = (h ^ v) * 1099511628211ull;
+            return (size_t)h;
+        }
+    };
+
+    std::unordered_map<std::vector<uint32_t>, uint32_t, KeyHash> ids; // state key -> DFA state
+    std::vector<std::vector<uint32_t>> sets; // DFA state -> NFA states
+    std::vector<uint32_t> next;              // next[state * classes_ + class], kUnknown until taken
+    std::vector<uint32_t> accept;            // rule matched on reaching the state (1-based), 0 for none
+    std::vector<uint32_t> accept_end;        // rule matched when the URL ends in the state
+    uint32_t start = kUnknown;
+    size_t flushes = 0;
+
+    // Closure scratch
+    std::vector<uint32_t> mark; // NFA state -> generation it was last visited in
+    uint32_t generation = 0;
+    std::vector<uint32_t> stack;
+    std::vector<uint32_t> scratch;
+
+    void Reset()
+    {
+        ids.clear();
+        sets.clear();
+        next.clear();
+        accept.clear();
+        accept_end.clear();
+        start = kUnknown;
+    }
+};
+
+RegexSet::RegexSet() : id_(NextId()) {}
+
+RegexSet::RegexSet(const RegexSet &other)
+    : rules_(other.rules_), nodes_(other.nodes_), starts_(other.starts_), sets_(other.sets_),
+      set_ids_(other.set_ids_), classes_(other.classes_), built_(other.built_), restart_(other.restart_),
+      id_(NextId())
+{
+    std::copy(std::begin(other.byte_class_), std::end(other.byte_class_), byte_class_);
+}
+
+RegexSet &RegexSet::operator=(const RegexSet &other)
+{
+    if (this != &other)
+    {
+        RegexSet copy(other);
+        *this = std::move(copy);
+    }
+    return *this;
+}
+
+RegexSet::RegexSet(RegexSet &&other) noexcept
+    : rules_(std::move(other.rules_)), nodes_(std::move(other.nodes_)), starts_(std::move(other.starts_)),
+      sets_(std::move(other.sets_)), set_ids_(std::move(other.set_ids_)), classes_(other.classes_),
+      built_(other.built_), restart_(std::move(other.restart_)), id_(other.id_)
+{
+    std::copy(std::begin(other.byte_class_), std::end(other.byte_class_), byte_class_);
+    other.Clear();
+}
+
+RegexSet &RegexSet::operator=(RegexSet &&other) noexcept
+{
+    if (this != &other)
+    {
+        rules_ = std::move(other.rules_);
+        nodes_ = std::move(other.nodes_);
+        starts_ = std::move(other.starts_);
+        sets_ = std::move(other.sets_);
+        set_ids_ = std::move(other.set_ids_);
+        std::copy(std::begin(other.byte_class_), std::end(other.byte_class_), byte_class_);
+        classes_ = other.classes_;
+        built_ = other.built_;
+        restart_ = std::move(other.restart_);
+        id_ = other.id_;
+        other.Clear();
+    }
+    return *this;
+}
+
+RegexSet::~RegexSet() = default;
+
+bool RegexSet::IsRegexRule(std::string_view line)
+{
+    return line.size() > 2 && line.front() == '/' && line.back() == '/' &&
+           line.substr(1, line.size() - 2).find_first_of("\\^$*+?()[]{}|") != std::string_view::npos;
+}
+
+bool RegexSet::Add(std::string_view rule, bool *added)
+{
+    if (added)
+        *added = false;
+    if (rule.size() < 3 || rule.front() != '/' || rule.back() != '/')
+        return false;
+    if (rules_.Find(rule) != StringArena::kNone)
+        return true;
+
+    Ast ast;
+    if (!Parser(rule.substr(1, rule.size() - 2)).Parse(ast))
+        return false;
+    RegexCompiler compiler(*this);
+    uint32_t start = 0;
+    if (!compiler.Compile(ast, (uint32_t)rules_.size(), start))
+    {
+        compiler.Rollback();
+        return false;
+    }
+
+    // A rule that matches the empty string matches every URL.
+    Cache probe;
+    probe.mark.assign(nodes_.size(), 0);
+    probe.generation = 1;
+    std::vector<uint32_t> set;
+    uint32_t accept = 0;
+    Closure(probe, start, true, true, set, accept);
+    if (accept != 0)
+    {
+        compiler.Rollback();
+        return false;
+    }
+
+    rules_.Intern(rule);
+    starts_.push_back(start);
+    if (added)
+        *added = true;
+    return true;
+}
+
+void RegexSet::Merge(RegexSet &&other)
+{
+    for (uint32_t id = 0; id < other.rules_.size(); ++id)
+        Add(other.rules_.Get(id));
+    other.Clear();
+}
+
+void RegexSet::Build()
+{
+    // Split the bytes into classes no set distinguishes, so a DFA row has
+    // one entry per class instead of 256.
+    uint16_t cls[256] = {};
+    uint32_t count = 1;
+    for (const ByteSet &set : sets_)
+    {
+        std::vector<uint16_t> split(count * 2, UINT16_MAX);
+        uint32_t next_count = 0;
+        for (int b = 0; b < 256; ++b)
+        {
+            uint16_t &c = split[cls[b] * 2 + (set[b] ? 1 : 0)];
+            if (c == UINT16_MAX)
+                c = (uint16_t)next_count++;
+            cls[b] = c;
+        }
+        count = next_count;
+    }
+    for (int b = 0; b < 256; ++b)
+        byte_class_[b] = (uint8_t)cls[b];
+    classes_ = count;
+    built_ = starts_.size();
+
+    // Every thread's cached DFA belongs to the rules before this build.
+    id_ = NextId();
+
+    // States every rule starts in after the first byte, added to each step.
+    Cache scratch;
+    scratch.mark.assign(nodes_.size(), 0);
+    scratch.generation = 1;
+    restart_.clear();
+    uint32_t accept = 0;
+    for (size_t r = 0; r < built_; ++r)
+        Closure(scratch, starts_[r], false, false, restart_, accept);
+}
+
+void RegexSet::Clear()
+{
+    rules_.Clear();
+    nodes_.clear();
+    starts_.clear();
+    sets_.clear();
+    set_ids_.clear();
+    std::fill(std::begin(byte_class_), std::end(byte_class_), 0);
+    classes_ = 0;
+    built_ = 0;
+    restart_.clear();
+    id_ = NextId();
+}
+
+size_t RegexSet::cached_states() const
+{
+    return ThreadCache().sets.size();
+}
+
+size_t RegexSet::cache_flushes() const
+{
+    return ThreadCache().flushes;
+}
+
+RegexSet::Cache &RegexSet::ThreadCache() const
+{
+    // Keyed by set id, which changes on every Build(), so a DFA never
+    // outlives the rules it was built from. The least recently used one
+    // makes room for a new set; a destroyed set's DFA lingers until then.
+    struct Slot
+    {
+        uint64_t id = 0;
+        uint64_t used = 0;
+        std::unique_ptr<Cache> cache;
+    };
+    thread_local Slot slots[kThreadCaches];
+    thread_local uint64_t clock = 0;
+
+    Slot *victim = &slots[0];
+    for (Slot &slot : slots)
+    {
+        if (slot.id == id_)
+        {
+            slot.used = ++clock;
+            return *slot.cache;
+        }
+        if (slot.used < victim->used)
+            victim = &slot;
+    }
+    if (!victim->cache)
+        victim->cache.reset(new Cache);
+    Cache &cache = *victim->cache;
+    cache.Reset();
+    cache.mark.assign(nodes_.size(), 0);
+    cache.generation = 1;
+    cache.flushes = 0;
+    victim->id = id_;
+    victim->used = ++clock;
+    return cache;
+}
+
+void RegexSet::Closure(Cache &cache, uint32_t node, bool at_start, bool at_end, std::vector<uint32_t> &set,
+                       uint32_t &accept) const
+{
+    auto &stack = cache.stack;
+    stack.push_back(node);
+    while (!stack.empty())
+    {
+        const uint32_t n = stack.back();
+        stack.pop_back();
+        if (cache.mark[n] == cache.generation)
+            continue;
+        cache.mark[n] = cache.generation;
+        const Node &s = nodes_[n];
+        switch (s.op)
+        {
+        case kByte:
+            set.push_back(n);
+            break;
+        case kSplit:
+            stack.push_back(s.out1);
+            stack.push_back(s.out);
+            break;
+        case kEmpty:
+            stack.push_back(s.out);
+            break;
+        case kBegin:
+            if (at_start)
+                stack.push_back(s.out);
+            break;
+        case kEnd:
+            if (at_end)
+                stack.push_back(s.out);
+            else
+                set.push_back(n); // may still pass if the URL ends here
+            break;
+        case kMatch:
+            if (accept == 0 || s.arg < accept)
+                accept = s.arg;
+            break;
+        }
+    }
+}
+
+uint32_t RegexSet::Intern(Cache &cache, std::vector<uint32_t> &set, uint32_t accept) const
+{
+    std::sort(set.begin(), set.end());
+    set.push_back(accept); // the key
+    auto it = cache.ids.find(set);
+    if (it != cache.ids.end())
+        return it->second;
+
+    if (cache.sets.size() >= kMaxCachedStates)
+    {
+        cache.Reset();
+        ++cache.flushes;
+    }
+    const uint32_t id = (uint32_t)cache.sets.size();
+    cache.ids.emplace(set, id);
+    set.pop_back();
+
+    // Pending '$' states decide whether the URL ending here is a match.
+    uint32_t end_accept = accept;
+    ++cache.generation;
+    std::vector<uint32_t> ignored;
+    for (uint32_t n : set)
+    {
+        if (nodes_[n].op == kEnd)
+            Closure(cache, nodes_[n].out, false, true, ignored, end_accept);
+    }
+
+    cache.sets.push_back(set);
+    cache.next.resize(cache.next.size() + classes_, kUnknown);
+    cache.accept.push_back(accept);
+    cache.accept_end.push_back(end_accept);
+    return id;
+}
+
+uint32_t RegexSet::StartState(Cache &cache) const
+{
+    auto &set = cache.scratch;
+    set.clear();
+    uint32_t accept = 0;
+    ++cache.generation;
+    for (size_t r = 0; r < built_; ++r)
+        Closure(cache, starts_[r], true, false, set, accept);
+    return Intern(cache, set, accept);
+}
+
+uint32_t RegexSet::Step(Cache &cache, uint32_t state, unsigned char byte) const
+{
+    auto &set = cache.scratch;
+    set.clear();
+    uint32_t accept = 0;
+    ++cache.generation;
+    for (uint32_t n : cache.sets[state])
+    {
+        const Node &s = nodes_[n];
+        if (s.op == kByte && sets_[s.arg][byte])
+            Closure(cache, s.out, false, false, set, accept);
+    }
+    // Unanchored search: every rule may also start at the next byte.
+    for (uint32_t n : restart_)
+    {
+        if (cache.mark[n] != cache.generation)
+        {
+            cache.mark[n] = cache.generation;
+            set.push_back(n);
+        }
+    }
+
+    const size_t flushes = cache.flushes;
+    const uint32_t next = Intern(cache, set, accept);
+    if (cache.flushes == flushes)
+        cache.next[(size_t)state * classes_ + byte_class_[byte]] = next;
+    return next;
+}
+
+uint32_t RegexSet::Find(std::string_view url) const
+{
+    if (built_ == 0)
+        return 0;
+    Cache &cache = ThreadCache();
+    if (cache.start == kUnknown)
+        cache.start = StartState(cache);
+    uint32_t s = cache.start;
+    for (unsigned char c : url)
+    {
+        if (cache.accept[s] != 0)
+            return cache.accept[s];
+        const uint32_t next = cache.next[(size_t)s * classes_ + byte_class_[c]];
+        s = next != kUnknown ? next : Step(cache, s, c);
+    }
+    return cache.accept[s] != 0 ? cache.accept[s] : cache.accept_end[s];
+}
@@ -0,0 +1,120 @@
+#pragma once
+#include <bitset>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "StringArena.h"
+
+// Regular expression URL rules ("/banner\d+\.gif/"), all matched in one pass.
+//
+// Each rule is parsed when it is added and compiled to a Thompson NFA; the
+// rules share one automaton. Matching runs it as a DFA built lazily: a DFA
+// state is the set of NFA states live after some input, and a transition is
+// computed the first time a URL takes it and cached. A URL is scanned once,
+// one table lookup per byte, for all rules together. Nothing backtracks: a
+// byte costs at most one state construction (linear in the NFA size), and
+// most bytes hit the cache.
+//
+// Each thread builds its own DFA, so lookups on the network threads never
+// wait on each other. A thread keeps the DFAs of the sets it used last; a
+// DFA holds at most kMaxCachedStates states. When it fills up it is dropped
+// and refilled from the current state, so memory stays bounded for any rules
+// and URLs.
+//
+// Supported syntax, matched byte by byte and case-insensitively against
+// lowercase URLs: literals and escapes (\. \/ \t \xHH ...), '.', classes
+// ("[a-z0-9_]", "[^/]", \d \w \s and their negations), groups "(...)" and
+// "(?:...)", '|', the quantifiers * + ? {n} {n,} {n,m} (lazy forms accept the
+// same URLs), and the ^ / $ anchors. Backreferences, lookaround and \b are
+// rejected, as are rules that match the empty string (they would block every
+// request).
+//
+// Immutable after Build(), so concurrent Find() calls are safe.
+class RegexSet
+{
+public:
+    static constexpr size_t kMaxCachedStates = 4096;
+
+    RegexSet();
+    // Copies the compiled rules; the copy starts with empty caches.
+    RegexSet(const RegexSet &other);
+    RegexSet &operator=(const RegexSet &other);
+    RegexSet(RegexSet &&other) noexcept;
+    RegexSet &operator=(RegexSet &&other) noexcept;
+    ~RegexSet();
+
+    // True for a "/pattern/" line whose pattern uses regex syntax. Plain
+    // "/path/" lines stay substring rules.
+    static bool IsRegexRule(std::string_view line);
+
+    // Queue a "/pattern/" rule. Returns false when the pattern is not
+    // supported. *added is false for a rule that was already queued. Takes
+    // effect after the next Build().
+    bool Add(std::string_view rule, bool *added = nullptr);
+    // Queue every rule of other (emptied).
+    void Merge(RegexSet &&other);
+    void Build();
+    void Clear();
+
+    // True when any rule matches somewhere in the (lowercase) URL.
+    bool Matches(std::string_view url) const { return Find(url) != 0; }
+    // 1-based id (arena id in rules(), plus one) of a rule matching url, 0 when none does.
+    uint32_t Find(std::string_view url) const;
+
+    size_t size() const { return rules_.size(); }
+    bool empty() const { return rules_.empty(); }
+    // Rule lines as added, slashes included.
+    const StringArena &rules() const { return rules_; }
+    size_t nfa_size() const { return nodes_.size(); }
+    // DFA states in the calling thread's cache, and how often it was dropped
+    // for being full.
+    size_t cached_states() const;
+    size_t cache_flushes() const;
+
+private:
+    using ByteSet = std::bitset<256>;
+    struct Cache;
+
+    enum Op : uint8_t
+    {
+        kByte,  // consume a byte in sets_[arg]
+        kSplit, // try out and out1
+        kEmpty, // go to out
+        kBegin, // go to out at the start of the URL
+        kEnd,   // go to out at the end of the URL
+        kMatch, // rule arg (1-based) matched
+    };
+    struct Node
+    {
+        Op op = kEmpty;
+        uint32_t out = 0;
+        uint32_t out1 = 0;
+        uint32_t arg = 0;
+    };
+
+    friend class RegexCompiler;
+
+    // Add the NFA states reachable from node without consuming a byte to
+    // set, and the lowest rule id reached to accept.
+    void Closure(Cache &cache, uint32_t node, bool at_start, bool at_end, std::vector<uint32_t> &set,
+                 uint32_t &accept) const;
+    uint32_t StartState(Cache &cache) const;
+    uint32_t Step(Cache &cache, uint32_t state, unsigned char byte) const;
+    uint32_t Intern(Cache &cache, std::vector<uint32_t> &set, uint32_t accept) const;
+    // The calling thread's DFA for this set, empty after a Build().
+    Cache &ThreadCache() const;
+
+    StringArena rules_;                         // rule id -> "/pattern/" line
+    std::vector<Node> nodes_;                   // every rule's NFA
+    std::vector<uint32_t> starts_;              // rule id -> first NFA state
+    std::vector<ByteSet> sets_;                 // byte sets of kByte states
+    std::unordered_map<ByteSet, uint32_t> set_ids_;
+    uint8_t byte_class_[256] = {};              // bytes no set tells apart share a class
+    uint32_t classes_ = 0;
+    size_t built_ = 0;                          // rules the last Build() covered
+    std::vector<uint32_t> restart_;             // NFA states of every rule's start, after the first byte
+    uint64_t id_;                               // tells the thread caches' sets apart; new on every Build()
+};
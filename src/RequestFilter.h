@@ -0,0 +1,88 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <string_view>
+
+#include "FilterEngine.h"
+#include "NetworkFilter.h"
+
+class FilterStats;
+
+// What one stage of a FilterPipeline makes of a request.
+enum class FilterAction : uint8_t
+{
+    None,     // no rule of the stage applies
+    Excepted, // a blocking rule matched, but one of the stage's own "@@" rules overrides it
+    Block,    // cancel the request
+    Allow,    // let the request through without asking the other stages
+};
+
+// A request as the pipeline's stages see it; every string is lowercase.
+class FilterRequest
+{
+public:
+    // Looks up the host of the page showing the requesting document, given the
+    // state passed to the constructor. Called at most once per request.
+    using PageHostFn = std::string_view (*)(const void *state);
+
+    FilterRequest(const RequestContext &ctx, PageHostFn page_host_fn, const void *state)
+        : ctx(ctx), page_host_fn_(page_host_fn), state_(state) {}
+    // For callers that know the page host up front (tools, tests).
+    FilterRequest(const RequestContext &ctx, std::string_view page_host)
+        : ctx(ctx), page_host_(page_host), page_host_known_(true) {}
+
+    const RequestContext &ctx;
+    // Set on the pipeline's extra timing pass over an already decided request
+    // (see FilterPipeline); stages skip their own accounting on it.
+    bool profiling = false;
+
+    // Host of the tab's page, for requests from its frames; empty when unknown.
+    // For the tab's top-level document load it is the host being loaded.
+    // Only stages that need it pay for the lookup.
+    std::string_view page_host() const
+    {
+        if (!page_host_known_)
+        {
+            page_host_ = page_host_fn_ ? page_host_fn_(state_) : std::string_view();
+            page_host_known_ = true;
+        }
+        return page_host_;
+    }
+
+private:
+    PageHostFn page_host_fn_ = nullptr;
+    const void *state_ = nullptr;
+    mutable std::string_view page_host_;
+    mutable bool page_host_known_ = false;
+};
+
+// One independent stage of a FilterPipeline: an engine that owns its rules
+// (ads, trackers, site policy) and is asked about every request.
+//
+// Evaluate() is called concurrently from network threads and must not block
+// on writers; stages publish immutable rule sets for that (see AdBlocker).
+class RequestFilter
+{
+public:
+    virtual ~RequestFilter() = default;
+
+    // Short name for reports and settings ("ads", "trackers", "site-policy").
+    virtual const char *name() const = 0;
+
+    // Decide on request. For any action but None, rule receives the rule that
+    // made the decision (for Allow, the allowed site), or an empty text when
+    // it cannot tell. The text stays valid until the calling thread's next
+    // Evaluate() call on any stage, so callers copy what they keep.
+    virtual FilterAction Evaluate(const FilterRequest &request, MatchedRule &rule) = 0;
+
+    // Time the stage's individual rules against url and record them in stats
+    // (FilterStats::RecordCost). Called on sampled requests only.
+    virtual void ProfileRules(std::string_view /*url*/, FilterStats & /*stats*/) {}
+
+    // A disabled stage is skipped by the pipeline.
+    void set_enabled(bool enabled) { enabled_.store(enabled, std::memory_order_relaxed); }
+    bool enabled() const { return enabled_.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<bool> enabled_{true};
+};
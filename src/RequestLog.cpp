@@ -0,0 +1,262 @@
+#include "RequestLog.h"
+#include "FilterStats.h"
+
+#include <algorithm>
+#include <cstring>
+#include <ctime>
+
+namespace
+{
+    uint64_t NowMs()
+    {
+        return (uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+                   std::chrono::system_clock::now().time_since_epoch())
+            .count();
+    }
+}
+
+const char *RequestLog::DecisionName(Decision decision)
+{
+    switch (decision)
+    {
+    case Decision::Blocked:
+        return "blocked";
+    case Decision::Allowed:
+        return "allowed";
+    case Decision::SiteAllowed:
+        return "site-allowed";
+    }
+    return "?";
+}
+
+std::string RequestLog::Entry::ToLine() const
+{
+    std::time_t raw = (std::time_t)(time_ms / 1000);
+    std::tm utc{};
+#if defined(_WIN32)
+    gmtime_s(&utc, &raw);
+#else
+    gmtime_r(&raw, &utc);
+#endif
+    char stamp[40];
+    size_t n = std::strftime(stamp, sizeof(stamp), "%Y-%m-%dT%H:%M:%S", &utc);
+    std::snprintf(stamp + n, sizeof(stamp) - n, ".%03uZ", (unsigned)(time_ms % 1000));
+
+    std::string line = stamp;
+    line += ' ';
+    line += DecisionName(decision);
+    line += ' ';
+    line += decision == Decision::SiteAllowed ? "site" : FilterStats::KindName(kind);
+    line += ' ';
+    line += rule;
+    line += ' ';
+    line += url;
+    return line;
+}
+
+RequestLog::RequestLog() = default;
+
+RequestLog::~RequestLog()
+{
+    Stop();
+}
+
+void RequestLog::Start(const std::string &path, uint64_t max_bytes, unsigned keep)
+{
+    Stop();
+    std::lock_guard<std::mutex> lock(mtx_);
+    if (!cells_)
+    {
+        cells_.reset(new Cell[kCapacity]);
+        for (size_t i = 0; i < kCapacity; ++i)
+            cells_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    path_ = path;
+    file_bytes_ = 0;
+    max_bytes_ = max_bytes;
+    keep_ = keep;
+    if (!path_.empty())
+    {
+        file_ = std::fopen(path_.c_str(), "ab");
+        if (!file_)
+            std::fprintf(stderr, "AdBlock: cannot write %s\n", path_.c_str());
+        if (file_ && std::fseek(file_, 0, SEEK_END) == 0)
+            file_bytes_ = (uint64_t)std::ftell(file_);
+    }
+    stop_ = false;
+    writer_ = std::thread([this]()
+                          { Run(); });
+    ring_ready_.store(true, std::memory_order_release);
+}
+
+void RequestLog::Stop()
+{
+    ring_ready_.store(false, std::memory_order_release);
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        stop_ = true;
+    }
+    wake_.notify_all();
+    if (writer_.joinable())
+        writer_.join();
+    std::lock_guard<std::mutex> lock(mtx_);
+    if (file_)
+    {
+        std::fclose(file_);
+        file_ = nullptr;
+    }
+}
+
+bool RequestLog::Push(Decision decision, RuleKind kind, std::string_view rule, std::string_view url)
+{
+    if (!ring_ready_.load(std::memory_order_acquire))
+    {
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    uint64_t pos = head_.load(std::memory_order_relaxed);
+    Cell *cell;
+    for (;;)
+    {
+        cell = &cells_[pos & (kCapacity - 1)];
+        const uint64_t sequence = cell->sequence.load(std::memory_order_acquire);
+        if (sequence == pos)
+        {
+            if (head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                break;
+        }
+        else if (sequence < pos)
+        {
+            // The writer has not read the cell from the previous lap yet.
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        else
+        {
+            pos = head_.load(std::memory_order_relaxed);
+        }
+    }
+
+    Record &r = cell->record;
+    r.time_ms = NowMs();
+    r.decision = decision;
+    r.kind = kind;
+    r.rule_size = (uint16_t)std::min(rule.size(), kMaxRuleBytes);
+    r.url_size = (uint16_t)std::min(url.size(), kMaxURLBytes);
+    std::memcpy(r.rule, rule.data(), r.rule_size);
+    std::memcpy(r.url, url.data(), r.url_size);
+    cell->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+}
+
+void RequestLog::Flush()
+{
+    std::lock_guard<std::mutex> lock(mtx_);
+    DrainLocked();
+}
+
+void RequestLog::Run()
+{
+    std::unique_lock<std::mutex> lock(mtx_);
+    while (!stop_)
+    {
+        wake_.wait_for(lock, kDrainInterval, [this]()
+                       { return stop_; });
+        DrainLocked();
+    }
+}
+
+void RequestLog::DrainLocked()
+{
+    if (!cells_)
+        return;
+    bool wrote = false;
+    for (;;)
+    {
+        Cell &cell = cells_[tail_ & (kCapacity - 1)];
+        if (cell.sequence.load(std::memory_order_acquire) != tail_ + 1)
+            break;
+        const Record &r = cell.record;
+        Entry entry;
+        entry.time_ms = r.time_ms;
+        entry.decision = r.decision;
+        entry.kind = r.kind;
+        entry.rule.assign(r.rule, r.rule_size);
+        entry.url.assign(r.url, r.url_size);
+        cell.sequence.store(tail_ + kCapacity, std::memory_order_release);
+        ++tail_;
+
+        if (file_)
+        {
+            WriteLocked(entry.ToLine());
+            wrote = true;
+        }
+        written_.fetch_add(1, std::memory_order_relaxed);
+        recent_.push_back(std::move(entry));
+        if (recent_.size() > kRecent)
+            recent_.pop_front();
+    }
+    if (wrote && file_)
+        std::fflush(file_);
+}
+
+void RequestLog::WriteLocked(const std::string &line)
+{
+    if (file_bytes_ > 0 && file_bytes_ + line.size() + 1 > max_bytes_)
+        RotateLocked();
+    if (!file_)
+        return;
+    std::fwrite(line.data(), 1, line.size(), file_);
+    std::fputc('\n', file_);
+    file_bytes_ += line.size() + 1;
+}
+
+void RequestLog::RotateLocked()
+{
+    std::fclose(file_);
+    if (keep_ == 0)
+    {
+        std::remove(path_.c_str());
+    }
+    else
+    {
+        std::remove((path_ + "." + std::to_string(keep_)).c_str());
+        for (unsigned i = keep_; i-- > 1;)
+            std::rename((path_ + "." + std::to_string(i)).c_str(), (path_ + "." + std::to_string(i + 1)).c_str());
+        std::rename(path_.c_str(), (path_ + ".1").c_str());
+    }
+    file_ = std::fopen(path_.c_str(), "wb");
+    file_bytes_ = 0;
+}
+
+std::vector<RequestLog::Entry> RequestLog::Recent(size_t max) const
+{
+    std::lock_guard<std::mutex> lock(mtx_);
+    const size_t count = std::min(max, recent_.size());
+    return std::vector<Entry>(recent_.end() - (std::ptrdiff_t)count, recent_.end());
+}
+
+std::string RequestLog::RecentJSON(size_t max) const
+{
+    std::string out = "{\"dropped\":" + std::to_string(dropped());
+    out += ",\"written\":" + std::to_string(written());
+    out += ",\"entries\":[";
+    const std::vector<Entry> entries = Recent(max);
+    for (size_t i = 0; i < entries.size(); ++i)
+    {
+        const Entry &e = entries[i];
+        out += i ? ",{" : "{";
+        out += "\"time_ms\":" + std::to_string(e.time_ms);
+        out += ",\"decision\":\"";
+        out += DecisionName(e.decision);
+        out += "\",\"kind\":\"";
+        out += e.decision == Decision::SiteAllowed ? "site" : FilterStats::KindName(e.kind);
+        out += "\",\"rule\":\"";
+        FilterStats::AppendEscaped(out, e.rule);
+        out += "\",\"url\":\"";
+        FilterStats::AppendEscaped(out, e.url);
+        out += "\"}";
+    }
+    out += "]}";
+    return out;
+}
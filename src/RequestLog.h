@@ -0,0 +1,126 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "FilterEngine.h"
+
+// Log of the ad blocker's decisions, written off the request path.
+//
+// Request threads Push() fixed-size records into a bounded lock-free ring
+// (one compare-and-swap to claim a cell, one release store to publish it); a
+// background writer drains the ring every kDrainInterval, formats the lines
+// and appends them to a log file rotated at a size limit. Pushing never
+// blocks, never allocates and never makes a system call. When the writer
+// falls behind and the ring is full, records are dropped and counted.
+//
+// The writer also keeps the last kRecent entries in memory for a live view
+// (Recent()), whether or not a file is open.
+class RequestLog
+{
+public:
+    static constexpr size_t kCapacity = 4096;   // ring cells, a power of two
+    static constexpr size_t kRecent = 500;      // entries kept for Recent()
+    static constexpr size_t kMaxURLBytes = 256; // longer URLs and rules are cut
+    static constexpr size_t kMaxRuleBytes = 128;
+    static constexpr std::chrono::milliseconds kDrainInterval{100};
+
+    enum class Decision : uint8_t
+    {
+        Blocked,     // by a blocking rule
+        Allowed,     // by an exception rule
+        SiteAllowed, // the page's site is on the allowlist
+    };
+
+    struct Entry
+    {
+        uint64_t time_ms = 0; // since the Unix epoch
+        Decision decision = Decision::Blocked;
+        RuleKind kind = RuleKind::Host; // unused for SiteAllowed
+        std::string rule;               // the rule, or the allowed site
+        std::string url;
+
+        // "2026-10-17T09:30:00.123Z blocked host example.com https://example.com/ad.js"
+        std::string ToLine() const;
+    };
+
+    RequestLog();
+    ~RequestLog();
+    RequestLog(const RequestLog &) = delete;
+    RequestLog &operator=(const RequestLog &) = delete;
+
+    // Start the writer. Entries also go to path, which is rotated once it
+    // exceeds max_bytes: path.1 ... path.<keep> hold older entries. An empty
+    // path keeps entries in memory only. Pushes before Start() are dropped.
+    void Start(const std::string &path = std::string(), uint64_t max_bytes = 1 << 20, unsigned keep = 2);
+    // Drain what is queued, close the file and join the writer.
+    void Stop();
+    bool running() const { return ring_ready_.load(std::memory_order_acquire); }
+
+    // Queue a decision; thread-safe and wait-free apart from CAS retries.
+    // Returns false, counting a drop, when the ring is full or not started.
+    bool Push(Decision decision, RuleKind kind, std::string_view rule, std::string_view url);
+    // Write everything queued so far, without waiting for the writer's next round.
+    void Flush();
+
+    // Up to max latest entries, oldest first.
+    std::vector<Entry> Recent(size_t max = kRecent) const;
+    // The same as JSON: {"dropped":N,"written":N,"entries":[{...}, ...]}.
+    std::string RecentJSON(size_t max = kRecent) const;
+    // Entries lost to a full ring, and entries the writer has taken off it.
+    uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+    uint64_t written() const { return written_.load(std::memory_order_relaxed); }
+
+    static const char *DecisionName(Decision decision);
+
+private:
+    struct Record
+    {
+        uint64_t time_ms;
+        Decision decision;
+        RuleKind kind;
+        uint16_t rule_size;
+        uint16_t url_size;
+        char rule[kMaxRuleBytes];
+        char url[kMaxURLBytes];
+    };
+    struct Cell
+    {
+        std::atomic<uint64_t> sequence; // position + 1 once written, position + kCapacity once read
+        Record record;
+    };
+
+    void Run();
+    // Caller holds mtx_. Move every published record out of the ring.
+    void DrainLocked();
+    void WriteLocked(const std::string &line);
+    void RotateLocked();
+
+    std::unique_ptr<Cell[]> cells_;
+    std::atomic<bool> ring_ready_{false};
+    alignas(64) std::atomic<uint64_t> head_{0}; // next position to claim
+    alignas(64) std::atomic<uint64_t> dropped_{0};
+    std::atomic<uint64_t> written_{0};
+
+    mutable std::mutex mtx_; // guards the members below; never taken by Push()
+    std::condition_variable wake_;
+    uint64_t tail_ = 0; // next position to read
+    std::deque<Entry> recent_;
+    std::string path_;
+    uint64_t max_bytes_ = 0;
+    unsigned keep_ = 0;
+    std::FILE *file_ = nullptr;
+    uint64_t file_bytes_ = 0;
+    bool stop_ = false;
+    std::thread writer_;
+};
@@ -0,0 +1,146 @@
+#include "ShadowList.h"
+#include "FilterStats.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+
+ShadowList::ShadowList(std::string source, std::shared_ptr<const FilterEngine> candidate)
+    : source_(std::move(source)), candidate_(std::move(candidate))
+{
+}
+
+FilterVerdict ShadowList::Evaluate(const RequestContext &ctx, const FilterSet &active, FilterVerdict verdict,
+                                   uint64_t active_ns)
+{
+    const auto start = std::chrono::steady_clock::now();
+    // The combination FilterSet::Match makes of two layers, with the active
+    // one's half already known.
+    FilterVerdict shadow = verdict;
+    if (IsBlocking(verdict))
+    {
+        if (candidate_->MatchesException(ctx))
+            shadow = FilterVerdict::Exception;
+    }
+    else if (verdict == FilterVerdict::Allow)
+    {
+        const bool host_blocked = !ctx.host.empty() && candidate_->IsBlockedHost(ctx.host);
+        const FilterVerdict blocking = candidate_->MatchBlocking(ctx, host_blocked);
+        if (IsBlocking(blocking))
+            shadow = candidate_->MatchesException(ctx) || active.MatchesException(ctx) ? FilterVerdict::Exception
+                                                                                        : blocking;
+    }
+    const auto end = std::chrono::steady_clock::now();
+
+    requests_.fetch_add(1, std::memory_order_relaxed);
+    active_ns_.fetch_add(active_ns, std::memory_order_relaxed);
+    shadow_ns_.fetch_add((uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count(),
+                         std::memory_order_relaxed);
+    const bool blocked = IsBlocking(verdict);
+    if (blocked)
+        active_blocked_.fetch_add(1, std::memory_order_relaxed);
+    if (IsBlocking(shadow) != blocked)
+        RecordDiff(ctx, shadow, blocked);
+    return shadow;
+}
+
+void ShadowList::RecordDiff(const RequestContext &ctx, FilterVerdict shadow, bool blocked)
+{
+    (blocked ? newly_allowed_ : newly_blocked_).fetch_add(1, std::memory_order_relaxed);
+    // The candidate's blocking rule, or its "@@" rule that lifted an active block
+    MatchedRule rule;
+    if (!candidate_->Explain(ctx, shadow, rule))
+        rule = MatchedRule();
+    std::string key(1, (char)rule.kind);
+    key.append(rule.text.data(), rule.text.size());
+
+    std::lock_guard<std::mutex> lock(mtx_);
+    auto it = diffs_.find(key);
+    if (it == diffs_.end())
+    {
+        if (diffs_.size() >= kMaxRules)
+        {
+            untracked_.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        it = diffs_.emplace(std::move(key), RuleDiff()).first;
+        it->second.kind = rule.kind;
+        it->second.rule.assign(rule.text.data(), rule.text.size());
+    }
+    RuleDiff &diff = it->second;
+    ++(blocked ? diff.unblocked : diff.blocked);
+    if (diff.examples.size() < kMaxExamples)
+        diff.examples.emplace_back(ctx.url);
+}
+
+ShadowList::Report ShadowList::Collect() const
+{
+    Report r;
+    r.source = source_;
+    r.candidate_rules = candidate_->rule_count();
+    r.requests = requests_.load(std::memory_order_relaxed);
+    r.active_blocked = active_blocked_.load(std::memory_order_relaxed);
+    r.newly_blocked = newly_blocked_.load(std::memory_order_relaxed);
+    r.newly_allowed = newly_allowed_.load(std::memory_order_relaxed);
+    r.untracked = untracked_.load(std::memory_order_relaxed);
+    r.active_ns = active_ns_.load(std::memory_order_relaxed);
+    r.shadow_ns = shadow_ns_.load(std::memory_order_relaxed);
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        for (const auto &d : diffs_)
+            r.diffs.push_back(d.second);
+    }
+    std::sort(r.diffs.begin(), r.diffs.end(), [](const RuleDiff &a, const RuleDiff &b)
+              {
+        const uint64_t na = a.blocked + a.unblocked, nb = b.blocked + b.unblocked;
+        return na != nb ? na > nb : a.rule < b.rule; });
+    return r;
+}
+
+std::string ShadowList::Report::ToJSON(size_t max_rules) const
+{
+    std::string out = "{\"source\":\"";
+    FilterStats::AppendEscaped(out, source);
+    out += "\",\"candidate_rules\":" + std::to_string(candidate_rules);
+    out += ",\"requests\":" + std::to_string(requests);
+    out += ",\"active_blocked\":" + std::to_string(active_blocked);
+    out += ",\"newly_blocked\":" + std::to_string(newly_blocked);
+    out += ",\"newly_allowed\":" + std::to_string(newly_allowed);
+    out += ",\"untracked\":" + std::to_string(untracked);
+    out += ",\"active_ns_per_request\":" + std::to_string(requests ? active_ns / requests : 0);
+    out += ",\"extra_ns_per_request\":" + std::to_string(requests ? shadow_ns / requests : 0);
+    // The candidate's cost relative to the rules already enforced
+    const double extra = active_ns ? 100.0 * (double)shadow_ns / (double)active_ns : 0.0;
+    out += ",\"extra_percent\":" + std::to_string((uint64_t)(extra + 0.5));
+    out += ",\"rules\":[";
+    for (size_t i = 0; i < diffs.size() && i < max_rules; ++i)
+    {
+        const RuleDiff &d = diffs[i];
+        out += i ? ",{" : "{";
+        out += "\"kind\":\"";
+        out += FilterStats::KindName(d.kind);
+        out += "\",\"rule\":\"";
+        FilterStats::AppendEscaped(out, d.rule);
+        out += "\",\"blocked\":" + std::to_string(d.blocked);
+        out += ",\"unblocked\":" + std::to_string(d.unblocked);
+        out += ",\"examples\":[";
+        for (size_t j = 0; j < d.examples.size(); ++j)
+        {
+            out += j ? ",\"" : "\"";
+            FilterStats::AppendEscaped(out, d.examples[j]);
+            out += "\"";
+        }
+        out += "]}";
+    }
+    out += "]}";
+    return out;
+}
+
+bool ShadowList::WriteReport(const std::string &path) const
+{
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out.is_open())
+        return false;
+    out << Collect().ToJSON() << '\n';
+    return (bool)out;
+}
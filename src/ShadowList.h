@@ -0,0 +1,93 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "FilterEngine.h"
+#include "FilterSet.h"
+
+// A candidate filter list evaluated next to an engine's active rules on real
+// requests but never enforced ("shadow mode"), to learn what rolling it out
+// would change and cost before it is.
+//
+// For each request the active rules decided, Evaluate() works out the verdict
+// the active rules plus the candidate's would give (exactly as if the
+// candidate were one more FilterSet layer) and records where the two differ:
+// requests the candidate would newly block and requests one of its "@@"
+// rules would let through, per candidate rule with a few example URLs. Only
+// the candidate engine is consulted on top of the active verdict, so the time
+// Evaluate() takes is what the list would add to each request.
+//
+// Totals are relaxed atomics shared by the request threads; the per-rule
+// differences, touched only by requests whose verdict changes, sit behind a
+// mutex.
+class ShadowList
+{
+public:
+    static constexpr size_t kMaxRules = 1000;  // distinct differing rules tracked
+    static constexpr size_t kMaxExamples = 5;  // example URLs kept per rule
+
+    struct RuleDiff
+    {
+        RuleKind kind = RuleKind::Host;
+        std::string rule;
+        uint64_t blocked = 0;   // requests the active rules allow and this rule blocks
+        uint64_t unblocked = 0; // requests the active rules block and this "@@" rule allows
+        std::vector<std::string> examples;
+    };
+
+    struct Report
+    {
+        std::string source;
+        size_t candidate_rules = 0;
+        uint64_t requests = 0;
+        uint64_t active_blocked = 0;
+        uint64_t newly_blocked = 0;
+        uint64_t newly_allowed = 0;
+        uint64_t untracked = 0;  // differences on rules beyond kMaxRules
+        uint64_t active_ns = 0;  // matching time of the active rules, total
+        uint64_t shadow_ns = 0;  // time the candidate added, total
+        std::vector<RuleDiff> diffs; // most differences first
+
+        // {"source":...,"requests":N,...,"extra_ns_per_request":N,"rules":[...]};
+        // max_rules caps the "rules" list.
+        std::string ToJSON(size_t max_rules = 100) const;
+    };
+
+    // candidate is built; source names it in the report (its file path).
+    ShadowList(std::string source, std::shared_ptr<const FilterEngine> candidate);
+    ShadowList(const ShadowList &) = delete;
+    ShadowList &operator=(const ShadowList &) = delete;
+
+    const std::string &source() const { return source_; }
+    const FilterEngine &candidate() const { return *candidate_; }
+
+    // verdict is what active gave ctx after active_ns of matching. Records the
+    // difference the candidate makes and returns the verdict with it added.
+    FilterVerdict Evaluate(const RequestContext &ctx, const FilterSet &active, FilterVerdict verdict,
+                           uint64_t active_ns);
+
+    Report Collect() const;
+    // Write Collect().ToJSON() to path. Returns false when the file cannot be written.
+    bool WriteReport(const std::string &path) const;
+
+private:
+    void RecordDiff(const RequestContext &ctx, FilterVerdict shadow, bool blocked);
+
+    const std::string source_;
+    const std::shared_ptr<const FilterEngine> candidate_;
+    std::atomic<uint64_t> requests_{0};
+    std::atomic<uint64_t> active_blocked_{0};
+    std::atomic<uint64_t> newly_blocked_{0};
+    std::atomic<uint64_t> newly_allowed_{0};
+    std::atomic<uint64_t> untracked_{0};
+    std::atomic<uint64_t> active_ns_{0};
+    std::atomic<uint64_t> shadow_ns_{0};
+    mutable std::mutex mtx_;                         // guards diffs_
+    std::unordered_map<std::string, RuleDiff> diffs_; // kind + rule text -> counts
+};
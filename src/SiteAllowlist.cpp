@@ -0,0 +1,106 @@
+#include "SiteAllowlist.h"
+#include "FilterEngine.h"
+#include "HostMatcher.h"
+#include "NetworkFilter.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+
+namespace
+{
+    // Lowercase site of a host as typed or taken from a URL ("WWW.Example.com." -> "example.com").
+    std::string SiteKey(std::string_view host)
+    {
+        std::string lower = FilterEngine::ToLower(FilterEngine::Trim(host));
+        while (!lower.empty() && lower.back() == '.')
+            lower.pop_back();
+        return std::string(url_util::BaseDomain(lower));
+    }
+}
+
+std::unordered_multimap<uint64_t, std::string>::const_iterator SiteAllowlist::Find(std::string_view site) const
+{
+    auto range = sites_.equal_range(HostMatcher::HashHost(site));
+    for (auto it = range.first; it != range.second; ++it)
+    {
+        if (it->second == site)
+            return it;
+    }
+    return sites_.end();
+}
+
+bool SiteAllowlist::Add(std::string_view host)
+{
+    std::string site = SiteKey(host);
+    if (site.empty() || Find(site) != sites_.end())
+        return false;
+    const uint64_t hash = HostMatcher::HashHost(site);
+    sites_.emplace(hash, std::move(site));
+    return true;
+}
+
+bool SiteAllowlist::Remove(std::string_view host)
+{
+    auto it = Find(SiteKey(host));
+    if (it == sites_.end())
+        return false;
+    sites_.erase(it);
+    return true;
+}
+
+bool SiteAllowlist::Contains(std::string_view host) const
+{
+    if (sites_.empty() || host.empty())
+        return false;
+    return Find(url_util::BaseDomain(host)) != sites_.end();
+}
+
+std::vector<std::string> SiteAllowlist::sites() const
+{
+    std::vector<std::string> out;
+    out.reserve(sites_.size());
+    for (const auto &s : sites_)
+        out.push_back(s.second);
+    std::sort(out.begin(), out.end());
+    return out;
+}
+
+bool SiteAllowlist::Load(const std::string &path)
+{
+    std::ifstream in(path);
+    if (!in.is_open())
+        return false;
+    sites_.clear();
+    std::string line;
+    while (std::getline(in, line))
+    {
+        std::string_view l = FilterEngine::Trim(line);
+        if (!l.empty() && l[0] != '#')
+            Add(l);
+    }
+    return true;
+}
+
+bool SiteAllowlist::Save(const std::string &path) const
+{
+    namespace fs = std::filesystem;
+    std::error_code ec;
+    fs::path target(path);
+    if (target.has_parent_path())
+        fs::create_directories(target.parent_path(), ec);
+    fs::path tmp = target;
+    tmp += ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        if (!out.is_open())
+            return false;
+        out << "# Sites where ad blocking is off, one per line\n";
+        for (const auto &site : sites())
+            out << site << '\n';
+        if (!out)
+            return false;
+    }
+    fs::rename(tmp, target, ec);
+    return !ec;
+}
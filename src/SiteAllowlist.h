@@ -0,0 +1,44 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Sites on which the user turned ad blocking off.
+//
+// A site is a registrable domain per the Public Suffix List
+// (url_util::BaseDomain), so allowing "www.example.com" covers every host under
+// example.com, while "user.github.io" leaves other github.io sites alone.
+// Entries are filed under the hash of their site, so Contains() costs one
+// BaseDomain() and one hash lookup however many sites are listed. Each entry
+// keeps its site, which every lookup compares, so two sites whose hashes
+// collide are both listed and neither matches the other's hosts.
+//
+// The list file holds one site per line; lines starting with '#' are comments.
+// Not thread-safe; SitePolicy publishes immutable copies.
+class SiteAllowlist
+{
+public:
+    // Add / remove host's site. Return false when nothing changed.
+    bool Add(std::string_view host);
+    bool Remove(std::string_view host);
+    // host must be lowercase.
+    bool Contains(std::string_view host) const;
+
+    size_t size() const { return sites_.size(); }
+    bool empty() const { return sites_.empty(); }
+    // Listed sites, sorted.
+    std::vector<std::string> sites() const;
+
+    // Replace the entries with a list file's. Returns false when it cannot be read.
+    bool Load(const std::string &path);
+    // Write the list file, replacing it in one rename. Returns false on failure.
+    bool Save(const std::string &path) const;
+
+private:
+    // Entry for site in sites_, or end().
+    std::unordered_multimap<uint64_t, std::string>::const_iterator Find(std::string_view site) const;
+
+    std::unordered_multimap<uint64_t, std::string> sites_; // site hash -> site
+};
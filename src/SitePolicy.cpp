@@ -0,0 +1,53 @@
+#include "SitePolicy.h"
+
+#include <cstdio>
+
+FilterAction SitePolicy::Evaluate(const FilterRequest &request, MatchedRule &rule)
+{
+    const AllowlistPtr allowlist = this->allowlist();
+    if (allowlist->empty())
+        return FilterAction::None;
+    // The requesting document's site, then the tab's page for requests from
+    // its frames. A request with neither is left to the blocking stages: its
+    // own host only stands for the page when it is the tab's top-level load,
+    // and the page host lookup reports that case.
+    if (request.ctx.has_origin && allowlist->Contains(request.ctx.origin_host))
+    {
+        rule.kind = RuleKind::Host;
+        rule.text = request.ctx.origin_host;
+        return FilterAction::Allow;
+    }
+    const std::string_view page = request.page_host();
+    if (!page.empty() && allowlist->Contains(page))
+    {
+        rule.kind = RuleKind::Host;
+        rule.text = page;
+        return FilterAction::Allow;
+    }
+    return FilterAction::None;
+}
+
+void SitePolicy::LoadAllowlist(const std::string &path)
+{
+    auto next = std::make_shared<SiteAllowlist>();
+    next->Load(path);
+    std::lock_guard<std::mutex> lock(write_mtx_);
+    path_ = path;
+    std::atomic_store_explicit(&allowlist_, AllowlistPtr(std::move(next)), std::memory_order_release);
+}
+
+void SitePolicy::SetSiteAllowed(const std::string &host, bool allowed)
+{
+    std::lock_guard<std::mutex> lock(write_mtx_);
+    auto next = std::make_shared<SiteAllowlist>(*allowlist());
+    if (!(allowed ? next->Add(host) : next->Remove(host)))
+        return;
+    if (!path_.empty() && !next->Save(path_))
+        std::fprintf(stderr, "AdBlock: cannot write %s\n", path_.c_str());
+    std::atomic_store_explicit(&allowlist_, AllowlistPtr(std::move(next)), std::memory_order_release);
+}
+
+bool SitePolicy::IsSiteAllowed(const std::string &host) const
+{
+    return allowlist()->Contains(FilterEngine::ToLower(host));
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "RequestFilter.h"
+#include "SiteAllowlist.h"
+
+// The pipeline's policy stage: sites the user trusts are exempt from
+// filtering (see SiteAllowlist). A request made by one of their pages, or from
+// a tab showing one, is allowed after one hashed lookup, before any blocking
+// stage is consulted. The tab's page URL is only looked up while some site is
+// allowed.
+//
+// The list is an immutable snapshot that requests load without a lock; each
+// change copies it and publishes the copy with one atomic store.
+class SitePolicy : public RequestFilter
+{
+public:
+    const char *name() const override { return "site-policy"; }
+    FilterAction Evaluate(const FilterRequest &request, MatchedRule &rule) override;
+
+    // Read the per-site allowlist from path; later changes are saved there.
+    // A missing file is an empty list.
+    void LoadAllowlist(const std::string &path);
+    // Turn filtering off (allowed) or back on for host's site, and save the list.
+    void SetSiteAllowed(const std::string &host, bool allowed);
+    bool IsSiteAllowed(const std::string &host) const;
+
+private:
+    using AllowlistPtr = std::shared_ptr<const SiteAllowlist>;
+
+    AllowlistPtr allowlist() const { return std::atomic_load_explicit(&allowlist_, std::memory_order_acquire); }
+
+    AllowlistPtr allowlist_ = std::make_shared<SiteAllowlist>(); // read with atomic_load only
+    std::mutex write_mtx_;                                       // serializes writers; never taken per request
+    std::string path_;                                           // guarded by write_mtx_
+};
@@ -0,0 +1,87 @@
+#include "StringArena.h"
+
+namespace
+{
+    size_t NextPow2(size_t n)
+    {
+        size_t p = 16;
+        while (p < n)
+            p <<= 1;
+        return p;
+    }
+}
+
+uint64_t StringArena::Hash(std::string_view s)
+{
+    uint64_t h = 14695981039346656037ull;
+    for (char c : s)
+        h = (h ^ (uint8_t)c) * 1099511628211ull;
+    return h;
+}
+
+uint32_t StringArena::Find(std::string_view s) const
+{
+    if (slots_.empty())
+        return kNone;
+    const size_t mask = slots_.size() - 1;
+    for (size_t i = (size_t)Hash(s) & mask; slots_[i] != 0; i = (i + 1) & mask)
+    {
+        if (Get(slots_[i] - 1) == s)
+            return slots_[i] - 1;
+    }
+    return kNone;
+}
+
+uint32_t StringArena::Intern(std::string_view s, bool *added)
+{
+    // Keep the table at most half full.
+    if ((size() + 1) * 2 > slots_.size())
+        Rehash(NextPow2((size() + 1) * 2));
+
+    const size_t mask = slots_.size() - 1;
+    size_t i = (size_t)Hash(s) & mask;
+    for (; slots_[i] != 0; i = (i + 1) & mask)
+    {
+        if (Get(slots_[i] - 1) == s)
+        {
+            if (added)
+                *added = false;
+            return slots_[i] - 1;
+        }
+    }
+    const uint32_t id = (uint32_t)size();
+    data_.insert(data_.end(), s.begin(), s.end());
+    ends_.push_back((uint32_t)data_.size());
+    slots_[i] = id + 1;
+    if (added)
+        *added = true;
+    return id;
+}
+
+void StringArena::Rehash(size_t capacity)
+{
+    slots_.assign(capacity, 0);
+    const size_t mask = capacity - 1;
+    for (uint32_t id = 0; id < size(); ++id)
+    {
+        size_t i = (size_t)Hash(Get(id)) & mask;
+        while (slots_[i] != 0)
+            i = (i + 1) & mask;
+        slots_[i] = id + 1;
+    }
+}
+
+void StringArena::Reserve(size_t count, size_t bytes)
+{
+    data_.reserve(bytes);
+    ends_.reserve(count + 1);
+    if (count * 2 > slots_.size())
+        Rehash(NextPow2(count * 2));
+}
+
+void StringArena::Clear()
+{
+    data_.clear();
+    ends_.assign(1, 0);
+    slots_.clear();
+}
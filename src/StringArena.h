@@ -0,0 +1,50 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+// Rule text stored back to back in one string, each distinct string once.
+//
+// Strings are numbered in the order they were first interned, and indexes
+// keep those 32-bit ids instead of owning copies, so a rule costs its bytes
+// plus a 4-byte offset and a hash slot rather than a heap block each. Adding
+// a string that is already stored returns the existing id, which is how
+// duplicate rules across lists are dropped on load.
+//
+// Views returned by Get() stay valid until the next Intern() or Clear();
+// moving the arena keeps them valid.
+// Not thread-safe; callers synchronize access.
+class StringArena
+{
+public:
+    static constexpr uint32_t kNone = UINT32_MAX;
+
+    // Id of s, storing it first when it is new. Sets *added accordingly.
+    uint32_t Intern(std::string_view s, bool *added = nullptr);
+    // Id of s, or kNone when it is not stored.
+    uint32_t Find(std::string_view s) const;
+    std::string_view Get(uint32_t id) const
+    {
+        return std::string_view(data_.data() + ends_[id], ends_[id + 1] - ends_[id]);
+    }
+
+    void Reserve(size_t count, size_t bytes);
+    void Clear();
+
+    size_t size() const { return ends_.size() - 1; }
+    bool empty() const { return ends_.size() == 1; }
+    // Text bytes plus offsets and hash slots.
+    size_t memory_bytes() const
+    {
+        return data_.capacity() + ends_.capacity() * sizeof(uint32_t) + slots_.capacity() * sizeof(uint32_t);
+    }
+
+private:
+    static uint64_t Hash(std::string_view s);
+    void Rehash(size_t capacity);
+
+    std::vector<char> data_;           // strings back to back (a vector, so moves keep views valid)
+    std::vector<uint32_t> ends_ = {0}; // string id is data_[ends_[id], ends_[id + 1])
+    std::vector<uint32_t> slots_;      // open addressing over id + 1, 0 = empty; power-of-two size
+};
@@ -1,6 +1,7 @@
 #include "Tab.h"
 #include "UI.h"
 #include "DownloadManager.h"
+#include "ContentBlocker.h"
 #include <iostream>
 #include <string>
 #include <cstdio>
@@ -15,6 +16,12 @@ Tab::Tab(UI *ui, uint64_t id, uint32_t width, uint32_t height, int x, int y)
   view()->set_view_listener(this);
   view()->set_load_listener(this);
   view()->set_download_listener(ui->download_manager());
+  // Every request the page makes goes through the ad/tracker filter pipeline
+  if (ui->blocker_)
+  {
+    ui->blocker_->OpenView(view().get());
+    view()->set_network_listener(ui->blocker_);
+  }
 }
 
 Tab::~Tab()
@@ -22,6 +29,9 @@ Tab::~Tab()
   view()->set_view_listener(nullptr);
   view()->set_load_listener(nullptr);
   view()->set_download_listener(nullptr);
+  view()->set_network_listener(nullptr);
+  if (ui_->blocker_)
+    ui_->blocker_->ReleaseView(view().get());
 }
 
 void Tab::Show()
@@ -165,6 +175,12 @@ void Tab::OnChangeTitle(View *caller, const String &title)
 void Tab::OnChangeURL(View *caller, const String &url)
 {
   ui_->UpdateTabURL(id_, url);
+  // The network threads filter this view's requests by its page host
+  if (ui_->blocker_)
+  {
+    auto url_utf8 = url.utf8();
+    ui_->blocker_->SetPageURL(caller, std::string_view(url_utf8.data(), url_utf8.length()));
+  }
   // Record history when the page URL changes (navigation start/change), not on load finish
   if (ui_)
   {
@@ -226,6 +242,12 @@ RefPtr<View> Tab::OnCreateInspectorView(ultralight::View *caller, bool is_local,
 
 void Tab::OnBeginLoading(View *caller, uint64_t frame_id, bool is_main_frame, const String &url)
 {
+  // Lets the blocker recognize the page's own document request
+  if (is_main_frame && ui_->blocker_)
+  {
+    auto url_utf8 = url.utf8();
+    ui_->blocker_->SetNavigationURL(caller, std::string_view(url_utf8.data(), url_utf8.length()));
+  }
   ui_->UpdateTabNavigation(id_, caller->is_loading(), caller->CanGoBack(), caller->CanGoForward());
 }
 
@@ -324,6 +346,37 @@ void Tab::OnDOMReady(View *caller, uint64_t frame_id, bool is_main_frame, const
       }catch(e){}
     })())JS";
     caller->EvaluateScript(attachScript, nullptr);
+
+    // Site-specific element hiding rules, once per navigation (generic ones are in the user stylesheet)
+    std::string page_url = url_utf8.data() ? url_utf8.data() : "";
+    if (ui_ && ui_->blocker_ && (page_url.rfind("http://", 0) == 0 || page_url.rfind("https://", 0) == 0))
+    {
+      std::string css = ui_->blocker_->CosmeticStylesheetForHost(std::string(url_util::HostFromURL(page_url)));
+      if (!css.empty())
+      {
+        std::string esc;
+        esc.reserve(css.size() + 8);
+        for (char c : css)
+        {
+          if (c == '\\')
+            esc += "\\\\";
+          else if (c == '"')
+            esc += "\\\"";
+          else if (c == '\n')
+            esc += "\\n";
+          else if (c == '\r')
+            esc += "\\r";
+          else if (c == '<')
+            esc += "\\x3c";
+          else
+            esc += c;
+        }
+        std::string js = "(function(){ if(document.getElementById('__ul_cosmetic')) return;"
+                         " var s=document.createElement('style'); s.id='__ul_cosmetic'; s.textContent=\"" +
+                         esc + "\"; (document.head||document.documentElement).appendChild(s); })()";
+        caller->EvaluateScript(String(js.c_str()), nullptr);
+      }
+    }
   }
 
   // Inject a contextmenu handler into the page to capture link/image/selection info
@@ -437,6 +490,9 @@ void Tab::OnDOMReady(View *caller, uint64_t frame_id, bool is_main_frame, const
       global["NativeQuickGetComputedStyle"] = BindJSCallbackWithRetval(&Tab::QI_GetComputedStyle);
       global["NativeQuickGetStorage"] = BindJSCallbackWithRetval(&Tab::QI_GetStorage);
       global["NativeQuickGetPerformance"] = BindJSCallbackWithRetval(&Tab::QI_GetPerformance);
+      global["NativeQuickGetAdblockStats"] = BindJSCallbackWithRetval(&Tab::QI_GetAdblockStats);
+      global["NativeQuickGetAdblockLog"] = BindJSCallbackWithRetval(&Tab::QI_GetAdblockLog);
+      global["NativeQuickGetNetworkTraffic"] = BindJSCallbackWithRetval(&Tab::QI_GetNetworkTraffic);
       global["NativeQuickGetOuterHTML"] = BindJSCallbackWithRetval(&Tab::QI_GetOuterHTML);
       global["NativeQuickSetAttribute"] = BindJSCallback(&Tab::QI_SetAttribute);
       global["NativeQuickRemoveAttribute"] = BindJSCallback(&Tab::QI_RemoveAttribute);
@@ -691,6 +747,33 @@ JSValue Tab::QI_GetPerformance(const JSObject &obj, const JSArgs &args)
   return JSValue(res);
 }
 
+JSValue Tab::QI_GetAdblockStats(const JSObject &obj, const JSArgs &args)
+{
+  // Browser-wide: the blocker filters every tab's requests.
+  if (!(ui_ && ui_->blocker_))
+    return JSValue(String("{}"));
+  std::string json = ui_->blocker_->pipeline().StatsJSON();
+  return JSValue(String(json.c_str()));
+}
+
+JSValue Tab::QI_GetAdblockLog(const JSObject &obj, const JSArgs &args)
+{
+  // Filled while Settings > "Log blocked requests" is on.
+  if (!(ui_ && ui_->blocker_))
+    return JSValue(String("{}"));
+  std::string json = ui_->blocker_->pipeline().RecentRequestsJSON();
+  return JSValue(String(json.c_str()));
+}
+
+JSValue Tab::QI_GetNetworkTraffic(const JSObject &obj, const JSArgs &args)
+{
+  // This tab only: the requests its page made since it opened.
+  if (!(ui_ && ui_->blocker_))
+    return JSValue(String("{}"));
+  std::string json = ui_->blocker_->traffic().Collect(view().get()).ToJSON();
+  return JSValue(String(json.c_str()));
+}
+
 JSValue Tab::QI_GetOuterHTML(const JSObject &obj, const JSArgs &args)
 {
   if (args.size() < 1 || !view())
@@ -108,6 +108,9 @@ public:
   JSValue QI_GetComputedStyle(const JSObject &obj, const JSArgs &args);
   JSValue QI_GetStorage(const JSObject &obj, const JSArgs &args);
   JSValue QI_GetPerformance(const JSObject &obj, const JSArgs &args);
+  JSValue QI_GetAdblockStats(const JSObject &obj, const JSArgs &args);
+  JSValue QI_GetAdblockLog(const JSObject &obj, const JSArgs &args);
+  JSValue QI_GetNetworkTraffic(const JSObject &obj, const JSArgs &args);
   JSValue QI_GetOuterHTML(const JSObject &obj, const JSArgs &args);
   void QI_SetAttribute(const JSObject &obj, const JSArgs &args);
   void QI_RemoveAttribute(const JSObject &obj, const JSArgs &args);
@@ -0,0 +1,132 @@
+#include "TokenIndex.h"
+
+#include <algorithm>
+
+namespace
+{
+    // Tokens present in nearly every URL make poor index keys; only use them
+    // when a rule has nothing better.
+    const char *kBadTokens[] = {"http", "https", "www", "com", "net", "org", "js", "html", "php"};
+    constexpr size_t kBadTokenPenalty = 1u << 24;
+
+    bool IsBadToken(uint64_t hash)
+    {
+        for (const char *bad : kBadTokens)
+        {
+            if (hash == TokenIndex::Hash(bad))
+                return true;
+        }
+        return false;
+    }
+}
+
+uint64_t TokenIndex::Hash(std::string_view token)
+{
+    uint64_t h = 14695981039346656037ull;
+    for (unsigned char c : token)
+        h = (h ^ c) * 1099511628211ull;
+    return h;
+}
+
+void TokenIndex::TokenizeURL(std::string_view url, Tokens &out)
+{
+    out.clear();
+    // One bit per low 6 hash bits seen; only a set bit needs the scan for a repeat.
+    uint64_t seen = 0;
+    size_t i = 0;
+    while (i < url.size())
+    {
+        if (!IsTokenChar((unsigned char)url[i]))
+        {
+            ++i;
+            continue;
+        }
+        uint64_t h = 14695981039346656037ull;
+        while (i < url.size() && IsTokenChar((unsigned char)url[i]))
+            h = (h ^ (unsigned char)url[i++]) * 1099511628211ull;
+        const uint64_t bit = 1ull << (h & 63);
+        if ((seen & bit) && std::find(out.begin(), out.end(), h) != out.end())
+            continue;
+        seen |= bit;
+        out.push_back(h);
+    }
+}
+
+TokenIndex::Tokens TokenIndex::PatternTokens(std::string_view p, std::string_view wildcards, bool start_anchored,
+                                             bool end_anchored)
+{
+    Tokens out;
+    size_t i = 0;
+    while (i < p.size())
+    {
+        if (!IsTokenChar((unsigned char)p[i]))
+        {
+            ++i;
+            continue;
+        }
+        size_t start = i;
+        while (i < p.size() && IsTokenChar((unsigned char)p[i]))
+            ++i;
+        bool left_ok = start == 0 ? start_anchored : wildcards.find(p[start - 1]) == std::string_view::npos;
+        bool right_ok = i == p.size() ? end_anchored : wildcards.find(p[i]) == std::string_view::npos;
+        if (left_ok && right_ok)
+            out.push_back(Hash(p.substr(start, i - start)));
+    }
+    return out;
+}
+
+void TokenIndex::Add(uint32_t id, Tokens candidates)
+{
+    pending_.emplace_back(id, std::move(candidates));
+    ++count_;
+}
+
+void TokenIndex::Build()
+{
+    // A token's frequency is its use among the queued rules plus the rules
+    // an earlier Build() already filed under it.
+    std::unordered_map<uint64_t, size_t> frequency;
+    for (const auto &entry : pending_)
+    {
+        for (uint64_t h : entry.second)
+            ++frequency[h];
+    }
+    for (auto &f : frequency)
+    {
+        auto it = by_token_.find(f.first);
+        if (it != by_token_.end())
+            f.second += it->second.size();
+    }
+
+    // File each rule under its least common candidate token.
+    for (const auto &entry : pending_)
+    {
+        if (entry.second.empty())
+        {
+            generic_.push_back(entry.first);
+            continue;
+        }
+        uint64_t best = 0;
+        size_t best_score = SIZE_MAX;
+        for (uint64_t h : entry.second)
+        {
+            size_t score = frequency[h] + (IsBadToken(h) ? kBadTokenPenalty : 0);
+            if (score < best_score)
+            {
+                best = h;
+                best_score = score;
+            }
+        }
+        by_token_[best].push_back(entry.first);
+    }
+    pending_.clear();
+    pending_.shrink_to_fit();
+}
+
+void TokenIndex::Clear()
+{
+    pending_.clear();
+    by_token_.clear();
+    generic_.clear();
+    count_ = 0;
+}
@@ -0,0 +1,78 @@
+#pragma once
+#include <cstdint>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Index of URL rules keyed by one literal token each (uBlock-style).
+//
+// A token is a maximal run of [a-z0-9%]. Each rule offers the tokens that any
+// matching URL must contain as complete tokens; Build() files the rule under
+// the least common of them across the whole set, so a URL only visits the
+// rules filed under its own tokens. Rules without a usable token land in a
+// generic list that every URL visits. Rules added after a Build() are filed
+// by the next one; the queue is freed once its rules are filed.
+class TokenIndex
+{
+public:
+    using Tokens = std::vector<uint64_t>;
+
+    // Queue rule id with its candidate token hashes (may be empty).
+    void Add(uint32_t id, Tokens candidates);
+    void Build();
+    void Clear();
+
+    // Call fn(id) for every rule filed under one of url_tokens, then for the
+    // generic rules, until fn returns true. Returns whether it did.
+    template <typename Fn>
+    bool ForEachCandidate(const Tokens &url_tokens, Fn &&fn) const
+    {
+        if (!by_token_.empty())
+        {
+            for (uint64_t h : url_tokens)
+            {
+                auto it = by_token_.find(h);
+                if (it == by_token_.end())
+                    continue;
+                for (uint32_t id : it->second)
+                {
+                    if (fn(id))
+                        return true;
+                }
+            }
+        }
+        for (uint32_t id : generic_)
+        {
+            if (fn(id))
+                return true;
+        }
+        return false;
+    }
+
+    size_t size() const { return count_; }
+    size_t generic_count() const { return generic_.size(); }
+    bool empty() const { return count_ == 0; }
+
+    static bool IsTokenChar(unsigned char c)
+    {
+        return (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c == '%';
+    }
+    static uint64_t Hash(std::string_view token);
+
+    // Hashes of the distinct tokens of a (lowercase) URL, in order of first
+    // appearance, so a repeated token does not visit its rules twice.
+    static void TokenizeURL(std::string_view url, Tokens &out);
+
+    // Tokens of a pattern that are safe to index: both neighbours must be
+    // literal non-token characters, or a pattern boundary that is anchored to
+    // the URL boundary. A run next to a wildcard could be part of a longer URL
+    // token, so it is skipped.
+    static Tokens PatternTokens(std::string_view pattern, std::string_view wildcards, bool start_anchored,
+                                bool end_anchored);
+
+private:
+    std::vector<std::pair<uint32_t, Tokens>> pending_; // added since the last Build()
+    std::unordered_map<uint64_t, std::vector<uint32_t>> by_token_;
+    std::vector<uint32_t> generic_;
+    size_t count_ = 0;
+};
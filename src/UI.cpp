@@ -18,7 +18,7 @@
 #include <vector>
 #include <cstdlib>
 #include "DownloadManager.h"
-#include "AdBlocker.h"
+#include "ContentBlocker.h"
 #ifdef _WIN32
 #include <direct.h> // _mkdir, _getcwd
 #ifndef NOMINMAX
@@ -69,8 +69,11 @@ namespace
       SettingDescriptor{"enable_adblock", "Enable ad blocking",
                         "Filter network requests using bundled block lists to hide intrusive ads.",
                         "privacy", nullptr, &UI::BrowserSettings::enable_adblock, true},
+      SettingDescriptor{"block_trackers", "Block trackers",
+                        "Also filter analytics and tracking requests; turn off when a site breaks without them.",
+                        "privacy", nullptr, &UI::BrowserSettings::block_trackers, true},
       SettingDescriptor{"log_blocked_requests", "Log blocked requests",
-                        "Write each blocked network request to the console for debugging rules.",
+                        "Write blocked and exception-allowed requests to data/adblock_requests.log and the Quick Inspector for debugging rules.",
                         "privacy", nullptr, &UI::BrowserSettings::log_blocked_requests, false},
       SettingDescriptor{"clear_history_on_exit", "Clear history on exit",
                         "Remove browsing history when Ultralight closes and skip saving new visits.",
@@ -503,11 +506,11 @@ UI::UI(RefPtr<Window> window) : window_(window), cur_cursor_(Cursor::kCursor_Poi
   LoadHistoryFromDisk();
 }
 
-// Compatibility overload: accepts optional ad/tracker blockers (ignored if not used)
-UI::UI(RefPtr<Window> window, AdBlocker *adblock, AdBlocker *tracker)
+// With the content blocker: tabs filter their requests through it
+UI::UI(RefPtr<Window> window, ContentBlocker *blocker)
     : window_(window), cur_cursor_(Cursor::kCursor_Pointer),
       is_resizing_inspector_(false), is_over_inspector_resize_drag_handle_(false),
-      adblock_(adblock), trackerblock_(tracker)
+      blocker_(blocker)
 {
   uint32_t window_width = window_->width();
   ui_height_ = (uint32_t)std::round(UI_HEIGHT * window_->scale());
@@ -542,7 +545,7 @@ UI::UI(RefPtr<Window> window, AdBlocker *adblock, AdBlocker *tracker)
   // Load history from disk
   LoadHistoryFromDisk();
 
-  adblock_enabled_cached_ = adblock_ ? adblock_->enabled() : adblock_enabled_cached_;
+  adblock_enabled_cached_ = blocker_ ? blocker_->pipeline().enabled() : adblock_enabled_cached_;
 }
 
 UI::~UI()
@@ -550,8 +553,8 @@ UI::~UI()
   // Persist or clear history on shutdown based on settings
   if (clear_history_on_exit_)
   {
-    history_.clear();
-    std::remove("data/history.json");
+    history_.Clear();
+    history_log_.Remove();
   }
   else
   {
@@ -992,6 +995,9 @@ void UI::OnDOMReady(View *caller, uint64_t frame_id, bool is_main_frame, const S
   global["GetDarkModeEnabled"] = BindJSCallbackWithRetval(&UI::OnGetDarkModeEnabled);
   global["OnToggleAdblock"] = BindJSCallback(&UI::OnToggleAdblock);
   global["GetAdblockEnabled"] = BindJSCallbackWithRetval(&UI::OnGetAdblockEnabled);
+  global["OnToggleSiteAdblock"] = BindJSCallback(&UI::OnToggleSiteAdblock);
+  global["GetSiteAdblockEnabled"] = BindJSCallbackWithRetval(&UI::OnGetSiteAdblockEnabled);
+  global["GetTabTraffic"] = BindJSCallbackWithRetval(&UI::OnGetTabTraffic);
   global["OnOpenSettingsPanel"] = BindJSCallback(&UI::OnOpenSettingsPanel);
   global["OnCloseSettingsPanel"] = BindJSCallback(&UI::OnCloseSettingsPanel);
 
@@ -1387,7 +1393,6 @@ void UI::RecordHistory(const String &url, const String &title)
   if (strncmp(c_url, "http://", 7) != 0 && strncmp(c_url, "https://", 8) != 0)
     return;
 
-  // Basic cap to avoid unbounded growth later (we'll prune oldest when exceeding)
   auto title_u = title.utf8();
   std::string t = title_u.data() ? title_u.data() : "";
   std::string u = c_url;
@@ -1395,45 +1400,12 @@ void UI::RecordHistory(const String &url, const String &title)
                         std::chrono::system_clock::now().time_since_epoch())
                         .count();
 
-  // Find existing entry by URL and update; otherwise push new
-  bool found = false;
-  for (auto &e : history_)
-  {
-    if (e.url == u)
-    {
-      if (!t.empty())
-        e.title = t;
-      e.timestamp_ms = now_ms;
-      e.visit_count = (e.visit_count + 1);
-      found = true;
-      break;
-    }
-  }
-  if (!found)
-  {
-    history_.push_back({u, t, now_ms, 1});
-  }
+  // Update the URL's entry or add one; past the cap the least recently visited goes
+  const HistoryEntry &entry = history_.Visit(u, t, now_ms);
 
-  // Cap to 500 by removing oldest (by timestamp)
-  if (history_.size() > 500)
-  {
-    // Find oldest
-    size_t idx = 0;
-    uint64_t oldest = UINT64_MAX;
-    size_t oldest_i = 0;
-    for (idx = 0; idx < history_.size(); ++idx)
-    {
-      if (history_[idx].timestamp_ms < oldest)
-      {
-        oldest = history_[idx].timestamp_ms;
-        oldest_i = idx;
-      }
-    }
-    history_.erase(history_.begin() + oldest_i);
-  }
-
-  // Save history to disk after recording
-  SaveHistoryToDisk();
+  // One appended record per visit; the log is folded into a snapshot in the background
+  if (!clear_history_on_exit_)
+    history_log_.Record(entry, history_);
 
   // If any tab is showing the History page, ask it to refresh now
   for (auto &it : tabs_)
@@ -1489,10 +1461,10 @@ String UI::GetHistoryJSON()
   // Serialize as { items: [ {url,title,time}, ... ] }
   std::string json = std::string("{\"items\":[");
   // Newest first
-  for (size_t i = 0; i < history_.size(); ++i)
+  for (auto it = history_.rbegin(); it != history_.rend(); ++it)
   {
-    const auto &e = history_[history_.size() - 1 - i];
-    if (i)
+    const auto &e = *it;
+    if (it != history_.rbegin())
       json += ",";
     json += "{\"url\":\"" + jsonEscape(e.url) + "\",\"title\":\"" + jsonEscape(e.title) + "\",\"time\":" + std::to_string(e.timestamp_ms) + "}";
   }
@@ -1502,7 +1474,8 @@ String UI::GetHistoryJSON()
 
 void UI::ClearHistory()
 {
-  history_.clear();
+  history_.Clear();
+  history_log_.Remove();
 }
 
 String UI::GetDownloadsJSON()
@@ -1847,21 +1820,73 @@ ultralight::JSValue UI::OnGetDarkModeEnabled(const JSObject &obj, const JSArgs &
 
 void UI::OnToggleAdblock(const JSObject &obj, const JSArgs &args)
 {
-  bool next_state = !(adblock_ ? adblock_->enabled() : adblock_enabled_cached_);
+  bool next_state = !(blocker_ ? blocker_->pipeline().enabled() : adblock_enabled_cached_);
   HandleSettingMutation("enable_adblock", next_state);
 }
 
 ultralight::JSValue UI::OnGetAdblockEnabled(const JSObject &obj, const JSArgs &args)
 {
-  bool enabled = adblock_ ? adblock_->enabled() : adblock_enabled_cached_;
+  bool enabled = blocker_ ? blocker_->pipeline().enabled() : adblock_enabled_cached_;
   adblock_enabled_cached_ = enabled;
   return ultralight::JSValue(enabled);
 }
 
+namespace
+{
+  // Host of the page a tab shows; empty for internal and file pages.
+  std::string PageHost(Tab *tab)
+  {
+    if (!tab)
+      return {};
+    auto url_u = tab->view()->url().utf8();
+    std::string url = url_u.data() ? url_u.data() : "";
+    if (url.rfind("http://", 0) != 0 && url.rfind("https://", 0) != 0)
+      return {};
+    return std::string(url_util::HostFromURL(url));
+  }
+}
+
+void UI::OnToggleSiteAdblock(const JSObject &obj, const JSArgs &args)
+{
+  // Per-site exception for the active tab's site; other sites stay filtered.
+  Tab *tab = active_tab();
+  std::string host = PageHost(tab);
+  if (!blocker_ || host.empty())
+    return;
+  SitePolicy &policy = blocker_->site_policy();
+  policy.SetSiteAllowed(host, !policy.IsSiteAllowed(host));
+  tab->view()->Reload();
+}
+
+ultralight::JSValue UI::OnGetSiteAdblockEnabled(const JSObject &obj, const JSArgs &args)
+{
+  std::string host = PageHost(active_tab());
+  return ultralight::JSValue(blocker_ && !host.empty() && !blocker_->site_policy().IsSiteAllowed(host));
+}
+
+ultralight::JSValue UI::OnGetTabTraffic(const JSObject &obj, const JSArgs &args)
+{
+  // {"<tab id>":{"requests":N,"allowed":N,"blocked":N,"host_count":N,...}}; the
+  // tab strip polls it to point out tabs that hammer the network.
+  std::string json = "{";
+  if (blocker_)
+  {
+    for (auto &tab : tabs_)
+    {
+      if (json.size() > 1)
+        json += ",";
+      json += "\"" + std::to_string(tab.first) + "\":";
+      json += blocker_->traffic().Collect(tab.second->view().get()).ToJSON(5);
+    }
+  }
+  json += "}";
+  return ultralight::JSValue(ultralight::String(json.c_str()));
+}
+
 void UI::SyncAdblockStateToUI()
 {
-  if (adblock_)
-    adblock_enabled_cached_ = adblock_->enabled();
+  if (blocker_)
+    adblock_enabled_cached_ = blocker_->pipeline().enabled();
   if (updateAdblockEnabled)
   {
     updateAdblockEnabled({adblock_enabled_cached_ ? 1.0 : 0.0});
@@ -1938,15 +1963,11 @@ void UI::ApplySettings(bool initial, bool snapshot_is_baseline)
   }
 
   // Privacy & Security
-  if (adblock_)
-  {
-    adblock_->set_enabled(settings_.enable_adblock);
-    adblock_->set_log_blocked(settings_.log_blocked_requests);
-  }
-  if (trackerblock_)
+  if (blocker_)
   {
-    trackerblock_->set_enabled(settings_.enable_adblock);
-    trackerblock_->set_log_blocked(settings_.log_blocked_requests);
+    blocker_->pipeline().set_enabled(settings_.enable_adblock);
+    blocker_->trackers().set_enabled(settings_.block_trackers);
+    blocker_->pipeline().set_log_requests(settings_.log_blocked_requests);
   }
   adblock_enabled_cached_ = settings_.enable_adblock;
   clear_history_on_exit_ = settings_.clear_history_on_exit;
@@ -2251,6 +2272,7 @@ std::string UI::BuildSettingsJSON() const
   ss << "\"experimental_compact_tabs\":" << (settings_.experimental_compact_tabs ? "true" : "false") << ",";
   // Privacy & Security
   ss << "\"enable_adblock\":" << (settings_.enable_adblock ? "true" : "false") << ",";
+  ss << "\"block_trackers\":" << (settings_.block_trackers ? "true" : "false") << ",";
   ss << "\"log_blocked_requests\":" << (settings_.log_blocked_requests ? "true" : "false") << ",";
   ss << "\"clear_history_on_exit\":" << (settings_.clear_history_on_exit ? "true" : "false") << ",";
   ss << "\"enable_javascript\":" << (settings_.enable_javascript ? "true" : "false") << ",";
@@ -2370,7 +2392,7 @@ void UI::HandleSettingMutation(const std::string &key, bool value)
   if (key == "clear_history_on_exit")
   {
     if (value)
-      std::remove("data/history.json");
+      history_log_.Remove();
     else
       SaveHistoryToDisk();
   }
@@ -2717,128 +2739,21 @@ void UI::LoadPopularSites()
 
 void UI::LoadHistoryFromDisk()
 {
-  std::ifstream in("data/history.json", std::ios::in | std::ios::binary);
-  if (!in.is_open())
-    return;
-
-  std::ostringstream ss;
-  ss << in.rdbuf();
-  std::string content = ss.str();
-  in.close();
-
-  // Parse JSON array of history entries
-  history_.clear();
-  size_t pos = 0;
-  while (pos < content.size())
-  {
-    size_t obj_start = content.find('{', pos);
-    if (obj_start == std::string::npos)
-      break;
-    size_t obj_end = content.find('}', obj_start);
-    if (obj_end == std::string::npos)
-      break;
-
-    std::string obj = content.substr(obj_start, obj_end - obj_start + 1);
-
-    // Extract url
-    size_t url_key = obj.find("\"url\"");
-    std::string url;
-    if (url_key != std::string::npos)
-    {
-      size_t url_start = obj.find('"', url_key + 5);
-      if (url_start != std::string::npos)
-      {
-        size_t url_end = obj.find('"', url_start + 1);
-        if (url_end != std::string::npos)
-          url = obj.substr(url_start + 1, url_end - url_start - 1);
-      }
-    }
-
-    // Extract title
-    size_t title_key = obj.find("\"title\"");
-    std::string title;
-    if (title_key != std::string::npos)
-    {
-      size_t title_start = obj.find('"', title_key + 7);
-      if (title_start != std::string::npos)
-      {
-        size_t title_end = obj.find('"', title_start + 1);
-        if (title_end != std::string::npos)
-          title = obj.substr(title_start + 1, title_end - title_start - 1);
-      }
-    }
-
-    // Extract timestamp
-    size_t time_key = obj.find("\"time\"");
-    uint64_t timestamp = 0;
-    if (time_key != std::string::npos)
-    {
-      size_t colon = obj.find(':', time_key);
-      if (colon != std::string::npos)
-      {
-        size_t num_start = colon + 1;
-        while (num_start < obj.size() && (obj[num_start] == ' ' || obj[num_start] == '\t'))
-          num_start++;
-        size_t num_end = num_start;
-        while (num_end < obj.size() && std::isdigit(obj[num_end]))
-          num_end++;
-        if (num_end > num_start)
-          timestamp = std::stoull(obj.substr(num_start, num_end - num_start));
-      }
-    }
-
-    // Extract count (optional)
-    size_t count_key = obj.find("\"count\"");
-    uint32_t count = 1;
-    if (count_key != std::string::npos)
-    {
-      size_t colon2 = obj.find(':', count_key);
-      if (colon2 != std::string::npos)
-      {
-        size_t num_start = colon2 + 1;
-        while (num_start < obj.size() && (obj[num_start] == ' ' || obj[num_start] == '\t'))
-          num_start++;
-        size_t num_end = num_start;
-        while (num_end < obj.size() && std::isdigit(obj[num_end]))
-          num_end++;
-        if (num_end > num_start)
-          count = (uint32_t)std::stoul(obj.substr(num_start, num_end - num_start));
-      }
-    }
-
-    if (!url.empty())
-      history_.push_back({url, title, timestamp, count});
-
-    pos = obj_end + 1;
-  }
+  // The snapshot plus the visits logged since it was written
+  history_log_.Load(history_);
 }
 
 void UI::SaveHistoryToDisk()
 {
   if (clear_history_on_exit_)
   {
-    std::remove("data/history.json");
+    history_log_.Remove();
     return;
   }
 
+  // Fold the visit log into a fresh snapshot
   EnsureDataDirectoryExists();
-  std::ofstream out("data/history.json", std::ios::out | std::ios::binary | std::ios::trunc);
-  if (!out.is_open())
-    return;
-
-  out << "[";
-  for (size_t i = 0; i < history_.size(); ++i)
-  {
-    if (i > 0)
-      out << ",";
-    const auto &entry = history_[i];
-    out << "{\"url\":\"" << jsonEscape(entry.url)
-        << "\",\"title\":\"" << jsonEscape(entry.title)
-        << "\",\"time\":" << entry.timestamp_ms
-        << ",\"count\":" << entry.visit_count << "}";
-  }
-  out << "]";
-  out.close();
+  history_log_.Compact(history_);
 }
 
 std::vector<std::string> UI::GetSuggestions(const std::string &input, int maxResults)
@@ -3606,6 +3521,7 @@ bool UI::BrowserSettings::operator==(const BrowserSettings &other) const
          experimental_transparent_toolbar == other.experimental_transparent_toolbar &&
          experimental_compact_tabs == other.experimental_compact_tabs &&
          enable_adblock == other.enable_adblock &&
+         block_trackers == other.block_trackers &&
          log_blocked_requests == other.log_blocked_requests &&
          clear_history_on_exit == other.clear_history_on_exit &&
          enable_javascript == other.enable_javascript &&
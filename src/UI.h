@@ -1,6 +1,8 @@
 #pragma once
 #include <AppCore/AppCore.h>
 #include "Tab.h"
+#include "HistoryLog.h"
+#include "HistoryStore.h"
 #include <map>
 #include <memory>
 #include <string>
@@ -13,7 +15,7 @@ using ultralight::JSObject;
 using namespace ultralight;
 
 class Console;
-class AdBlocker; // forward declaration, optional dependency
+class ContentBlocker; // forward declaration, optional dependency
 class DownloadManager;
 
 /**
@@ -25,8 +27,8 @@ class UI : public WindowListener,
 {
 public:
   UI(RefPtr<Window> window);
-  // Overload retained for compatibility; adblockers are optional and may be unused.
-  UI(RefPtr<Window> window, AdBlocker *adblock, AdBlocker *tracker);
+  // With the browser's request filter, installed on every tab and driven by the settings.
+  UI(RefPtr<Window> window, ContentBlocker *blocker);
   ~UI();
 
   struct BrowserSettings
@@ -39,6 +41,7 @@ public:
 
     // Privacy & Security
     bool enable_adblock = true;
+    bool block_trackers = true;
     bool log_blocked_requests = false;
     bool clear_history_on_exit = true;
     bool enable_javascript = true;
@@ -119,6 +122,9 @@ public:
   ultralight::JSValue OnGetDarkModeEnabled(const JSObject &obj, const JSArgs &args);
   void OnToggleAdblock(const JSObject &obj, const JSArgs &args);
   ultralight::JSValue OnGetAdblockEnabled(const JSObject &obj, const JSArgs &args);
+  void OnToggleSiteAdblock(const JSObject &obj, const JSArgs &args);
+  ultralight::JSValue OnGetSiteAdblockEnabled(const JSObject &obj, const JSArgs &args);
+  ultralight::JSValue OnGetTabTraffic(const JSObject &obj, const JSArgs &args);
   void OnOpenSettingsPanel(const JSObject &obj, const JSArgs &args);
   void OnCloseSettingsPanel(const JSObject &obj, const JSArgs &args);
   ultralight::JSValue OnGetSettings(const JSObject &obj, const JSArgs &args);
@@ -229,9 +235,8 @@ protected:
   RefPtr<Overlay> context_menu_overlay_;
   RefPtr<Overlay> suggestions_overlay_;
   float scale_;
-  // Optional ad/tracker blocker references (may be unused in this build)
-  AdBlocker *adblock_ = nullptr;
-  AdBlocker *trackerblock_ = nullptr;
+  // Optional ad/tracker blocker (may be unused in this build)
+  ContentBlocker *blocker_ = nullptr;
   std::unique_ptr<DownloadManager> download_manager_;
   bool downloads_overlay_had_active_ = false;
   bool downloads_overlay_user_dismissed_ = false;
@@ -289,15 +294,11 @@ protected:
   std::map<std::string, std::string> favicon_file_cache_;
   size_t favicon_cache_limit_ = 128;
 
-  // Simple in-memory history
-  struct HistoryEntry
-  {
-    std::string url;
-    std::string title;
-    uint64_t timestamp_ms;
-    uint32_t visit_count;
-  };
-  std::vector<HistoryEntry> history_;
+  // In-memory history, the 500 most recently visited URLs
+  using HistoryEntry = HistoryStore::Entry;
+  HistoryStore history_{500};
+  // data/history.json plus a visit log appended on every visit
+  HistoryLog history_log_{"data/history.json"};
   // Always enabled (disable-history feature removed)
 
   // Popular sites loaded from assets/popular_sites.json
@@ -0,0 +1,196 @@
+#include "ViewTraffic.h"
+#include "FilterStats.h"
+#include "HostMatcher.h"
+
+#include <algorithm>
+#include <cstring>
+
+const void *const ViewTraffic::kReleased = reinterpret_cast<const void *>(uintptr_t(1));
+const void *const ViewTraffic::kOpening = reinterpret_cast<const void *>(uintptr_t(2));
+
+ViewTraffic::ViewTraffic() : slots_(new Slot[kMaxViews]) {}
+
+size_t ViewTraffic::Home(const void *view)
+{
+    // Views are heap objects; drop the alignment bits and mix the rest.
+    uint64_t h = (uint64_t)(uintptr_t)view >> 4;
+    h *= 0x9E3779B97F4A7C15ull;
+    return (size_t)(h >> 32) % kMaxViews;
+}
+
+ViewTraffic::Slot *ViewTraffic::Find(const void *view)
+{
+    // Open() takes the first free slot from Home(view), and slots are never
+    // returned to nullptr, so the probe ends at the first never-used slot.
+    const size_t home = Home(view);
+    for (size_t i = 0; i < kMaxViews; ++i)
+    {
+        Slot &slot = slots_[(home + i) % kMaxViews];
+        const void *current = slot.view.load(std::memory_order_acquire);
+        if (current == view)
+            return &slot;
+        if (current == nullptr)
+            return nullptr;
+    }
+    return nullptr;
+}
+
+void ViewTraffic::Open(const void *view)
+{
+    if (!view || Find(view))
+        return;
+    const size_t home = Home(view);
+    for (size_t i = 0; i < kMaxViews; ++i)
+    {
+        Slot &slot = slots_[(home + i) % kMaxViews];
+        const void *current = slot.view.load(std::memory_order_acquire);
+        if (current != nullptr && current != kReleased)
+            continue;
+        if (!slot.view.compare_exchange_strong(current, kOpening, std::memory_order_acq_rel))
+            continue;
+        // Cleared here rather than in Release(): a request of the old view that
+        // found the slot just before it was released may still add to it.
+        for (Host &entry : slot.hosts)
+        {
+            entry.named.store(false, std::memory_order_relaxed);
+            entry.requests.store(0, std::memory_order_relaxed);
+            entry.blocked.store(0, std::memory_order_relaxed);
+            entry.hash.store(0, std::memory_order_relaxed);
+        }
+        slot.requests.store(0, std::memory_order_relaxed);
+        slot.blocked.store(0, std::memory_order_relaxed);
+        slot.untracked_hosts.store(0, std::memory_order_relaxed);
+        // Publishes the cleared counters to the network threads
+        slot.view.store(view, std::memory_order_release);
+        return;
+    }
+}
+
+void ViewTraffic::RecordHost(Slot &slot, std::string_view host, bool blocked)
+{
+    uint64_t hash = HostMatcher::HashHost(host);
+    if (hash == 0)
+        hash = 1;
+    for (size_t i = 0, at = (size_t)(hash % kMaxHosts); i < kMaxHosts; ++i, at = (at + 1) % kMaxHosts)
+    {
+        Host &entry = slot.hosts[at];
+        uint64_t current = entry.hash.load(std::memory_order_acquire);
+        if (current == 0)
+        {
+            if (entry.hash.compare_exchange_strong(current, hash, std::memory_order_acq_rel))
+            {
+                // First request to the host: the claiming thread names the entry.
+                const size_t len = std::min(host.size(), kMaxHostLength);
+                std::memcpy(entry.name, host.data(), len);
+                entry.name[len] = '\0';
+                entry.named.store(true, std::memory_order_release);
+                current = hash;
+            }
+        }
+        if (current == hash)
+        {
+            entry.requests.fetch_add(1, std::memory_order_relaxed);
+            if (blocked)
+                entry.blocked.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+    }
+    slot.untracked_hosts.fetch_add(1, std::memory_order_relaxed);
+}
+
+void ViewTraffic::Record(const void *view, std::string_view host, bool blocked)
+{
+    Slot *slot = view ? Find(view) : nullptr;
+    if (!slot)
+    {
+        untracked_views_.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    slot->requests.fetch_add(1, std::memory_order_relaxed);
+    if (blocked)
+        slot->blocked.fetch_add(1, std::memory_order_relaxed);
+    if (!host.empty())
+        RecordHost(*slot, host, blocked);
+}
+
+ViewTraffic::Report ViewTraffic::Collect(const void *view) const
+{
+    Report r;
+    if (!view)
+        return r;
+    for (size_t i = 0; i < kMaxViews; ++i)
+    {
+        const Slot &slot = slots_[i];
+        if (slot.view.load(std::memory_order_acquire) != view)
+            continue;
+        r.requests += slot.requests.load(std::memory_order_relaxed);
+        r.blocked += slot.blocked.load(std::memory_order_relaxed);
+        r.untracked_hosts += slot.untracked_hosts.load(std::memory_order_relaxed);
+        for (const Host &entry : slot.hosts)
+        {
+            if (!entry.named.load(std::memory_order_acquire))
+                continue;
+            const std::string host(entry.name);
+            const uint64_t requests = entry.requests.load(std::memory_order_relaxed);
+            const uint64_t blocked = entry.blocked.load(std::memory_order_relaxed);
+            auto it = std::find_if(r.hosts.begin(), r.hosts.end(), [&](const HostCount &h)
+                                   { return h.host == host; });
+            if (it == r.hosts.end())
+                r.hosts.push_back({host, requests, blocked});
+            else
+            {
+                it->requests += requests;
+                it->blocked += blocked;
+            }
+        }
+    }
+    // requests is read before blocked, so a racing request can put it one behind
+    r.requests = std::max(r.requests, r.blocked);
+    std::sort(r.hosts.begin(), r.hosts.end(), [](const HostCount &a, const HostCount &b)
+              { return a.requests != b.requests ? a.requests > b.requests : a.host < b.host; });
+    return r;
+}
+
+void ViewTraffic::Release(const void *view)
+{
+    if (!view)
+        return;
+    for (size_t i = 0; i < kMaxViews; ++i)
+    {
+        Slot &slot = slots_[i];
+        const void *current = view;
+        slot.view.compare_exchange_strong(current, kReleased, std::memory_order_acq_rel);
+    }
+}
+
+size_t ViewTraffic::open_views() const
+{
+    size_t n = 0;
+    for (size_t i = 0; i < kMaxViews; ++i)
+    {
+        const void *current = slots_[i].view.load(std::memory_order_acquire);
+        n += current != nullptr && current != kReleased && current != kOpening;
+    }
+    return n;
+}
+
+std::string ViewTraffic::Report::ToJSON(size_t max_hosts) const
+{
+    std::string out = "{\"requests\":" + std::to_string(requests);
+    out += ",\"allowed\":" + std::to_string(allowed());
+    out += ",\"blocked\":" + std::to_string(blocked);
+    out += ",\"host_count\":" + std::to_string(hosts.size());
+    out += ",\"untracked_hosts\":" + std::to_string(untracked_hosts);
+    out += ",\"hosts\":[";
+    for (size_t i = 0; i < hosts.size() && i < max_hosts; ++i)
+    {
+        const HostCount &h = hosts[i];
+        out += i ? ",{\"host\":\"" : "{\"host\":\"";
+        FilterStats::AppendEscaped(out, h.host);
+        out += "\",\"requests\":" + std::to_string(h.requests);
+        out += ",\"blocked\":" + std::to_string(h.blocked);
+        out += "}";
+    }
+    out += "]}";
+    return out;
+}
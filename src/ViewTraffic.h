@@ -0,0 +1,105 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Per-view network accounting: how many requests each view (tab) made, how
+// many were blocked, and which hosts they went to. Filled from the network
+// threads on every request, read by the UI to find pages that hammer the
+// network.
+//
+// Views are opaque keys (the Ultralight View a request came from). A view
+// takes one of kMaxViews slots when it is opened (Open(), on the UI thread);
+// Record() only counts into the slot of an open view and never claims one, so
+// a request still in flight when its view is released is dropped instead of
+// taking a slot for a view that no longer exists. Each slot counts up to
+// kMaxHosts distinct hosts in a fixed open-addressed table, and requests to
+// further hosts only count towards the view's totals. Recording is a few
+// relaxed atomic adds with no lock and no allocation; only the first request
+// to a new host copies its name into the slot.
+//
+// Release() a view when it closes: its slot is marked free for the next
+// Open(), which clears it, so a later view at the same address does not
+// inherit its counts.
+class ViewTraffic
+{
+public:
+    static constexpr size_t kMaxViews = 64;
+    static constexpr size_t kMaxHosts = 64;        // hosts tracked per view
+    static constexpr size_t kMaxHostLength = 47;   // longer host names are cut in reports
+
+    struct HostCount
+    {
+        std::string host;
+        uint64_t requests = 0;
+        uint64_t blocked = 0;
+    };
+
+    struct Report
+    {
+        uint64_t requests = 0;
+        uint64_t blocked = 0;
+        uint64_t untracked_hosts = 0; // requests to hosts beyond kMaxHosts
+        std::vector<HostCount> hosts; // most requests first
+
+        uint64_t allowed() const { return requests - blocked; }
+        // {"requests":N,"allowed":N,"blocked":N,"host_count":N,"untracked_hosts":N,
+        //  "hosts":[{"host":...,"requests":N,"blocked":N},...]}; max_hosts caps "hosts".
+        std::string ToJSON(size_t max_hosts = 20) const;
+    };
+
+    ViewTraffic();
+    ViewTraffic(const ViewTraffic &) = delete;
+    ViewTraffic &operator=(const ViewTraffic &) = delete;
+
+    // Give view a slot. Call on the UI thread before it makes requests.
+    void Open(const void *view);
+    // Count a request of view to host (lowercase; may be empty). Thread-safe.
+    // Requests of views that are not open only count in untracked_views().
+    void Record(const void *view, std::string_view host, bool blocked);
+
+    // The counts of view so far; all zero for a view that made no request.
+    Report Collect(const void *view) const;
+    // Forget view and free its slot. Requests still in flight are dropped.
+    void Release(const void *view);
+
+    // Views holding a slot.
+    size_t open_views() const;
+    // Requests from views without a slot: not open, released, or opened when
+    // every slot was taken.
+    uint64_t untracked_views() const { return untracked_views_.load(std::memory_order_relaxed); }
+
+private:
+    struct Host
+    {
+        std::atomic<uint64_t> hash{0}; // 0: free
+        std::atomic<uint64_t> requests{0};
+        std::atomic<uint64_t> blocked{0};
+        std::atomic<bool> named{false}; // name holds the host
+        char name[kMaxHostLength + 1] = {};
+    };
+
+    struct Slot
+    {
+        std::atomic<const void *> view{nullptr}; // nullptr: never used; kReleased: free
+        std::atomic<uint64_t> requests{0};
+        std::atomic<uint64_t> blocked{0};
+        std::atomic<uint64_t> untracked_hosts{0};
+        Host hosts[kMaxHosts];
+    };
+
+    // Slot::view of a slot given up by Release(), and of one Open() is clearing.
+    static const void *const kReleased;
+    static const void *const kOpening;
+
+    Slot *Find(const void *view);
+    static size_t Home(const void *view);
+    static void RecordHost(Slot &slot, std::string_view host, bool blocked);
+
+    std::unique_ptr<Slot[]> slots_;
+    std::atomic<uint64_t> untracked_views_{0};
+};
@@ -0,0 +1,311 @@
+// Compile the Public Suffix List into the perfect hash table of src/PublicSuffix.cpp.
+//
+// Usage: psl_compile -o <PublicSuffixTable.inc> <public_suffix_list.dat>
+//
+// Every rule becomes a key ("*.ck" -> "ck" with kWildcard, "!www.ck" -> "www.ck"
+// with kException), and every parent domain of a key is added with no flags so
+// a lookup can stop at the first suffix it does not find. Non-ASCII labels are
+// stored in punycode, as they appear in URLs. Keys are placed with hash and
+// displace: keys are hashed into buckets of about four, and the largest buckets
+// first get a seed that sends all of their keys to free slots.
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+#include "HostMatcher.h"
+#include "PublicSuffix.h"
+
+namespace
+{
+    constexpr int kFlagBits = 3;
+    constexpr int kLengthBits = 7;
+    constexpr int kOffsetBits = 32 - kFlagBits - kLengthBits;
+
+    int Usage()
+    {
+        std::fprintf(stderr, "usage: psl_compile -o <table.inc> <public_suffix_list.dat>\n");
+        return 2;
+    }
+
+    uint64_t HashKey(std::string_view key)
+    {
+        uint64_t hash = 0;
+        HostMatcher::ForEachSuffix(key, [&](uint64_t h, std::string_view suffix)
+                                   {
+            hash = h;
+            return suffix.size() == key.size(); });
+        return hash;
+    }
+
+    // RFC 3492 encoding of one label's code points.
+    std::string Punycode(const std::vector<uint32_t> &input)
+    {
+        constexpr uint32_t kBase = 36, kTMin = 1, kTMax = 26, kSkew = 38, kDamp = 700;
+        auto digit = [](uint32_t d)
+        { return (char)(d < 26 ? 'a' + d : '0' + d - 26); };
+        auto adapt = [&](uint32_t delta, uint32_t points, bool first)
+        {
+            delta = first ? delta / kDamp : delta / 2;
+            delta += delta / points;
+            uint32_t k = 0;
+            while (delta > ((kBase - kTMin) * kTMax) / 2)
+            {
+                delta /= kBase - kTMin;
+                k += kBase;
+            }
+            return k + (kBase - kTMin + 1) * delta / (delta + kSkew);
+        };
+
+        std::string out;
+        for (uint32_t c : input)
+            if (c < 0x80)
+                out += (char)c;
+        const uint32_t basic = (uint32_t)out.size();
+        if (basic > 0)
+            out += '-';
+        uint32_t n = 0x80, delta = 0, bias = 72;
+        for (uint32_t h = basic; h < input.size(); ++delta, ++n)
+        {
+            uint32_t m = UINT32_MAX;
+            for (uint32_t c : input)
+                if (c >= n)
+                    m = std::min(m, c);
+            delta += (m - n) * (h + 1);
+            n = m;
+            for (uint32_t c : input)
+            {
+                if (c < n)
+                    ++delta;
+                if (c != n)
+                    continue;
+                uint32_t q = delta;
+                for (uint32_t k = kBase;; k += kBase)
+                {
+                    uint32_t t = k <= bias ? kTMin : k >= bias + kTMax ? kTMax
+                                                                         : k - bias;
+                    if (q < t)
+                        break;
+                    out += digit(t + (q - t) % (kBase - t));
+                    q = (q - t) / (kBase - t);
+                }
+                out += digit(q);
+                bias = adapt(delta, h + 1, h == basic);
+                delta = 0;
+                ++h;
+            }
+        }
+        return out;
+    }
+
+    // Lowercase ASCII form of a UTF-8 domain, IDN labels in punycode. Empty on
+    // malformed UTF-8.
+    std::string ToASCII(std::string_view domain)
+    {
+        std::string out;
+        size_t begin = 0;
+        while (begin <= domain.size())
+        {
+            size_t end = std::min(domain.find('.', begin), domain.size());
+            std::vector<uint32_t> points;
+            bool ascii = true;
+            for (size_t i = begin; i < end;)
+            {
+                unsigned char c = (unsigned char)domain[i];
+                int extra = c < 0x80 ? 0 : (c >> 5) == 0x6 ? 1 : (c >> 4) == 0xe ? 2 : (c >> 3) == 0x1e ? 3 : -1;
+                if (extra < 0 || i + extra >= end)
+                    return std::string();
+                uint32_t cp = extra == 0 ? c : c & (0x3f >> extra);
+                for (int j = 1; j <= extra; ++j)
+                {
+                    unsigned char cont = (unsigned char)domain[i + j];
+                    if ((cont & 0xc0) != 0x80)
+                        return std::string();
+                    cp = (cp << 6) | (cont & 0x3f);
+                }
+                if (cp >= 'A' && cp <= 'Z')
+                    cp += 'a' - 'A';
+                ascii = ascii && cp < 0x80;
+                points.push_back(cp);
+                i += extra + 1;
+            }
+            if (begin > 0)
+                out += '.';
+            if (ascii)
+                for (uint32_t cp : points)
+                    out += (char)cp;
+            else
+                out += "xn--" + Punycode(points);
+            begin = end + 1;
+        }
+        return out;
+    }
+
+    bool Place(const std::vector<uint64_t> &hashes, uint32_t slot_count, uint32_t bucket_count,
+               std::vector<uint16_t> &seeds, std::vector<int32_t> &slots)
+    {
+        std::vector<std::vector<uint32_t>> buckets(bucket_count);
+        for (uint32_t i = 0; i < hashes.size(); ++i)
+            buckets[psl::Bucket(hashes[i], bucket_count)].push_back(i);
+        std::vector<uint32_t> order(bucket_count);
+        for (uint32_t b = 0; b < bucket_count; ++b)
+            order[b] = b;
+        std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b)
+                         { return buckets[a].size() > buckets[b].size(); });
+
+        seeds.assign(bucket_count, 0);
+        slots.assign(slot_count, -1);
+        std::vector<uint32_t> taken;
+        for (uint32_t b : order)
+        {
+            const std::vector<uint32_t> &keys = buckets[b];
+            if (keys.empty())
+                break;
+            uint32_t seed = 0;
+            for (; seed <= UINT16_MAX; ++seed)
+            {
+                taken.clear();
+                for (uint32_t key : keys)
+                {
+                    uint32_t slot = psl::Slot(hashes[key], seed, slot_count);
+                    if (slots[slot] >= 0 || std::find(taken.begin(), taken.end(), slot) != taken.end())
+                        break;
+                    taken.push_back(slot);
+                }
+                if (taken.size() == keys.size())
+                    break;
+            }
+            if (seed > UINT16_MAX)
+                return false;
+            seeds[b] = (uint16_t)seed;
+            for (size_t i = 0; i < keys.size(); ++i)
+                slots[taken[i]] = (int32_t)keys[i];
+        }
+        return true;
+    }
+
+    template <typename T>
+    void WriteArray(std::FILE *out, const char *decl, const std::vector<T> &values)
+    {
+        std::fprintf(out, "%s[] = {", decl);
+        for (size_t i = 0; i < values.size(); ++i)
+            std::fprintf(out, "%s%lu,", i % 16 == 0 ? "\n    " : "", (unsigned long)values[i]);
+        std::fprintf(out, "\n};\n");
+    }
+}
+
+int main(int argc, char **argv)
+{
+    std::string output, input;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+            output = argv[++i];
+        else if (argv[i][0] == '-' || !input.empty())
+            return Usage();
+        else
+            input = argv[i];
+    }
+    if (output.empty() || input.empty())
+        return Usage();
+
+    std::ifstream in(input);
+    if (!in)
+    {
+        std::fprintf(stderr, "psl_compile: cannot read %s\n", input.c_str());
+        return 1;
+    }
+    std::map<std::string, uint8_t> keys;
+    size_t rules = 0;
+    std::string line;
+    for (size_t number = 1; std::getline(in, line); ++number)
+    {
+        std::string_view rule = line;
+        rule = rule.substr(0, rule.find_first_of(" \t\r"));
+        if (rule.empty() || rule.substr(0, 2) == "//")
+            continue;
+        uint8_t flags = psl::kRule;
+        if (rule.front() == '!')
+        {
+            flags = psl::kException;
+            rule.remove_prefix(1);
+        }
+        else if (rule.substr(0, 2) == "*.")
+        {
+            flags = psl::kWildcard;
+            rule.remove_prefix(2);
+        }
+        std::string key = ToASCII(rule);
+        if (key.empty() || key.find('*') != std::string::npos || key.front() == '.' || key.back() == '.' ||
+            (flags == psl::kException && key.find('.') == std::string::npos))
+        {
+            std::fprintf(stderr, "psl_compile: %s:%zu: unsupported rule\n", input.c_str(), number);
+            return 1;
+        }
+        keys[key] |= flags;
+        for (size_t dot = key.find('.'); dot != std::string::npos; dot = key.find('.', dot + 1))
+            keys.emplace(key.substr(dot + 1), 0);
+        ++rules;
+    }
+
+    std::vector<uint64_t> hashes;
+    std::vector<uint32_t> entries;
+    std::vector<unsigned char> text;
+    std::unordered_set<uint64_t> seen;
+    for (const auto &key : keys)
+    {
+        if (key.first.size() >= (1u << kLengthBits) || text.size() + key.first.size() >= (1u << kOffsetBits))
+        {
+            std::fprintf(stderr, "psl_compile: %s does not fit the table\n", key.first.c_str());
+            return 1;
+        }
+        hashes.push_back(HashKey(key.first));
+        if (!seen.insert(hashes.back()).second)
+        {
+            std::fprintf(stderr, "psl_compile: hash collision on %s\n", key.first.c_str());
+            return 1;
+        }
+        entries.push_back((uint32_t)(text.size() << (kFlagBits + kLengthBits)) |
+                          (uint32_t)(key.first.size() << kFlagBits) | key.second);
+        text.insert(text.end(), key.first.begin(), key.first.end());
+    }
+
+    // About 90% of the slots are used; a few more are added in the rare case
+    // some bucket finds no seed.
+    const uint32_t bucket_count = (uint32_t)(hashes.size() + 3) / 4;
+    uint32_t slot_count = (uint32_t)(hashes.size() + hashes.size() / 9 + 1);
+    std::vector<uint16_t> seeds;
+    std::vector<int32_t> placed;
+    while (!Place(hashes, slot_count, bucket_count, seeds, placed))
+        slot_count += slot_count / 32 + 1;
+    std::vector<uint32_t> slots(slot_count, 0);
+    for (uint32_t i = 0; i < slot_count; ++i)
+        if (placed[i] >= 0)
+            slots[i] = entries[placed[i]];
+
+    std::FILE *out = std::fopen(output.c_str(), "w");
+    if (!out)
+    {
+        std::fprintf(stderr, "psl_compile: cannot write %s\n", output.c_str());
+        return 1;
+    }
+    std::fprintf(out, "// Generated by psl_compile from %zu rules of public_suffix_list.dat. Do not edit.\n", rules);
+    std::fprintf(out, "constexpr uint32_t kBucketCount = %u;\n", bucket_count);
+    std::fprintf(out, "constexpr uint32_t kSlotCount = %u;\n", slot_count);
+    WriteArray(out, "const uint16_t kSeeds", seeds);
+    WriteArray(out, "const uint32_t kSlots", slots);
+    WriteArray(out, "const char kText", std::vector<unsigned>(text.begin(), text.end()));
+    if (std::fclose(out) != 0)
+    {
+        std::fprintf(stderr, "psl_compile: cannot write %s\n", output.c_str());
+        return 1;
+    }
+    std::printf("psl_compile: %zu rules, %zu keys in %u slots, %zu bytes of text\n", rules, keys.size(), slot_count,
+                text.size());
+    return 0;
+}